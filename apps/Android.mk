@@ -7,7 +7,8 @@ LOCAL_MODULE_TAGS := debug eng
 
 LOCAL_CFLAGS:= -Wall
 
-LOCAL_SRC_FILES := healthd_android.c healthd_common.c
+LOCAL_SRC_FILES := healthd_android.c healthd_common.c healthd_encoder.c \
+	healthd_subscription.c
 LOCAL_CFLAGS := -Wall
 LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/.. $(LOCAL_PATH)/../src
 
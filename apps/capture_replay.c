@@ -0,0 +1,516 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file capture_replay.c
+ * \brief Replays APDU captures against a TCP manager.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/*
+ * Plays the agent role of one or more captures made with
+ * apdu_capture_start() (e.g. healthd --capture=FILE): APDUs the
+ * capturing manager received are sent again, over one TCP connection
+ * per captured context, with the original timing, N times faster or
+ * as fast as possible. Rotated files are given in order, oldest first.
+ *
+ * APDUs coming from the manager are counted and dropped. With -w,
+ * an APDU is only sent after the manager has answered as many APDUs
+ * on that connection as it had at that point of the capture.
+ *
+ * Usage: ieee_replay [options] capture..., see print_help().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <ieee11073.h>
+#include "util/apdu_capture.h"
+
+/**
+ * Milliseconds to wait for manager answers in lockstep mode
+ */
+#define REPLAY_WAIT_TIMEOUT 5000
+
+/**
+ * Replayed connection, one per captured context
+ */
+typedef struct ReplayConnection {
+	unsigned int plugin;
+	unsigned long long connid;
+	int fd;
+
+	/**
+	 * Association was released or aborted, next AARQ reconnects
+	 */
+	int ended;
+
+	/**
+	 * APDUs the manager sent in the capture and in this replay
+	 */
+	unsigned long expected;
+	unsigned long received;
+
+	/**
+	 * Framing of the incoming stream: APDU header bytes gathered
+	 * and bytes left of the current APDU
+	 */
+	intu8 header[4];
+	int header_size;
+	unsigned int skip;
+} ReplayConnection;
+
+static ReplayConnection *connections = NULL;
+static int connection_count = 0;
+static int connection_last = 0;
+
+static struct sockaddr_in addr;
+static int port = 6024;
+static int port_count = 1;
+static double speed = 1.0;
+static int lockstep = 0;
+static int linger_ms = 500;
+static ApduCaptureDirection direction = APDU_CAPTURE_RECEIVED;
+
+static unsigned long long apdus_sent = 0;
+static unsigned long long bytes_sent = 0;
+static unsigned long long apdus_received = 0;
+static unsigned long long bytes_received = 0;
+static unsigned long long connects = 0;
+static unsigned long long wait_timeouts = 0;
+static unsigned long long send_errors = 0;
+
+/**
+ * Monotonic clock in microseconds
+ */
+static unsigned long long now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static ReplayConnection *connection_get(unsigned int plugin,
+					unsigned long long connid)
+{
+	ReplayConnection *c;
+	int i;
+
+	if (connection_last < connection_count) {
+		c = &connections[connection_last];
+		if (c->plugin == plugin && c->connid == connid)
+			return c;
+	}
+
+	for (i = 0; i < connection_count; ++i) {
+		c = &connections[i];
+		if (c->plugin == plugin && c->connid == connid) {
+			connection_last = i;
+			return c;
+		}
+	}
+
+	connections = realloc(connections,
+			      (connection_count + 1) * sizeof(ReplayConnection));
+	c = &connections[connection_count];
+	memset(c, 0, sizeof(ReplayConnection));
+	c->plugin = plugin;
+	c->connid = connid;
+	c->fd = -1;
+	connection_last = connection_count++;
+
+	return c;
+}
+
+static void connection_close(ReplayConnection *c)
+{
+	if (c->fd >= 0) {
+		close(c->fd);
+		c->fd = -1;
+	}
+
+	c->ended = 0;
+	c->header_size = 0;
+	c->skip = 0;
+}
+
+static int connection_open(ReplayConnection *c)
+{
+	struct sockaddr_in sa = addr;
+	int opt = 1;
+
+	connection_close(c);
+
+	// new association, counting starts over
+	c->expected = 0;
+	c->received = 0;
+
+	sa.sin_port = htons(port + (c - connections) % port_count);
+
+	c->fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	if (c->fd < 0) {
+		return 0;
+	}
+
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+	if (connect(c->fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+		fprintf(stderr, "ERROR: cannot connect to port %d: %s\n",
+			ntohs(sa.sin_port), strerror(errno));
+		close(c->fd);
+		c->fd = -1;
+		return 0;
+	}
+
+	++connects;
+	return 1;
+}
+
+/**
+ * Counts the APDUs in bytes received from the manager
+ */
+static void connection_count_apdus(ReplayConnection *c, intu8 *buf, int size)
+{
+	while (size > 0) {
+		if (c->skip > 0) {
+			unsigned int n = c->skip < (unsigned int) size ?
+						c->skip : (unsigned int) size;
+			c->skip -= n;
+			buf += n;
+			size -= n;
+			continue;
+		}
+
+		c->header[c->header_size++] = *buf++;
+		--size;
+
+		if (c->header_size == 4) {
+			intu16 choice = c->header[0] << 8 | c->header[1];
+
+			c->skip = c->header[2] << 8 | c->header[3];
+			c->header_size = 0;
+			++c->received;
+			++apdus_received;
+
+			if (choice == RLRE_CHOSEN || choice == ABRT_CHOSEN) {
+				c->ended = 1;
+			}
+		}
+	}
+}
+
+static void connection_read(ReplayConnection *c)
+{
+	intu8 buf[4096];
+
+	while (c->fd >= 0) {
+		int got = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+
+		if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		}
+
+		if (got <= 0) {
+			// manager hung up
+			close(c->fd);
+			c->fd = -1;
+			c->ended = 1;
+			return;
+		}
+
+		bytes_received += got;
+		connection_count_apdus(c, buf, got);
+	}
+}
+
+/**
+ * Reads whatever the manager sends until deadline (microseconds of
+ * the monotonic clock), or until the connection has received the
+ * expected APDUs, if given.
+ */
+static void wait_until(unsigned long long deadline, ReplayConnection *until)
+{
+	struct pollfd *fds = calloc(connection_count + 1, sizeof(struct pollfd));
+	int *index = calloc(connection_count + 1, sizeof(int));
+
+	while (1) {
+		unsigned long long now = now_us();
+		int n = 0;
+		int i;
+
+		if (until && (until->fd < 0 || until->received >= until->expected))
+			break;
+
+		if (now >= deadline)
+			break;
+
+		for (i = 0; i < connection_count; ++i) {
+			if (connections[i].fd >= 0) {
+				fds[n].fd = connections[i].fd;
+				fds[n].events = POLLIN;
+				index[n++] = i;
+			}
+		}
+
+		int timeout = (deadline - now + 999) / 1000;
+
+		if (n == 0) {
+			if (until)
+				break;
+			usleep(deadline - now);
+			break;
+		}
+
+		if (poll(fds, n, timeout) <= 0)
+			continue;
+
+		for (i = 0; i < n; ++i) {
+			if (fds[i].revents) {
+				connection_read(&connections[index[i]]);
+			}
+		}
+	}
+
+	free(fds);
+	free(index);
+}
+
+static void replay_record(ApduCaptureRecord *record)
+{
+	ReplayConnection *c = connection_get(record->plugin, record->connid);
+	intu16 choice = record->length >= 2 ?
+			record->apdu[0] << 8 | record->apdu[1] : 0;
+
+	if (record->direction != direction) {
+		++c->expected;
+		return;
+	}
+
+	if (c->fd < 0 && c->ended && choice != AARQ_CHOSEN) {
+		// manager dropped the association, wait for the next one
+		++send_errors;
+		return;
+	}
+
+	if (c->fd < 0 || (c->ended && choice == AARQ_CHOSEN)) {
+		if (!connection_open(c)) {
+			++send_errors;
+			return;
+		}
+	}
+
+	if (lockstep && c->received < c->expected) {
+		wait_until(now_us() + REPLAY_WAIT_TIMEOUT * 1000ULL, c);
+
+		if (c->received < c->expected) {
+			++wait_timeouts;
+			c->received = c->expected;
+		}
+	}
+
+	if (c->fd < 0) {
+		++send_errors;
+		return;
+	}
+
+	intu32 written = 0;
+
+	while (written < record->length) {
+		int ret = send(c->fd, record->apdu + written,
+			       record->length - written, MSG_NOSIGNAL);
+
+		if (ret <= 0) {
+			if (ret < 0 && errno == EINTR)
+				continue;
+			++send_errors;
+			connection_close(c);
+			return;
+		}
+
+		written += ret;
+	}
+
+	++apdus_sent;
+	bytes_sent += record->length;
+
+	if (choice == RLRE_CHOSEN || choice == ABRT_CHOSEN) {
+		c->ended = 1;
+	}
+}
+
+/**
+ * Prints utility command-line tool help.
+ */
+static void print_help()
+{
+	printf(
+		"Replays APDU captures against an IEEE 11073 manager over TCP\n\n"
+		"Usage: ieee_replay [OPTION] capture...\n"
+		"Options:\n"
+		"        -h host        Manager address, default 127.0.0.1\n"
+		"        -p port        First manager port, default 6024\n"
+		"        -P count       Number of manager ports, captured contexts\n"
+		"                       are spread over them, default 1\n"
+		"        -s speed       1 original timing (default), N for N times\n"
+		"                       faster, 0 as fast as possible\n"
+		"        -w             Wait for the manager to answer as in the\n"
+		"                       capture before each APDU\n"
+		"        -a             Capture was made by an agent: replay\n"
+		"                       the APDUs it sent\n"
+		"        -l ms          Wait for late answers at the end, default 500\n"
+		"        --help         Print this help\n\n");
+}
+
+/**
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+	const char *host = "127.0.0.1";
+	struct addrinfo hints;
+	struct addrinfo *res;
+	ApduCaptureRecord record;
+	unsigned long long first = 0, start = 0, end;
+	unsigned long long last_sent;
+	int have_first = 0;
+	int opt;
+	int i;
+
+	if (argc > 1 && strcmp(argv[1], "--help") == 0) {
+		print_help();
+		exit(0);
+	}
+
+	while ((opt = getopt(argc, argv, "h:p:P:s:wal:")) != -1) {
+		switch (opt) {
+		case 'h':
+			host = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'P':
+			port_count = atoi(optarg);
+			break;
+		case 's':
+			speed = atof(optarg);
+			break;
+		case 'w':
+			lockstep = 1;
+			break;
+		case 'a':
+			direction = APDU_CAPTURE_SENT;
+			break;
+		case 'l':
+			linger_ms = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Try `%s --help'"
+				" for more information.\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (optind >= argc || port_count < 1 || speed < 0) {
+		fprintf(stderr, "ERROR: invalid arguments\n");
+		fprintf(stderr, "Try `%s --help' for more information.\n",
+			argv[0]);
+		exit(1);
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(host, NULL, &hints, &res) != 0) {
+		fprintf(stderr, "ERROR: cannot resolve %s\n", host);
+		exit(1);
+	}
+
+	memcpy(&addr, res->ai_addr, sizeof(addr));
+	freeaddrinfo(res);
+
+	start = now_us();
+
+	for (i = optind; i < argc; ++i) {
+		ApduCaptureReader *reader = apdu_capture_reader_open(argv[i]);
+
+		if (!reader) {
+			fprintf(stderr, "ERROR: %s is not a capture file\n",
+				argv[i]);
+			exit(1);
+		}
+
+		while (apdu_capture_reader_next(reader, &record)) {
+			if (!have_first) {
+				first = record.time_us;
+				have_first = 1;
+			}
+
+			if (speed > 0 && record.direction == direction &&
+			    record.time_us > first) {
+				unsigned long long due = start +
+					(record.time_us - first) / speed;
+				wait_until(due, NULL);
+			}
+
+			replay_record(&record);
+		}
+
+		apdu_capture_reader_close(reader);
+	}
+
+	last_sent = now_us();
+	wait_until(last_sent + linger_ms * 1000ULL, NULL);
+	end = now_us();
+
+	for (i = 0; i < connection_count; ++i) {
+		connection_close(&connections[i]);
+	}
+
+	double elapsed = (last_sent - start) / 1000000.0;
+
+	printf("contexts       %d (%llu connections)\n", connection_count,
+	       connects);
+	printf("apdus sent     %llu (%llu bytes), %.1f apdus/s\n",
+	       apdus_sent, bytes_sent,
+	       elapsed > 0 ? apdus_sent / elapsed : 0.0);
+	printf("apdus received %llu (%llu bytes)\n", apdus_received,
+	       bytes_received);
+	printf("errors         send %llu, answer timeouts %llu\n",
+	       send_errors, wait_timeouts);
+	printf("elapsed        %.3fs replaying, %.3fs total\n", elapsed,
+	       (end - start) / 1000000.0);
+
+	free(connections);
+
+	return send_errors ? 1 : 0;
+}
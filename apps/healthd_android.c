@@ -181,7 +181,7 @@ void healthd_idle_add(void* f, void *param)
  *
  * @return success status
  */
-static void notif_java_associated(ContextId conn_cid, char *xml)
+static void notif_java_associated(const healthd_event *evt, ContextId conn_cid, char *xml)
 {
 	JNIEnv *env = java_get_env();
 	jstring jxml = (*env)->NewStringUTF(env, xml);
@@ -192,11 +192,12 @@ static void notif_java_associated(ContextId conn_cid, char *xml)
 /**
  * Function that calls D-Bus agent.MeasurementData method.
  *
+ * @param evt event being delivered
  * @param conn_cid device handle
  * @param xml Data in xml format
  * @return success status
  */
-static void notif_java_measurementdata(ContextId conn_cid, char *xml)
+static void notif_java_measurementdata(const healthd_event *evt, ContextId conn_cid, char *xml)
 {
 	JNIEnv *env = java_get_env();
 	jstring jxml = (*env)->NewStringUTF(env, xml);
@@ -208,11 +209,12 @@ static void notif_java_measurementdata(ContextId conn_cid, char *xml)
 /**
  * Function that calls D-Bus agent.SegmentInfo method.
  *
+ * @param evt event being delivered
  * @param handle PM-Store handle
  * @param xml PM-Segment instance data in XML format
  * @return success status
  */
-static void notif_java_segmentinfo(ContextId conn_cid, unsigned int handle, char *xml)
+static void notif_java_segmentinfo(const healthd_event *evt, ContextId conn_cid, unsigned int handle, char *xml)
 {
 	// JNIEnv *env = java_get_env();
 	// (*env)->CallVoidMethod(env, bridge_obj,jni_up_segmentinfo(conn_handle, handle, xml);
@@ -223,13 +225,14 @@ static void notif_java_segmentinfo(ContextId conn_cid, unsigned int handle, char
 /**
  * Function that calls D-Bus agent.SegmentDataResponse method.
  *
+ * @param evt event being delivered
  * @param conn_cid device handle
  * @param handle PM-Store handle
  * @param instnumber PM-Segment instance number
  * @param status Return status
  * @return success status
  */
-static void notif_java_segmentdataresponse(ContextId conn_cid,
+static void notif_java_segmentdataresponse(const healthd_event *evt, ContextId conn_cid,
 			unsigned int handle, unsigned int instnumber, unsigned int retstatus)
 {
 	// JNIEnv *env = java_get_env();
@@ -241,13 +244,14 @@ static void notif_java_segmentdataresponse(ContextId conn_cid,
 /**
  * Function that calls D-Bus agent.SegmentData method.
  *
+ * @param evt event being delivered
  * @param conn_cid device handle
  * @param handle PM-Store handle
  * @param instnumber PM-Segment instance number
  * @param xml PM-Segment instance data in XML format
  * @return success status
  */
-static void notif_java_segmentdata(ContextId conn_cid, unsigned int handle,
+static void notif_java_segmentdata(const healthd_event *evt, ContextId conn_cid, unsigned int handle,
 					unsigned int instnumber, char *xml)
 {
 	// JNIEnv *env = java_get_env();:q
@@ -260,12 +264,13 @@ static void notif_java_segmentdata(ContextId conn_cid, unsigned int handle,
 /**
  * Function that calls D-Bus agent.PMStoreData method.
  *
+ * @param evt event being delivered
  * @param conn_cid device handle
  * @param handle PM-Store handle
  * @param xml PM-Store data attributes in XML format
  * @return success status
  */
-static void notif_java_pmstoredata(ContextId conn_cid, unsigned int handle, char *xml)
+static void notif_java_pmstoredata(const healthd_event *evt, ContextId conn_cid, unsigned int handle, char *xml)
 {
 	// JNIEnv *env = java_get_env();
 	// (*env)->CallVoidMethod(env, bridge_obj, jni_up_pmstoredata(conn_handle, handle, jxml);
@@ -276,12 +281,13 @@ static void notif_java_pmstoredata(ContextId conn_cid, unsigned int handle, char
 /**
  * Function that calls D-Bus agent.SegmentCleared method.
  *
+ * @param evt event being delivered
  * @param conn_cid device handle
  * @param handle PM-Store handle
  * @param PM-Segment instance number
  * @return success status
  */
-static void notif_java_segmentcleared(ContextId conn_cid, unsigned int handle,
+static void notif_java_segmentcleared(const healthd_event *evt, ContextId conn_cid, unsigned int handle,
 							unsigned int instnumber,
 							unsigned int retstatus)
 {
@@ -296,7 +302,7 @@ static void notif_java_segmentcleared(ContextId conn_cid, unsigned int handle,
  *
  * @return success status
  */
-static void notif_java_deviceattributes(ContextId conn_cid, char *xml)
+static void notif_java_deviceattributes(const healthd_event *evt, ContextId conn_cid, char *xml)
 {
 	JNIEnv *env = java_get_env();
 	jstring jxml = (*env)->NewStringUTF(env, xml);
@@ -310,7 +316,7 @@ static void notif_java_deviceattributes(ContextId conn_cid, char *xml)
  *
  * @return success status
  */
-static void notif_java_disassociated(ContextId conn_cid)
+static void notif_java_disassociated(const healthd_event *evt, ContextId conn_cid)
 {
 	JNIEnv *env = java_get_env();
 	(*env)->CallVoidMethod(env, bridge_obj,
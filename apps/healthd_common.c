@@ -46,11 +46,199 @@
 #include "src/util/linkedlist.h"
 #include "src/communication/service.h"
 #include "src/dim/pmstore_req.h"
+#include "src/api/text_encoder.h"
 #include "healthd_ipc.h"
 #include "healthd_service.h"
+#include "healthd_common.h"
+#include "healthd_encoder.h"
 
 extern healthd_ipc ipc;
 
+/**
+ * What healthd knows about a connected device, for subscriptions
+ */
+typedef struct {
+	ContextId id;
+	char *low_addr;
+	char *system_id;
+	int associated;
+} device_info;
+
+static LinkedList *_device_infos = NULL;
+
+/**
+ * Counters reported by healthd_get_device_stats(). Like device_infos,
+ * only touched by the main loop.
+ */
+static unsigned long long measurements = 0;
+static unsigned long long segment_requests = 0;
+static unsigned long long segment_failures = 0;
+static unsigned long long segments_received = 0;
+
+static LinkedList *device_infos()
+{
+	if (!_device_infos) {
+		_device_infos = llist_new();
+	}
+	return _device_infos;
+}
+
+static int cmp_device_info(void *arg, void *element)
+{
+	ContextId id = *((ContextId *) arg);
+	device_info *info = element;
+
+	return info->id.plugin == id.plugin && info->id.connid == id.connid;
+}
+
+static device_info *device_info_get(ContextId id, int create)
+{
+	device_info *info = llist_search_first(device_infos(), &id,
+						cmp_device_info);
+
+	if (!info && create) {
+		info = calloc(1, sizeof(device_info));
+		info->id = id;
+		llist_add(device_infos(), info);
+	}
+
+	return info;
+}
+
+static void device_info_del(ContextId id)
+{
+	device_info *info = device_info_get(id, 0);
+
+	if (!info)
+		return;
+
+	llist_remove(device_infos(), info);
+	free(info->low_addr);
+	free(info->system_id);
+	free(info);
+}
+
+typedef struct {
+	healthd_event evt;
+	int handle;
+	int instnumber;
+	int status;
+} ipc_evt;
+
+/**
+ * Forwards an event to IPC, once its data list has been encoded.
+ * Runs in main loop.
+ *
+ * @param id context ID
+ * @param revt pointer to event struct
+ * @param data encoded data list, or NULL
+ */
+static void ipc_evt_deliver(ContextId id, void *revt, char *data)
+{
+	ipc_evt *evt = revt;
+
+	switch (evt->evt.type) {
+	case HEALTHD_EVT_MEASUREMENT:
+		if (data)
+			ipc.call_agent_measurementdata(&evt->evt, id, data);
+		break;
+	case HEALTHD_EVT_SEGMENTDATA:
+		DEBUG("PM-Segment Data phase 2");
+		if (data)
+			ipc.call_agent_segmentdata(&evt->evt, id, evt->handle,
+						evt->instnumber, data);
+		break;
+	case HEALTHD_EVT_ASSOCIATED:
+		if (data)
+			ipc.call_agent_associated(&evt->evt, id, data);
+		break;
+	case HEALTHD_EVT_CONNECTED:
+		ipc.call_agent_connected(&evt->evt, id, evt->evt.low_addr);
+		break;
+	case HEALTHD_EVT_DISCONNECTED:
+		ipc.call_agent_disconnected(&evt->evt, id, evt->evt.low_addr);
+		break;
+	case HEALTHD_EVT_DISASSOCIATED:
+		ipc.call_agent_disassociated(&evt->evt, id);
+		break;
+	case HEALTHD_EVT_DEVICEATTRIBUTES:
+		if (data)
+			ipc.call_agent_deviceattributes(&evt->evt, id, data);
+		break;
+	case HEALTHD_EVT_PMSTOREDATA:
+		ipc.call_agent_pmstoredata(&evt->evt, id, evt->handle, data ? data : "");
+		break;
+	case HEALTHD_EVT_SEGMENTINFO:
+		if (data)
+			ipc.call_agent_segmentinfo(&evt->evt, id, evt->handle, data);
+		break;
+	case HEALTHD_EVT_SEGMENTDATARESPONSE:
+		ipc.call_agent_segmentdataresponse(&evt->evt, id, evt->handle,
+					evt->instnumber, evt->status);
+		break;
+	case HEALTHD_EVT_SEGMENTCLEARED:
+		ipc.call_agent_segmentcleared(&evt->evt, id, evt->handle,
+					evt->instnumber, evt->status);
+		break;
+	default:
+		break;
+	}
+
+	healthd_event_clear(&evt->evt);
+	free(evt);
+}
+
+/**
+ * Queues an event to IPC. All events of a device go through the
+ * encoder, so they keep their order even when lists are encoded
+ * off the main loop.
+ *
+ * If no IPC client subscribed to the event, the list is not encoded
+ * at all. Events are still delivered, since backends may keep track
+ * of devices.
+ *
+ * @param id context ID
+ * @param type event type
+ * @param list data list to be encoded, may be NULL
+ * @param mds device MDS, to find which metrics list holds; may be NULL
+ * @param owned 1 if a reference to list is passed, 0 if one must be taken
+ * @param handle object handle, if applicable
+ * @param instnumber PM-Segment instance number, if applicable
+ * @param status error status, if applicable
+ */
+static void ipc_evt_submit(ContextId id, healthd_event_type type,
+				DataList *list, MDS *mds, int owned,
+				int handle, int instnumber, int status)
+{
+	ipc_evt *evt = calloc(1, sizeof(ipc_evt));
+	device_info *info = device_info_get(id, 0);
+
+	evt->evt.type = type;
+	evt->evt.id = id;
+	evt->handle = handle;
+	evt->instnumber = instnumber;
+	evt->status = status;
+
+	if (info && info->low_addr)
+		evt->evt.low_addr = strdup(info->low_addr);
+	if (info && info->system_id)
+		evt->evt.system_id = strdup(info->system_id);
+
+	if (list && (type & (HEALTHD_EVT_MEASUREMENT | HEALTHD_EVT_SEGMENTDATA)))
+		healthd_event_set_metrics(&evt->evt, list, mds);
+
+	if (list && ipc.subscribers && !ipc.subscribers(&evt->evt)) {
+		DEBUG("No subscribers, not encoding");
+		if (owned)
+			data_list_del(list);
+		list = NULL;
+	} else if (list && !owned) {
+		list = data_list_ref(list);
+	}
+
+	healthd_encoder_submit(id, list, ipc_evt_deliver, evt);
+}
+
 /**
  * Callback for when new data has been received.
  *
@@ -61,12 +249,11 @@ void new_data_received(Context *ctx, DataList *list)
 {
 	DEBUG("Medical Device System Data");
 
-	char *data = xml_encode_data_list(list);
+	++measurements;
 
-	if (data) {
-		ipc.call_agent_measurementdata(ctx->id, data);
-		free(data);
-	}
+	// core drops its reference to list after return
+	ipc_evt_submit(ctx->id, HEALTHD_EVT_MEASUREMENT, list, ctx->mds,
+			0, 0, 0, 0);
 }
 
 typedef struct {
@@ -86,16 +273,8 @@ static void segment_data_received_phase2(void *revt)
 {
 	segment_data_evt *evt = revt;
 
-	DEBUG("PM-Segment Data phase 2");
-
-	char *data = xml_encode_data_list(evt->list);
-
-	if (data) {
-		ipc.call_agent_segmentdata(evt->id, evt->handle, evt->instnumber, data);
-		free(data);
-	}
-
-	data_list_del(evt->list);
+	ipc_evt_submit(evt->id, HEALTHD_EVT_SEGMENTDATA, evt->list, NULL, 1,
+			evt->handle, evt->instnumber, 0);
 	free(revt);
 }
 
@@ -110,10 +289,11 @@ static void segment_data_received_phase2(void *revt)
 void segment_data_received(Context *ctx, int handle, int instnumber, DataList *list)
 {
 	DEBUG("PM-Segment Data");
-	segment_data_evt *evt = calloc(1, sizeof(segment_data_evt));
 
-	// Different from other callback events, "list" is not freed by core, but
-	// it is passed ownership instead.
+	++segments_received;
+
+	// Different from other callback events, a reference to "list" is
+	// given to us, to be dropped when done.
 
 	// Encoding a whole PM-Segment to XML may take a *LONG* time. If the program
 	// is single-threaded, encoding here would block the 11073 stack, causing
@@ -122,6 +302,13 @@ void segment_data_received(Context *ctx, int handle, int instnumber, DataList *l
 	// So, encoding XML from data list is better left to a thread, or, at very
 	// least, delayed until there are no pending events.
 
+	if (healthd_encoder_running()) {
+		ipc_evt_submit(ctx->id, HEALTHD_EVT_SEGMENTDATA, list, ctx->mds, 1,
+				handle, instnumber, 0);
+		return;
+	}
+
+	segment_data_evt *evt = calloc(1, sizeof(segment_data_evt));
 	evt->id = ctx->id;
 	evt->handle = handle;
 	evt->instnumber = instnumber;
@@ -141,12 +328,17 @@ void device_associated(Context *ctx, DataList *list)
 {
 	DEBUG("Device associated");
 
-	char *data = xml_encode_data_list(list);
+	device_info *info = device_info_get(ctx->id, 1);
+	info->associated = 1;
 
-	if (data) {
-		ipc.call_agent_associated(ctx->id, data);
-		free(data);
+	// same hex form as the System-Id entry nested in the list
+	if (ctx->mds) {
+		free(info->system_id);
+		info->system_id = octet_string2hex(&ctx->mds->system_id);
 	}
+
+	// core drops its reference to list after return
+	ipc_evt_submit(ctx->id, HEALTHD_EVT_ASSOCIATED, list, NULL, 0, 0, 0, 0);
 }
 
 /**
@@ -158,7 +350,12 @@ void device_associated(Context *ctx, DataList *list)
 int device_connected(Context *ctx, const char *low_addr)
 {
 	DEBUG("Device connected");
-	ipc.call_agent_connected(ctx->id, low_addr);
+
+	device_info *info = device_info_get(ctx->id, 1);
+	free(info->low_addr);
+	info->low_addr = low_addr ? strdup(low_addr) : NULL;
+
+	ipc_evt_submit(ctx->id, HEALTHD_EVT_CONNECTED, NULL, NULL, 0, 0, 0, 0);
 	return 1;
 }
 
@@ -171,7 +368,13 @@ int device_connected(Context *ctx, const char *low_addr)
 int device_disconnected(Context *ctx, const char *low_addr)
 {
 	DEBUG("Device disconnected");
-	ipc.call_agent_disconnected(ctx->id, low_addr);
+
+	device_info *info = device_info_get(ctx->id, 1);
+	if (low_addr && !info->low_addr)
+		info->low_addr = strdup(low_addr);
+
+	ipc_evt_submit(ctx->id, HEALTHD_EVT_DISCONNECTED, NULL, NULL, 0, 0, 0, 0);
+	device_info_del(ctx->id);
 	return 1;
 }
 
@@ -181,7 +384,12 @@ int device_disconnected(Context *ctx, const char *low_addr)
 void device_disassociated(Context *ctx)
 {
 	DEBUG("Device unassociated");
-	ipc.call_agent_disassociated(ctx->id);
+
+	device_info *info = device_info_get(ctx->id, 0);
+	if (info)
+		info->associated = 0;
+
+	ipc_evt_submit(ctx->id, HEALTHD_EVT_DISASSOCIATED, NULL, NULL, 0, 0, 0, 0);
 }
 
 /**
@@ -198,12 +406,8 @@ static void device_reqmdsattr_callback(Context *ctx, Request *r, DATA_apdu *resp
 	DataList *list = manager_get_mds_attributes(ctx->id);
 
 	if (list) {
-		char *data = xml_encode_data_list(list);
-		if (data) {
-			ipc.call_agent_deviceattributes(ctx->id, data);
-			free(data);
-		}
-		data_list_del(list);
+		ipc_evt_submit(ctx->id, HEALTHD_EVT_DEVICEATTRIBUTES, list, NULL, 1,
+				0, 0, 0);
 	}
 }
 
@@ -333,7 +537,6 @@ static void device_get_pmstore_cb(Context *ctx, Request *r, DATA_apdu *response_
 {
 	PMStoreGetRet *ret = (PMStoreGetRet*) r->return_data;
 	DataList *list;
-	char *data;
 
 	DEBUG("device_get_pmstore_cb");
 
@@ -342,16 +545,14 @@ static void device_get_pmstore_cb(Context *ctx, Request *r, DATA_apdu *response_
 
 	if (ret->error) {
 		// some error
-		ipc.call_agent_pmstoredata(ctx->id, ret->handle, "");
+		ipc_evt_submit(ctx->id, HEALTHD_EVT_PMSTOREDATA, NULL, NULL, 0,
+				ret->handle, 0, 0);
 		return;
 	}
 
 	if ((list = manager_get_pmstore_data(ctx->id, ret->handle))) {
-		if ((data = xml_encode_data_list(list))) {
-			ipc.call_agent_pmstoredata(ctx->id, ret->handle, data);
-			free(data);
-			data_list_del(list);
-		}
+		ipc_evt_submit(ctx->id, HEALTHD_EVT_PMSTOREDATA, list, NULL, 1,
+				ret->handle, 0, 0);
 	}
 }
 
@@ -384,17 +585,13 @@ static void device_get_segminfo_cb(Context *ctx, Request *r, DATA_apdu *response
 {
 	PMStoreGetSegmInfoRet *ret = (PMStoreGetSegmInfoRet*) r->return_data;
 	DataList *list;
-	char *data;
 
 	if (!ret)
 		return;
 
 	if ((list = manager_get_segment_info_data(ctx->id, ret->handle))) {
-		if ((data = xml_encode_data_list(list))) {
-			ipc.call_agent_segmentinfo(ctx->id, ret->handle, data);
-			free(data);
-			data_list_del(list);
-		}
+		ipc_evt_submit(ctx->id, HEALTHD_EVT_SEGMENTINFO, list, NULL, 1,
+				ret->handle, 0, 0);
 	}
 }
 
@@ -412,7 +609,11 @@ static void device_get_segmdata_cb(Context *ctx, Request *r, DATA_apdu *response
 	if (!ret)
 		return;
 
-	ipc.call_agent_segmentdataresponse(ctx->id, ret->handle, ret->inst, ret->error);
+	if (ret->error)
+		++segment_failures;
+
+	ipc_evt_submit(ctx->id, HEALTHD_EVT_SEGMENTDATARESPONSE, NULL, NULL, 0,
+			ret->handle, ret->inst, ret->error);
 }
 
 /**
@@ -429,7 +630,8 @@ static void device_clear_segm_cb(Context *ctx, Request *r, DATA_apdu *response_a
 	if (!ret)
 		return;
 
-	ipc.call_agent_segmentcleared(ctx->id, ret->handle, ret->inst, ret->error);
+	ipc_evt_submit(ctx->id, HEALTHD_EVT_SEGMENTCLEARED, NULL, NULL, 0,
+			ret->handle, ret->inst, ret->error);
 }
 
 /**
@@ -466,6 +668,10 @@ void device_get_segmdata(ContextId ctx, int handle, int instnumber,
 	req = manager_request_get_segment_data(ctx, handle,
 				instnumber, device_get_segmdata_cb);
 	*ret = req ? 0 : 1;
+
+	++segment_requests;
+	if (!req)
+		++segment_failures;
 }
 
 /**
@@ -504,4 +710,29 @@ void device_clearallsegmdata(ContextId ctx, int handle, int *ret)
 	*ret = req ? 0 : 1;
 }
 
+/**
+ * Fills device and PM-Segment transfer counters
+ *
+ * \param stats filled with current counters
+ */
+void healthd_get_device_stats(healthd_device_stats *stats)
+{
+	LinkedNode *node = device_infos()->first;
+
+	memset(stats, 0, sizeof(healthd_device_stats));
+
+	while (node) {
+		device_info *info = node->element;
+		++stats->connected;
+		if (info->associated)
+			++stats->associated;
+		node = node->next;
+	}
+
+	stats->measurements = measurements;
+	stats->segment_requests = segment_requests;
+	stats->segment_failures = segment_failures;
+	stats->segments_received = segments_received;
+}
+
 /** @} */
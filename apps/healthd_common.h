@@ -4,6 +4,27 @@
 #include "src/communication/context_manager.h"
 #include "src/api/api_definitions.h"
 
+/**
+ * Device and PM-Segment transfer counters, for metrics
+ */
+typedef struct {
+	unsigned int connected;
+	unsigned int associated;
+	unsigned long long measurements;
+	/**
+	 * PM-Segment transfers requested by IPC clients
+	 */
+	unsigned long long segment_requests;
+	/**
+	 * Transfers the agent refused, or that failed
+	 */
+	unsigned long long segment_failures;
+	/**
+	 * PM-Segments fully received
+	 */
+	unsigned long long segments_received;
+} healthd_device_stats;
+
 void new_data_received(Context *ctx, DataList *list);
 void segment_data_received(Context *ctx, int handle, int instnumber, DataList *list);
 void device_associated(Context *ctx, DataList *list);
@@ -25,5 +46,6 @@ void device_get_segmdata(ContextId ctx, int handle, int instnumber,
 void device_clearsegmdata(ContextId ctx, int handle, int instnumber,
 				int *ret);
 void device_clearallsegmdata(ContextId ctx, int handle, int *ret);
+void healthd_get_device_stats(healthd_device_stats *stats);
 
 #endif
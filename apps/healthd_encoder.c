@@ -0,0 +1,289 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file healthd_encoder.c
+ * \brief Health manager service - DataList encoding worker pool
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * @addtogroup Healthd
+ * @{
+ */
+
+/*
+ * Encoding a DataList to XML may take a long time (a whole PM-Segment
+ * easily takes seconds), and listener callbacks run with the context
+ * locked. Jobs are handed to worker threads instead, and the results
+ * go back to the main loop through healthd_idle_add().
+ *
+ * A device is always served by the same worker, so its events reach
+ * IPC in the order they were submitted. Jobs without a DataList are
+ * queued too, so e.g. a disassociation is never announced before the
+ * last measurement.
+ *
+ * If the pool is not started (e.g. Android), jobs are encoded and
+ * delivered synchronously.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ieee11073.h>
+#include "src/util/log.h"
+#include "src/communication/stats.h"
+#include "healthd_service.h"
+#include "healthd_encoder.h"
+
+typedef struct encoder_job {
+	ContextId id;
+	DataList *list;
+	healthd_encoder_deliver deliver;
+	void *arg;
+	char *xml;
+	struct encoder_job *next;
+} encoder_job;
+
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	encoder_job *first;
+	encoder_job *last;
+	unsigned int count;
+	int stopping;
+} encoder_worker;
+
+static encoder_worker *workers = NULL;
+static unsigned int worker_count = 0;
+static unsigned int worker_queue_size = 0;
+
+/**
+ * Updated by workers, read by main loop
+ */
+static unsigned long long encoded = 0;
+static unsigned long long encode_ns = 0;
+
+/**
+ * Delivers an encoded job. Runs in main loop.
+ *
+ * @param data job
+ */
+static void encoder_job_done(void *data)
+{
+	encoder_job *job = data;
+
+	job->deliver(job->id, job->arg, job->xml);
+
+	free(job->xml);
+	free(job);
+}
+
+static void encoder_job_run(encoder_job *job)
+{
+	if (job->list) {
+		unsigned long long start = stats_clock();
+
+		job->xml = xml_encode_data_list(job->list);
+		data_list_del(job->list);
+		job->list = NULL;
+
+		__atomic_fetch_add(&encode_ns, stats_clock() - start,
+				   __ATOMIC_RELAXED);
+		__atomic_fetch_add(&encoded, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void *encoder_worker_loop(void *arg)
+{
+	encoder_worker *w = arg;
+
+	while (1) {
+		pthread_mutex_lock(&w->mutex);
+
+		while (!w->first && !w->stopping)
+			pthread_cond_wait(&w->not_empty, &w->mutex);
+
+		if (!w->first) {
+			pthread_mutex_unlock(&w->mutex);
+			break;
+		}
+
+		encoder_job *job = w->first;
+		w->first = job->next;
+		if (!w->first)
+			w->last = NULL;
+		--w->count;
+
+		pthread_cond_signal(&w->not_full);
+		pthread_mutex_unlock(&w->mutex);
+
+		encoder_job_run(job);
+
+		// same worker, same order in idle queue
+		healthd_idle_add(encoder_job_done, job);
+	}
+
+	return NULL;
+}
+
+/**
+ * Starts encoding threads
+ *
+ * @param count number of worker threads (0 = encode synchronously)
+ * @param queue_size maximum pending jobs, for all workers
+ */
+void healthd_encoder_start(unsigned int count, unsigned int queue_size)
+{
+	unsigned int i;
+
+	if (workers || count == 0)
+		return;
+
+	worker_count = count;
+	worker_queue_size = queue_size / count;
+	if (worker_queue_size < 1)
+		worker_queue_size = 1;
+
+	workers = calloc(count, sizeof(encoder_worker));
+
+	for (i = 0; i < count; ++i) {
+		encoder_worker *w = &workers[i];
+		pthread_mutex_init(&w->mutex, NULL);
+		pthread_cond_init(&w->not_empty, NULL);
+		pthread_cond_init(&w->not_full, NULL);
+
+		if (pthread_create(&w->thread, NULL, encoder_worker_loop, w)) {
+			ERROR("Cannot create encoder thread");
+		}
+	}
+
+	DEBUG("Encoder: %u workers", count);
+}
+
+/**
+ * Stops encoding threads after pending jobs are encoded. Jobs not
+ * yet delivered to main loop are lost, so call at termination only.
+ */
+void healthd_encoder_stop()
+{
+	unsigned int i;
+
+	if (!workers)
+		return;
+
+	for (i = 0; i < worker_count; ++i) {
+		pthread_mutex_lock(&workers[i].mutex);
+		workers[i].stopping = 1;
+		pthread_cond_broadcast(&workers[i].not_empty);
+		pthread_mutex_unlock(&workers[i].mutex);
+	}
+
+	for (i = 0; i < worker_count; ++i) {
+		encoder_worker *w = &workers[i];
+		pthread_join(w->thread, NULL);
+		pthread_mutex_destroy(&w->mutex);
+		pthread_cond_destroy(&w->not_empty);
+		pthread_cond_destroy(&w->not_full);
+	}
+
+	free(workers);
+	workers = NULL;
+	worker_count = 0;
+}
+
+/**
+ * @return 1 if encoding threads are running
+ */
+int healthd_encoder_running()
+{
+	return workers != NULL;
+}
+
+/**
+ * Submits a DataList to be encoded, and the result to be delivered
+ * to main loop. If the device's queue is full, waits for room.
+ *
+ * @param id context ID, selects the worker
+ * @param list list to be encoded (ownership is passed), may be NULL
+ * @param deliver callback
+ * @param arg callback argument
+ */
+void healthd_encoder_submit(ContextId id, DataList *list,
+			healthd_encoder_deliver deliver, void *arg)
+{
+	encoder_job *job = calloc(1, sizeof(encoder_job));
+	job->id = id;
+	job->list = list;
+	job->deliver = deliver;
+	job->arg = arg;
+
+	if (!workers) {
+		encoder_job_run(job);
+		encoder_job_done(job);
+		return;
+	}
+
+	unsigned int n = (id.plugin * 31 + (unsigned int) id.connid)
+				% worker_count;
+	encoder_worker *w = &workers[n];
+
+	pthread_mutex_lock(&w->mutex);
+
+	while (w->count >= worker_queue_size)
+		pthread_cond_wait(&w->not_full, &w->mutex);
+
+	if (w->last)
+		w->last->next = job;
+	else
+		w->first = job;
+	w->last = job;
+	++w->count;
+
+	pthread_cond_signal(&w->not_empty);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+/**
+ * Fills encoder counters
+ *
+ * @param stats filled with current counters
+ */
+void healthd_encoder_get_stats(healthd_encoder_stats *stats)
+{
+	unsigned int i;
+
+	memset(stats, 0, sizeof(healthd_encoder_stats));
+
+	stats->encoded = __atomic_load_n(&encoded, __ATOMIC_RELAXED);
+	stats->encode_ns = __atomic_load_n(&encode_ns, __ATOMIC_RELAXED);
+
+	for (i = 0; workers && i < worker_count; ++i) {
+		pthread_mutex_lock(&workers[i].mutex);
+		stats->pending += workers[i].count;
+		pthread_mutex_unlock(&workers[i].mutex);
+	}
+}
+
+/** @} */
@@ -0,0 +1,41 @@
+#ifndef HEALTHD_ENCODER_
+#define HEALTHD_ENCODER_
+
+#include "src/communication/context.h"
+#include "src/api/api_definitions.h"
+
+/**
+ * Called in main loop with the encoded payload of a submitted list
+ * (NULL if no list was submitted). Payload is freed after return.
+ */
+typedef void (*healthd_encoder_deliver)(ContextId id, void *arg, char *xml);
+
+/**
+ * Encoder counters, for metrics
+ */
+typedef struct {
+	/**
+	 * Data lists encoded
+	 */
+	unsigned long long encoded;
+	/**
+	 * Time spent encoding them, in nanoseconds
+	 */
+	unsigned long long encode_ns;
+	/**
+	 * Jobs waiting for a worker
+	 */
+	unsigned int pending;
+} healthd_encoder_stats;
+
+#define HEALTHD_ENCODER_DEFAULT_WORKERS 2
+#define HEALTHD_ENCODER_DEFAULT_QUEUE_SIZE 1024
+
+void healthd_encoder_start(unsigned int workers, unsigned int queue_size);
+void healthd_encoder_stop();
+int healthd_encoder_running();
+void healthd_encoder_submit(ContextId id, DataList *list,
+			healthd_encoder_deliver deliver, void *arg);
+void healthd_encoder_get_stats(healthd_encoder_stats *stats);
+
+#endif
@@ -1,18 +1,27 @@
 #ifndef HEALTHD_IPC_
 #define HEALTHD_IPC_
 
+#include "healthd_subscription.h"
+
 typedef struct {
-	void (*call_agent_measurementdata)(ContextId, char *);
-	void (*call_agent_connected)(ContextId, const char *);
-	void (*call_agent_disconnected)(ContextId, const char *);
-	void (*call_agent_associated)(ContextId, char *);
-	void (*call_agent_disassociated)(ContextId);
-	void (*call_agent_segmentinfo)(ContextId, unsigned int, char *);
-	void (*call_agent_segmentdataresponse)(ContextId, unsigned int, unsigned int, unsigned int);
-	void (*call_agent_segmentdata)(ContextId, unsigned int, unsigned int, char *);
-	void (*call_agent_segmentcleared)(ContextId, unsigned int, unsigned int, unsigned int);
-	void (*call_agent_pmstoredata)(ContextId, unsigned int, char *);
-	void (*call_agent_deviceattributes)(ContextId, char *xml);
+	void (*call_agent_measurementdata)(const healthd_event *, ContextId, char *);
+	void (*call_agent_connected)(const healthd_event *, ContextId, const char *);
+	void (*call_agent_disconnected)(const healthd_event *, ContextId, const char *);
+	void (*call_agent_associated)(const healthd_event *, ContextId, char *);
+	void (*call_agent_disassociated)(const healthd_event *, ContextId);
+	void (*call_agent_segmentinfo)(const healthd_event *, ContextId, unsigned int, char *);
+	void (*call_agent_segmentdataresponse)(const healthd_event *, ContextId, unsigned int, unsigned int, unsigned int);
+	void (*call_agent_segmentdata)(const healthd_event *, ContextId, unsigned int, unsigned int, char *);
+	void (*call_agent_segmentcleared)(const healthd_event *, ContextId, unsigned int, unsigned int, unsigned int);
+	void (*call_agent_pmstoredata)(const healthd_event *, ContextId, unsigned int, char *);
+	void (*call_agent_deviceattributes)(const healthd_event *, ContextId, char *xml);
+	/**
+	 * Optional. Returns how many clients want the event, so that
+	 * unwanted events need not be encoded. NULL means every client
+	 * gets every event. Each call_agent_* receives the event and
+	 * filters its clients by itself.
+	 */
+	int (*subscribers)(const healthd_event *evt);
 	void (*start)();
 	void (*stop)();
 } healthd_ipc;
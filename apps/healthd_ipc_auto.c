@@ -70,11 +70,12 @@ static void self_configure()
 /**
  * Function that calls agent.Connected method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param low_addr Device address e.g. Bluetooth MAC
  * @return TRUE if success
  */
-static void call_agent_connected(ContextId ctx, const char *low_addr)
+static void call_agent_connected(const healthd_event *evt, ContextId ctx, const char *low_addr)
 {
 	DEBUG("call_agent_connected");
 	announce("CONNECTED", ctx, low_addr);
@@ -83,11 +84,12 @@ static void call_agent_connected(ContextId ctx, const char *low_addr)
 /**
  * Function that calls agent.Associated method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param xml Data in XML format
  * @return success status
  */
-static void call_agent_associated(ContextId ctx, char *xml)
+static void call_agent_associated(const healthd_event *evt, ContextId ctx, char *xml)
 {
 	DEBUG("call_agent_associated");
 	announce("ASSOCIATED", ctx, "");
@@ -97,11 +99,12 @@ static void call_agent_associated(ContextId ctx, char *xml)
 /**
  * Function that calls agent.MeasurementData method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param xml Data in xml format
  * @return success status
  */
-static void call_agent_measurementdata(ContextId ctx, char *xml)
+static void call_agent_measurementdata(const healthd_event *evt, ContextId ctx, char *xml)
 {
 	DEBUG("call_agent_measurementdata");
 	announce("MEASUREMENT", ctx, xml);
@@ -110,12 +113,13 @@ static void call_agent_measurementdata(ContextId ctx, char *xml)
 /**
  * Function that calls agent.SegmentInfo method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param handle PM-Store handle
  * @param xml PM-Segment instance data in XML format
  * @return success status
  */
-static void call_agent_segmentinfo(ContextId ctx, unsigned int handle, char *xml)
+static void call_agent_segmentinfo(const healthd_event *evt, ContextId ctx, unsigned int handle, char *xml)
 {
 	DEBUG("call_agent_segmentinfo");
 
@@ -131,13 +135,14 @@ static void call_agent_segmentinfo(ContextId ctx, unsigned int handle, char *xml
 /**
  * Function that calls agent.SegmentDataResponse method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param handle PM-Store handle
  * @param instnumber PM-Segment instance number
  * @param status Return status
  * @return success status
  */
-static void call_agent_segmentdataresponse(ContextId ctx,
+static void call_agent_segmentdataresponse(const healthd_event *evt, ContextId ctx,
 			unsigned int handle, unsigned int instnumber,
 			unsigned int retstatus)
 {
@@ -155,13 +160,14 @@ static void call_agent_segmentdataresponse(ContextId ctx,
 /**
  * Function that calls agent.SegmentData method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param handle PM-Store handle
  * @param instnumber PM-Segment instance number
  * @param xml PM-Segment instance data in XML format
  * @return success status
  */
-static void call_agent_segmentdata(ContextId ctx, unsigned int handle,
+static void call_agent_segmentdata(const healthd_event *evt, ContextId ctx, unsigned int handle,
 					unsigned int instnumber, char *xml)
 {
 	DEBUG("call_agent_segmentdata");
@@ -178,12 +184,13 @@ static void call_agent_segmentdata(ContextId ctx, unsigned int handle,
 /**
  * Function that calls agent.PMStoreData method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param handle PM-Store handle
  * @param xml PM-Store data attributes in XML format
  * @return success status
  */
-static void call_agent_pmstoredata(ContextId ctx, unsigned int handle, char *xml)
+static void call_agent_pmstoredata(const healthd_event *evt, ContextId ctx, unsigned int handle, char *xml)
 {
 	DEBUG("call_agent_pmstoredata");
 
@@ -199,12 +206,13 @@ static void call_agent_pmstoredata(ContextId ctx, unsigned int handle, char *xml
 /**
  * Function that calls agent.SegmentCleared method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param handle PM-Store handle
  * @param PM-Segment instance number
  * @return success status
  */
-static void call_agent_segmentcleared(ContextId ctx, unsigned int handle,
+static void call_agent_segmentcleared(const healthd_event *evt, ContextId ctx, unsigned int handle,
 							unsigned int instnumber,
 							unsigned int retstatus)
 {
@@ -220,11 +228,12 @@ static void call_agent_segmentcleared(ContextId ctx, unsigned int handle,
 /**
  * Function that calls agent.DeviceAttributes method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param xml Data in xml format
  * @return success status
  */
-static void call_agent_deviceattributes(ContextId ctx, char *xml)
+static void call_agent_deviceattributes(const healthd_event *evt, ContextId ctx, char *xml)
 {
 	announce("ATTRIBUTES", ctx, xml);
 }
@@ -232,10 +241,11 @@ static void call_agent_deviceattributes(ContextId ctx, char *xml)
 /**
  * Function that calls agent.Disassociated method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @return success status
  */
-static void call_agent_disassociated(ContextId ctx)
+static void call_agent_disassociated(const healthd_event *evt, ContextId ctx)
 {
 	DEBUG("call_agent_disassociated");
 	announce("DISASSOCIATE", ctx, "");
@@ -244,11 +254,12 @@ static void call_agent_disassociated(ContextId ctx)
 /**
  * Function that calls agent.Disconnected method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param low_addr Device address e.g. Bluetooth MAC
  * @return success status
  */
-static void call_agent_disconnected(ContextId ctx, const char *low_addr)
+static void call_agent_disconnected(const healthd_event *evt, ContextId ctx, const char *low_addr)
 {
 	DEBUG("call_agent_disconnected");
 	announce("DISCONNECT", ctx, "");
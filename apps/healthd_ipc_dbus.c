@@ -159,6 +159,7 @@ static LinkedList *_devices = NULL;
 
 static DBusGConnection *bus = NULL;
 static DBusGProxy *agent_proxy = NULL;
+static healthd_subscription *agent_subscription = NULL;
 
 static const char *get_device_object(const char *, ContextId);
 static void get_agent_proxy();
@@ -257,6 +258,63 @@ gboolean srv_configurepassive(Serv *obj, gchar *agent,
 	return TRUE;
 }
 
+/**
+ * Callback related to manager.Subscribe D-Bus method.
+ * Called when D-Bus service client wants to restrict the events
+ * it gets. Only the client that called ConfigurePassive may do it.
+ *
+ * @param obj Serv object (GObject)
+ * @param filter event filter (see healthd_subscription.c); empty
+ *	  string subscribes to every event
+ * @param call Method invocation struct
+ * @return success status
+ */
+gboolean srv_subscribe(Serv *obj, gchar *filter, DBusGMethodInvocation *call)
+{
+	GQuark domain = g_quark_from_static_string(
+				"com.signove_health_service_error");
+	GError *error = NULL;
+	gchar *sender;
+	healthd_subscription *sub;
+
+	DEBUG("Subscribe: %s", filter);
+
+	sender = dbus_g_method_get_sender(call);
+
+	if (!agent_proxy || !client_name || strcmp(sender, client_name) != 0) {
+		error = g_error_new(domain, 1, "Client not configured");
+	} else if (!(sub = healthd_subscription_new(filter))) {
+		error = g_error_new(domain, 1, "Bad subscription filter");
+	}
+
+	g_free(sender);
+
+	if (error) {
+		dbus_g_method_return_error(call, error);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	healthd_subscription_del(agent_subscription);
+	agent_subscription = sub;
+	dbus_g_method_return(call);
+
+	return TRUE;
+}
+
+/**
+ * Tells whether D-Bus client wants an event. Device objects are kept
+ * up to date either way.
+ *
+ * @param evt event
+ * @return 1 if client wants event
+ */
+static int subscribers(const healthd_event *evt)
+{
+	return agent_proxy &&
+		healthd_subscription_match(agent_subscription, evt);
+}
+
 static int cmp_device_by_handle(void *arg, void *nodeElement) 
 {
 	ContextId handle = *((ContextId *) arg);
@@ -361,6 +419,9 @@ static void client_disconnected()
 		agent_proxy = NULL;
 		client_agent = NULL;
 		client_name = NULL;
+
+		healthd_subscription_del(agent_subscription);
+		agent_subscription = NULL;
 	}
 }
 
@@ -476,11 +537,12 @@ static void call_agent_epilogue(DBusGProxy *proxy, DBusGProxyCall *call, gpointe
 /**
  * Function that calls D-Bus agent.Connected method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param low_addr Device address e.g. Bluetooth MAC
  * @return TRUE if success
  */
-static void call_agent_connected(ContextId ctx, const char *low_addr)
+static void call_agent_connected(const healthd_event *evt, ContextId ctx, const char *low_addr)
 {
 	DBusGProxyCall *call;
 	const char *device_path;
@@ -494,7 +556,7 @@ static void call_agent_connected(ContextId ctx, const char *low_addr)
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -515,10 +577,11 @@ static void call_agent_connected(ContextId ctx, const char *low_addr)
 /**
  * Function that calls D-Bus agent.Associated method.
  *
+ * @param evt event being delivered
  * @param conn_handle Context ID
  * @param xml Data in XML format
  */
-static void call_agent_associated(ContextId conn_handle, char *xml)
+static void call_agent_associated(const healthd_event *evt, ContextId conn_handle, char *xml)
 {
 	DBusGProxyCall *call;
 	const char *device_path;
@@ -532,7 +595,7 @@ static void call_agent_associated(ContextId conn_handle, char *xml)
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -553,10 +616,11 @@ static void call_agent_associated(ContextId conn_handle, char *xml)
 /**
  * Function that calls D-Bus agent.MeasurementData method.
  *
+ * @param evt event being delivered
  * @param conn_handle device handle
  * @param xml Data in xml format
  */
-static void call_agent_measurementdata(ContextId conn_handle, char *xml)
+static void call_agent_measurementdata(const healthd_event *evt, ContextId conn_handle, char *xml)
 {
 	/* Called back by new_data_received() */
 
@@ -572,7 +636,7 @@ static void call_agent_measurementdata(ContextId conn_handle, char *xml)
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -593,11 +657,12 @@ static void call_agent_measurementdata(ContextId conn_handle, char *xml)
 /**
  * Function that calls D-Bus agent.SegmentInfo method.
  *
+ * @param evt event being delivered
  * @param conn_handle Context ID
  * @param handle PM-Store handle
  * @param xml PM-Segment instance data in XML format
  */
-static void call_agent_segmentinfo(ContextId conn_handle, unsigned int handle, char *xml)
+static void call_agent_segmentinfo(const healthd_event *evt, ContextId conn_handle, unsigned int handle, char *xml)
 {
 	DBusGProxyCall *call;
 	const char *device_path;
@@ -611,7 +676,7 @@ static void call_agent_segmentinfo(ContextId conn_handle, unsigned int handle, c
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -634,12 +699,13 @@ static void call_agent_segmentinfo(ContextId conn_handle, unsigned int handle, c
 /**
  * Function that calls D-Bus agent.SegmentDataResponse method.
  *
+ * @param evt event being delivered
  * @param conn_handle device handle
  * @param handle PM-Store handle
  * @param instnumber PM-Segment instance number
  * @param status Return status
  */
-static void call_agent_segmentdataresponse(ContextId conn_handle,
+static void call_agent_segmentdataresponse(const healthd_event *evt, ContextId conn_handle,
 			unsigned int handle, unsigned int instnumber, unsigned int retstatus)
 {
 	DBusGProxyCall *call;
@@ -654,7 +720,7 @@ static void call_agent_segmentdataresponse(ContextId conn_handle,
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -678,12 +744,13 @@ static void call_agent_segmentdataresponse(ContextId conn_handle,
 /**
  * Function that calls D-Bus agent.SegmentData method.
  *
+ * @param evt event being delivered
  * @param conn_handle device handle
  * @param handle PM-Store handle
  * @param instnumber PM-Segment instance number
  * @param xml PM-Segment instance data in XML format
  */
-static void call_agent_segmentdata(ContextId conn_handle, unsigned int handle,
+static void call_agent_segmentdata(const healthd_event *evt, ContextId conn_handle, unsigned int handle,
 					unsigned int instnumber, char *xml)
 {
 	DBusGProxyCall *call;
@@ -698,7 +765,7 @@ static void call_agent_segmentdata(ContextId conn_handle, unsigned int handle,
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -722,11 +789,12 @@ static void call_agent_segmentdata(ContextId conn_handle, unsigned int handle,
 /**
  * Function that calls D-Bus agent.PMStoreData method.
  *
+ * @param evt event being delivered
  * @param conn_handle device handle
  * @param handle PM-Store handle
  * @param xml PM-Store data attributes in XML format
  */
-static void call_agent_pmstoredata(ContextId conn_handle, unsigned int handle, char *xml)
+static void call_agent_pmstoredata(const healthd_event *evt, ContextId conn_handle, unsigned int handle, char *xml)
 {
 	DBusGProxyCall *call;
 	const char *device_path;
@@ -740,7 +808,7 @@ static void call_agent_pmstoredata(ContextId conn_handle, unsigned int handle, c
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -763,11 +831,12 @@ static void call_agent_pmstoredata(ContextId conn_handle, unsigned int handle, c
 /**
  * Function that calls D-Bus agent.SegmentCleared method.
  *
+ * @param evt event being delivered
  * @param conn_handle device handle
  * @param handle PM-Store handle
  * @param PM-Segment instance number
  */
-static void call_agent_segmentcleared(ContextId conn_handle, unsigned int handle,
+static void call_agent_segmentcleared(const healthd_event *evt, ContextId conn_handle, unsigned int handle,
 							unsigned int instnumber,
 							unsigned int retstatus)
 {
@@ -783,7 +852,7 @@ static void call_agent_segmentcleared(ContextId conn_handle, unsigned int handle
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -807,11 +876,12 @@ static void call_agent_segmentcleared(ContextId conn_handle, unsigned int handle
 /**
  * Function that calls D-Bus agent.DeviceAttributes method.
  *
+ * @param evt event being delivered
  * @param conn_handle Context ID
  * @param xml Data in xml format
  * @return success status
  */
-static void call_agent_deviceattributes(ContextId conn_handle, char *xml)
+static void call_agent_deviceattributes(const healthd_event *evt, ContextId conn_handle, char *xml)
 {
 	DBusGProxyCall *call;
 	const char *device_path;
@@ -825,7 +895,7 @@ static void call_agent_deviceattributes(ContextId conn_handle, char *xml)
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -846,9 +916,10 @@ static void call_agent_deviceattributes(ContextId conn_handle, char *xml)
 /**
  * Function that calls D-Bus agent.Disassociated method.
  *
+ * @param evt event being delivered
  * @param conn_handle Context ID
  */
-static void call_agent_disassociated(ContextId conn_handle)
+static void call_agent_disassociated(const healthd_event *evt, ContextId conn_handle)
 {
 	DBusGProxyCall *call;
 	const char *device_path;
@@ -862,7 +933,7 @@ static void call_agent_disassociated(ContextId conn_handle)
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -882,10 +953,11 @@ static void call_agent_disassociated(ContextId conn_handle)
 /**
  * Function that calls D-Bus agent.Disconnected method.
  *
+ * @param evt event being delivered
  * @param conn_handle Context ID
  * @param low_addr Device address e.g. Bluetooth MAC
  */
-static void call_agent_disconnected(ContextId ctx, const char *low_addr)
+static void call_agent_disconnected(const healthd_event *evt, ContextId ctx, const char *low_addr)
 {
 	DBusGProxyCall *call;
 	const char *device_path;
@@ -899,7 +971,7 @@ static void call_agent_disconnected(ContextId ctx, const char *low_addr)
 		return; // FALSE;
 	}
 
-	if (!agent_proxy) {
+	if (!subscribers(evt)) {
 		return; // FALSE;
 	}
 
@@ -1229,6 +1301,7 @@ void healthd_ipc_dbus_init(healthd_ipc *ipc)
 	ipc->call_agent_segmentcleared = &call_agent_segmentcleared;
 	ipc->call_agent_pmstoredata = &call_agent_pmstoredata;
 	ipc->call_agent_deviceattributes = &call_agent_deviceattributes;
+	ipc->subscribers = &subscribers;
 	ipc->start = &start;
 	ipc->stop = &stop;
 }
@@ -0,0 +1,407 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file healthd_ipc_shm.c
+ * \brief Health manager service - shared memory ring IPC
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * @addtogroup Healthd
+ * @{
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "src/communication/context_manager.h"
+#include "src/util/log.h"
+#include "healthd_common.h"
+#include "healthd_service.h"
+#include "healthd_ipc.h"
+#include "healthd_ipc_shm.h"
+
+static char *shm_name = NULL;
+static unsigned int shm_size = HEALTHD_SHM_DEFAULT_SIZE;
+
+static healthd_shm_header *shm_header = NULL;
+static unsigned char *shm_ring = NULL;
+static size_t shm_mapped_size = 0;
+
+static size_t shm_align(size_t len)
+{
+	return (len + HEALTHD_SHM_ALIGN - 1) & ~((size_t) HEALTHD_SHM_ALIGN - 1);
+}
+
+static uint64_t shm_timestamp()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Claims 'size' bytes of ring at the current write position. Old data
+ * in that area is declared invalid before it is touched.
+ *
+ * @param size record size, aligned
+ * @param record_pos returns the ring position of record
+ * @return record
+ */
+static healthd_shm_record *shm_reserve(size_t size, uint64_t *record_pos)
+{
+	uint64_t capacity = shm_header->capacity;
+	uint64_t pos = shm_header->write_pos;
+	uint64_t room = capacity - (pos % capacity);
+
+	if (room < size) {
+		// fill the tail, so records never wrap around
+		healthd_shm_record *pad;
+		pad = (healthd_shm_record *) (shm_ring + pos % capacity);
+
+		__atomic_store_n(&shm_header->reserve_pos, pos + room,
+				 __ATOMIC_RELAXED);
+		// readers must see the claim before the old data changes
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memset(pad, 0, sizeof(healthd_shm_record));
+		pad->size = room;
+		pad->type = HEALTHD_SHM_PAD;
+		__atomic_store_n(&pad->pos, pos, __ATOMIC_RELEASE);
+		__atomic_store_n(&shm_header->write_pos, pos + room,
+				 __ATOMIC_RELEASE);
+		pos += room;
+	}
+
+	__atomic_store_n(&shm_header->reserve_pos, pos + size,
+			 __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	*record_pos = pos;
+	return (healthd_shm_record *) (shm_ring + pos % capacity);
+}
+
+/**
+ * Publishes an event in the ring.
+ *
+ * @param type record type
+ * @param ctx Context ID
+ * @param handle PM-Store handle, if applicable
+ * @param instnumber PM-Segment instance number, if applicable
+ * @param status return status, if applicable
+ * @param payload XML or address, may be NULL
+ */
+static void shm_publish(healthd_shm_record_type type, ContextId ctx,
+			unsigned int handle, unsigned int instnumber,
+			unsigned int status, const char *payload)
+{
+	if (!shm_header)
+		return;
+
+	size_t payload_len = payload ? strlen(payload) : 0;
+	size_t size = shm_align(sizeof(healthd_shm_record) + payload_len + 1);
+
+	if (size > shm_header->capacity / 2) {
+		DEBUG("SHM: %d-byte event does not fit in ring", (int) size);
+		return;
+	}
+
+	uint64_t pos;
+	healthd_shm_record *rec = shm_reserve(size, &pos);
+
+	rec->size = size;
+	rec->type = type;
+	rec->flags = 0;
+	rec->timestamp = shm_timestamp();
+	rec->connid = ctx.connid;
+	rec->plugin = ctx.plugin;
+	rec->handle = handle;
+	rec->instnumber = instnumber;
+	rec->status = status;
+	rec->payload_len = payload_len;
+	memcpy((char *) (rec + 1), payload ? payload : "", payload_len + 1);
+
+	__atomic_store_n(&rec->pos, pos, __ATOMIC_RELEASE);
+	__atomic_store_n(&shm_header->write_pos, pos + size, __ATOMIC_RELEASE);
+}
+
+static void self_configure()
+{
+	uint16_t hdp_data_types[] = {0x1004, 0x1007, 0x1029, 0x100f, 0x0};
+	hdp_types_configure(hdp_data_types);
+}
+
+/**
+ * Function that calls agent.Connected method.
+ *
+ * @param evt event being delivered
+ * @param ctx Context ID
+ * @param low_addr Device address e.g. Bluetooth MAC
+ */
+static void call_agent_connected(const healthd_event *evt, ContextId ctx, const char *low_addr)
+{
+	DEBUG("call_agent_connected");
+	shm_publish(HEALTHD_SHM_CONNECTED, ctx, 0, 0, 0, low_addr);
+}
+
+/**
+ * Function that calls agent.Associated method.
+ *
+ * @param evt event being delivered
+ * @param ctx Context ID
+ * @param xml Data in XML format
+ */
+static void call_agent_associated(const healthd_event *evt, ContextId ctx, char *xml)
+{
+	DEBUG("call_agent_associated");
+	shm_publish(HEALTHD_SHM_ASSOCIATED, ctx, 0, 0, 0, xml);
+}
+
+/**
+ * Function that calls agent.MeasurementData method.
+ *
+ * @param evt event being delivered
+ * @param ctx device handle
+ * @param xml Data in xml format
+ */
+static void call_agent_measurementdata(const healthd_event *evt, ContextId ctx, char *xml)
+{
+	DEBUG("call_agent_measurementdata");
+	shm_publish(HEALTHD_SHM_MEASUREMENT, ctx, 0, 0, 0, xml);
+}
+
+/**
+ * Function that calls agent.SegmentInfo method.
+ *
+ * @param evt event being delivered
+ * @param ctx Context ID
+ * @param handle PM-Store handle
+ * @param xml PM-Segment instance data in XML format
+ */
+static void call_agent_segmentinfo(const healthd_event *evt, ContextId ctx, unsigned int handle, char *xml)
+{
+	DEBUG("call_agent_segmentinfo");
+	shm_publish(HEALTHD_SHM_SEGMENTINFO, ctx, handle, 0, 0, xml);
+}
+
+/**
+ * Function that calls agent.SegmentDataResponse method.
+ *
+ * @param evt event being delivered
+ * @param ctx device handle
+ * @param handle PM-Store handle
+ * @param instnumber PM-Segment instance number
+ * @param status Return status
+ */
+static void call_agent_segmentdataresponse(const healthd_event *evt, ContextId ctx,
+			unsigned int handle, unsigned int instnumber,
+			unsigned int retstatus)
+{
+	DEBUG("call_agent_segmentdataresponse");
+	shm_publish(HEALTHD_SHM_SEGMENTDATARESPONSE, ctx, handle, instnumber,
+		    retstatus, NULL);
+}
+
+/**
+ * Function that calls agent.SegmentData method.
+ *
+ * @param evt event being delivered
+ * @param ctx device handle
+ * @param handle PM-Store handle
+ * @param instnumber PM-Segment instance number
+ * @param xml PM-Segment instance data in XML format
+ */
+static void call_agent_segmentdata(const healthd_event *evt, ContextId ctx, unsigned int handle,
+					unsigned int instnumber, char *xml)
+{
+	DEBUG("call_agent_segmentdata");
+	shm_publish(HEALTHD_SHM_SEGMENTDATA, ctx, handle, instnumber, 0, xml);
+}
+
+/**
+ * Function that calls agent.PMStoreData method.
+ *
+ * @param evt event being delivered
+ * @param ctx device handle
+ * @param handle PM-Store handle
+ * @param xml PM-Store data attributes in XML format
+ */
+static void call_agent_pmstoredata(const healthd_event *evt, ContextId ctx, unsigned int handle, char *xml)
+{
+	DEBUG("call_agent_pmstoredata");
+	shm_publish(HEALTHD_SHM_PMSTOREDATA, ctx, handle, 0, 0, xml);
+}
+
+/**
+ * Function that calls agent.SegmentCleared method.
+ *
+ * @param evt event being delivered
+ * @param ctx device handle
+ * @param handle PM-Store handle
+ * @param PM-Segment instance number
+ */
+static void call_agent_segmentcleared(const healthd_event *evt, ContextId ctx, unsigned int handle,
+							unsigned int instnumber,
+							unsigned int retstatus)
+{
+	shm_publish(HEALTHD_SHM_SEGMENTCLEARED, ctx, handle, instnumber,
+		    retstatus, NULL);
+}
+
+/**
+ * Function that calls agent.DeviceAttributes method.
+ *
+ * @param evt event being delivered
+ * @param ctx Context ID
+ * @param xml Data in xml format
+ */
+static void call_agent_deviceattributes(const healthd_event *evt, ContextId ctx, char *xml)
+{
+	shm_publish(HEALTHD_SHM_ATTRIBUTES, ctx, 0, 0, 0, xml);
+}
+
+/**
+ * Function that calls agent.Disassociated method.
+ *
+ * @param evt event being delivered
+ * @param ctx Context ID
+ */
+static void call_agent_disassociated(const healthd_event *evt, ContextId ctx)
+{
+	DEBUG("call_agent_disassociated");
+	shm_publish(HEALTHD_SHM_DISASSOCIATED, ctx, 0, 0, 0, NULL);
+}
+
+/**
+ * Function that calls agent.Disconnected method.
+ *
+ * @param evt event being delivered
+ * @param ctx Context ID
+ * @param low_addr Device address e.g. Bluetooth MAC
+ */
+static void call_agent_disconnected(const healthd_event *evt, ContextId ctx, const char *low_addr)
+{
+	DEBUG("call_agent_disconnected");
+	shm_publish(HEALTHD_SHM_DISCONNECTED, ctx, 0, 0, 0, low_addr);
+}
+
+/**
+ * Creates and maps the shared memory segment
+ */
+static void start()
+{
+	size_t capacity = 4096;
+	const char *name = shm_name ? shm_name : HEALTHD_SHM_DEFAULT_NAME;
+
+	// ring capacity is a power of two, at least one page
+	while (capacity < shm_size)
+		capacity <<= 1;
+
+	shm_mapped_size = sizeof(healthd_shm_header) + capacity;
+
+	int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+
+	if (fd < 0) {
+		ERROR("SHM: cannot create %s", name);
+		return;
+	}
+
+	if (ftruncate(fd, shm_mapped_size) < 0) {
+		ERROR("SHM: cannot size %s", name);
+		close(fd);
+		shm_unlink(name);
+		return;
+	}
+
+	void *mem = mmap(NULL, shm_mapped_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mem == MAP_FAILED) {
+		ERROR("SHM: cannot map %s", name);
+		shm_unlink(name);
+		return;
+	}
+
+	shm_header = mem;
+	shm_ring = (unsigned char *) mem + sizeof(healthd_shm_header);
+
+	shm_header->version = HEALTHD_SHM_VERSION;
+	shm_header->capacity = capacity;
+	shm_header->write_pos = 0;
+	shm_header->reserve_pos = 0;
+	shm_header->producer_pid = getpid();
+	// magic last: consumers wait for it
+	__atomic_store_n(&shm_header->magic, HEALTHD_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	DEBUG("SHM: publishing at %s, %u bytes", name, (unsigned int) capacity);
+
+	self_configure();
+}
+
+static void stop()
+{
+	if (!shm_header)
+		return;
+
+	munmap(shm_header, shm_mapped_size);
+	shm_unlink(shm_name ? shm_name : HEALTHD_SHM_DEFAULT_NAME);
+	shm_header = NULL;
+	shm_ring = NULL;
+}
+
+/**
+ * Configures shared memory segment. Must be called before start().
+ *
+ * @param name POSIX shared memory object name, NULL for default
+ * @param size ring size in bytes (rounded up to a power of two)
+ */
+void healthd_ipc_shm_configure(const char *name, unsigned int size)
+{
+	free(shm_name);
+	shm_name = name ? strdup(name) : NULL;
+	if (size > 0)
+		shm_size = size;
+}
+
+void healthd_ipc_shm_init(healthd_ipc *ipc)
+{
+	ipc->call_agent_measurementdata = call_agent_measurementdata;
+	ipc->call_agent_connected = &call_agent_connected;
+	ipc->call_agent_disconnected = &call_agent_disconnected;
+	ipc->call_agent_associated = &call_agent_associated;
+	ipc->call_agent_disassociated = &call_agent_disassociated;
+	ipc->call_agent_segmentinfo = &call_agent_segmentinfo;
+	ipc->call_agent_segmentdataresponse = &call_agent_segmentdataresponse;
+	ipc->call_agent_segmentdata = &call_agent_segmentdata;
+	ipc->call_agent_segmentcleared = &call_agent_segmentcleared;
+	ipc->call_agent_pmstoredata = &call_agent_pmstoredata;
+	ipc->call_agent_deviceattributes = &call_agent_deviceattributes;
+	ipc->start = &start;
+	ipc->stop = &stop;
+}
+
+/** @} */
@@ -0,0 +1,106 @@
+#ifndef HEALTHD_IPC_SHM_
+#define HEALTHD_IPC_SHM_
+
+#include <stdint.h>
+#include "healthd_ipc.h"
+
+/*
+ * Shared memory layout, as seen by consumers.
+ *
+ * The segment starts with a healthd_shm_header, followed by a ring of
+ * 'capacity' bytes. Records are 64-byte aligned and never straddle
+ * the end of the ring (a HEALTHD_SHM_PAD record fills the tail).
+ *
+ * Positions are byte counters that never wrap; a record at position P
+ * lives at offset P % capacity. healthd is the only writer and never
+ * waits for readers, so a consumer that falls more than 'capacity'
+ * bytes behind loses data. Reading protocol:
+ *
+ * 1. w = atomic load (acquire) of write_pos; if my_pos == w, no data
+ * 2. if w - my_pos > capacity, data was lost: resync my_pos = w
+ * 3. rec = ring + my_pos % capacity; if rec->pos != my_pos, resync
+ * 4. copy rec and its payload out
+ * 5. acquire fence, then load reserve_pos; if reserve_pos - my_pos >
+ *    capacity the copy may be torn: discard and resync
+ * 6. my_pos += rec->size
+ *
+ * See healthd_shm_reader.c for a complete consumer.
+ */
+
+#define HEALTHD_SHM_MAGIC 0x484d5331
+#define HEALTHD_SHM_VERSION 1
+#define HEALTHD_SHM_ALIGN 64
+
+#define HEALTHD_SHM_DEFAULT_NAME "/healthd"
+#define HEALTHD_SHM_DEFAULT_SIZE (4 * 1024 * 1024)
+
+/**
+ * Record types, one per healthd_ipc event
+ */
+typedef enum {
+	HEALTHD_SHM_PAD = 0,
+	HEALTHD_SHM_CONNECTED,
+	HEALTHD_SHM_DISCONNECTED,
+	HEALTHD_SHM_ASSOCIATED,
+	HEALTHD_SHM_DISASSOCIATED,
+	HEALTHD_SHM_MEASUREMENT,
+	HEALTHD_SHM_SEGMENTINFO,
+	HEALTHD_SHM_SEGMENTDATARESPONSE,
+	HEALTHD_SHM_SEGMENTDATA,
+	HEALTHD_SHM_SEGMENTCLEARED,
+	HEALTHD_SHM_PMSTOREDATA,
+	HEALTHD_SHM_ATTRIBUTES
+} healthd_shm_record_type;
+
+/**
+ * Segment header, one cache line
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+	/**
+	 * End of last published record
+	 */
+	uint64_t write_pos;
+	/**
+	 * End of record being written; ahead of write_pos while
+	 * the producer is overwriting old data
+	 */
+	uint64_t reserve_pos;
+	uint32_t producer_pid;
+	uint32_t reserved[7];
+} healthd_shm_header;
+
+/**
+ * Record header, followed by payload_len bytes of payload and a NUL.
+ * Payload is the same XML (or address) sent by other IPC backends.
+ */
+typedef struct {
+	/**
+	 * Whole record size including header and padding
+	 */
+	uint32_t size;
+	uint16_t type;
+	uint16_t flags;
+	/**
+	 * Ring position of this record
+	 */
+	uint64_t pos;
+	/**
+	 * Wall clock time of publication, microseconds
+	 */
+	uint64_t timestamp;
+	uint64_t connid;
+	uint32_t plugin;
+	uint32_t handle;
+	uint32_t instnumber;
+	uint32_t status;
+	uint32_t payload_len;
+	uint32_t reserved[3];
+} healthd_shm_record;
+
+void healthd_ipc_shm_init(healthd_ipc *ipc);
+void healthd_ipc_shm_configure(const char *name, unsigned int size);
+
+#endif
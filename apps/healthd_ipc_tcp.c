@@ -37,7 +37,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <glib.h>
 #include <gio/gio.h>
@@ -47,18 +50,75 @@
 #include "healthd_common.h"
 #include "healthd_service.h"
 #include "healthd_ipc.h"
+#include "healthd_ipc_tcp.h"
+
+/**
+ * Framed outgoing message, shared among all clients it is
+ * queued to. Freed when the last client has sent (or dropped) it.
+ */
+typedef struct {
+	int ref;
+	size_t len;
+	char data[];
+} tcp_msg;
+
+/**
+ * Maximum length of a command line sent by client
+ */
+#define TCP_LINE_MAX 1024
 
 /* TCP clients */
 
 typedef struct {
 	int fd;
-	char *buf;
+	GIOChannel *channel;
+	guint read_watch;
+	guint write_watch;
+
+	/**
+	 * Ring of pending messages, queue_size slots
+	 */
+	tcp_msg **ring;
+	unsigned int head;
+	unsigned int count;
+
+	/**
+	 * Bytes of ring[head] already sent
+	 */
+	size_t head_offset;
+
+	unsigned int dropped;
+
+	/**
+	 * Events this client wants, NULL for all
+	 */
+	healthd_subscription *subscription;
+
+	/**
+	 * Incoming command line being assembled
+	 */
+	char inbuf[TCP_LINE_MAX];
+	size_t inlen;
 } tcp_client;
 
+/**
+ * Maximum number of messages sent in a single sendmsg() call
+ */
+#define TCP_IOV_BATCH 64
+
+/**
+ * Maximum time to wait for a slow client under TCP_SLOW_CLIENT_BLOCK
+ */
+#define TCP_BLOCK_TIMEOUT_MS 5000
+
 static const unsigned int PORT = 9005;
 static LinkedList *_tcp_clients = NULL;
 static int server_fd = -1;
 
+static unsigned int queue_size = HEALTHD_TCP_DEFAULT_QUEUE_SIZE;
+static healthd_tcp_slow_client_policy slow_policy = TCP_SLOW_CLIENT_DROP_OLDEST;
+static unsigned long long dropped_total = 0;
+
 static LinkedList *tcp_clients()
 {
 	if ( ! _tcp_clients) {
@@ -67,107 +127,350 @@ static LinkedList *tcp_clients()
 	return _tcp_clients;
 }
 
+static tcp_msg *tcp_msg_new(const char *text)
+{
+	size_t len = strlen(text);
+	tcp_msg *msg = malloc(sizeof(tcp_msg) + len);
+
+	if (!msg)
+		return NULL;
+
+	msg->ref = 1;
+	msg->len = len;
+	memcpy(msg->data, text, len);
+	return msg;
+}
+
+static void tcp_msg_unref(tcp_msg *msg)
+{
+	if (--msg->ref <= 0)
+		free(msg);
+}
+
 static void tcp_close(tcp_client *client)
 {
 	DEBUG("TCP: freeing client %p", client);
 
+	if (client->write_watch)
+		g_source_remove(client->write_watch);
+	if (client->read_watch)
+		g_source_remove(client->read_watch);
+	g_io_channel_unref(client->channel);
+
 	shutdown(client->fd, SHUT_RDWR);
 	close(client->fd);
 	client->fd = -1;
-	free(client->buf);
-	client->buf = 0;
+
+	while (client->count > 0) {
+		tcp_msg_unref(client->ring[client->head]);
+		client->head = (client->head + 1) % queue_size;
+		--client->count;
+	}
+	free(client->ring);
+	healthd_subscription_del(client->subscription);
+
 	llist_remove(tcp_clients(), client);
 	free(client);
 }
 
+/**
+ * Sends as much of the pending queue as the socket accepts,
+ * without blocking, several messages per system call.
+ *
+ * @param client TCP client
+ * @return 0 if ok (even if nothing could be sent), -1 if connection failed
+ */
+static int tcp_flush(tcp_client *client)
+{
+	struct iovec iov[TCP_IOV_BATCH];
+	struct msghdr mh;
+
+	while (client->count > 0) {
+		unsigned int n = 0;
+		unsigned int idx = client->head;
+
+		while (n < client->count && n < TCP_IOV_BATCH) {
+			tcp_msg *msg = client->ring[idx];
+			size_t skip = n ? 0 : client->head_offset;
+			iov[n].iov_base = msg->data + skip;
+			iov[n].iov_len = msg->len - skip;
+			idx = (idx + 1) % queue_size;
+			++n;
+		}
+
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_iov = iov;
+		mh.msg_iovlen = n;
+
+		ssize_t written = sendmsg(client->fd, &mh, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if (written < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return 0;
+			DEBUG("TCP: client %p send error %d", client, errno);
+			return -1;
+		}
+
+		DEBUG("TCP: client %p written %d bytes", client, (int) written);
+
+		size_t left = written;
+
+		while (client->count > 0) {
+			tcp_msg *msg = client->ring[client->head];
+			size_t pending = msg->len - client->head_offset;
+
+			if (left < pending) {
+				client->head_offset += left;
+				return 0;
+			}
+
+			left -= pending;
+			client->head_offset = 0;
+			tcp_msg_unref(msg);
+			client->ring[client->head] = NULL;
+			client->head = (client->head + 1) % queue_size;
+			--client->count;
+		}
+	}
+
+	return 0;
+}
+
 static gboolean tcp_write(GIOChannel *src, GIOCondition cond, gpointer data)
 {
 	tcp_client *client = (tcp_client*) data;
-	gsize len = strlen(client->buf);
-	gsize written;
-	char *newbuf;
-	gboolean more;
 
-	if (cond != G_IO_OUT) {
-		DEBUG("TCP: write: false alarm");
-		return TRUE;
+	if (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		client->write_watch = 0;
+		tcp_close(client);
+		return FALSE;
 	}
 
-	if (len <= 0) {
-		g_io_channel_unref(src);
+	DEBUG("TCP: writing client %p", data);
+
+	if (tcp_flush(client) < 0) {
+		client->write_watch = 0;
+		tcp_close(client);
 		return FALSE;
 	}
 
-	DEBUG("TCP: writing client %p", data);
+	if (client->count > 0)
+		return TRUE;
 
-	int fd = g_io_channel_unix_get_fd(src);
-	written = send(fd, client->buf, len, 0);
+	client->write_watch = 0;
+	return FALSE;
+}
 
-	DEBUG("TCP: client %p written %d bytes", data, (int) written);
+static int tcp_send(tcp_client *client, tcp_msg *msg);
+static tcp_msg *tcp_format(const char *command, ContextId ctx, const char *arg);
 
-	if (written <= 0) {
-		free(client->buf);
-		client->buf = strdup("");
-		g_io_channel_unref(src);
-		return FALSE;
+/**
+ * Sends a message to one client only
+ *
+ * @param client TCP client
+ * @param command message type
+ * @param arg message argument
+ * @return 0 if ok, -1 if client must be disconnected
+ */
+static int tcp_reply(tcp_client *client, const char *command, const char *arg)
+{
+	ContextId none = {0, 0};
+	tcp_msg *msg = tcp_format(command, none, arg);
+	int ret = 0;
+
+	if (msg) {
+		ret = tcp_send(client, msg);
+		tcp_msg_unref(msg);
 	}
 
-	if (written >= len) {
-		newbuf = strdup("");
-		g_io_channel_unref(src);
-		more = FALSE;
+	return ret;
+}
+
+/**
+ * Handles a command line sent by client:
+ *
+ * SUBSCRIBE [filter] - replaces client subscription (see
+ *	healthd_subscription.c for filter syntax; empty = all events)
+ * UNSUBSCRIBE - client gets no more events
+ *
+ * @param client TCP client
+ * @param line command, without line terminator
+ * @return 0 if ok, -1 if client must be disconnected
+ */
+static int tcp_command(tcp_client *client, char *line)
+{
+	healthd_subscription *sub;
+
+	DEBUG("TCP: client %p command %s", client, line);
+
+	if (strncmp(line, "SUBSCRIBE", 9) == 0
+	    && (line[9] == 0 || line[9] == ' ' || line[9] == '\t')) {
+		sub = healthd_subscription_new(line + 9);
+		if (!sub)
+			return tcp_reply(client, "ERROR", "bad subscription filter");
+	} else if (strcmp(line, "UNSUBSCRIBE") == 0) {
+		sub = healthd_subscription_new("events=NONE");
+	} else if (line[0] == 0) {
+		return 0;
 	} else {
-		newbuf = strdup(client->buf + written);
-		more = TRUE;
+		return tcp_reply(client, "ERROR", "unknown command");
 	}
-	free(client->buf);
-	client->buf = newbuf;
 
-	return more;
+	healthd_subscription_del(client->subscription);
+	client->subscription = sub;
+
+	return tcp_reply(client, "SUBSCRIBED", line);
 }
 
 static gboolean tcp_read(GIOChannel *src, GIOCondition cond, gpointer data)
 {
-	char buf[256];
-	gsize count;
+	ssize_t count;
 
 	DEBUG("TCP: reading client %p", data);
 
 	tcp_client *client = (tcp_client*) data;
 
 	if (cond != G_IO_IN) {
+		client->read_watch = 0;
 		tcp_close(client);
-		g_io_channel_unref(src);
 		return FALSE;
 	}
 
 	int fd = g_io_channel_unix_get_fd(src);
-	count = recv(fd, buf, 256, 0);
+	count = recv(fd, client->inbuf + client->inlen,
+			TCP_LINE_MAX - client->inlen, 0);
+
+	if (count <= 0) {
+		client->read_watch = 0;
+		tcp_close(client);
+		return FALSE;
+	}
+
+	client->inlen += count;
+
+	char *line = client->inbuf;
+	char *eol;
+
+	while ((eol = memchr(line, '\n', client->inlen - (line - client->inbuf)))) {
+		*eol = 0;
+		if (eol > line && eol[-1] == '\r')
+			eol[-1] = 0;
+
+		if (tcp_command(client, line) < 0) {
+			client->read_watch = 0;
+			tcp_close(client);
+			return FALSE;
+		}
+
+		line = eol + 1;
+	}
+
+	client->inlen -= line - client->inbuf;
+	memmove(client->inbuf, line, client->inlen);
 
-	if (count == 0) {
+	if (client->inlen >= TCP_LINE_MAX) {
+		DEBUG("TCP: client %p command too long", client);
+		client->read_watch = 0;
 		tcp_close(client);
-		g_io_channel_unref(src);
 		return FALSE;
 	}
 
 	return TRUE;
 }
 
-static void tcp_send(tcp_client *client, const char *msg)
+/**
+ * Waits until a client under TCP_SLOW_CLIENT_BLOCK policy has room
+ * in its queue. This stalls the whole fan-out (and the main loop)
+ * on purpose, so the client sees every message.
+ *
+ * @param client TCP client
+ * @return 0 if queue has room, -1 if client must be disconnected
+ */
+static int tcp_wait_room(tcp_client *client)
 {
-	char *newbuf;
+	int remaining = TCP_BLOCK_TIMEOUT_MS;
+
+	while (client->count >= queue_size && remaining > 0) {
+		struct pollfd pfd;
+		pfd.fd = client->fd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
 
+		if (poll(&pfd, 1, 100) < 0 && errno != EINTR)
+			return -1;
+		remaining -= 100;
+
+		if (tcp_flush(client) < 0)
+			return -1;
+	}
+
+	return client->count < queue_size ? 0 : -1;
+}
+
+/**
+ * Queues a message to client, applying the slow client policy
+ * when its queue is full.
+ *
+ * @param client TCP client
+ * @param msg message (a reference is taken)
+ * @return 0 if ok, -1 if client must be disconnected
+ */
+static int tcp_send(tcp_client *client, tcp_msg *msg)
+{
 	DEBUG("TCP: scheduling write %p", client);
 
-	if (asprintf(&newbuf, "%s%s", client->buf, msg) < 0) {
-		return;
+	if (client->count >= queue_size) {
+		if (slow_policy == TCP_SLOW_CLIENT_DISCONNECT) {
+			DEBUG("TCP: client %p too slow, disconnecting", client);
+			return -1;
+		} else if (slow_policy == TCP_SLOW_CLIENT_BLOCK) {
+			if (tcp_wait_room(client) < 0) {
+				DEBUG("TCP: client %p blocked too long", client);
+				return -1;
+			}
+		} else {
+			// Drop the oldest message that has not started
+			// going out; a partially sent one must be finished
+			// or the stream framing breaks.
+			unsigned int victim = client->head_offset ? 1 : 0;
+
+			++client->dropped;
+			++dropped_total;
+			DEBUG("TCP: client %p too slow, %u messages dropped",
+			      client, client->dropped);
+
+			if (victim >= client->count) {
+				// queue of 1 with a partial message: drop newest
+				return 0;
+			}
+
+			if (victim == 0) {
+				tcp_msg_unref(client->ring[client->head]);
+			} else {
+				unsigned int next = (client->head + 1) % queue_size;
+				tcp_msg_unref(client->ring[next]);
+				client->ring[next] = client->ring[client->head];
+			}
+
+			client->ring[client->head] = NULL;
+			client->head = (client->head + 1) % queue_size;
+			--client->count;
+		}
 	}
 
-	free(client->buf);
-	client->buf = newbuf;
+	++msg->ref;
+	client->ring[(client->head + client->count) % queue_size] = msg;
+	++client->count;
+
+	// One write watch per client, kept while there is pending data.
+	// Messages queued in the same main loop iteration go out together.
+	if (!client->write_watch) {
+		client->write_watch = g_io_add_watch(client->channel,
+					G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+					tcp_write, client);
+	}
 
-	GIOChannel *channel = g_io_channel_unix_new(client->fd);
-	g_io_add_watch(channel, G_IO_OUT, tcp_write, client);
+	return 0;
 }
 
 static gboolean tcp_accept(GIOChannel *src, GIOCondition cond, gpointer data)
@@ -189,12 +492,14 @@ static gboolean tcp_accept(GIOChannel *src, GIOCondition cond, gpointer data)
 
 	new_client = g_new0(tcp_client, 1);
 	new_client->fd = fd;
-	new_client->buf = strdup("");
+	new_client->ring = calloc(queue_size, sizeof(tcp_msg *));
 
 	DEBUG("TCP: adding client %p to list", new_client);
 
-	GIOChannel *channel = g_io_channel_unix_new(fd);
-	g_io_add_watch(channel, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL, tcp_read, new_client);
+	new_client->channel = g_io_channel_unix_new(fd);
+	new_client->read_watch = g_io_add_watch(new_client->channel,
+				G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+				tcp_read, new_client);
 
 	llist_add(tcp_clients(), new_client);
 
@@ -222,9 +527,17 @@ static void tcp_listen()
 	DEBUG("TCP: listening");
 }
 
-static void tcp_announce(const char *command, ContextId ctx, const char *arg)
+/**
+ * Formats a message for clients
+ *
+ * @param command message type
+ * @param ctx device the message is about
+ * @param arg message argument
+ * @return new message, or NULL
+ */
+static tcp_msg *tcp_format(const char *command, ContextId ctx, const char *arg)
 {
-	char *msg;
+	char *text;
 	char *j;
 	char *arg2 = strdup(arg);
 
@@ -232,22 +545,75 @@ static void tcp_announce(const char *command, ContextId ctx, const char *arg)
 		if ((*j == '\t') || (*j == '\n'))
 			*j = ' ';
 
-	if (asprintf(&msg, "%s\t%d:%llu\t%s\n", command, ctx.plugin, ctx.connid, arg2) < 0) {
+	if (asprintf(&text, "%s\t%d:%llu\t%s\n", command, ctx.plugin, ctx.connid, arg2) < 0) {
 		free(arg2);
-		return;
+		return NULL;
 	}
 
-	printf("%s\n", msg);
-	
+	printf("%s\n", text);
+
+	tcp_msg *msg = tcp_msg_new(text);
+	free(text);
+	free(arg2);
+
+	return msg;
+}
+
+/**
+ * Sends an announcement to the clients subscribed to its event.
+ *
+ * @param evt event being announced
+ * @param command announcement name
+ * @param ctx context ID
+ * @param arg announcement argument
+ */
+static void tcp_announce(const healthd_event *evt, const char *command,
+			ContextId ctx, const char *arg)
+{
+	tcp_msg *msg = NULL;
 	LinkedNode *i = tcp_clients()->first;
 
 	while (i) {
-		tcp_send(i->element, msg);
-		i = i->next;
+		// client may be removed from list by tcp_close()
+		LinkedNode *next = i->next;
+		tcp_client *client = i->element;
+
+		if (!healthd_subscription_match(client->subscription, evt)) {
+			i = next;
+			continue;
+		}
+
+		// formatted once, for the first subscribed client
+		if (!msg && !(msg = tcp_format(command, ctx, arg)))
+			return;
+
+		if (tcp_send(client, msg) < 0) {
+			tcp_close(client);
+		}
+		i = next;
 	}
 
-	free(arg2);
-	free(msg);
+	if (msg)
+		tcp_msg_unref(msg);
+}
+
+/**
+ * Counts the clients subscribed to an event.
+ *
+ * @param evt event
+ * @return number of subscribed clients
+ */
+static int subscribers(const healthd_event *evt)
+{
+	LinkedNode *i;
+	int count = 0;
+
+	for (i = tcp_clients()->first; i; i = i->next) {
+		tcp_client *client = i->element;
+		count += healthd_subscription_match(client->subscription, evt);
+	}
+
+	return count;
 }
 
 static void self_configure()
@@ -259,52 +625,56 @@ static void self_configure()
 /**
  * Function that calls agent.Connected method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param low_addr Device address e.g. Bluetooth MAC
  * @return TRUE if success
  */
-static void call_agent_connected(ContextId ctx, const char *low_addr)
+static void call_agent_connected(const healthd_event *evt, ContextId ctx, const char *low_addr)
 {
 	DEBUG("call_agent_connected");
-	tcp_announce("CONNECTED", ctx, low_addr);
+	tcp_announce(evt, "CONNECTED", ctx, low_addr);
 }
 
 /**
  * Function that calls agent.Associated method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param xml Data in XML format
  * @return success status
  */
-static void call_agent_associated(ContextId ctx, char *xml)
+static void call_agent_associated(const healthd_event *evt, ContextId ctx, char *xml)
 {
 	DEBUG("call_agent_associated");
-	tcp_announce("ASSOCIATED", ctx, "");
-	tcp_announce("DESCRIPTION", ctx, xml);
+	tcp_announce(evt, "ASSOCIATED", ctx, "");
+	tcp_announce(evt, "DESCRIPTION", ctx, xml);
 }
 
 /**
  * Function that calls agent.MeasurementData method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param xml Data in xml format
  * @return success status
  */
-static void call_agent_measurementdata(ContextId ctx, char *xml)
+static void call_agent_measurementdata(const healthd_event *evt, ContextId ctx, char *xml)
 {
 	DEBUG("call_agent_measurementdata");
-	tcp_announce("MEASUREMENT", ctx, xml);
+	tcp_announce(evt, "MEASUREMENT", ctx, xml);
 }
 
 /**
  * Function that calls agent.SegmentInfo method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param handle PM-Store handle
  * @param xml PM-Segment instance data in XML format
  * @return success status
  */
-static void call_agent_segmentinfo(ContextId ctx, unsigned int handle, char *xml)
+static void call_agent_segmentinfo(const healthd_event *evt, ContextId ctx, unsigned int handle, char *xml)
 {
 	DEBUG("call_agent_segmentinfo");
 
@@ -312,7 +682,7 @@ static void call_agent_segmentinfo(ContextId ctx, unsigned int handle, char *xml
 	if (asprintf(&params, "%d %s", handle, xml) < 0) {
 		return; // FALSE;
 	}
-	tcp_announce("SEGMENTINFO", ctx, params);
+	tcp_announce(evt, "SEGMENTINFO", ctx, params);
 	free(params);
 }
 
@@ -320,13 +690,14 @@ static void call_agent_segmentinfo(ContextId ctx, unsigned int handle, char *xml
 /**
  * Function that calls agent.SegmentDataResponse method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param handle PM-Store handle
  * @param instnumber PM-Segment instance number
  * @param status Return status
  * @return success status
  */
-static void call_agent_segmentdataresponse(ContextId ctx,
+static void call_agent_segmentdataresponse(const healthd_event *evt, ContextId ctx,
 			unsigned int handle, unsigned int instnumber,
 			unsigned int retstatus)
 {
@@ -336,7 +707,7 @@ static void call_agent_segmentdataresponse(ContextId ctx,
 	if (asprintf(&params, "%d %d %d", handle, instnumber, retstatus) < 0) {
 		return; // FALSE;
 	}
-	tcp_announce("SEGMENTDATARESPONSE", ctx, params);
+	tcp_announce(evt, "SEGMENTDATARESPONSE", ctx, params);
 	free(params);
 }
 
@@ -344,12 +715,13 @@ static void call_agent_segmentdataresponse(ContextId ctx,
 /**
  * Function that calls agent.SegmentData method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param handle PM-Store handle
  * @param instnumber PM-Segment instance number
  * @param xml PM-Segment instance data in XML format
  */
-static void call_agent_segmentdata(ContextId ctx, unsigned int handle,
+static void call_agent_segmentdata(const healthd_event *evt, ContextId ctx, unsigned int handle,
 					unsigned int instnumber, char *xml)
 {
 	DEBUG("call_agent_segmentdata");
@@ -358,7 +730,7 @@ static void call_agent_segmentdata(ContextId ctx, unsigned int handle,
 	if (asprintf(&params, "%d %d %s", handle, instnumber, xml) < 0) {
 		return; // FALSE;
 	}
-	tcp_announce("SEGMENTDATA", ctx, params);
+	tcp_announce(evt, "SEGMENTDATA", ctx, params);
 	free(params);
 }
 
@@ -366,11 +738,12 @@ static void call_agent_segmentdata(ContextId ctx, unsigned int handle,
 /**
  * Function that calls agent.PMStoreData method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param handle PM-Store handle
  * @param xml PM-Store data attributes in XML format
  */
-static void call_agent_pmstoredata(ContextId ctx, unsigned int handle, char *xml)
+static void call_agent_pmstoredata(const healthd_event *evt, ContextId ctx, unsigned int handle, char *xml)
 {
 	DEBUG("call_agent_pmstoredata");
 
@@ -378,7 +751,7 @@ static void call_agent_pmstoredata(ContextId ctx, unsigned int handle, char *xml
 	if (asprintf(&params, "%d %s", handle, xml) < 0) {
 		return; // FALSE;
 	}
-	tcp_announce("PMSTOREDATA", ctx, params);
+	tcp_announce(evt, "PMSTOREDATA", ctx, params);
 	free(params);
 }
 
@@ -386,11 +759,12 @@ static void call_agent_pmstoredata(ContextId ctx, unsigned int handle, char *xml
 /**
  * Function that calls agent.SegmentCleared method.
  *
+ * @param evt event being delivered
  * @param ctx device handle
  * @param handle PM-Store handle
  * @param PM-Segment instance number
  */
-static void call_agent_segmentcleared(ContextId ctx, unsigned int handle,
+static void call_agent_segmentcleared(const healthd_event *evt, ContextId ctx, unsigned int handle,
 							unsigned int instnumber,
 							unsigned int retstatus)
 {
@@ -398,7 +772,7 @@ static void call_agent_segmentcleared(ContextId ctx, unsigned int handle,
 	if (asprintf(&params, "%d %d %d", handle, instnumber, retstatus) < 0) {
 		return; // FALSE;
 	}
-	tcp_announce("SEGMENTCLEARED", ctx, params);
+	tcp_announce(evt, "SEGMENTCLEARED", ctx, params);
 	free(params);
 }
 
@@ -406,35 +780,38 @@ static void call_agent_segmentcleared(ContextId ctx, unsigned int handle,
 /**
  * Function that calls agent.DeviceAttributes method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param xml Data in xml format
  */
-static void call_agent_deviceattributes(ContextId ctx, char *xml)
+static void call_agent_deviceattributes(const healthd_event *evt, ContextId ctx, char *xml)
 {
-	tcp_announce("ATTRIBUTES", ctx, xml);
+	tcp_announce(evt, "ATTRIBUTES", ctx, xml);
 }
 
 /**
  * Function that calls agent.Disassociated method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  */
-static void call_agent_disassociated(ContextId ctx)
+static void call_agent_disassociated(const healthd_event *evt, ContextId ctx)
 {
 	DEBUG("call_agent_disassociated");
-	tcp_announce("DISASSOCIATE", ctx, "");
+	tcp_announce(evt, "DISASSOCIATE", ctx, "");
 }
 
 /**
  * Function that calls agent.Disconnected method.
  *
+ * @param evt event being delivered
  * @param ctx Context ID
  * @param low_addr Device address e.g. Bluetooth MAC
  */
-static void call_agent_disconnected(ContextId ctx, const char *low_addr)
+static void call_agent_disconnected(const healthd_event *evt, ContextId ctx, const char *low_addr)
 {
 	DEBUG("call_agent_disconnected");
-	tcp_announce("DISCONNECT", ctx, "");
+	tcp_announce(evt, "DISCONNECT", ctx, "");
 }
 
 static void start()
@@ -447,6 +824,43 @@ static void stop()
 {
 }
 
+/**
+ * Configures per-client output queue. Must be called before start().
+ *
+ * @param size maximum number of messages queued to each client
+ * @param policy what to do when a client queue is full
+ */
+void healthd_ipc_tcp_configure(unsigned int size,
+				healthd_tcp_slow_client_policy policy)
+{
+	if (size > 0)
+		queue_size = size;
+	slow_policy = policy;
+}
+
+/**
+ * Fills client queue counters. All zero if TCP IPC is not in use.
+ *
+ * @param stats filled with current counters
+ */
+void healthd_ipc_tcp_get_stats(healthd_tcp_stats *stats)
+{
+	LinkedNode *node = _tcp_clients ? _tcp_clients->first : NULL;
+
+	memset(stats, 0, sizeof(healthd_tcp_stats));
+
+	while (node) {
+		tcp_client *client = node->element;
+		++stats->clients;
+		stats->queued += client->count;
+		if (client->count > stats->max_queued)
+			stats->max_queued = client->count;
+		node = node->next;
+	}
+
+	stats->dropped = dropped_total;
+}
+
 void healthd_ipc_tcp_init(healthd_ipc *ipc)
 {
 	ipc->call_agent_measurementdata = call_agent_measurementdata;
@@ -460,6 +874,7 @@ void healthd_ipc_tcp_init(healthd_ipc *ipc)
 	ipc->call_agent_segmentcleared = &call_agent_segmentcleared;
 	ipc->call_agent_pmstoredata = &call_agent_pmstoredata;
 	ipc->call_agent_deviceattributes = &call_agent_deviceattributes;
+	ipc->subscribers = &subscribers;
 	ipc->start = &start;
 	ipc->stop = &stop;
 }
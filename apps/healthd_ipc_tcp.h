@@ -3,6 +3,39 @@
 
 #include "healthd_ipc.h"
 
+/**
+ * What to do with a TCP client whose output queue is full
+ */
+typedef enum {
+	TCP_SLOW_CLIENT_DROP_OLDEST = 0,
+	TCP_SLOW_CLIENT_DISCONNECT,
+	TCP_SLOW_CLIENT_BLOCK
+} healthd_tcp_slow_client_policy;
+
+/**
+ * TCP IPC client queue counters, for metrics
+ */
+typedef struct {
+	unsigned int clients;
+	/**
+	 * Messages queued to all clients
+	 */
+	unsigned int queued;
+	/**
+	 * Deepest client queue
+	 */
+	unsigned int max_queued;
+	/**
+	 * Messages dropped to slow clients, since start
+	 */
+	unsigned long long dropped;
+} healthd_tcp_stats;
+
+#define HEALTHD_TCP_DEFAULT_QUEUE_SIZE 256
+
 void healthd_ipc_tcp_init(healthd_ipc *ipc);
+void healthd_ipc_tcp_configure(unsigned int size,
+				healthd_tcp_slow_client_policy policy);
+void healthd_ipc_tcp_get_stats(healthd_tcp_stats *stats);
 
 #endif
@@ -0,0 +1,542 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file healthd_metrics.c
+ * \brief Health manager service - Prometheus metrics endpoint
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * @addtogroup Healthd
+ * @{
+ */
+
+/*
+ * Serves GET /metrics in Prometheus text format, on 127.0.0.1 only.
+ * Each scrape is a separate connection, handled in the main loop
+ * without blocking: the page is rendered in one go into a buffer that
+ * belongs to the connection, so a scrape costs one allocation and a
+ * few hundred snprintf() calls, however many devices are connected.
+ *
+ * Counters are cumulative; e.g. measurements per second are
+ * rate(healthd_measurements_total[1m]) on the Prometheus side.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <glib.h>
+#include <ieee11073.h>
+#include "src/manager.h"
+#include "src/util/log.h"
+#include "healthd_common.h"
+#include "healthd_encoder.h"
+#include "healthd_ipc_tcp.h"
+#include "healthd_metrics.h"
+
+/**
+ * Room for the response page, headers included
+ */
+#define METRICS_PAGE_SIZE (32 * 1024)
+
+/**
+ * Room reserved ahead of the body for the response headers
+ */
+#define METRICS_HEADER_ROOM 256
+
+/**
+ * Maximum length of the request head; the rest is ignored
+ */
+#define METRICS_REQUEST_MAX 1024
+
+/**
+ * Scrapes served at the same time; more are refused
+ */
+#define METRICS_MAX_CLIENTS 8
+
+typedef struct {
+	int fd;
+	GIOChannel *channel;
+	guint watch;
+
+	char request[METRICS_REQUEST_MAX];
+	size_t request_len;
+
+	/**
+	 * Response, response_len bytes from page + response_pos
+	 */
+	size_t response_pos;
+	size_t response_len;
+	size_t sent;
+	char page[METRICS_PAGE_SIZE];
+} metrics_client;
+
+/**
+ * Page being rendered
+ */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+	int truncated;
+} metrics_page;
+
+static int server_fd = -1;
+static GIOChannel *server_channel = NULL;
+static guint server_watch = 0;
+static unsigned int client_count = 0;
+
+/**
+ * Appends formatted text to page. Text that does not fit is
+ * dropped and the page marked as truncated.
+ */
+static void page_printf(metrics_page *p, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (p->truncated)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(p->data + p->len, p->size - p->len, fmt, ap);
+	va_end(ap);
+
+	if (n < 0 || (size_t) n >= p->size - p->len) {
+		p->truncated = 1;
+		return;
+	}
+
+	p->len += n;
+}
+
+static void page_help(metrics_page *p, const char *name, const char *type,
+			const char *help)
+{
+	page_printf(p, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void page_value(metrics_page *p, const char *name, const char *type,
+			const char *help, unsigned long long value)
+{
+	page_help(p, name, type, help);
+	page_printf(p, "%s %llu\n", name, value);
+}
+
+/**
+ * Nanoseconds as seconds, without floating point rounding
+ */
+static void page_seconds(metrics_page *p, const char *name, const char *type,
+			const char *help, unsigned long long ns)
+{
+	page_help(p, name, type, help);
+	page_printf(p, "%s %llu.%09llu\n", name, ns / 1000000000ULL,
+			ns % 1000000000ULL);
+}
+
+static void render_stack(metrics_page *p)
+{
+	static const char *quantiles[4] = {"0.5", "0.9", "0.99", "0.999"};
+	CommunicationStats stats;
+	LatencySummary l;
+	unsigned long long values[4];
+	int i;
+	int q;
+
+	manager_get_stats(&stats);
+
+	page_help(p, "antidote_apdus_received_total", "counter",
+			"APDUs received, by kind");
+	for (i = 0; i < STATS_APDU_KINDS; ++i) {
+		page_printf(p, "antidote_apdus_received_total{kind=\"%s\"} %llu\n",
+				stats_apdu_kind_name(i), stats.apdus_in[i]);
+	}
+
+	page_help(p, "antidote_apdus_sent_total", "counter",
+			"APDUs sent, by kind");
+	for (i = 0; i < STATS_APDU_KINDS; ++i) {
+		page_printf(p, "antidote_apdus_sent_total{kind=\"%s\"} %llu\n",
+				stats_apdu_kind_name(i), stats.apdus_out[i]);
+	}
+
+	page_value(p, "antidote_received_bytes_total", "counter",
+			"Bytes of APDUs received", stats.bytes_in);
+	page_value(p, "antidote_sent_bytes_total", "counter",
+			"Bytes of APDUs sent", stats.bytes_out);
+	page_value(p, "antidote_decode_errors_total", "counter",
+			"Received APDUs that could not be decoded",
+			stats.decode_errors);
+	page_value(p, "antidote_fsm_transitions_total", "counter",
+			"State machine transitions", stats.fsm_transitions);
+	page_value(p, "antidote_timeouts_total", "counter",
+			"Protocol timeouts", stats.timeouts);
+	page_value(p, "antidote_requests_pending", "gauge",
+			"Confirmed requests waiting for an answer",
+			stats.requests_pending > 0 ? stats.requests_pending : 0);
+	page_seconds(p, "antidote_decode_seconds_total", "counter",
+			"Time spent decoding received APDUs", stats.decode_ns);
+	page_seconds(p, "antidote_listener_seconds_total", "counter",
+			"Time spent in application listeners", stats.listener_ns);
+
+	page_help(p, "antidote_latency_seconds", "summary",
+			"Latency of associations, configurations, requests "
+			"and listeners");
+	for (i = 0; i < STATS_LATENCY_KINDS; ++i) {
+		const char *name = stats_latency_name(i);
+
+		manager_get_latency(i, &l);
+		values[0] = l.p50;
+		values[1] = l.p90;
+		values[2] = l.p99;
+		values[3] = l.p999;
+
+		for (q = 0; q < 4; ++q) {
+			page_printf(p, "antidote_latency_seconds{interval=\"%s\","
+					"quantile=\"%s\"} %llu.%09llu\n",
+					name, quantiles[q],
+					values[q] / 1000000000ULL,
+					values[q] % 1000000000ULL);
+		}
+
+		page_printf(p, "antidote_latency_seconds_sum{interval=\"%s\"} "
+				"%llu.%09llu\n", name, l.sum / 1000000000ULL,
+				l.sum % 1000000000ULL);
+		page_printf(p, "antidote_latency_seconds_count{interval=\"%s\"} "
+				"%llu\n", name, l.count);
+	}
+}
+
+/**
+ * Lock call sites that waited the longest (healthd --lock-profile)
+ */
+#define METRICS_LOCK_SITES 10
+
+static void render_locks(metrics_page *p)
+{
+	LockSiteStats sites[METRICS_LOCK_SITES];
+	int count;
+	int i;
+
+	count = manager_get_lock_sites(STATS_LOCK_BY_WAIT, sites,
+					METRICS_LOCK_SITES);
+	if (count == 0)
+		return;
+
+	page_help(p, "antidote_lock_wait_seconds_total", "counter",
+			"Time spent waiting for locks, worst call sites");
+	for (i = 0; i < count; ++i) {
+		page_printf(p, "antidote_lock_wait_seconds_total{lock=\"%s\","
+				"site=\"%s:%d\",function=\"%s\"} %llu.%09llu\n",
+				sites[i].gil ? "gil" : "context",
+				sites[i].file, sites[i].line, sites[i].function,
+				sites[i].wait.sum / 1000000000ULL,
+				sites[i].wait.sum % 1000000000ULL);
+	}
+
+	page_help(p, "antidote_lock_hold_seconds_total", "counter",
+			"Time spent holding locks, same call sites");
+	for (i = 0; i < count; ++i) {
+		page_printf(p, "antidote_lock_hold_seconds_total{lock=\"%s\","
+				"site=\"%s:%d\",function=\"%s\"} %llu.%09llu\n",
+				sites[i].gil ? "gil" : "context",
+				sites[i].file, sites[i].line, sites[i].function,
+				sites[i].hold.sum / 1000000000ULL,
+				sites[i].hold.sum % 1000000000ULL);
+	}
+
+	page_help(p, "antidote_lock_acquisitions_total", "counter",
+			"Lock acquisitions, same call sites");
+	for (i = 0; i < count; ++i) {
+		page_printf(p, "antidote_lock_acquisitions_total{lock=\"%s\","
+				"site=\"%s:%d\",function=\"%s\"} %llu\n",
+				sites[i].gil ? "gil" : "context",
+				sites[i].file, sites[i].line, sites[i].function,
+				sites[i].wait.count);
+	}
+}
+
+static void render_daemon(metrics_page *p)
+{
+	healthd_device_stats devices;
+	healthd_encoder_stats encoder;
+	healthd_tcp_stats tcp;
+	unsigned long long done;
+
+	healthd_get_device_stats(&devices);
+	healthd_encoder_get_stats(&encoder);
+	healthd_ipc_tcp_get_stats(&tcp);
+
+	page_value(p, "healthd_devices_connected", "gauge",
+			"Devices connected", devices.connected);
+	page_value(p, "healthd_devices_associated", "gauge",
+			"Devices associated", devices.associated);
+	page_value(p, "healthd_measurements_total", "counter",
+			"Measurement reports received", devices.measurements);
+
+	page_value(p, "healthd_tcp_clients", "gauge",
+			"TCP IPC clients", tcp.clients);
+	page_value(p, "healthd_tcp_queued_messages", "gauge",
+			"Messages queued to all TCP IPC clients", tcp.queued);
+	page_value(p, "healthd_tcp_max_client_queue", "gauge",
+			"Messages queued to the slowest TCP IPC client",
+			tcp.max_queued);
+	page_value(p, "healthd_tcp_dropped_messages_total", "counter",
+			"Messages dropped to slow TCP IPC clients", tcp.dropped);
+
+	page_value(p, "healthd_encoder_lists_total", "counter",
+			"Data lists encoded for IPC", encoder.encoded);
+	page_seconds(p, "healthd_encoder_seconds_total", "counter",
+			"Time spent encoding data lists", encoder.encode_ns);
+	page_value(p, "healthd_encoder_pending", "gauge",
+			"Encoding jobs waiting for a worker", encoder.pending);
+
+	done = devices.segment_failures + devices.segments_received;
+
+	page_value(p, "healthd_pmsegment_requests_total", "counter",
+			"PM-Segment transfers requested", devices.segment_requests);
+	page_value(p, "healthd_pmsegment_failures_total", "counter",
+			"PM-Segment transfers refused or failed",
+			devices.segment_failures);
+	page_value(p, "healthd_pmsegment_received_total", "counter",
+			"PM-Segments fully received", devices.segments_received);
+	page_value(p, "healthd_pmsegment_transfers_in_progress", "gauge",
+			"PM-Segment transfers requested and not finished",
+			devices.segment_requests > done ?
+			devices.segment_requests - done : 0);
+}
+
+/**
+ * Builds the response to the request in client->request
+ */
+static void metrics_respond(metrics_client *client)
+{
+	metrics_page page;
+	const char *status = "200 OK";
+	char header[METRICS_HEADER_ROOM];
+	int hlen;
+
+	page.data = client->page + METRICS_HEADER_ROOM;
+	page.len = 0;
+	page.size = METRICS_PAGE_SIZE - METRICS_HEADER_ROOM;
+	page.truncated = 0;
+
+	if (strncmp(client->request, "GET ", 4) != 0) {
+		status = "405 Method Not Allowed";
+	} else if (strncmp(client->request + 4, "/metrics ", 9) != 0 &&
+		   strncmp(client->request + 4, "/metrics?", 9) != 0) {
+		status = "404 Not Found";
+	} else {
+		render_stack(&page);
+		render_locks(&page);
+		render_daemon(&page);
+
+		if (page.truncated)
+			ERROR("metrics: page truncated at %d bytes",
+				(int) page.len);
+	}
+
+	hlen = snprintf(header, sizeof(header),
+			"HTTP/1.0 %s\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %d\r\n"
+			"Connection: close\r\n\r\n", status, (int) page.len);
+
+	client->response_pos = METRICS_HEADER_ROOM - hlen;
+	client->response_len = hlen + page.len;
+	client->sent = 0;
+	memcpy(client->page + client->response_pos, header, hlen);
+}
+
+static void metrics_close(metrics_client *client)
+{
+	if (client->watch)
+		g_source_remove(client->watch);
+	g_io_channel_unref(client->channel);
+	close(client->fd);
+	free(client);
+	--client_count;
+}
+
+static gboolean metrics_write(GIOChannel *src, GIOCondition cond,
+				gpointer data)
+{
+	metrics_client *client = data;
+	ssize_t n;
+
+	if (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		client->watch = 0;
+		metrics_close(client);
+		return FALSE;
+	}
+
+	n = send(client->fd, client->page + client->response_pos + client->sent,
+		 client->response_len - client->sent,
+		 MSG_DONTWAIT | MSG_NOSIGNAL);
+
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return TRUE;
+
+	if (n > 0)
+		client->sent += n;
+
+	if (n > 0 && client->sent < client->response_len)
+		return TRUE;
+
+	client->watch = 0;
+	metrics_close(client);
+	return FALSE;
+}
+
+static gboolean metrics_read(GIOChannel *src, GIOCondition cond,
+				gpointer data)
+{
+	metrics_client *client = data;
+	size_t room = METRICS_REQUEST_MAX - 1 - client->request_len;
+	ssize_t n = 0;
+
+	if (!(cond & (G_IO_ERR | G_IO_NVAL)) && room > 0) {
+		n = recv(client->fd, client->request + client->request_len,
+			 room, MSG_DONTWAIT);
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			return TRUE;
+	}
+
+	if (n <= 0 && room > 0) {
+		client->watch = 0;
+		metrics_close(client);
+		return FALSE;
+	}
+
+	client->request_len += n;
+	client->request[client->request_len] = '\0';
+
+	// only the request line matters, but wait for the whole head
+	// so the client is not reset while still sending it
+	if (!strstr(client->request, "\r\n\r\n") &&
+	    !strstr(client->request, "\n\n") &&
+	    client->request_len < METRICS_REQUEST_MAX - 1)
+		return TRUE;
+
+	metrics_respond(client);
+
+	client->watch = g_io_add_watch(client->channel,
+				G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+				metrics_write, client);
+	return FALSE;
+}
+
+static gboolean metrics_accept(GIOChannel *src, GIOCondition cond,
+				gpointer data)
+{
+	metrics_client *client;
+	int fd;
+
+	fd = accept(g_io_channel_unix_get_fd(src), NULL, NULL);
+
+	if (fd < 0) {
+		DEBUG("metrics: failed accept");
+		return TRUE;
+	}
+
+	if (client_count >= METRICS_MAX_CLIENTS) {
+		DEBUG("metrics: too many scrapes, refusing");
+		close(fd);
+		return TRUE;
+	}
+
+	client = malloc(sizeof(metrics_client));
+	client->fd = fd;
+	client->request_len = 0;
+	client->channel = g_io_channel_unix_new(fd);
+	client->watch = g_io_add_watch(client->channel,
+				G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+				metrics_read, client);
+	++client_count;
+
+	return TRUE;
+}
+
+/**
+ * Starts serving metrics on 127.0.0.1
+ *
+ * @param port TCP port
+ */
+void healthd_metrics_start(unsigned int port)
+{
+	struct sockaddr_in addr;
+	int reuse = 1;
+
+	if (server_fd >= 0)
+		return;
+
+	server_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (server_fd < 0) {
+		ERROR("metrics: cannot create socket");
+		return;
+	}
+
+	setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	if (bind(server_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(server_fd, METRICS_MAX_CLIENTS) < 0) {
+		ERROR("metrics: cannot listen on port %u", port);
+		close(server_fd);
+		server_fd = -1;
+		return;
+	}
+
+	server_channel = g_io_channel_unix_new(server_fd);
+	server_watch = g_io_add_watch(server_channel, G_IO_IN,
+					metrics_accept, 0);
+
+	DEBUG("metrics: listening on 127.0.0.1:%u", port);
+}
+
+/**
+ * Stops serving metrics. Scrapes in progress are finished by
+ * the main loop, if it still runs.
+ */
+void healthd_metrics_stop()
+{
+	if (server_fd < 0)
+		return;
+
+	g_source_remove(server_watch);
+	g_io_channel_unref(server_channel);
+	close(server_fd);
+
+	server_watch = 0;
+	server_channel = NULL;
+	server_fd = -1;
+}
+
+/** @} */
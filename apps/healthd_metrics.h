@@ -0,0 +1,12 @@
+#ifndef HEALTHD_METRICS_
+#define HEALTHD_METRICS_
+
+/**
+ * Metrics endpoint (--metrics[=PORT]), bound to localhost only
+ */
+#define HEALTHD_METRICS_DEFAULT_PORT 9006
+
+void healthd_metrics_start(unsigned int port);
+void healthd_metrics_stop();
+
+#endif
@@ -52,17 +52,23 @@
 #include "src/trans/trans.h"
 #include "src/util/log.h"
 #include "src/util/linkedlist.h"
+#include "src/util/apdu_capture.h"
 #include "src/communication/service.h"
+#include "src/communication/trace.h"
 #include "src/dim/pmstore_req.h"
 #include "healthd_service.h"
 #include "healthd_common.h"
 #include "healthd_ipc_dbus.h"
 #include "healthd_ipc_tcp.h"
 #include "healthd_ipc_auto.h"
+#include "healthd_ipc_shm.h"
+#include "healthd_encoder.h"
+#include "healthd_metrics.h"
 
 static const int DBUS_SERVER = 0;
 static const int TCP_SERVER = 1;
 static const int AUTOTESTING = 2;
+static const int SHM_SERVER = 3;
 
 healthd_ipc ipc;
 
@@ -148,6 +154,8 @@ static void app_clean_up()
 {
 	g_main_loop_unref(mainloop);
 
+	healthd_metrics_stop();
+	healthd_encoder_stop();
 	ipc.stop();
 }
 
@@ -161,6 +169,37 @@ static void app_finalize(int sig)
 	g_main_loop_quit(mainloop);
 }
 
+static const char *trace_prefix = NULL;
+static volatile sig_atomic_t trace_dump_requested = 0;
+
+/**
+ * Asks for a trace dump (SIGUSR1), done by trace_dump_poll()
+ * @param int Signal code
+ */
+static void app_request_trace_dump(int sig)
+{
+	trace_dump_requested = 1;
+}
+
+/**
+ * Dumps the trace to <prefix>.json if asked to
+ *
+ * @param data unused
+ * @return TRUE (to keep polling)
+ */
+static gboolean trace_dump_poll(gpointer data)
+{
+	char path[1024];
+
+	if (trace_dump_requested) {
+		trace_dump_requested = 0;
+		snprintf(path, sizeof(path), "%s.json", trace_prefix);
+		trace_dump(path);
+	}
+
+	return TRUE;
+}
+
 /**
  * Sets up application signal handlers, linking them to app finalization
  */
@@ -168,6 +207,7 @@ static void app_setup_signals()
 {
 	signal(SIGINT, app_finalize);
 	signal(SIGTERM, app_finalize);
+	signal(SIGUSR1, app_request_trace_dump);
 }
 
 /**
@@ -195,6 +235,22 @@ int main(int argc, char *argv[])
 	int usb_support = 0;
 	int tcpp_support = 0;
 
+	int tcp_queue_size = HEALTHD_TCP_DEFAULT_QUEUE_SIZE;
+	healthd_tcp_slow_client_policy tcp_slow_policy = TCP_SLOW_CLIENT_DROP_OLDEST;
+
+	const char *shm_name = NULL;
+	int shm_size = HEALTHD_SHM_DEFAULT_SIZE;
+
+	int encoder_threads = HEALTHD_ENCODER_DEFAULT_WORKERS;
+
+	const char *capture_path = NULL;
+	int capture_size = HEALTHD_CAPTURE_DEFAULT_SIZE;
+	int capture_files = HEALTHD_CAPTURE_DEFAULT_FILES;
+
+	int metrics_port = 0;
+
+	int log_async = 0;
+
 	int i;
 
 	int opmode = DBUS_SERVER;
@@ -210,6 +266,14 @@ int main(int argc, char *argv[])
 			opmode = TCP_SERVER;
 		} else if (strcmp(argv[i], "--tcpserver") == 0) {
 			opmode = TCP_SERVER;
+		} else if (strcmp(argv[i], "--shm") == 0) {
+			opmode = SHM_SERVER;
+		} else if (strncmp(argv[i], "--shm-name=", 11) == 0) {
+			shm_name = argv[i] + 11;
+		} else if (strncmp(argv[i], "--shm-size=", 11) == 0) {
+			shm_size = atoi(argv[i] + 11);
+			if (shm_size <= 0)
+				shm_size = HEALTHD_SHM_DEFAULT_SIZE;
 		} else if (strcmp(argv[i], "--bluez") == 0) {
 		} else if (strcmp(argv[i], "--trans") == 0) {
 			trans_support = 1;
@@ -217,15 +281,78 @@ int main(int argc, char *argv[])
 			usb_support = 1;
 		} else if (strcmp(argv[i], "--tcpp") == 0) {
 			tcpp_support = 1;
+		} else if (strncmp(argv[i], "--tcp-queue=", 12) == 0) {
+			tcp_queue_size = atoi(argv[i] + 12);
+			if (tcp_queue_size <= 0)
+				tcp_queue_size = HEALTHD_TCP_DEFAULT_QUEUE_SIZE;
+		} else if (strcmp(argv[i], "--tcp-slow=drop") == 0) {
+			tcp_slow_policy = TCP_SLOW_CLIENT_DROP_OLDEST;
+		} else if (strcmp(argv[i], "--tcp-slow=disconnect") == 0) {
+			tcp_slow_policy = TCP_SLOW_CLIENT_DISCONNECT;
+		} else if (strcmp(argv[i], "--tcp-slow=block") == 0) {
+			tcp_slow_policy = TCP_SLOW_CLIENT_BLOCK;
+		} else if (strncmp(argv[i], "--encoder-threads=", 18) == 0) {
+			encoder_threads = atoi(argv[i] + 18);
+			if (encoder_threads < 0)
+				encoder_threads = 0;
+		} else if (strncmp(argv[i], "--capture=", 10) == 0) {
+			capture_path = argv[i] + 10;
+		} else if (strncmp(argv[i], "--capture-size=", 15) == 0) {
+			capture_size = atoi(argv[i] + 15);
+			if (capture_size < 0)
+				capture_size = HEALTHD_CAPTURE_DEFAULT_SIZE;
+		} else if (strncmp(argv[i], "--capture-files=", 16) == 0) {
+			capture_files = atoi(argv[i] + 16);
+			if (capture_files < 0)
+				capture_files = HEALTHD_CAPTURE_DEFAULT_FILES;
+		} else if (strcmp(argv[i], "--metrics") == 0) {
+			metrics_port = HEALTHD_METRICS_DEFAULT_PORT;
+		} else if (strncmp(argv[i], "--metrics=", 10) == 0) {
+			metrics_port = atoi(argv[i] + 10);
+			if (metrics_port <= 0 || metrics_port > 65535)
+				metrics_port = HEALTHD_METRICS_DEFAULT_PORT;
+		} else if (strcmp(argv[i], "--log-level=error") == 0) {
+			log_set_level(LOG_LEVEL_ERROR);
+		} else if (strcmp(argv[i], "--log-level=warning") == 0) {
+			log_set_level(LOG_LEVEL_WARNING);
+		} else if (strcmp(argv[i], "--log-level=info") == 0) {
+			log_set_level(LOG_LEVEL_INFO);
+		} else if (strcmp(argv[i], "--log-level=debug") == 0) {
+			log_set_level(LOG_LEVEL_DEBUG);
+		} else if (strcmp(argv[i], "--log-async") == 0) {
+			log_async = 1;
+		} else if (strncmp(argv[i], "--trace=", 8) == 0) {
+			trace_prefix = argv[i] + 8;
+		} else if (strcmp(argv[i], "--lock-profile") == 0) {
+			manager_set_lock_profiling(1);
 		}
 	}
 
+	if (log_async) {
+		log_async_start();
+	}
+
+	if (trace_prefix) {
+		trace_dump_on_abort(trace_prefix);
+		trace_start();
+	}
+
+	if (capture_path) {
+		apdu_capture_start(capture_path,
+				   (unsigned long) capture_size * 1024 * 1024,
+				   capture_files);
+	}
+
 	if (opmode == DBUS_SERVER) {
 		healthd_ipc_dbus_init(&ipc);
 	} else if (opmode == TCP_SERVER) {
+		healthd_ipc_tcp_configure(tcp_queue_size, tcp_slow_policy);
 		healthd_ipc_tcp_init(&ipc);
 	} else if (opmode == AUTOTESTING) {
 		healthd_ipc_auto_init(&ipc);
+	} else if (opmode == SHM_SERVER) {
+		healthd_ipc_shm_configure(shm_name, shm_size);
+		healthd_ipc_shm_init(&ipc);
 	}
 
 	bt_plugin = communication_plugin();
@@ -259,6 +386,13 @@ int main(int argc, char *argv[])
 		plugins[plugin_count++] = &tcp_plugin;
 	}
 
+	healthd_encoder_start(encoder_threads,
+				HEALTHD_ENCODER_DEFAULT_QUEUE_SIZE);
+
+	// the stack only runs in the main loop; encoder threads merely
+	// drop their references to data lists
+	communication_set_single_thread(1);
+
 	manager_init(plugins);
 
 	ManagerListener listener = MANAGER_LISTENER_EMPTY;
@@ -278,13 +412,23 @@ int main(int argc, char *argv[])
 
 	ipc.start();
 
+	if (metrics_port) {
+		healthd_metrics_start(metrics_port);
+	}
+
+	if (trace_prefix) {
+		g_timeout_add(500, trace_dump_poll, NULL);
+	}
+
 	mainloop = g_main_loop_new(NULL, FALSE);
 	g_main_loop_ref(mainloop);
 	g_main_loop_run(mainloop);
 	DEBUG("Main loop stopped");
 	manager_finalize();
+	apdu_capture_stop();
 	app_clean_up();
 	DEBUG("Stopped.");
+	log_async_stop();
 
 	return 0;
 }
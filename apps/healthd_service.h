@@ -3,6 +3,13 @@
 
 #include <stdint.h>
 
+/**
+ * APDU capture (--capture=FILE): rotation size in MiB and number of
+ * rotated files kept
+ */
+#define HEALTHD_CAPTURE_DEFAULT_SIZE 64
+#define HEALTHD_CAPTURE_DEFAULT_FILES 4
+
 void hdp_types_configure(uint16_t hdp_data_types[]);
 void healthd_idle_add(void*, void*);
 #endif
@@ -0,0 +1,183 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file healthd_shm_reader.c
+ * \brief Sample consumer of healthd shared memory ring IPC
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * Maps the ring published by 'healthd --shm' read-only and prints
+ * every event. Any number of these may run at the same time; healthd
+ * is not aware of them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "src/communication/context.h"
+#include "healthd_ipc_shm.h"
+
+static const char *type_names[] = {
+	"PAD", "CONNECTED", "DISCONNECT", "ASSOCIATED", "DISASSOCIATE",
+	"MEASUREMENT", "SEGMENTINFO", "SEGMENTDATARESPONSE", "SEGMENTDATA",
+	"SEGMENTCLEARED", "PMSTOREDATA", "ATTRIBUTES"
+};
+
+/**
+ * Copies the record at *pos to buf, following the protocol described
+ * in healthd_ipc_shm.h.
+ *
+ * @param hdr segment header
+ * @param ring start of ring
+ * @param pos consumer position, updated
+ * @param buf destination, at least capacity / 2 bytes
+ * @param lost incremented by the number of bytes lost to overrun
+ * @return 1 if a record was copied, 0 if there is no new data
+ */
+static int shm_read(healthd_shm_header *hdr, unsigned char *ring,
+		    uint64_t *pos, unsigned char *buf, uint64_t *lost)
+{
+	uint64_t capacity = hdr->capacity;
+
+	while (1) {
+		uint64_t w = __atomic_load_n(&hdr->write_pos, __ATOMIC_ACQUIRE);
+
+		if (*pos == w)
+			return 0;
+
+		if (w - *pos > capacity) {
+			*lost += w - *pos;
+			*pos = w;
+			continue;
+		}
+
+		healthd_shm_record *rec;
+		rec = (healthd_shm_record *) (ring + *pos % capacity);
+
+		if (__atomic_load_n(&rec->pos, __ATOMIC_ACQUIRE) != *pos) {
+			*lost += w - *pos;
+			*pos = w;
+			continue;
+		}
+
+		uint32_t size = rec->size;
+
+		if (size < sizeof(healthd_shm_record) || size > capacity / 2) {
+			if (rec->type == HEALTHD_SHM_PAD && size <= capacity) {
+				*pos += size;
+				continue;
+			}
+			*pos = w;
+			continue;
+		}
+
+		memcpy(buf, rec, size);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint64_t r = __atomic_load_n(&hdr->reserve_pos, __ATOMIC_RELAXED);
+
+		if (r - *pos > capacity) {
+			// overwritten while we were copying
+			*lost += w - *pos;
+			*pos = w;
+			continue;
+		}
+
+		*pos += size;
+
+		if (((healthd_shm_record *) buf)->type == HEALTHD_SHM_PAD)
+			continue;
+
+		return 1;
+	}
+}
+
+/**
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+	const char *name = argc > 1 ? argv[1] : HEALTHD_SHM_DEFAULT_NAME;
+	struct stat st;
+
+	int fd = shm_open(name, O_RDONLY, 0);
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "Cannot open %s; is 'healthd --shm' running?\n",
+			name);
+		return 1;
+	}
+
+	void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mem == MAP_FAILED) {
+		fprintf(stderr, "Cannot map %s\n", name);
+		return 1;
+	}
+
+	healthd_shm_header *hdr = mem;
+	unsigned char *ring = (unsigned char *) mem + sizeof(healthd_shm_header);
+
+	while (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != HEALTHD_SHM_MAGIC)
+		usleep(10000);
+
+	if (hdr->version != HEALTHD_SHM_VERSION) {
+		fprintf(stderr, "Unknown ring version %u\n", hdr->version);
+		return 1;
+	}
+
+	unsigned char *buf = malloc(hdr->capacity / 2);
+	uint64_t pos = __atomic_load_n(&hdr->write_pos, __ATOMIC_ACQUIRE);
+	uint64_t lost = 0;
+	uint64_t reported_lost = 0;
+
+	while (1) {
+		if (!shm_read(hdr, ring, &pos, buf, &lost)) {
+			// a real consumer could spin here instead
+			usleep(1000);
+			continue;
+		}
+
+		if (lost != reported_lost) {
+			printf("(%llu bytes lost)\n",
+			       (unsigned long long) (lost - reported_lost));
+			reported_lost = lost;
+		}
+
+		healthd_shm_record *rec = (healthd_shm_record *) buf;
+		const char *tname = rec->type <= HEALTHD_SHM_ATTRIBUTES ?
+					type_names[rec->type] : "?";
+
+		printf("%s\t%u:%llu\t%u %u %u\t%s\n", tname, rec->plugin,
+		       (unsigned long long) rec->connid, rec->handle,
+		       rec->instnumber, rec->status, (char *) (rec + 1));
+		fflush(stdout);
+	}
+
+	return 0;
+}
@@ -0,0 +1,385 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file healthd_subscription.c
+ * \brief Health manager service - IPC client event subscriptions
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * @addtogroup Healthd
+ * @{
+ */
+
+/*
+ * Filter syntax, shared by all IPC backends:
+ *
+ *	[events=NAME,...] [addr=ADDR,...] [sysid=HEX,...] [metric=ID,...]
+ *
+ * Event names are the ones used by TCP IPC (CONNECTED, DISCONNECT,
+ * ASSOCIATED, DISASSOCIATE, MEASUREMENT, ATTRIBUTES, SEGMENTINFO,
+ * SEGMENTDATARESPONSE, SEGMENTDATA, SEGMENTCLEARED, PMSTOREDATA),
+ * plus ALL and NONE. Metric-ids are decimal (e.g. 18949 for
+ * MDC_PRESS_BLD_NONINV_SYS).
+ *
+ * An event matches if it matches every key given; within a key, any
+ * value. A missing key matches anything. The metric key only
+ * restricts events that carry observations (MEASUREMENT and
+ * SEGMENTDATA), so "events=ASSOCIATED,MEASUREMENT metric=18949"
+ * still gets every association.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "src/util/log.h"
+#include "healthd_subscription.h"
+
+static const struct {
+	const char *name;
+	unsigned int mask;
+} event_names[] = {
+	{"CONNECTED", HEALTHD_EVT_CONNECTED},
+	{"DISCONNECT", HEALTHD_EVT_DISCONNECTED},
+	{"ASSOCIATED", HEALTHD_EVT_ASSOCIATED},
+	{"DISASSOCIATE", HEALTHD_EVT_DISASSOCIATED},
+	{"MEASUREMENT", HEALTHD_EVT_MEASUREMENT},
+	{"ATTRIBUTES", HEALTHD_EVT_DEVICEATTRIBUTES},
+	{"SEGMENTINFO", HEALTHD_EVT_SEGMENTINFO},
+	{"SEGMENTDATARESPONSE", HEALTHD_EVT_SEGMENTDATARESPONSE},
+	{"SEGMENTDATA", HEALTHD_EVT_SEGMENTDATA},
+	{"SEGMENTCLEARED", HEALTHD_EVT_SEGMENTCLEARED},
+	{"PMSTOREDATA", HEALTHD_EVT_PMSTOREDATA},
+	{"ALL", HEALTHD_EVT_ALL},
+	{"NONE", 0},
+	{NULL, 0}
+};
+
+static int parse_events(healthd_subscription *sub, char *values)
+{
+	char *saveptr;
+	char *value;
+
+	sub->events = 0;
+
+	for (value = strtok_r(values, ",", &saveptr); value;
+	     value = strtok_r(NULL, ",", &saveptr)) {
+		int i;
+
+		for (i = 0; event_names[i].name; ++i) {
+			if (strcasecmp(value, event_names[i].name) == 0)
+				break;
+		}
+
+		if (!event_names[i].name) {
+			DEBUG("subscription: unknown event %s", value);
+			return 0;
+		}
+
+		sub->events |= event_names[i].mask;
+	}
+
+	return 1;
+}
+
+static int parse_strings(char ***list, unsigned int *count, char *values)
+{
+	char *saveptr;
+	char *value;
+
+	for (value = strtok_r(values, ",", &saveptr); value;
+	     value = strtok_r(NULL, ",", &saveptr)) {
+		*list = realloc(*list, sizeof(char *) * (*count + 1));
+		(*list)[(*count)++] = strdup(value);
+	}
+
+	return 1;
+}
+
+static int parse_metrics(healthd_subscription *sub, char *values)
+{
+	char *saveptr;
+	char *value;
+
+	for (value = strtok_r(values, ",", &saveptr); value;
+	     value = strtok_r(NULL, ",", &saveptr)) {
+		char *end;
+		unsigned long id = strtoul(value, &end, 0);
+
+		if (*end || id > 0xffff) {
+			DEBUG("subscription: bad metric-id %s", value);
+			return 0;
+		}
+
+		sub->metric_ids = realloc(sub->metric_ids, sizeof(unsigned int)
+					  * (sub->metric_count + 1));
+		sub->metric_ids[sub->metric_count++] = id;
+	}
+
+	return 1;
+}
+
+/**
+ * Creates a subscription from its textual form
+ *
+ * @param filter filter string (see top of file); NULL or empty
+ *	  subscribes to everything
+ * @return new subscription, or NULL if filter is invalid
+ */
+healthd_subscription *healthd_subscription_new(const char *filter)
+{
+	healthd_subscription *sub = calloc(1, sizeof(healthd_subscription));
+	char *copy = strdup(filter ? filter : "");
+	char *saveptr;
+	char *token;
+	int ok = 1;
+
+	sub->events = HEALTHD_EVT_ALL;
+
+	for (token = strtok_r(copy, " \t\r\n", &saveptr); token && ok;
+	     token = strtok_r(NULL, " \t\r\n", &saveptr)) {
+		char *values = strchr(token, '=');
+
+		if (!values) {
+			ok = 0;
+			break;
+		}
+
+		*values++ = 0;
+
+		if (strcmp(token, "events") == 0) {
+			ok = parse_events(sub, values);
+		} else if (strcmp(token, "addr") == 0) {
+			ok = parse_strings(&sub->addrs, &sub->addr_count,
+					   values);
+		} else if (strcmp(token, "sysid") == 0) {
+			ok = parse_strings(&sub->system_ids,
+					   &sub->system_id_count, values);
+		} else if (strcmp(token, "metric") == 0) {
+			ok = parse_metrics(sub, values);
+		} else {
+			DEBUG("subscription: unknown key %s", token);
+			ok = 0;
+		}
+	}
+
+	free(copy);
+
+	if (!ok) {
+		healthd_subscription_del(sub);
+		return NULL;
+	}
+
+	return sub;
+}
+
+/**
+ * Frees a subscription
+ *
+ * @param sub subscription, may be NULL
+ */
+void healthd_subscription_del(healthd_subscription *sub)
+{
+	unsigned int i;
+
+	if (!sub)
+		return;
+
+	for (i = 0; i < sub->addr_count; ++i)
+		free(sub->addrs[i]);
+	for (i = 0; i < sub->system_id_count; ++i)
+		free(sub->system_ids[i]);
+
+	free(sub->addrs);
+	free(sub->system_ids);
+	free(sub->metric_ids);
+	free(sub);
+}
+
+static int match_string(char **list, unsigned int count, const char *value)
+{
+	unsigned int i;
+
+	if (count == 0)
+		return 1;
+
+	if (!value)
+		return 0;
+
+	for (i = 0; i < count; ++i) {
+		if (strcasecmp(list[i], value) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Tells whether a subscriber wants an event
+ *
+ * @param sub subscription, NULL matches everything
+ * @param evt event
+ * @return 1 if event matches
+ */
+int healthd_subscription_match(const healthd_subscription *sub,
+				const healthd_event *evt)
+{
+	unsigned int i, j;
+
+	if (!sub)
+		return 1;
+
+	if (!(sub->events & evt->type))
+		return 0;
+
+	if (!match_string(sub->addrs, sub->addr_count, evt->low_addr))
+		return 0;
+
+	if (!match_string(sub->system_ids, sub->system_id_count,
+			  evt->system_id))
+		return 0;
+
+	if (sub->metric_count == 0 || !(evt->type & (HEALTHD_EVT_MEASUREMENT
+						| HEALTHD_EVT_SEGMENTDATA)))
+		return 1;
+
+	for (i = 0; i < evt->metric_count; ++i) {
+		for (j = 0; j < sub->metric_count; ++j) {
+			if (evt->metric_ids[i] == sub->metric_ids[j])
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void add_metric(healthd_event *evt, unsigned int id)
+{
+	unsigned int i;
+
+	for (i = 0; i < evt->metric_count; ++i) {
+		if (evt->metric_ids[i] == id)
+			return;
+	}
+
+	evt->metric_ids = realloc(evt->metric_ids, sizeof(unsigned int)
+				  * (evt->metric_count + 1));
+	evt->metric_ids[evt->metric_count++] = id;
+}
+
+/**
+ * Gets the type of a metric object
+ *
+ * @param mds device MDS
+ * @param handle object handle
+ * @param id type code, output
+ * @return 1 if handle is a metric, 0 if not
+ */
+static int metric_type_of(MDS *mds, unsigned int handle, unsigned int *id)
+{
+	struct MDS_object *obj = mds_get_object_by_handle(mds, handle);
+
+	if (!obj || obj->choice != MDS_OBJ_METRIC)
+		return 0;
+
+	switch (obj->u.metric.choice) {
+	case METRIC_NUMERIC:
+		*id = obj->u.metric.u.numeric.metric.type.code;
+		return 1;
+	case METRIC_ENUM:
+		*id = obj->u.metric.u.enumeration.metric.type.code;
+		return 1;
+	case METRIC_RTSA:
+		*id = obj->u.metric.u.rtsa.metric.type.code;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void collect_metrics(healthd_event *evt, const DataEntry *entry,
+			    MDS *mds)
+{
+	int i;
+
+	for (i = 0; i < entry->meta_data.size; ++i) {
+		MetaAtt *meta = &entry->meta_data.values[i];
+		unsigned int id;
+
+		if (!meta->name || !meta->value)
+			continue;
+
+		if (strcmp(meta->name, "metric-id") == 0) {
+			add_metric(evt, strtoul(meta->value, NULL, 10));
+		} else if (mds && strcmp(meta->name, "HANDLE") == 0
+			   && metric_type_of(mds, strtoul(meta->value, NULL, 10),
+					     &id)) {
+			// simple observations only carry the metric handle
+			add_metric(evt, id);
+		}
+	}
+
+	if (entry->choice == COMPOUND_DATA_ENTRY) {
+		for (i = 0; i < entry->u.compound.entries_count; ++i)
+			collect_metrics(evt, &entry->u.compound.entries[i],
+					mds);
+	}
+}
+
+/**
+ * Fills event metric-ids from its data list: the metric-id meta
+ * attributes, and the type of the metrics whose handles appear.
+ *
+ * @param evt event
+ * @param list data list, may be NULL
+ * @param mds device MDS, to resolve metric handles; may be NULL
+ */
+void healthd_event_set_metrics(healthd_event *evt, const DataList *list,
+				MDS *mds)
+{
+	int i;
+
+	if (!list)
+		return;
+
+	for (i = 0; i < list->size; ++i)
+		collect_metrics(evt, &list->values[i], mds);
+}
+
+/**
+ * Frees memory owned by event (but not the event itself)
+ *
+ * @param evt event
+ */
+void healthd_event_clear(healthd_event *evt)
+{
+	free(evt->low_addr);
+	free(evt->system_id);
+	free(evt->metric_ids);
+	evt->low_addr = NULL;
+	evt->system_id = NULL;
+	evt->metric_ids = NULL;
+	evt->metric_count = 0;
+}
+
+/** @} */
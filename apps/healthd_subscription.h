@@ -0,0 +1,70 @@
+#ifndef HEALTHD_SUBSCRIPTION_
+#define HEALTHD_SUBSCRIPTION_
+
+#include "src/communication/context.h"
+#include "src/api/api_definitions.h"
+#include "src/dim/mds.h"
+
+/**
+ * Event types, as a bit mask
+ */
+typedef enum {
+	HEALTHD_EVT_CONNECTED = 1 << 0,
+	HEALTHD_EVT_DISCONNECTED = 1 << 1,
+	HEALTHD_EVT_ASSOCIATED = 1 << 2,
+	HEALTHD_EVT_DISASSOCIATED = 1 << 3,
+	HEALTHD_EVT_MEASUREMENT = 1 << 4,
+	HEALTHD_EVT_DEVICEATTRIBUTES = 1 << 5,
+	HEALTHD_EVT_SEGMENTINFO = 1 << 6,
+	HEALTHD_EVT_SEGMENTDATARESPONSE = 1 << 7,
+	HEALTHD_EVT_SEGMENTDATA = 1 << 8,
+	HEALTHD_EVT_SEGMENTCLEARED = 1 << 9,
+	HEALTHD_EVT_PMSTOREDATA = 1 << 10,
+	HEALTHD_EVT_ALL = (1 << 11) - 1
+} healthd_event_type;
+
+/**
+ * What subscriptions are matched against
+ */
+typedef struct {
+	healthd_event_type type;
+	ContextId id;
+	/**
+	 * Device transport address, NULL if unknown
+	 */
+	char *low_addr;
+	/**
+	 * Device System-Id in hex, NULL if not associated yet
+	 */
+	char *system_id;
+	/**
+	 * Metric-ids found in event data (measurements and PM-Segment
+	 * data only)
+	 */
+	unsigned int *metric_ids;
+	unsigned int metric_count;
+} healthd_event;
+
+/**
+ * Client subscription. Clients without one get every event.
+ */
+typedef struct {
+	unsigned int events;
+	char **addrs;
+	unsigned int addr_count;
+	char **system_ids;
+	unsigned int system_id_count;
+	unsigned int *metric_ids;
+	unsigned int metric_count;
+} healthd_subscription;
+
+healthd_subscription *healthd_subscription_new(const char *filter);
+void healthd_subscription_del(healthd_subscription *sub);
+int healthd_subscription_match(const healthd_subscription *sub,
+				const healthd_event *evt);
+
+void healthd_event_set_metrics(healthd_event *evt, const DataList *list,
+				MDS *mds);
+void healthd_event_clear(healthd_event *evt);
+
+#endif
@@ -0,0 +1,1192 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file load_agent.c
+ * \brief Multi-agent load generator.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/*
+ * Opens many simultaneous agent TCP connections against a running
+ * manager and measures association latency (AARQ to AARE), round trip
+ * of confirmed event reports and the sustained APDU rate.
+ *
+ * The agent facade keeps a single connection in global state, so the
+ * virtual agents do not go through it. APDUs are encoded with the same
+ * library functions the agent uses (the specializations' event report
+ * builders and the MDER encoder), and connections are driven by a few
+ * epoll worker threads. Event reports are encoded once per
+ * specialization and only the invoke id is patched before sending.
+ *
+ * The TCP manager plug-in serves one agent per port at a time, so
+ * agents are spread over a range of ports (-P).
+ *
+ * Usage: ieee_load_agent [options], see print_help().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include <ieee11073.h>
+#include "communication/stdconfigurations.h"
+#include "communication/parser/encoder_ASN1.h"
+#include "communication/parser/struct_cleaner.h"
+#include "specializations/pulse_oximeter.h"
+#include "specializations/blood_pressure_monitor.h"
+#include "specializations/weighing_scale.h"
+#include "specializations/glucometer.h"
+#include "dim/mds.h"
+#include "util/bytelib.h"
+#include "sample_agent_common.h"
+
+/**
+ * Confirmed event reports an agent may have in flight
+ */
+#define LOAD_WINDOW 16
+
+/**
+ * Seconds to wait for AARE or for an event report confirmation
+ */
+#define LOAD_TIMEOUT 10
+
+/**
+ * Seconds before a dropped or rejected agent reconnects
+ */
+#define LOAD_RECONNECT 1
+
+/**
+ * Specialization simulated by an agent
+ */
+typedef struct LoadSpec {
+	const char *name;
+	ConfigId config;
+	void *(*event_report_cb)();
+	/**
+	 * Encoded event report APDU, invoke id at PRST_INVOKE_ID
+	 */
+	intu8 *report;
+	int report_size;
+} LoadSpec;
+
+static LoadSpec specs[] = {
+	{"oximeter", 0x0190, oximeter_event_report_cb, NULL, 0},
+	{"bp", 0x02BC, blood_pressure_event_report_cb, NULL, 0},
+	{"scale", 0x05DC, weightscale_event_report_cb, NULL, 0},
+	{"glucometer", 0x06A4, glucometer_event_report_cb, NULL, 0},
+};
+
+#define SPEC_COUNT ((int) (sizeof(specs) / sizeof(specs[0])))
+
+/**
+ * Offsets inside an encoded PRST APDU: choice (2), length (2),
+ * octet string length (2), invoke id (2), data apdu choice (2),
+ * data apdu length (2), object handle (2).
+ */
+#define PRST_INVOKE_ID 6
+#define PRST_MESSAGE_CHOICE 8
+#define PRST_OBJ_HANDLE 12
+
+/**
+ * Offset of the result in an encoded AARE APDU
+ */
+#define AARE_RESULT 4
+
+typedef enum {
+	PROFILE_STEADY = 0,
+	PROFILE_POISSON,
+	PROFILE_BURST
+} LoadProfile;
+
+typedef enum {
+	AGENT_IDLE = 0,
+	AGENT_CONNECTING,
+	AGENT_ASSOCIATING,
+	AGENT_OPERATING,
+	AGENT_RELEASING
+} LoadAgentState;
+
+/**
+ * Growable array of latency samples, in microseconds
+ */
+typedef struct LoadSamples {
+	unsigned int *value;
+	unsigned long count;
+	unsigned long size;
+} LoadSamples;
+
+/**
+ * Counters of a worker thread. Updated by the worker, read by the
+ * progress printer, hence the relaxed atomics.
+ */
+typedef struct LoadCounters {
+	unsigned long long apdus_sent;
+	unsigned long long apdus_received;
+	unsigned long long bytes_sent;
+	unsigned long long bytes_received;
+	unsigned long long reports_sent;
+	unsigned long long reports_confirmed;
+	unsigned long long associations;
+	unsigned long long assoc_rejected;
+	unsigned long long assoc_timeouts;
+	unsigned long long connect_errors;
+	unsigned long long disconnects;
+	unsigned long long report_timeouts;
+	unsigned long long window_full;
+} LoadCounters;
+
+typedef struct LoadAgent {
+	int fd;
+	LoadAgentState state;
+	LoadSpec *spec;
+	intu8 system_id[8];
+	struct sockaddr_in addr;
+
+	/**
+	 * Partial APDU being received
+	 */
+	intu8 *rx;
+	int rx_size;
+	int rx_alloc;
+
+	/**
+	 * Bytes the socket did not take yet
+	 */
+	intu8 *tx;
+	int tx_size;
+	int tx_alloc;
+
+	/**
+	 * Time of AARQ (associating) or of the next action, in
+	 * microseconds of the monotonic clock
+	 */
+	unsigned long long aarq_us;
+	unsigned long long next_us;
+
+	intu16 invoke_id;
+	int outstanding;
+	unsigned long long sent_us[LOAD_WINDOW];
+	int session_reports;
+} LoadAgent;
+
+typedef struct LoadWorker {
+	pthread_t thread;
+	int epfd;
+	LoadAgent *agents;
+	int count;
+	unsigned int seed;
+	LoadSpec specs[sizeof(specs) / sizeof(specs[0])];
+	LoadCounters counters;
+	LoadSamples assoc;
+	LoadSamples rtt;
+} LoadWorker;
+
+static const char *host = "127.0.0.1";
+static int port = 6024;
+static int port_count = 1;
+static int agent_count = 100;
+static int thread_count = 1;
+static int spec_index = -1;
+static double rate = 1.0;
+static LoadProfile profile = PROFILE_STEADY;
+static int burst = 10;
+static double ramp = 5.0;
+static double duration = 30.0;
+static int session_length = 0;
+static int spec_confirm_mode = 0;
+
+/**
+ * Set by signal handler or when duration elapses, read by workers
+ */
+static int stopping = 0;
+
+/**
+ * Monotonic clock in microseconds
+ */
+static unsigned long long now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void count(unsigned long long *counter, unsigned long long n)
+{
+	__atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static unsigned long long counter_get(unsigned long long *counter)
+{
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void samples_add(LoadSamples *samples, unsigned long long value)
+{
+	if (samples->count == samples->size) {
+		samples->size = samples->size ? samples->size * 2 : 1024;
+		samples->value = realloc(samples->value,
+					 samples->size * sizeof(unsigned int));
+	}
+
+	samples->value[samples->count++] = value > 0xffffffffULL ?
+						0xffffffff : value;
+}
+
+static int samples_cmp(const void *a, const void *b)
+{
+	unsigned int x = *((const unsigned int *) a);
+	unsigned int y = *((const unsigned int *) b);
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Encodes the event report of a specialization, the same way
+ * communication_agent_send_event_tx() does.
+ *
+ * @param spec specialization
+ * @return 1 if ok
+ */
+static int spec_encode_report(LoadSpec *spec)
+{
+	struct StdConfiguration *cfg =
+		std_configurations_get_supported_standard(spec->config);
+	APDU apdu;
+	PRST_apdu prst;
+	DATA_apdu *data;
+	ByteStreamWriter *writer;
+
+	if (!cfg) {
+		return 0;
+	}
+
+	void *evtreport = spec->event_report_cb();
+	data = cfg->event_report(evtreport);
+	free(evtreport);
+
+	if (!spec_confirm_mode) {
+		// confirmations are what RTT is measured on
+		data->message.choice = ROIV_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN;
+	}
+	data->invoke_id = 0;
+
+	prst.length = data->message.length + 6;
+	encode_set_data_apdu(&prst, data);
+
+	apdu.choice = PRST_CHOSEN;
+	apdu.length = prst.length + 2;
+	apdu.u.prst = prst;
+
+	writer = byte_stream_writer_instance(apdu.length + 4);
+	encode_apdu(writer, &apdu);
+
+	spec->report = writer->buffer;
+	spec->report_size = writer->size;
+
+	del_byte_stream_writer(writer, 0);
+	// also frees data
+	del_apdu(&apdu);
+
+	return 1;
+}
+
+/**
+ * Encodes the association request of an agent, see
+ * association_aarq_tx().
+ *
+ * @param agent virtual agent
+ * @return writer with the encoded APDU
+ */
+static ByteStreamWriter *agent_encode_aarq(LoadAgent *agent)
+{
+	APDU apdu;
+	DataProto proto;
+	PhdAssociationInformation info;
+	ByteStreamWriter *info_writer;
+	ByteStreamWriter *writer;
+
+	memset(&info, 0, sizeof(PhdAssociationInformation));
+	info.protocolVersion = ASSOC_VERSION1;
+	info.encodingRules = MDER;
+	info.nomenclatureVersion = NOM_VERSION1;
+	info.functionalUnits = 0x00000000;
+	info.systemType = SYS_TYPE_AGENT;
+	info.system_id.length = sizeof(agent->system_id);
+	info.system_id.value = agent->system_id;
+	info.dev_config_id = agent->spec->config;
+	info.data_req_mode_capab.data_req_mode_flags = DATA_REQ_SUPP_INIT_AGENT;
+	info.data_req_mode_capab.data_req_init_agent_count = 0x01;
+	info.data_req_mode_capab.data_req_init_manager_count = 0x00;
+	info.optionList.count = 0;
+	info.optionList.length = 0;
+
+	info_writer = byte_stream_writer_instance(38);
+	encode_phdassociationinformation(info_writer, &info);
+
+	proto.data_proto_id = DATA_PROTO_ID_20601;
+	proto.data_proto_info.length = 38;
+	proto.data_proto_info.value = info_writer->buffer;
+
+	apdu.choice = AARQ_CHOSEN;
+	apdu.length = 50;
+	apdu.u.aarq.assoc_version = ASSOC_VERSION1;
+	apdu.u.aarq.data_proto_list.count = 1;
+	apdu.u.aarq.data_proto_list.length = 42;
+	apdu.u.aarq.data_proto_list.value = &proto;
+
+	writer = byte_stream_writer_instance(apdu.length + 4);
+	encode_apdu(writer, &apdu);
+
+	del_byte_stream_writer(info_writer, 1);
+
+	return writer;
+}
+
+/**
+ * Encodes the answer to a GET of MDS attributes, see
+ * communication_agent_roiv_get_mds_tx().
+ *
+ * @param agent virtual agent
+ * @param invoke_id invoke id of the request
+ * @return writer with the encoded APDU
+ */
+static ByteStreamWriter *agent_encode_mds(LoadAgent *agent,
+						InvokeIDType invoke_id)
+{
+	APDU apdu;
+	DATA_apdu *data_apdu = calloc(sizeof(DATA_apdu), 1);
+	AttributeList attrs;
+	ByteStreamWriter *writer;
+	MDS *mds = mds_create();
+
+	mds->dev_configuration_id = agent->spec->config;
+	mds->data_req_mode_capab.data_req_mode_flags = DATA_REQ_SUPP_INIT_AGENT;
+	mds->data_req_mode_capab.data_req_init_agent_count = 1;
+	mds->data_req_mode_capab.data_req_init_manager_count = 0;
+	mds->system_id.length = sizeof(agent->system_id);
+	mds->system_id.value = malloc(mds->system_id.length);
+	memcpy(mds->system_id.value, agent->system_id, mds->system_id.length);
+
+	attrs.count = 0;
+	attrs.length = 0;
+	attrs.value = mds_get_attributes(mds, &attrs.count, &attrs.length);
+
+	data_apdu->invoke_id = invoke_id;
+	data_apdu->message.choice = RORS_CMIP_GET_CHOSEN;
+	data_apdu->message.u.rors_cmipGet.obj_handle = MDS_HANDLE;
+	data_apdu->message.u.rors_cmipGet.attribute_list = attrs;
+	data_apdu->message.length = sizeof(ASN1_HANDLE) + 2 + 2 + attrs.length;
+
+	apdu.choice = PRST_CHOSEN;
+	apdu.u.prst.length = sizeof(InvokeIDType) + 2 + 2
+			     + data_apdu->message.length;
+	apdu.length = sizeof(apdu.u.prst.length) + apdu.u.prst.length;
+	encode_set_data_apdu(&apdu.u.prst, data_apdu);
+
+	writer = byte_stream_writer_instance(apdu.length + 4);
+	encode_apdu(writer, &apdu);
+
+	// deletes attributes and data_apdu
+	del_apdu(&apdu);
+	mds_destroy(mds);
+
+	return writer;
+}
+
+/**
+ * Queues bytes to the agent socket, buffering what does not fit
+ *
+ * @return 1 if ok, 0 if connection failed
+ */
+static int agent_send(LoadWorker *w, LoadAgent *agent, intu8 *buf, int size)
+{
+	int sent = 0;
+
+	if (agent->tx_size == 0) {
+		sent = send(agent->fd, buf, size, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				return 0;
+			}
+			sent = 0;
+		}
+	}
+
+	if (sent < size) {
+		int rest = size - sent;
+
+		if (agent->tx_size + rest > agent->tx_alloc) {
+			agent->tx_alloc = agent->tx_size + rest;
+			agent->tx = realloc(agent->tx, agent->tx_alloc);
+		}
+
+		memcpy(agent->tx + agent->tx_size, buf + sent, rest);
+
+		if (agent->tx_size == 0) {
+			struct epoll_event ev;
+			ev.events = EPOLLIN | EPOLLOUT;
+			ev.data.ptr = agent;
+			epoll_ctl(w->epfd, EPOLL_CTL_MOD, agent->fd, &ev);
+		}
+
+		agent->tx_size += rest;
+	}
+
+	count(&w->counters.apdus_sent, 1);
+	count(&w->counters.bytes_sent, size);
+
+	return 1;
+}
+
+/**
+ * Writes buffered bytes once the socket is writable
+ *
+ * @return 1 if ok, 0 if connection failed
+ */
+static int agent_flush(LoadWorker *w, LoadAgent *agent)
+{
+	int sent = send(agent->fd, agent->tx, agent->tx_size, MSG_NOSIGNAL);
+
+	if (sent < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	}
+
+	agent->tx_size -= sent;
+	memmove(agent->tx, agent->tx + sent, agent->tx_size);
+
+	if (agent->tx_size == 0) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = agent;
+		epoll_ctl(w->epfd, EPOLL_CTL_MOD, agent->fd, &ev);
+	}
+
+	return 1;
+}
+
+/**
+ * Closes the connection and schedules a reconnection
+ */
+static void agent_close(LoadWorker *w, LoadAgent *agent, unsigned long long now)
+{
+	if (agent->fd >= 0) {
+		close(agent->fd);
+		agent->fd = -1;
+	}
+
+	agent->state = AGENT_IDLE;
+	agent->rx_size = 0;
+	agent->tx_size = 0;
+	agent->outstanding = 0;
+	memset(agent->sent_us, 0, sizeof(agent->sent_us));
+	agent->next_us = now + LOAD_RECONNECT * 1000000ULL;
+}
+
+static void agent_connect(LoadWorker *w, LoadAgent *agent, unsigned long long now)
+{
+	struct epoll_event ev;
+	int opt = 1;
+
+	agent->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+
+	if (agent->fd < 0) {
+		count(&w->counters.connect_errors, 1);
+		agent_close(w, agent, now);
+		return;
+	}
+
+	setsockopt(agent->fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+	if (connect(agent->fd, (struct sockaddr *) &agent->addr,
+		    sizeof(agent->addr)) < 0 && errno != EINPROGRESS) {
+		count(&w->counters.connect_errors, 1);
+		agent_close(w, agent, now);
+		return;
+	}
+
+	agent->state = AGENT_CONNECTING;
+	agent->next_us = now + LOAD_TIMEOUT * 1000000ULL;
+
+	ev.events = EPOLLOUT;
+	ev.data.ptr = agent;
+	epoll_ctl(w->epfd, EPOLL_CTL_ADD, agent->fd, &ev);
+}
+
+/**
+ * Connection is up, starts association
+ */
+static void agent_connected(LoadWorker *w, LoadAgent *agent, unsigned long long now)
+{
+	struct epoll_event ev;
+	int error = 0;
+	socklen_t len = sizeof(error);
+
+	getsockopt(agent->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+
+	if (error) {
+		count(&w->counters.connect_errors, 1);
+		agent_close(w, agent, now);
+		return;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = agent;
+	epoll_ctl(w->epfd, EPOLL_CTL_MOD, agent->fd, &ev);
+
+	ByteStreamWriter *aarq = agent_encode_aarq(agent);
+	agent->state = AGENT_ASSOCIATING;
+	agent->aarq_us = now;
+	agent->next_us = now + LOAD_TIMEOUT * 1000000ULL;
+	agent->session_reports = 0;
+
+	if (!agent_send(w, agent, aarq->buffer, aarq->size)) {
+		count(&w->counters.connect_errors, 1);
+		agent_close(w, agent, now);
+	}
+
+	del_byte_stream_writer(aarq, 1);
+}
+
+/**
+ * Time until the next report, following the load profile
+ */
+static unsigned long long next_interval(LoadWorker *w)
+{
+	double interval = 1.0 / rate;
+
+	if (profile == PROFILE_POISSON) {
+		double u = (rand_r(&w->seed) + 1.0) / (RAND_MAX + 2.0);
+		interval = -log(u) / rate;
+	} else if (profile == PROFILE_BURST) {
+		interval *= burst;
+	}
+
+	return interval * 1000000.0;
+}
+
+static void agent_release(LoadWorker *w, LoadAgent *agent, unsigned long long now)
+{
+	// RLRQ, reason normal
+	intu8 rlrq[] = {0xE4, 0x00, 0x00, 0x02, 0x00, 0x00};
+
+	agent->state = AGENT_RELEASING;
+	agent->next_us = now + LOAD_TIMEOUT * 1000000ULL;
+
+	if (!agent_send(w, agent, rlrq, sizeof(rlrq))) {
+		agent_close(w, agent, now);
+	}
+}
+
+static void agent_send_reports(LoadWorker *w, LoadAgent *agent,
+				unsigned long long now)
+{
+	int n = profile == PROFILE_BURST ? burst : 1;
+	LoadSpec *spec = agent->spec;
+	int confirmed = spec->report[PRST_MESSAGE_CHOICE + 1] ==
+			(ROIV_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN & 0xff);
+
+	while (n-- > 0) {
+		int slot = agent->invoke_id % LOAD_WINDOW;
+
+		if (confirmed && agent->sent_us[slot]) {
+			count(&w->counters.window_full, 1);
+			break;
+		}
+
+		spec->report[PRST_INVOKE_ID] = agent->invoke_id >> 8;
+		spec->report[PRST_INVOKE_ID + 1] = agent->invoke_id & 0xff;
+
+		if (!agent_send(w, agent, spec->report, spec->report_size)) {
+			count(&w->counters.disconnects, 1);
+			agent_close(w, agent, now);
+			return;
+		}
+
+		if (confirmed) {
+			agent->sent_us[slot] = now;
+			++agent->outstanding;
+		}
+
+		++agent->invoke_id;
+		++agent->session_reports;
+		count(&w->counters.reports_sent, 1);
+	}
+
+	agent->next_us = now + next_interval(w);
+
+	if (session_length > 0 && agent->session_reports >= session_length) {
+		agent_release(w, agent, now);
+	}
+}
+
+/**
+ * Handles one APDU received from the manager
+ */
+static void agent_process_apdu(LoadWorker *w, LoadAgent *agent,
+				intu8 *apdu, int size, unsigned long long now)
+{
+	intu16 choice = apdu[0] << 8 | apdu[1];
+
+	count(&w->counters.apdus_received, 1);
+	count(&w->counters.bytes_received, size);
+
+	if (choice == AARE_CHOSEN && agent->state == AGENT_ASSOCIATING) {
+		intu16 result = size > AARE_RESULT + 1 ?
+			apdu[AARE_RESULT] << 8 | apdu[AARE_RESULT + 1] : 0xffff;
+
+		if (result != ACCEPTED) {
+			// ACCEPTED_UNKNOWN_CONFIG included: std configs only
+			count(&w->counters.assoc_rejected, 1);
+			agent_close(w, agent, now);
+			return;
+		}
+
+		count(&w->counters.associations, 1);
+		samples_add(&w->assoc, now - agent->aarq_us);
+		agent->state = AGENT_OPERATING;
+		agent->next_us = now + next_interval(w) *
+					(rand_r(&w->seed) / (RAND_MAX + 1.0));
+	} else if (choice == PRST_CHOSEN && size > PRST_OBJ_HANDLE + 1) {
+		intu16 invoke_id = apdu[PRST_INVOKE_ID] << 8 | apdu[PRST_INVOKE_ID + 1];
+		intu16 msg = apdu[PRST_MESSAGE_CHOICE] << 8 |
+				apdu[PRST_MESSAGE_CHOICE + 1];
+		intu16 handle = apdu[PRST_OBJ_HANDLE] << 8 | apdu[PRST_OBJ_HANDLE + 1];
+
+		if (msg == RORS_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN) {
+			int slot = invoke_id % LOAD_WINDOW;
+
+			if (agent->sent_us[slot]) {
+				samples_add(&w->rtt, now - agent->sent_us[slot]);
+				agent->sent_us[slot] = 0;
+				--agent->outstanding;
+				count(&w->counters.reports_confirmed, 1);
+			}
+		} else if (msg == ROIV_CMIP_GET_CHOSEN && handle == MDS_HANDLE) {
+			ByteStreamWriter *rors = agent_encode_mds(agent, invoke_id);
+
+			if (!agent_send(w, agent, rors->buffer, rors->size)) {
+				count(&w->counters.disconnects, 1);
+				agent_close(w, agent, now);
+			}
+
+			del_byte_stream_writer(rors, 1);
+		}
+	} else if (choice == RLRQ_CHOSEN) {
+		// RLRE, reason normal
+		intu8 rlre[] = {0xE5, 0x00, 0x00, 0x02, 0x00, 0x00};
+		agent_send(w, agent, rlre, sizeof(rlre));
+		count(&w->counters.disconnects, 1);
+		agent_close(w, agent, now);
+	} else if (choice == RLRE_CHOSEN) {
+		agent_close(w, agent, now);
+		// reconnects right away
+		agent->next_us = now;
+	} else if (choice == ABRT_CHOSEN) {
+		count(&w->counters.disconnects, 1);
+		agent_close(w, agent, now);
+	}
+}
+
+static void agent_receive(LoadWorker *w, LoadAgent *agent, unsigned long long now)
+{
+	intu8 buf[4096];
+	int got = recv(agent->fd, buf, sizeof(buf), 0);
+
+	if (got <= 0) {
+		if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		}
+		count(&w->counters.disconnects, 1);
+		agent_close(w, agent, now);
+		return;
+	}
+
+	if (agent->rx_size + got > agent->rx_alloc) {
+		agent->rx_alloc = agent->rx_size + got;
+		agent->rx = realloc(agent->rx, agent->rx_alloc);
+	}
+
+	memcpy(agent->rx + agent->rx_size, buf, got);
+	agent->rx_size += got;
+
+	int offset = 0;
+
+	while (agent->fd >= 0 && agent->rx_size - offset >= 4) {
+		intu8 *apdu = agent->rx + offset;
+		int apdu_size = (apdu[2] << 8 | apdu[3]) + 4;
+
+		if (agent->rx_size - offset < apdu_size) {
+			break;
+		}
+
+		agent_process_apdu(w, agent, apdu, apdu_size, now);
+		offset += apdu_size;
+	}
+
+	if (agent->fd < 0) {
+		return;
+	}
+
+	agent->rx_size -= offset;
+	memmove(agent->rx, agent->rx + offset, agent->rx_size);
+}
+
+/**
+ * Runs due timers of all agents of a worker
+ *
+ * @return time of the next timer
+ */
+static unsigned long long worker_timers(LoadWorker *w, unsigned long long now)
+{
+	unsigned long long next = now + 100000;
+	int i, j;
+
+	for (i = 0; i < w->count; ++i) {
+		LoadAgent *agent = &w->agents[i];
+
+		if (agent->outstanding > 0) {
+			for (j = 0; j < LOAD_WINDOW; ++j) {
+				if (agent->sent_us[j] &&
+				    now - agent->sent_us[j] > LOAD_TIMEOUT * 1000000ULL) {
+					agent->sent_us[j] = 0;
+					--agent->outstanding;
+					count(&w->counters.report_timeouts, 1);
+				}
+			}
+		}
+
+		if (agent->next_us <= now) {
+			switch (agent->state) {
+			case AGENT_IDLE:
+				agent_connect(w, agent, now);
+				break;
+			case AGENT_OPERATING:
+				agent_send_reports(w, agent, now);
+				break;
+			case AGENT_ASSOCIATING:
+				count(&w->counters.assoc_timeouts, 1);
+				agent_close(w, agent, now);
+				break;
+			case AGENT_CONNECTING:
+				count(&w->counters.connect_errors, 1);
+				agent_close(w, agent, now);
+				break;
+			case AGENT_RELEASING:
+				agent_close(w, agent, now);
+				break;
+			}
+		}
+
+		if (agent->next_us < next) {
+			next = agent->next_us;
+		}
+	}
+
+	return next;
+}
+
+static void *worker_loop(void *arg)
+{
+	LoadWorker *w = arg;
+	struct epoll_event events[256];
+	unsigned long long next = now_us();
+	int i;
+
+	while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+		unsigned long long now = now_us();
+		int timeout = next > now ? (next - now + 999) / 1000 : 0;
+		int n = epoll_wait(w->epfd, events, 256, timeout);
+
+		now = now_us();
+
+		for (i = 0; i < n; ++i) {
+			LoadAgent *agent = events[i].data.ptr;
+
+			if (agent->state == AGENT_CONNECTING) {
+				agent_connected(w, agent, now);
+				continue;
+			}
+
+			if ((events[i].events & EPOLLOUT) && agent->fd >= 0) {
+				if (!agent_flush(w, agent)) {
+					count(&w->counters.disconnects, 1);
+					agent_close(w, agent, now);
+				}
+			}
+
+			if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			    && agent->fd >= 0) {
+				agent_receive(w, agent, now);
+			}
+		}
+
+		next = worker_timers(w, now);
+	}
+
+	for (i = 0; i < w->count; ++i) {
+		if (w->agents[i].fd >= 0) {
+			close(w->agents[i].fd);
+		}
+	}
+
+	return NULL;
+}
+
+static void counters_sum(LoadWorker *workers, LoadCounters *total)
+{
+	int i, j;
+	int fields = sizeof(LoadCounters) / sizeof(unsigned long long);
+
+	memset(total, 0, sizeof(LoadCounters));
+
+	for (i = 0; i < thread_count; ++i) {
+		unsigned long long *src = (unsigned long long *) &workers[i].counters;
+		unsigned long long *dst = (unsigned long long *) total;
+
+		for (j = 0; j < fields; ++j) {
+			dst[j] += counter_get(&src[j]);
+		}
+	}
+}
+
+static void print_latency(const char *name, LoadWorker *workers, int rtt)
+{
+	LoadSamples all = {NULL, 0, 0};
+	unsigned long i, j;
+	static const double pct[] = {50.0, 90.0, 99.0, 99.9};
+
+	for (i = 0; i < (unsigned long) thread_count; ++i) {
+		LoadSamples *s = rtt ? &workers[i].rtt : &workers[i].assoc;
+
+		for (j = 0; j < s->count; ++j) {
+			samples_add(&all, s->value[j]);
+		}
+	}
+
+	printf("%-14s samples %lu", name, all.count);
+
+	if (all.count > 0) {
+		qsort(all.value, all.count, sizeof(unsigned int), samples_cmp);
+
+		for (i = 0; i < sizeof(pct) / sizeof(pct[0]); ++i) {
+			unsigned long k = (unsigned long) (pct[i] / 100.0 * all.count);
+			k = k >= all.count ? all.count - 1 : k;
+			printf("  p%g %.3fms", pct[i], all.value[k] / 1000.0);
+		}
+
+		printf("  max %.3fms", all.value[all.count - 1] / 1000.0);
+	}
+
+	printf("\n");
+	free(all.value);
+}
+
+static void sigint(int dummy)
+{
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Prints utility command-line tool help.
+ */
+static void print_help()
+{
+	printf(
+		"Load generator: many simulated IEEE 11073 agents over TCP\n\n"
+		"Usage: ieee_load_agent [OPTION]\n"
+		"Options:\n"
+		"        -h host        Manager address, default 127.0.0.1\n"
+		"        -p port        First manager port, default 6024\n"
+		"        -P count       Number of manager ports, agents are spread\n"
+		"                       over them, default 1\n"
+		"        -n agents      Number of virtual agents, default 100\n"
+		"        -j threads     Worker threads, default 1\n"
+		"        -s type        oximeter, bp, scale, glucometer or mix\n"
+		"                       (default, round robin)\n"
+		"        -r rate        Reports per second per agent, default 1\n"
+		"        -m profile     steady, poisson or burst, default steady\n"
+		"        -b size        Reports per burst, default 10\n"
+		"        -R seconds     Spread agent start over this time, default 5\n"
+		"        -d seconds     Test duration, default 30\n"
+		"        -k reports     Release and reassociate after this many\n"
+		"                       reports, default 0 (never)\n"
+		"        -u             Keep each specialization's confirmation\n"
+		"                       mode (oximeter reports are unconfirmed)\n"
+		"        --help         Print this help\n\n");
+}
+
+/**
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	struct sockaddr_in addr;
+	LoadWorker *workers;
+	LoadAgent *agents;
+	LoadCounters total;
+	unsigned long long start, steady_start = 0;
+	unsigned long long steady_apdus = 0, last_apdus = 0;
+	int opt;
+	int i;
+
+	if (argc > 1 && strcmp(argv[1], "--help") == 0) {
+		print_help();
+		exit(0);
+	}
+
+	while ((opt = getopt(argc, argv, "h:p:P:n:j:s:r:m:b:R:d:k:u")) != -1) {
+		switch (opt) {
+		case 'h':
+			host = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'P':
+			port_count = atoi(optarg);
+			break;
+		case 'n':
+			agent_count = atoi(optarg);
+			break;
+		case 'j':
+			thread_count = atoi(optarg);
+			break;
+		case 's':
+			for (i = 0; i < SPEC_COUNT; ++i) {
+				if (strcmp(optarg, specs[i].name) == 0) {
+					spec_index = i;
+				}
+			}
+			if (spec_index < 0 && strcmp(optarg, "mix") != 0) {
+				fprintf(stderr, "ERROR: invalid type: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'm':
+			if (strcmp(optarg, "poisson") == 0) {
+				profile = PROFILE_POISSON;
+			} else if (strcmp(optarg, "burst") == 0) {
+				profile = PROFILE_BURST;
+			} else if (strcmp(optarg, "steady") == 0) {
+				profile = PROFILE_STEADY;
+			} else {
+				fprintf(stderr, "ERROR: invalid profile: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'b':
+			burst = atoi(optarg);
+			break;
+		case 'R':
+			ramp = atof(optarg);
+			break;
+		case 'd':
+			duration = atof(optarg);
+			break;
+		case 'k':
+			session_length = atoi(optarg);
+			break;
+		case 'u':
+			spec_confirm_mode = 1;
+			break;
+		default:
+			fprintf(stderr, "Try `%s --help'"
+				" for more information.\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (agent_count < 1 || thread_count < 1 || port_count < 1 ||
+	    rate <= 0 || burst < 1 || ramp < 0 || duration <= 0) {
+		fprintf(stderr, "ERROR: invalid arguments\n");
+		exit(1);
+	}
+
+	if (thread_count > agent_count) {
+		thread_count = agent_count;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(host, NULL, &hints, &res) != 0) {
+		fprintf(stderr, "ERROR: cannot resolve %s\n", host);
+		exit(1);
+	}
+
+	memcpy(&addr, res->ai_addr, sizeof(addr));
+	freeaddrinfo(res);
+
+	std_configurations_register_conf(
+		blood_pressure_monitor_create_std_config_ID02BC());
+	std_configurations_register_conf(
+		pulse_oximeter_create_std_config_ID0190());
+	std_configurations_register_conf(
+		weighting_scale_create_std_config_ID05DC());
+	std_configurations_register_conf(
+		glucometer_create_std_config_ID06A4());
+
+	for (i = 0; i < SPEC_COUNT; ++i) {
+		if (!spec_encode_report(&specs[i])) {
+			fprintf(stderr, "ERROR: no configuration for %s\n",
+				specs[i].name);
+			exit(1);
+		}
+	}
+
+	agents = calloc(agent_count, sizeof(LoadAgent));
+	workers = calloc(thread_count, sizeof(LoadWorker));
+	start = now_us();
+
+	for (i = 0; i < agent_count; ++i) {
+		LoadAgent *agent = &agents[i];
+
+		agent->fd = -1;
+		agent->state = AGENT_IDLE;
+		agent->spec = &specs[spec_index >= 0 ? spec_index : i % SPEC_COUNT];
+		memcpy(agent->system_id, AGENT_SYSTEM_ID_VALUE, 4);
+		agent->system_id[4] = i >> 24;
+		agent->system_id[5] = i >> 16;
+		agent->system_id[6] = i >> 8;
+		agent->system_id[7] = i;
+		agent->addr = addr;
+		agent->addr.sin_port = htons(port + i % port_count);
+		agent->next_us = start + ramp * 1000000.0 * i / agent_count;
+	}
+
+	signal(SIGINT, sigint);
+	signal(SIGTERM, sigint);
+
+	for (i = 0; i < thread_count; ++i) {
+		LoadWorker *w = &workers[i];
+		int first = (long long) agent_count * i / thread_count;
+		int last = (long long) agent_count * (i + 1) / thread_count;
+		int j;
+
+		w->agents = &agents[first];
+		w->count = last - first;
+		w->seed = i + 1;
+		w->epfd = epoll_create1(0);
+
+		// each worker patches invoke ids into its own templates
+		memcpy(w->specs, specs, sizeof(specs));
+		for (j = 0; j < SPEC_COUNT; ++j) {
+			w->specs[j].report = malloc(specs[j].report_size);
+			memcpy(w->specs[j].report, specs[j].report,
+			       specs[j].report_size);
+		}
+
+		for (j = 0; j < w->count; ++j) {
+			LoadAgent *agent = &w->agents[j];
+			agent->spec = &w->specs[agent->spec - specs];
+		}
+	}
+
+	for (i = 0; i < thread_count; ++i) {
+		pthread_create(&workers[i].thread, NULL, worker_loop, &workers[i]);
+	}
+
+	printf("%d agents, %d threads, %s:%d-%d, %.2f reports/s per agent\n",
+	       agent_count, thread_count, host, port, port + port_count - 1,
+	       rate);
+
+	while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+		unsigned long long now;
+		unsigned long long apdus;
+
+		sleep(1);
+
+		now = now_us();
+		counters_sum(workers, &total);
+		apdus = total.apdus_sent + total.apdus_received;
+
+		printf("%6.1fs associated %llu apdus/s %llu confirmed %llu"
+		       " errors %llu\n",
+		       (now - start) / 1000000.0,
+		       total.associations, apdus - last_apdus,
+		       total.reports_confirmed,
+		       total.assoc_rejected + total.assoc_timeouts +
+		       total.connect_errors + total.disconnects +
+		       total.report_timeouts);
+		fflush(stdout);
+		last_apdus = apdus;
+
+		if (!steady_start && now - start >= ramp * 1000000.0) {
+			steady_start = now;
+			steady_apdus = apdus;
+		}
+
+		if (now - start >= (ramp + duration) * 1000000.0) {
+			__atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	for (i = 0; i < thread_count; ++i) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	unsigned long long end = now_us();
+	counters_sum(workers, &total);
+
+	printf("\n");
+	printf("associations   %llu (rejected %llu, timeouts %llu)\n",
+	       total.associations, total.assoc_rejected, total.assoc_timeouts);
+	printf("connections    errors %llu, dropped %llu\n",
+	       total.connect_errors, total.disconnects);
+	printf("reports        sent %llu, confirmed %llu, timeouts %llu,"
+	       " window full %llu\n",
+	       total.reports_sent, total.reports_confirmed,
+	       total.report_timeouts, total.window_full);
+	printf("apdus          sent %llu (%llu bytes), received %llu"
+	       " (%llu bytes)\n",
+	       total.apdus_sent, total.bytes_sent,
+	       total.apdus_received, total.bytes_received);
+
+	if (steady_start && end > steady_start) {
+		printf("sustained      %.1f apdus/s after ramp-up\n",
+		       (total.apdus_sent + total.apdus_received - steady_apdus)
+		       * 1000000.0 / (end - steady_start));
+	}
+
+	print_latency("association", workers, 0);
+	print_latency("report rtt", workers, 1);
+
+	return 0;
+}
@@ -28,13 +28,21 @@
  * \date Jul 7, 2010
  */
 
+#ifdef __linux__
+#include <sched.h>
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include <ieee11073.h>
 #include "communication/plugin/plugin_tcp.h"
+#include "communication/plugin/plugin_tcp_uring.h"
 #include "communication/service.h"
 #include "util/log.h"
 
@@ -59,6 +67,26 @@ static CommunicationPlugin comm_plugin = COMMUNICATION_PLUGIN_NULL;
  */
 int port = 6024;
 
+/**
+ * Set to use the io_uring TCP plugin
+ */
+static int use_uring = 0;
+
+/**
+ * Worker processes sharing the TCP port, 0 to run a single process
+ */
+static int workers = 0;
+
+/**
+ * Process ids of workers, 0 for those not running (supervisor only)
+ */
+static pid_t *worker_pids = NULL;
+
+/**
+ * Set when the supervisor is asked to stop
+ */
+static volatile sig_atomic_t stopping = 0;
+
 /**
  * Callback function that is called whenever a new data
  * has been received.
@@ -151,7 +179,155 @@ static void print_help()
 		"Usage: ieee_manager [OPTION]\n"
 		"Options:\n"
 		"        --help                Print this help\n"
-		"        --tcp                 Run TCP mode on default port\n");
+		"        --tcp                 Run TCP mode on default port\n"
+		"        --uring               Use io_uring for TCP, if available\n"
+		"        --workers=N           Fork N workers sharing the TCP port,\n"
+		"                              each pinned to a core\n");
+}
+
+/**
+ * Signal handler of the supervisor
+ *
+ * @param sig signal number
+ */
+static void supervisor_signal(int sig)
+{
+	stopping = 1;
+}
+
+/**
+ * Pins the calling process to a core, chosen by worker number
+ *
+ * @param worker worker number
+ */
+static void pin_to_core(int worker)
+{
+#ifdef __linux__
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t set;
+
+	if (cores < 1) {
+		return;
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(worker % cores, &set);
+
+	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+		fprintf(stderr, "worker %d: cannot pin to core: %d\n",
+			worker, errno);
+	}
+#endif
+}
+
+/**
+ * Forks a worker
+ *
+ * @param worker worker number
+ * @return 0 in the worker, 1 in the supervisor, -1 on error
+ */
+static int spawn_worker(int worker)
+{
+	pid_t pid = fork();
+
+	if (pid < 0) {
+		fprintf(stderr, "Cannot fork worker %d: %d\n", worker, errno);
+		return -1;
+	}
+
+	if (pid == 0) {
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		free(worker_pids);
+		worker_pids = NULL;
+		pin_to_core(worker);
+		return 0;
+	}
+
+	worker_pids[worker] = pid;
+	return 1;
+}
+
+/**
+ * Forks the workers and waits for them, restarting those that crash,
+ * until all have finished. SIGINT or SIGTERM stop the workers.
+ *
+ * @return 1 in workers, which go on to serve agents; 0 in the
+ *	   supervisor when done
+ */
+static int supervise()
+{
+	struct sigaction sa;
+	int running = 0;
+	int status;
+	pid_t pid;
+	int ret;
+	int i;
+
+	worker_pids = calloc(workers, sizeof(pid_t));
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = supervisor_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	for (i = 0; i < workers; ++i) {
+		ret = spawn_worker(i);
+
+		if (ret == 0) {
+			return 1;
+		} else if (ret > 0) {
+			++running;
+		}
+	}
+
+	while (running > 0) {
+		pid = waitpid(-1, &status, 0);
+
+		if (pid < 0) {
+			if (errno != EINTR) {
+				break;
+			}
+
+			for (i = 0; stopping && i < workers; ++i) {
+				if (worker_pids[i] > 0) {
+					kill(worker_pids[i], SIGTERM);
+				}
+			}
+
+			continue;
+		}
+
+		for (i = 0; i < workers && worker_pids[i] != pid; ++i)
+			;
+
+		if (i == workers) {
+			continue;
+		}
+
+		worker_pids[i] = 0;
+		--running;
+
+		if (stopping || !WIFSIGNALED(status)) {
+			continue;
+		}
+
+		fprintf(stderr, "Worker %d killed by signal %d, restarting\n",
+			i, WTERMSIG(status));
+
+		ret = spawn_worker(i);
+
+		if (ret == 0) {
+			return 1;
+		} else if (ret > 0) {
+			++running;
+		}
+	}
+
+	free(worker_pids);
+	worker_pids = NULL;
+
+	return 0;
 }
 
 /**
@@ -182,7 +358,12 @@ static void tcp_mode()
 	// but might not be the case if there were many plugins!
 	CONTEXT_ID.plugin = 1;
 	CONTEXT_ID.connid = port;
-	plugin_network_tcp_setup(&comm_plugin, 1, port);
+
+	if (use_uring) {
+		plugin_network_tcp_uring_setup(&comm_plugin, 1, port);
+	} else {
+		plugin_network_tcp_setup(&comm_plugin, 1, port);
+	}
 }
 
 /**
@@ -190,29 +371,44 @@ static void tcp_mode()
  */
 int main(int argc, char **argv)
 {
+	int i;
+
 	comm_plugin = communication_plugin();
 
-	if (argc == 2) {
-		if (strcmp(argv[1], "--help") == 0) {
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--help") == 0) {
 			print_help();
 			exit(0);
-		} else if (strcmp(argv[1], "--tcp") == 0) {
-			tcp_mode();
+		} else if (strcmp(argv[i], "--tcp") == 0) {
+			// TCP is default mode
+		} else if (strcmp(argv[i], "--uring") == 0) {
+			use_uring = 1;
+		} else if (strncmp(argv[i], "--workers=", 10) == 0) {
+			workers = atoi(argv[i] + 10);
+			if (workers < 1) {
+				fprintf(stderr, "ERROR: invalid number of workers\n");
+				exit(1);
+			}
 		} else {
-			fprintf(stderr, "ERROR: invalid option: %s\n", argv[1]);
+			fprintf(stderr, "ERROR: invalid option: %s\n", argv[i]);
 			fprintf(stderr, "Try `ieee_manager --help'"
 				" for more information.\n");
 			exit(1);
 		}
+	}
 
-	} else if (argc > 2) {
-		fprintf(stderr, "ERROR: Invalid number of options\n");
-		fprintf(stderr, "Try `ieee_manager --help'"
-			" for more information.\n");
-		exit(1);
-	} else {
-		// TCP is default mode
-		tcp_mode();
+	tcp_mode();
+
+	if (workers > 0) {
+		if (!plugin_network_tcp_set_reuseport(1)) {
+			fprintf(stderr, "ERROR: port sharing not supported\n");
+			exit(1);
+		}
+
+		// only workers go on
+		if (!supervise()) {
+			return 0;
+		}
 	}
 
 	fprintf(stderr, "\nIEEE 11073 Sample application\n");
@@ -233,7 +429,11 @@ int main(int argc, char **argv)
 
 	int x = 0;
 	while (x++ < 3) {
-		plugin_network_tcp_connect(port);
+		if (use_uring) {
+			plugin_network_tcp_uring_connect(port);
+		} else {
+			plugin_network_tcp_connect(port);
+		}
 		manager_connection_loop(CONTEXT_ID);
 		DEBUG("----------------------");
 	}
@@ -153,6 +153,50 @@ dbus_glib_marshal_srv_VOID__BOXED_BOXED_POINTER (GClosure     *closure,
 }
 #define dbus_glib_marshal_srv_NONE__BOXED_BOXED_POINTER	dbus_glib_marshal_srv_VOID__BOXED_BOXED_POINTER
 
+/* NONE:STRING,POINTER */
+extern void dbus_glib_marshal_srv_VOID__STRING_POINTER (GClosure     *closure,
+                                                        GValue       *return_value,
+                                                        guint         n_param_values,
+                                                        const GValue *param_values,
+                                                        gpointer      invocation_hint,
+                                                        gpointer      marshal_data);
+void
+dbus_glib_marshal_srv_VOID__STRING_POINTER (GClosure     *closure,
+                                            GValue       *return_value G_GNUC_UNUSED,
+                                            guint         n_param_values,
+                                            const GValue *param_values,
+                                            gpointer      invocation_hint G_GNUC_UNUSED,
+                                            gpointer      marshal_data)
+{
+  typedef void (*GMarshalFunc_VOID__STRING_POINTER) (gpointer     data1,
+                                                     gpointer     arg_1,
+                                                     gpointer     arg_2,
+                                                     gpointer     data2);
+  register GMarshalFunc_VOID__STRING_POINTER callback;
+  register GCClosure *cc = (GCClosure*) closure;
+  register gpointer data1, data2;
+
+  g_return_if_fail (n_param_values == 3);
+
+  if (G_CCLOSURE_SWAP_DATA (closure))
+    {
+      data1 = closure->data;
+      data2 = g_value_peek_pointer (param_values + 0);
+    }
+  else
+    {
+      data1 = g_value_peek_pointer (param_values + 0);
+      data2 = closure->data;
+    }
+  callback = (GMarshalFunc_VOID__STRING_POINTER) (marshal_data ? marshal_data : cc->callback);
+
+  callback (data1,
+            g_marshal_value_peek_string (param_values + 1),
+            g_marshal_value_peek_pointer (param_values + 2),
+            data2);
+}
+#define dbus_glib_marshal_srv_NONE__STRING_POINTER	dbus_glib_marshal_srv_VOID__STRING_POINTER
+
 G_END_DECLS
 
 #endif /* __dbus_glib_marshal_srv_MARSHAL_H__ */
@@ -161,12 +205,13 @@ G_END_DECLS
 static const DBusGMethodInfo dbus_glib_srv_methods[] = {
   { (GCallback) srv_configure, dbus_glib_marshal_srv_NONE__BOXED_STRING_BOXED_POINTER, 0 },
   { (GCallback) srv_configurepassive, dbus_glib_marshal_srv_NONE__BOXED_BOXED_POINTER, 75 },
+  { (GCallback) srv_subscribe, dbus_glib_marshal_srv_NONE__STRING_POINTER, 148 },
 };
 
 const DBusGObjectInfo dbus_glib_srv_object_info = {  1,
   dbus_glib_srv_methods,
-  2,
-"com.signove.health.manager\0Configure\0A\0agent\0I\0o\0addr\0I\0s\0data_types\0I\0ai\0\0com.signove.health.manager\0ConfigurePassive\0A\0agent\0I\0o\0data_types\0I\0ai\0\0\0",
+  3,
+"com.signove.health.manager\0Configure\0A\0agent\0I\0o\0addr\0I\0s\0data_types\0I\0ai\0\0com.signove.health.manager\0ConfigurePassive\0A\0agent\0I\0o\0data_types\0I\0ai\0\0com.signove.health.manager\0Subscribe\0A\0filter\0I\0s\0\0\0",
 "\0",
 "\0"
 };
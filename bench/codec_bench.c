@@ -0,0 +1,778 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file codec_bench.c
+ * \brief Codec microbenchmarks
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/*
+ * Replays APDUs of the test corpus (tests/resources/apdu) through the
+ * codec, the DIM update functions and the data list encoders, and
+ * prints one JSON object per benchmark:
+ *
+ *	{"benchmark": "decode_apdu/aarq", "iterations": 100000,
+ *	 "ns_per_op": 210.4, "allocs_per_op": 3.00, "bytes_per_op": 86.0}
+ *
+ * Allocations are counted by replacing malloc() (glibc only, and not
+ * under AddressSanitizer); elsewhere allocs_per_op and bytes_per_op
+ * are reported as -1. Library log messages go to stderr.
+ *
+ * RT-SA and PM-Segment data events have no sample in the corpus, so
+ * they are built here.
+ *
+ * Usage: codec_bench [-d corpus_dir] [-t min_ms] [-n iterations]
+ *		      [filter]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "src/asn1/phd_types.h"
+#include "src/api/api_definitions.h"
+#include "src/api/data_list.h"
+#include "src/api/xml_encoder.h"
+#include "src/api/json_encoder.h"
+#include "src/communication/context.h"
+#include "src/communication/service.h"
+#include "src/communication/stdconfigurations.h"
+#include "src/communication/parser/decoder_ASN1.h"
+#include "src/communication/parser/encoder_ASN1.h"
+#include "src/communication/parser/struct_cleaner.h"
+#include "src/dim/mds.h"
+#include "src/dim/dimutil.h"
+#include "src/dim/nomenclature.h"
+#include "src/util/bytelib.h"
+#include "src/util/ioutil.h"
+#include "src/specializations/blood_pressure_monitor.h"
+
+static unsigned long long alloc_count = 0;
+static unsigned long long alloc_bytes = 0;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+	++alloc_count;
+	alloc_bytes += size;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	++alloc_count;
+	alloc_bytes += nmemb * size;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	++alloc_count;
+	alloc_bytes += size;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+#define ALLOC_COUNTING 1
+
+#else
+
+#define ALLOC_COUNTING 0
+
+#endif
+
+/**
+ * APDU of the corpus, decoded once so it can be re-encoded and its
+ * event info extracted
+ */
+typedef struct {
+	const char *name;
+	const char *file;
+	intu8 *buffer;
+	unsigned long size;
+	APDU apdu;
+	/**
+	 * Event info of ROIV event reports, NULL otherwise
+	 */
+	Any *event_info;
+} CorpusApdu;
+
+enum {
+	AARQ = 0,
+	CONFIG,
+	SCAN_FIXED,
+	SCAN_VAR,
+	SCAN_GROUPED,
+	RTSA_CONFIG,
+	RTSA_FIXED,
+	SEGMENT_DATA,
+	CORPUS_SIZE
+};
+
+static CorpusApdu corpus[CORPUS_SIZE] = {
+	{.name = "aarq", .file = "blood_pressure/aarq"},
+	{.name = "config_report",
+	 .file = "pulse_oximeter/pulse_oximeter_noti_config_with_scanner"},
+	{.name = "scan_report_fixed",
+	 .file = "pulse_oximeter/pulse_oximeter_unbuf_scan_report_fixed"},
+	{.name = "scan_report_var",
+	 .file = "pulse_oximeter/pulse_oximeter_unbuf_scan_report_var"},
+	{.name = "scan_report_grouped",
+	 .file = "pulse_oximeter/pulse_oximeter_unbuf_scan_report_grouped"},
+	{.name = "rtsa_config_report"},
+	{.name = "rtsa_scan_report_fixed"},
+	{.name = "segment_data_event"},
+};
+
+/**
+ * Handles used by the synthetic APDUs
+ */
+#define RTSA_HANDLE 20
+#define PMSTORE_HANDLE 16
+#define EPI_SCANNER_HANDLE 55
+#define RTSA_SAMPLES 64
+#define SEGMENT_ENTRIES_SIZE 256
+
+static Context *pulse_ctx = NULL;
+static Context *rtsa_ctx = NULL;
+
+static ScanReportInfoFixed scan_fixed;
+static ScanReportInfoVar scan_var;
+static ScanReportInfoGrouped scan_grouped;
+static ScanReportInfoFixed rtsa_fixed;
+static DataList *measurement_list = NULL;
+static DataList *configuration_list = NULL;
+
+static intu8 float_buffer[4] = {0xFE, 0x00, 0x01, 0xF4};
+static intu8 sfloat_buffer[2] = {0xF0, 0x62};
+
+static double min_time = 0.2;
+static unsigned long fixed_iterations = 0;
+
+/**
+ * Wraps an event report into a PRST APDU
+ */
+static intu8 *build_event_apdu(ASN1_HANDLE handle, OID_Type event_type,
+			       ByteStreamWriter *info, unsigned long *size)
+{
+	ByteStreamWriter *stream = byte_stream_writer_instance(info->size + 22);
+	intu8 *buffer;
+	int error;
+
+	write_intu16(stream, PRST_CHOSEN);
+	write_intu16(stream, info->size + 18);
+	write_intu16(stream, info->size + 16);
+	write_intu16(stream, 0x0001); /* invoke-id */
+	write_intu16(stream, ROIV_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN);
+	write_intu16(stream, info->size + 10);
+	write_intu16(stream, handle);
+	write_intu32(stream, 0xFFFFFFFF); /* event-time */
+	write_intu16(stream, event_type);
+	write_intu16(stream, info->size);
+	write_intu8_many(stream, info->buffer, info->size, &error);
+
+	buffer = stream->buffer;
+	*size = stream->size;
+	del_byte_stream_writer(stream, 0);
+	del_byte_stream_writer(info, 1);
+
+	return buffer;
+}
+
+/**
+ * Config report with a single RT-SA object (a plethysmogram)
+ */
+static void build_rtsa_config()
+{
+	ByteStreamWriter *info = byte_stream_writer_instance(128);
+
+	write_intu16(info, 0x4000); /* config-report-id */
+	write_intu16(info, 1); /* config-obj-list.count */
+	write_intu16(info, 62); /* config-obj-list.length */
+	write_intu16(info, MDC_MOC_VMO_METRIC_SA_RT);
+	write_intu16(info, RTSA_HANDLE);
+	write_intu16(info, 5); /* attributes.count */
+	write_intu16(info, 54); /* attributes.length */
+
+	write_intu16(info, MDC_ATTR_ID_TYPE);
+	write_intu16(info, 4);
+	write_intu16(info, MDC_PART_SCADA);
+	write_intu16(info, 19380); /* MDC_PULS_OXIM_PLETH */
+
+	write_intu16(info, MDC_ATTR_SA_SPECN);
+	write_intu16(info, 6);
+	write_intu16(info, RTSA_SAMPLES); /* array-size */
+	write_intu8(info, 8); /* sample-size */
+	write_intu8(info, 8); /* significant-bits */
+	write_intu16(info, 0); /* flags */
+
+	write_intu16(info, MDC_ATTR_SCALE_SPECN_I16);
+	write_intu16(info, 12);
+	write_float(info, 0.0);
+	write_float(info, 100.0);
+	write_intu16(info, 0);
+	write_intu16(info, 255);
+
+	write_intu16(info, MDC_ATTR_TIME_PD_SAMP);
+	write_intu16(info, 4);
+	write_intu32(info, 0x00000050);
+
+	write_intu16(info, MDC_ATTR_ATTRIBUTE_VAL_MAP);
+	write_intu16(info, 8);
+	write_intu16(info, 1); /* AttrValMap.count */
+	write_intu16(info, 4); /* AttrValMap.length */
+	write_intu16(info, MDC_ATTR_SIMP_SA_OBS_VAL);
+	write_intu16(info, RTSA_SAMPLES + 2);
+
+	corpus[RTSA_CONFIG].buffer = build_event_apdu(0, MDC_NOTI_CONFIG, info,
+					&corpus[RTSA_CONFIG].size);
+}
+
+/**
+ * Fixed scan report carrying one RT-SA observation
+ */
+static void build_rtsa_scan_report()
+{
+	ByteStreamWriter *info = byte_stream_writer_instance(128);
+	int i;
+
+	write_intu16(info, 0xF000); /* data-req-id */
+	write_intu16(info, 0); /* scan-report-no */
+	write_intu16(info, 1); /* obs-scan-fixed.count */
+	write_intu16(info, RTSA_SAMPLES + 6); /* obs-scan-fixed.length */
+	write_intu16(info, RTSA_HANDLE);
+	write_intu16(info, RTSA_SAMPLES + 2); /* obs-val-data.length */
+	write_intu16(info, RTSA_SAMPLES); /* Simple-Sa-Observed-Value */
+
+	for (i = 0; i < RTSA_SAMPLES; ++i)
+		write_intu8(info, (i * 7) & 0xff);
+
+	corpus[RTSA_FIXED].buffer = build_event_apdu(EPI_SCANNER_HANDLE,
+					MDC_NOTI_UNBUF_SCAN_REPORT_FIXED, info,
+					&corpus[RTSA_FIXED].size);
+}
+
+/**
+ * PM-Segment data event
+ */
+static void build_segment_data_event()
+{
+	ByteStreamWriter *info = byte_stream_writer_instance(
+					 SEGMENT_ENTRIES_SIZE + 16);
+	int i;
+
+	write_intu16(info, 0); /* segm-instance */
+	write_intu32(info, 0); /* segm-evt-entry-index */
+	write_intu32(info, SEGMENT_ENTRIES_SIZE / 8); /* segm-evt-entry-count */
+	write_intu16(info, 0xE000); /* first, last, agent-initiated */
+	write_intu16(info, SEGMENT_ENTRIES_SIZE);
+
+	for (i = 0; i < SEGMENT_ENTRIES_SIZE; ++i)
+		write_intu8(info, i & 0xff);
+
+	corpus[SEGMENT_DATA].buffer = build_event_apdu(PMSTORE_HANDLE,
+					MDC_NOTI_SEGMENT_DATA, info,
+					&corpus[SEGMENT_DATA].size);
+}
+
+static int load_corpus(const char *dir)
+{
+	int i;
+
+	build_rtsa_config();
+	build_rtsa_scan_report();
+	build_segment_data_event();
+
+	for (i = 0; i < CORPUS_SIZE; ++i) {
+		CorpusApdu *entry = &corpus[i];
+		ByteStreamReader *stream;
+		int error = 0;
+
+		if (entry->file) {
+			char path[1024];
+
+			snprintf(path, sizeof(path), "%s/%s", dir, entry->file);
+			entry->buffer = ioutil_buffer_from_file(path, &entry->size);
+
+			if (!entry->buffer) {
+				fprintf(stderr, "Unable to read %s\n", path);
+				return 0;
+			}
+		}
+
+		stream = byte_stream_reader_instance(entry->buffer, entry->size);
+		decode_apdu(stream, &entry->apdu, &error);
+		free(stream);
+
+		if (error) {
+			fprintf(stderr, "Unable to decode %s\n", entry->name);
+			return 0;
+		}
+
+		if (entry->apdu.choice == PRST_CHOSEN) {
+			DATA_apdu *data = encode_get_data_apdu(&entry->apdu.u.prst);
+
+			if (data->message.choice == ROIV_CMIP_EVENT_REPORT_CHOSEN)
+				entry->event_info = &data->message.u.
+						    roiv_cmipEventReport.event_info;
+			else if (data->message.choice
+				 == ROIV_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN)
+				entry->event_info = &data->message.u.
+						    roiv_cmipConfirmedEventReport.event_info;
+		}
+	}
+
+	return 1;
+}
+
+static ByteStreamReader *event_reader(int index)
+{
+	Any *info = corpus[index].event_info;
+
+	return byte_stream_reader_instance(info->value, info->length);
+}
+
+static Context *configure(int index)
+{
+	Context *ctx = calloc(1, sizeof(Context));
+	ByteStreamReader *stream = event_reader(index);
+	ConfigReport config;
+	int error = 0;
+
+	decode_configreport(stream, &config, &error);
+	free(stream);
+
+	ctx->mds = mds_create();
+	mds_configure_operating(ctx, &config.config_obj_list, 0);
+	del_configreport(&config);
+
+	return ctx;
+}
+
+static void release(Context *ctx)
+{
+	mds_destroy(ctx->mds);
+	service_destroy(ctx->service);
+	free(ctx);
+}
+
+static HandleAttrValMap *grouped_map()
+{
+	struct MDS_object *obj = mds_get_object_by_handle(pulse_ctx->mds,
+						EPI_SCANNER_HANDLE);
+
+	return &obj->u.scanner.u.epi_cfg_scanner.scanner.scanner.
+	       scan_handle_attr_val_map;
+}
+
+static void setup()
+{
+	ByteStreamReader *stream;
+	MDS *mds;
+	int error = 0;
+
+	pulse_ctx = configure(CONFIG);
+	rtsa_ctx = configure(RTSA_CONFIG);
+
+	stream = event_reader(SCAN_FIXED);
+	decode_scanreportinfofixed(stream, &scan_fixed, &error);
+	free(stream);
+
+	stream = event_reader(SCAN_VAR);
+	decode_scanreportinfovar(stream, &scan_var, &error);
+	free(stream);
+
+	stream = event_reader(SCAN_GROUPED);
+	decode_scanreportinfogrouped(stream, &scan_grouped, &error);
+	free(stream);
+
+	stream = event_reader(RTSA_FIXED);
+	decode_scanreportinfofixed(stream, &rtsa_fixed, &error);
+	free(stream);
+
+	measurement_list = data_list_new(scan_var.obs_scan_var.count);
+
+	for (error = 0; error < scan_var.obs_scan_var.count; ++error)
+		dimutil_update_mds_from_obs_scan(pulse_ctx->mds,
+						 &scan_var.obs_scan_var.value[error],
+						 &measurement_list->values[error]);
+
+	std_configurations_register_conf(
+		blood_pressure_monitor_create_std_config_ID02BC());
+	mds = mds_create();
+	mds->dev_configuration_id = 0x02BC;
+	configuration_list = mds_populate_configuration(mds);
+	mds_destroy(mds);
+}
+
+static void cleanup()
+{
+	int i;
+
+	data_list_del(measurement_list);
+	data_list_del(configuration_list);
+	del_scanreportinfofixed(&scan_fixed);
+	del_scanreportinfovar(&scan_var);
+	del_scanreportinfogrouped(&scan_grouped);
+	del_scanreportinfofixed(&rtsa_fixed);
+	release(pulse_ctx);
+	release(rtsa_ctx);
+	std_configurations_destroy();
+
+	for (i = 0; i < CORPUS_SIZE; ++i) {
+		del_apdu(&corpus[i].apdu);
+		free(corpus[i].buffer);
+	}
+}
+
+/* Benchmarked operations. arg is an index in corpus when relevant. */
+
+static void op_decode_apdu(int arg)
+{
+	ByteStreamReader stream;
+	APDU apdu;
+	int error = 0;
+
+	stream.buffer = stream.buffer_cur = corpus[arg].buffer;
+	stream.unread_bytes = corpus[arg].size;
+	decode_apdu(&stream, &apdu, &error);
+	del_apdu(&apdu);
+}
+
+static void op_encode_apdu(int arg)
+{
+	ByteStreamWriter *stream = byte_stream_writer_instance(
+					   corpus[arg].apdu.length + 4);
+
+	encode_apdu(stream, &corpus[arg].apdu);
+	del_byte_stream_writer(stream, 1);
+}
+
+static void op_decode_event(int arg)
+{
+	Any *info = corpus[arg].event_info;
+	ByteStreamReader stream;
+	int error = 0;
+
+	stream.buffer = stream.buffer_cur = info->value;
+	stream.unread_bytes = info->length;
+
+	switch (arg) {
+	case CONFIG:
+	case RTSA_CONFIG: {
+		ConfigReport config;
+		decode_configreport(&stream, &config, &error);
+		del_configreport(&config);
+		break;
+	}
+	case SCAN_FIXED:
+	case RTSA_FIXED: {
+		ScanReportInfoFixed report;
+		decode_scanreportinfofixed(&stream, &report, &error);
+		del_scanreportinfofixed(&report);
+		break;
+	}
+	case SCAN_VAR: {
+		ScanReportInfoVar report;
+		decode_scanreportinfovar(&stream, &report, &error);
+		del_scanreportinfovar(&report);
+		break;
+	}
+	case SCAN_GROUPED: {
+		ScanReportInfoGrouped report;
+		decode_scanreportinfogrouped(&stream, &report, &error);
+		del_scanreportinfogrouped(&report);
+		break;
+	}
+	case SEGMENT_DATA: {
+		SegmentDataEvent event;
+		decode_segmentdataevent(&stream, &event, &error);
+		del_segmentdataevent(&event);
+		break;
+	}
+	}
+}
+
+static void op_read_float(int arg)
+{
+	ByteStreamReader stream;
+	int error = 0;
+
+	stream.buffer = stream.buffer_cur = float_buffer;
+	stream.unread_bytes = sizeof(float_buffer);
+	read_float(&stream, &error);
+}
+
+static void op_read_sfloat(int arg)
+{
+	ByteStreamReader stream;
+	int error = 0;
+
+	stream.buffer = stream.buffer_cur = sfloat_buffer;
+	stream.unread_bytes = sizeof(sfloat_buffer);
+	read_sfloat(&stream, &error);
+}
+
+static void op_write_float(int arg)
+{
+	intu8 buffer[4];
+	ByteStreamWriter stream = {0, buffer, sizeof(buffer), 0};
+
+	write_float(&stream, 98.6);
+}
+
+static void op_write_sfloat(int arg)
+{
+	intu8 buffer[2];
+	ByteStreamWriter stream = {0, buffer, sizeof(buffer), 0};
+
+	write_sfloat(&stream, 72.5);
+}
+
+static void op_update_fixed(int arg)
+{
+	ScanReportInfoFixed *report = arg == RTSA_FIXED ? &rtsa_fixed
+				      : &scan_fixed;
+	MDS *mds = arg == RTSA_FIXED ? rtsa_ctx->mds : pulse_ctx->mds;
+	DataList *list = data_list_new(report->obs_scan_fixed.count);
+	int i;
+
+	for (i = 0; i < report->obs_scan_fixed.count; ++i)
+		dimutil_update_mds_from_obs_scan_fixed(mds,
+				&report->obs_scan_fixed.value[i],
+				&list->values[i]);
+
+	data_list_del(list);
+}
+
+static void op_update_var(int arg)
+{
+	DataList *list = data_list_new(scan_var.obs_scan_var.count);
+	int i;
+
+	for (i = 0; i < scan_var.obs_scan_var.count; ++i)
+		dimutil_update_mds_from_obs_scan(pulse_ctx->mds,
+						 &scan_var.obs_scan_var.value[i],
+						 &list->values[i]);
+
+	data_list_del(list);
+}
+
+static void op_update_grouped(int arg)
+{
+	HandleAttrValMap *map = grouped_map();
+	int i, j;
+
+	for (i = 0; i < scan_grouped.obs_scan_grouped.count; ++i) {
+		ObservationScanGrouped *data =
+			&scan_grouped.obs_scan_grouped.value[i];
+		ByteStreamReader stream;
+		DataList *list = data_list_new(map->count);
+
+		stream.buffer = stream.buffer_cur = data->value;
+		stream.unread_bytes = data->length;
+
+		for (j = 0; j < map->count; ++j)
+			dimutil_update_mds_from_grouped_observations(
+				pulse_ctx->mds, &stream, &map->value[j],
+				&list->values[j]);
+
+		data_list_del(list);
+	}
+}
+
+static void op_xml_measurement(int arg)
+{
+	free(xml_encode_data_list(measurement_list));
+}
+
+static void op_json_measurement(int arg)
+{
+	free(json_encode_data_list(measurement_list));
+}
+
+static void op_xml_configuration(int arg)
+{
+	free(xml_encode_data_list(configuration_list));
+}
+
+static void op_json_configuration(int arg)
+{
+	free(json_encode_data_list(configuration_list));
+}
+
+typedef struct {
+	const char *name;
+	void (*op)(int arg);
+	int arg;
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+	{"decode_apdu/aarq", op_decode_apdu, AARQ},
+	{"decode_apdu/config_report", op_decode_apdu, CONFIG},
+	{"decode_apdu/scan_report_fixed", op_decode_apdu, SCAN_FIXED},
+	{"decode_apdu/scan_report_var", op_decode_apdu, SCAN_VAR},
+	{"decode_apdu/scan_report_grouped", op_decode_apdu, SCAN_GROUPED},
+	{"decode_apdu/rtsa_scan_report_fixed", op_decode_apdu, RTSA_FIXED},
+	{"decode_apdu/segment_data_event", op_decode_apdu, SEGMENT_DATA},
+	{"encode_apdu/aarq", op_encode_apdu, AARQ},
+	{"encode_apdu/config_report", op_encode_apdu, CONFIG},
+	{"encode_apdu/scan_report_fixed", op_encode_apdu, SCAN_FIXED},
+	{"encode_apdu/scan_report_var", op_encode_apdu, SCAN_VAR},
+	{"encode_apdu/scan_report_grouped", op_encode_apdu, SCAN_GROUPED},
+	{"encode_apdu/rtsa_scan_report_fixed", op_encode_apdu, RTSA_FIXED},
+	{"encode_apdu/segment_data_event", op_encode_apdu, SEGMENT_DATA},
+	{"decode_event/config_report", op_decode_event, CONFIG},
+	{"decode_event/rtsa_config_report", op_decode_event, RTSA_CONFIG},
+	{"decode_event/scan_report_fixed", op_decode_event, SCAN_FIXED},
+	{"decode_event/scan_report_var", op_decode_event, SCAN_VAR},
+	{"decode_event/scan_report_grouped", op_decode_event, SCAN_GROUPED},
+	{"decode_event/rtsa_scan_report_fixed", op_decode_event, RTSA_FIXED},
+	{"decode_event/segment_data_event", op_decode_event, SEGMENT_DATA},
+	{"mder/read_float", op_read_float, 0},
+	{"mder/read_sfloat", op_read_sfloat, 0},
+	{"mder/write_float", op_write_float, 0},
+	{"mder/write_sfloat", op_write_sfloat, 0},
+	{"dimutil/update_mds_from_obs_scan_fixed", op_update_fixed, SCAN_FIXED},
+	{"dimutil/update_mds_from_obs_scan_fixed_rtsa", op_update_fixed, RTSA_FIXED},
+	{"dimutil/update_mds_from_obs_scan", op_update_var, SCAN_VAR},
+	{"dimutil/update_mds_from_grouped_observations", op_update_grouped,
+	 SCAN_GROUPED},
+	{"xml_encode_data_list/measurement", op_xml_measurement, 0},
+	{"xml_encode_data_list/configuration", op_xml_configuration, 0},
+	{"json_encode_data_list/measurement", op_json_measurement, 0},
+	{"json_encode_data_list/configuration", op_json_configuration, 0},
+	{NULL, NULL, 0}
+};
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const Benchmark *bench)
+{
+	unsigned long iterations = fixed_iterations ? fixed_iterations : 16;
+	unsigned long long count, bytes;
+	double start, elapsed;
+	unsigned long i;
+
+	/* warm up, and let lazily initialized state settle */
+	for (i = 0; i < 16; ++i)
+		bench->op(bench->arg);
+
+	for (;;) {
+		count = alloc_count;
+		bytes = alloc_bytes;
+		start = now();
+
+		for (i = 0; i < iterations; ++i)
+			bench->op(bench->arg);
+
+		elapsed = now() - start;
+		count = alloc_count - count;
+		bytes = alloc_bytes - bytes;
+
+		if (fixed_iterations || elapsed >= min_time)
+			break;
+
+		iterations *= elapsed > 0 ? 1.2 * min_time / elapsed : 16;
+
+		if (iterations > 1000000000UL)
+			iterations = 1000000000UL;
+	}
+
+	printf("{\"benchmark\": \"%s\", \"iterations\": %lu, "
+	       "\"ns_per_op\": %.1f, ", bench->name, iterations,
+	       elapsed * 1e9 / iterations);
+
+	if (ALLOC_COUNTING)
+		printf("\"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}\n",
+		       (double) count / iterations, (double) bytes / iterations);
+	else
+		printf("\"allocs_per_op\": -1, \"bytes_per_op\": -1}\n");
+
+	fflush(stdout);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-d corpus_dir] [-t min_ms] "
+		"[-n iterations] [filter]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "tests/resources/apdu";
+	const char *filter = NULL;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "d:t:n:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 't':
+			min_time = atoi(optarg) / 1000.0;
+			break;
+		case 'n':
+			fixed_iterations = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind < argc)
+		filter = argv[optind];
+
+	if (!load_corpus(dir))
+		return 1;
+
+	setup();
+
+	for (i = 0; benchmarks[i].name; ++i) {
+		if (filter && !strstr(benchmarks[i].name, filter))
+			continue;
+
+		run(&benchmarks[i]);
+	}
+
+	cleanup();
+
+	return 0;
+}
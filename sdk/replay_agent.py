@@ -1,13 +1,14 @@
 #!/usr/bin/env python
 
-# This script takes a dump generated by uncommenting APDU_DUMP in
-# src/communication/communication.c, and replays it against a TCP/IP manager,
-# playing the Agent role.
+# This script takes a dump in one of the formats below and replays it
+# against a TCP/IP manager, playing the Agent role. Captures made by
+# apdu_capture_start() (healthd --capture=FILE) are replayed by
+# apps/ieee_replay instead.
 #
 # It accepts two dump formats, they can even be intermixed in the same
 # file.
 #
-# APDU_DUMP: Each APDU begins with "send" or "recv" then one space,
+# Raw dump: Each APDU begins with "send" or "recv" then one space,
 # then binary data, then \n. It is semi-editable using a editor that can cope
 # with binary files e.g. vi. The final \n helps humans to see APDU boundaries.
 # Because this format uses APDU length to find boundaries, it does not support
@@ -52,6 +52,7 @@
 #include "src/communication/communication.h"
 #include "src/communication/configuring.h"
 #include "src/communication/stdconfigurations.h"
+#include "src/communication/stats.h"
 #include "src/specializations/blood_pressure_monitor.h"
 #include "src/specializations/pulse_oximeter.h"
 #include "src/specializations/weighing_scale.h"
@@ -144,8 +145,9 @@ void agent_init(CommunicationPlugin **plugins, int config,
 
 	// Listen to all communication state transitions
 	communication_add_state_transition_listener(fsm_state_size, &agent_handle_transition_evt);
-	communication_set_connection_listeners(&agent_notify_evt_device_connected,
-						&agent_notify_evt_device_disconnected);
+	communication_set_context_connection_listeners(AGENT_CONTEXT,
+					&agent_notify_evt_device_connected,
+					&agent_notify_evt_device_disconnected);
 
 	// Register standard configurations for each specialization.
 	std_configurations_register_conf(
@@ -238,6 +240,7 @@ int agent_notify_evt_device_associated(Context *ctx)
 {
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
 
 	for (i = 0; i < agent_listener_count; i++) {
 		AgentListener *l = &agent_listener_list[i];
@@ -248,6 +251,8 @@ int agent_notify_evt_device_associated(Context *ctx)
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	return ret_val;
 }
 
@@ -264,6 +269,7 @@ int agent_notify_evt_device_connected(Context *ctx, const char *addr)
 {
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
 
 	for (i = 0; i < agent_listener_count; i++) {
 		AgentListener *l = &agent_listener_list[i];
@@ -274,6 +280,8 @@ int agent_notify_evt_device_connected(Context *ctx, const char *addr)
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	return ret_val;
 }
 
@@ -290,6 +298,7 @@ int agent_notify_evt_device_disconnected(Context *ctx, const char *addr)
 {
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
 
 	for (i = 0; i < agent_listener_count; i++) {
 		AgentListener *l = &agent_listener_list[i];
@@ -300,6 +309,8 @@ int agent_notify_evt_device_disconnected(Context *ctx, const char *addr)
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	return ret_val;
 }
 
@@ -315,6 +326,7 @@ int agent_notify_evt_device_unavailable(Context *ctx)
 {
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
 
 	for (i = 0; i < agent_listener_count; i++) {
 		AgentListener *l = &agent_listener_list[i];
@@ -325,6 +337,8 @@ int agent_notify_evt_device_unavailable(Context *ctx)
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	return ret_val;
 }
 
@@ -341,6 +355,7 @@ int agent_notify_evt_timeout(Context *ctx)
 {
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
 
 	for (i = 0; i < agent_listener_count; i++) {
 		AgentListener *l = &agent_listener_list[i];
@@ -351,6 +366,8 @@ int agent_notify_evt_timeout(Context *ctx)
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	return ret_val;
 }
 
@@ -440,6 +457,11 @@ void agent_request_association_abort(ContextId id)
  */
 void agent_handle_transition_evt(Context *ctx, fsm_states previous, fsm_states next)
 {
+	if (!(ctx->type & AGENT_CONTEXT)) {
+		// manager context in the same process
+		return;
+	}
+
 	DEBUG("agent: handling transition event");
 
 	if (previous == fsm_state_operating && next != previous) {
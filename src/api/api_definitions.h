@@ -126,6 +126,10 @@ typedef struct DataEntry {
 typedef struct DataList {
 	int size;
 	DataEntry *values;
+	/**
+	 * References held besides the first one, see data_list_ref()
+	 */
+	int refs;
 } DataList;
 
 /** @} */
@@ -1240,7 +1240,8 @@ DataList *data_list_new(int size)
 }
 
 /**
- * Deletes all elements of the list. It also deletes the list.
+ * Drops a reference to the list. When it was the last one, deletes
+ * all elements of the list, and the list itself.
  *
  * @param pointer the list of elements to be deleted.
  */
@@ -1249,6 +1250,10 @@ void data_list_del(DataList *pointer)
 	if (pointer) {
 		int i = 0;
 
+		if (__atomic_fetch_sub(&pointer->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+			return;
+		}
+
 		for (i = 0; i < pointer->size; i++) {
 			data_entry_del(&pointer->values[i]);
 		}
@@ -1261,4 +1266,99 @@ void data_list_del(DataList *pointer)
 	}
 }
 
+/**
+ * Takes another reference to a list, e.g. to keep data handed to a
+ * listener after the callback returns, or to share it with other
+ * threads, without copying it. Each reference is dropped with
+ * data_list_del(); references may be dropped from any thread.
+ * A shared list must not be modified.
+ *
+ * @param list the list, may be NULL.
+ * @return the same list.
+ */
+DataList *data_list_ref(DataList *list)
+{
+	if (list) {
+		__atomic_fetch_add(&list->refs, 1, __ATOMIC_RELAXED);
+	}
+
+	return list;
+}
+
+/**
+ * Duplicates a string that may be NULL.
+ */
+static char *data_strcp_null(const char *str)
+{
+	return str ? data_strcp(str) : NULL;
+}
+
+/**
+ * Copies a data entry and all of its children into dest.
+ *
+ * @param dest destination entry (previous contents are not freed)
+ * @param src the entry to be copied.
+ */
+void data_entry_copy(DataEntry *dest, const DataEntry *src)
+{
+	int i;
+
+	*dest = *src;
+
+	if (src->meta_data.values != NULL && src->meta_data.size > 0) {
+		dest->meta_data.values = calloc(src->meta_data.size,
+						sizeof(MetaAtt));
+
+		for (i = 0; i < src->meta_data.size; i++) {
+			MetaAtt *meta = &src->meta_data.values[i];
+			dest->meta_data.values[i].name = data_strcp_null(meta->name);
+			dest->meta_data.values[i].value = data_strcp_null(meta->value);
+		}
+	} else {
+		dest->meta_data.values = NULL;
+	}
+
+	if (src->choice == SIMPLE_DATA_ENTRY) {
+		// type is always a static string
+		dest->u.simple.name = data_strcp_null(src->u.simple.name);
+		dest->u.simple.value = data_strcp_null(src->u.simple.value);
+	} else if (src->choice == COMPOUND_DATA_ENTRY) {
+		const CompoundDataEntry *c = &src->u.compound;
+		dest->u.compound.name = data_strcp_null(c->name);
+		dest->u.compound.entries = NULL;
+
+		if (c->entries_count > 0 && c->entries != NULL) {
+			dest->u.compound.entries = calloc(c->entries_count,
+							sizeof(DataEntry));
+			for (i = 0; i < c->entries_count; i++) {
+				data_entry_copy(&dest->u.compound.entries[i],
+						&c->entries[i]);
+			}
+		}
+	}
+}
+
+/**
+ * Creates a deep copy of a list of elements, e.g. to modify data
+ * handed to a listener. Use data_list_ref() to just keep it.
+ *
+ * @param list the list to be copied.
+ * @return a new list, to be deleted with data_list_del().
+ */
+DataList *data_list_clone(const DataList *list)
+{
+	int i;
+
+	if (list == NULL)
+		return NULL;
+
+	DataList *copy = data_list_new(list->size);
+
+	for (i = 0; i < list->size; i++) {
+		data_entry_copy(&copy->values[i], &list->values[i]);
+	}
+
+	return copy;
+}
+
 /** @} */
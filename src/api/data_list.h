@@ -35,5 +35,8 @@
 void data_entry_del(DataEntry *pointer);
 DataList *data_list_new(int size);
 void data_list_del(DataList *pointer);
+DataList *data_list_ref(DataList *list);
+void data_entry_copy(DataEntry *dest, const DataEntry *src);
+DataList *data_list_clone(const DataList *list);
 
 #endif /* DATA_LIST_H_ */
@@ -241,6 +241,8 @@ int association_accept_data_protocol_20601_in(Context *ctx,
 {
 	FSMEventData evt;
 	FSMEventData *evtp = NULL;
+	MDS *mds = NULL;
+	int known = 0;
 
 	if (! trans) {
 		// transcoded events don't need apdu responses
@@ -263,9 +265,35 @@ int association_accept_data_protocol_20601_in(Context *ctx,
 
 	if (ctx->mds != NULL) {
 		mds_destroy(ctx->mds);
+		ctx->mds = NULL;
 	}
 
-	MDS *mds = mds_create();
+	if (! trans) {
+		known = association_check_config_id(&agent_assoc_information);
+	}
+
+	if (known) {
+		// objects of a device seen moments ago are still in place
+		mds = mds_cache_take(&agent_assoc_information.system_id,
+				     agent_assoc_information.dev_config_id);
+	}
+
+	if (mds) {
+		ctx->mds = mds;
+		mds->data_req_mode_capab = agent_assoc_information.data_req_mode_capab;
+
+		DEBUG("associating: reusing warm MDS");
+
+		evt.u.association_result = ACCEPTED;
+		communication_fire_evt(ctx,
+			       fsm_evt_rx_aarq_acceptable_and_known_configuration,
+			       evtp);
+		mds_resume_operating(ctx, 1);
+
+		return 2;
+	}
+
+	mds = mds_create();
 	ctx->mds = mds;
 
 	mds->dev_configuration_id = agent_assoc_information.dev_config_id;
@@ -281,7 +309,7 @@ int association_accept_data_protocol_20601_in(Context *ctx,
 		       mds->system_id.length * sizeof(intu8));
 	}
 
-	if ((! trans) && association_check_config_id(&agent_assoc_information)) {
+	if (known) {
 		// Configuration known
 		ConfigId id = agent_assoc_information.dev_config_id;
 		ConfigObjectList *config;
@@ -48,17 +48,15 @@
 #include "src/communication/disassociating.h"
 #include "src/communication/plugin/plugin.h"
 #include "src/communication/service.h"
+#include "src/communication/stats.h"
+#include "src/communication/trace.h"
+#include "src/dim/mds.h"
 #include "src/util/bytelib.h"
 #include "src/communication/parser/encoder_ASN1.h"
 #include "src/communication/parser/decoder_ASN1.h"
 #include "src/communication/parser/struct_cleaner.h"
 #include "src/util/log.h"
-
-// #define APDU_DUMP
-
-#ifdef APDU_DUMP
-#include <util/ioutil.h>
-#endif
+#include "src/util/apdu_capture.h"
 
 /**
  * Represents the network layer status
@@ -80,6 +78,20 @@ static communication_network_status network_status;
 static unsigned int plugin_count = 0;
 static CommunicationPlugin **comm_plugins = NULL;
 
+/**
+ * Whether the network of each plugin is started, indexed like
+ * comm_plugins
+ */
+static int *plugin_started = NULL;
+
+/**
+ * GIL functions, taken from the first plugin added (in a multithreaded
+ * environment, all plugins must implement thread locking). Kept apart
+ * so the GIL survives the removal of that plugin.
+ */
+static thread_lock_ptr gil_lock_fn = NULL;
+static thread_unlock_ptr gil_unlock_fn = NULL;
+
 // TODO use LinkedList
 
 /**
@@ -139,14 +151,25 @@ static StateTransitionListener *state_transition_listener_list = NULL;
 static int state_transition_listener_size = 0;
 
 /**
- * Connection listener
+ * Connection listeners, for manager and agent contexts
  */
-static comm_conn_cb connection_listener = NULL;
+static comm_conn_cb connection_listener[2] = {NULL, NULL};
 
 /**
- * Disconnection listener
+ * Disconnection listeners, for manager and agent contexts
  */
-static comm_disconn_cb disconnection_listener = NULL;
+static comm_disconn_cb disconnection_listener[2] = {NULL, NULL};
+
+/**
+ * Listeners of contexts destroyed together, for manager and agent
+ * contexts
+ */
+static comm_teardown_cb teardown_listener[2] = {NULL, NULL};
+
+/**
+ * Index of listeners of a context type
+ */
+#define LISTENER_INDEX(type) (((type) & AGENT_CONTEXT) ? 1 : 0)
 
 static int communication_fire_transport_disconnect_evt(Context *ctx);
 
@@ -187,6 +210,44 @@ void communication_add_plugin(CommunicationPlugin *plugin)
 	}
 
 	comm_plugins[plugin_count] = plugin;
+
+	plugin_started = realloc(plugin_started,
+				 sizeof(int) * (plugin_count + 1));
+	plugin_started[plugin_count] = 0;
+
+	// room for its contexts, so that lookups never grow the table
+	context_set_plugin_lock(plugin_count, NULL);
+
+	if (plugin_count == 1) {
+		gil_lock_fn = plugin->thread_lock;
+		gil_unlock_fn = plugin->thread_unlock;
+	}
+}
+
+/**
+ * Removes a communication plugin: stops its network, destroys its
+ * contexts and clears it. Its id is not reused.
+ *
+ * This method should be invoked in a thread safe execution.
+ *
+ * @param plugin Communication plugin
+ */
+void communication_remove_plugin(CommunicationPlugin *plugin)
+{
+	unsigned int id = communication_plugin_id(plugin);
+
+	if (!id) {
+		return;
+	}
+
+	communication_plugin_network_stop(plugin);
+	context_remove_plugin(id);
+	// the plugin finalizes thread state of its contexts
+	context_reclaim();
+
+	communication_plugin_clear(plugin);
+	plugin->owner = NULL;
+	comm_plugins[id] = NULL;
 }
 
 /**
@@ -265,9 +326,15 @@ void communication_finalize()
 	if (communication_is_network_started()) {
 		for (i = 1; i <= plugin_count; ++i) {
 			CommunicationPlugin *comm_plugin = comm_plugins[i];
+
+			if (!comm_plugin || !plugin_started[i])
+				continue;
+
 			if (comm_plugin->network_finalize() != NETWORK_ERROR_NONE) {
 				DEBUG("Trouble finalizing plugin %d", i);
 			}
+
+			plugin_started[i] = 0;
 		}
 
 		network_status = NETWORK_STATUS_NOT_INITIALIZED;
@@ -281,13 +348,22 @@ void communication_finalize()
 
 	for (i = 1; i <= plugin_count; ++i) {
 		CommunicationPlugin *comm_plugin = comm_plugins[i];
-		communication_plugin_clear(comm_plugin);
+
+		if (comm_plugin) {
+			communication_plugin_clear(comm_plugin);
+			comm_plugin->owner = NULL;
+		}
+
 		comm_plugins[i] = NULL;
 	}
 
 	free(comm_plugins);
 	comm_plugins = NULL;
+	free(plugin_started);
+	plugin_started = NULL;
 	plugin_count = 0;
+	gil_lock_fn = NULL;
+	gil_unlock_fn = NULL;
 
 	trans_finalize();
 }
@@ -307,6 +383,15 @@ int communication_add_state_transition_listener(
 {
 
 	int size = state_transition_listener_size;
+	int i;
+
+	// every manager instance asks for the same listeners
+	for (i = 0; i < size; ++i) {
+		if (state_transition_listener_list[i].state == state &&
+		    state_transition_listener_list[i].handler == listener_function) {
+			return 1;
+		}
+	}
 
 	// test if there is not elements in the list
 	if (size == 0) {
@@ -348,15 +433,94 @@ void communication_remove_all_state_transition_listeners()
 }
 
 
+/**
+ * Sets listeners of connection and disconnection of every context
+ *
+ * @param cf connection listener
+ * @param df disconnection listener
+ */
 void communication_set_connection_listeners(comm_conn_cb cf, comm_disconn_cb df)
 {
-	connection_listener = cf;
-	disconnection_listener = df;
+	communication_set_context_connection_listeners(MANAGER_CONTEXT, cf, df);
+	communication_set_context_connection_listeners(AGENT_CONTEXT, cf, df);
+}
+
+/**
+ * Sets listeners of connection and disconnection of contexts of one
+ * type, so manager and agent may live in the same process
+ *
+ * @param type MANAGER_CONTEXT or AGENT_CONTEXT
+ * @param cf connection listener
+ * @param df disconnection listener
+ */
+void communication_set_context_connection_listeners(int type, comm_conn_cb cf,
+						    comm_disconn_cb df)
+{
+	connection_listener[LISTENER_INDEX(type)] = cf;
+	disconnection_listener[LISTENER_INDEX(type)] = df;
+}
+
+/**
+ * Sets the listener told about contexts of one type destroyed
+ * together, when teardown is deferred (see
+ * communication_set_deferred_teardown()). It is called without locks,
+ * from the thread that reclaims, with the ids of the contexts; some
+ * may already be connected again.
+ *
+ * @param type MANAGER_CONTEXT or AGENT_CONTEXT
+ * @param tf teardown listener
+ */
+void communication_set_context_teardown_listener(int type,
+						 comm_teardown_cb tf)
+{
+	teardown_listener[LISTENER_INDEX(type)] = tf;
 }
 
 void communication_remove_connection_listeners()
 {
-	connection_listener = disconnection_listener = NULL;
+	communication_set_connection_listeners(NULL, NULL);
+	communication_set_context_teardown_listener(MANAGER_CONTEXT, NULL);
+	communication_set_context_teardown_listener(AGENT_CONTEXT, NULL);
+}
+
+/**
+ * Tells the teardown listener of a context type about reclaimed
+ * contexts
+ *
+ * @param type context type
+ * @param ids context ids
+ * @param count number of ids
+ */
+void communication_notify_teardown(int type, ContextId *ids, int count)
+{
+	comm_teardown_cb tf = teardown_listener[LISTENER_INDEX(type)];
+
+	if (tf && ids && count > 0) {
+		tf(ids, count);
+	}
+}
+
+/**
+ * Starts the network of one plugin.
+ *
+ * This method should be invoked in a thread safe execution.
+ *
+ * @param plugin Communication plugin, already added
+ */
+void communication_plugin_network_start(CommunicationPlugin *plugin)
+{
+	unsigned int i = communication_plugin_id(plugin);
+
+	if (!i || plugin_started[i]) {
+		return;
+	}
+
+	if (plugin->network_init(i) != NETWORK_ERROR_NONE) {
+		ERROR(" Cannot initialize plugin %d", i);
+	}
+
+	plugin_started[i] = 1;
+	network_status = NETWORK_STATUS_INITIALIZED;
 }
 
 /**
@@ -371,11 +535,8 @@ void communication_network_start()
 		unsigned int i;
 
 		for (i = 1; i <= plugin_count; ++i) {
-			CommunicationPlugin *comm_plugin = comm_plugins[i];
-			int ret_code = comm_plugin->network_init(i);
-
-			if (ret_code != NETWORK_ERROR_NONE) {
-				ERROR(" Cannot initialize plugin %d", i);
+			if (comm_plugins[i]) {
+				communication_plugin_network_start(comm_plugins[i]);
 			}
 		}
 
@@ -386,6 +547,112 @@ void communication_network_start()
 	}
 }
 
+/**
+ * Set when the application runs the stack in a single thread, see
+ * communication_set_single_thread()
+ */
+#ifndef SINGLE_THREAD
+int communication_single_thread = 0;
+#endif
+
+/**
+ * Declares that the stack runs in a single thread, e.g. the one of
+ * a main loop, so the GIL and context locks are not taken at all.
+ * Plugins must not run threads of their own that call into the
+ * stack; those based on plugin_pthread do.
+ *
+ * Must be called before the network is started. A library built
+ * with --enable-single-thread is always single-threaded, and locking
+ * is compiled out.
+ *
+ * @param enabled 1 for single-threaded
+ * @return 1 if the mode is now the one asked for, 0 if not
+ */
+int communication_set_single_thread(int enabled)
+{
+#ifdef SINGLE_THREAD
+	return enabled != 0;
+#else
+	if (communication_is_network_started()) {
+		ERROR("Threading mode must be set before network start");
+		return (communication_single_thread != 0) == (enabled != 0);
+	}
+
+	communication_single_thread = enabled ? 1 : 0;
+	return 1;
+#endif
+}
+
+/**
+ * Defers destruction of contexts, so that a mass disconnection does
+ * not tear down thousands of contexts one by one in the threads that
+ * see them go. Contexts leave the context lists (and the latest value
+ * cache) at once, as usual, but their state is destroyed in batches:
+ * when batch contexts are waiting, or when communication_reclaim() is
+ * called. Teardown listeners are then told about the whole batch.
+ *
+ * A full batch is destroyed by the reclaimer thread, if started with
+ * communication_start_reclaimer(). Otherwise the disconnecting thread
+ * that queues the batch-th context does it, stalling its transport;
+ * to avoid that, start the reclaimer, or use a batch larger than any
+ * expected disconnection burst and call communication_reclaim()
+ * periodically from one thread of the application.
+ *
+ * @param batch number of waiting contexts that triggers a reclaim,
+ *        0 (the default) to destroy contexts as soon as they go away
+ */
+void communication_set_deferred_teardown(unsigned int batch)
+{
+	context_set_deferred_destroy(batch);
+}
+
+/**
+ * Tells whether teardown of contexts is deferred (see
+ * communication_set_deferred_teardown()).
+ *
+ * @return 1 if deferred, 0 if not
+ */
+int communication_is_teardown_deferred()
+{
+	return context_is_destroy_deferred();
+}
+
+/**
+ * Destroys the contexts waiting for deferred teardown. May be called
+ * from any thread that holds no context lock; it waits for a reclaim
+ * already running in another thread.
+ *
+ * @return number of contexts destroyed
+ */
+unsigned int communication_reclaim()
+{
+	return context_reclaim();
+}
+
+/**
+ * Starts a thread that destroys the contexts waiting for deferred
+ * teardown, instead of the disconnecting threads. It runs when a batch
+ * is waiting and every interval milliseconds. Teardown listeners are
+ * called from it.
+ *
+ * @param interval milliseconds between reclaims, 0 to reclaim only
+ *        full batches
+ * @return 1 if started, 0 if already running or on error
+ */
+int communication_start_reclaimer(unsigned int interval)
+{
+	return context_start_reclaimer(interval);
+}
+
+/**
+ * Stops the reclaimer thread. Contexts still waiting are destroyed by
+ * the next communication_reclaim(), or by the disconnecting threads.
+ */
+void communication_stop_reclaimer()
+{
+	context_stop_reclaimer();
+}
+
 /**
  * Check if network layer is running
  * @return 1 if true, 0 if not
@@ -412,6 +679,39 @@ static int communication_fire_transport_disconnect_evt(Context *ctx)
 
 	return 1;
 }
+/**
+ * Stops the network of one plugin, and disconnects its contexts.
+ *
+ * This method should be invoked in a thread safe execution.
+ *
+ * @param plugin Communication plugin
+ */
+void communication_plugin_network_stop(CommunicationPlugin *plugin)
+{
+	unsigned int i = communication_plugin_id(plugin);
+	unsigned int j;
+
+	if (!i || !plugin_started[i]) {
+		return;
+	}
+
+	if (plugin->network_finalize() != NETWORK_ERROR_NONE) {
+		DEBUG("Trouble finalizing plugin %d", i);
+	}
+
+	plugin_started[i] = 0;
+	network_status = NETWORK_STATUS_NOT_INITIALIZED;
+
+	for (j = 1; j <= plugin_count; ++j) {
+		if (plugin_started[j]) {
+			network_status = NETWORK_STATUS_INITIALIZED;
+			break;
+		}
+	}
+
+	context_iterate_plugin(i, &communication_fire_transport_disconnect_evt);
+}
+
 /**
  * Stops network layer.
  *
@@ -428,9 +728,15 @@ int communication_network_stop()
 
 	for (i = 1; i <= plugin_count; ++i) {
 		CommunicationPlugin *comm_plugin = comm_plugins[i];
+
+		if (!comm_plugin || !plugin_started[i])
+			continue;
+
 		if (comm_plugin->network_finalize() != NETWORK_ERROR_NONE) {
 			DEBUG("Trouble finalizing plugin %d", i);
 		}
+
+		plugin_started[i] = 0;
 	}
 
 	network_status = NETWORK_STATUS_NOT_INITIALIZED;
@@ -458,6 +764,10 @@ Context *communication_transport_connect_indication(ContextId id, const char *ad
 
 	Context *ctx = context_create(id, comm_plugin->type);
 
+	if (ctx != NULL) {
+		stats_count_connection(ctx);
+	}
+
 	// thread-safe block - begin
 	comm_plugin->thread_init(ctx);
 	communication_lock(ctx);
@@ -467,8 +777,8 @@ Context *communication_transport_connect_indication(ContextId id, const char *ad
 				       NULL);
 	}
 
-	if (connection_listener)
-		connection_listener(ctx, addr);
+	if (ctx != NULL && connection_listener[LISTENER_INDEX(ctx->type)])
+		connection_listener[LISTENER_INDEX(ctx->type)](ctx, addr);
 
 	communication_unlock(ctx);
 	// thread-safe block - end
@@ -493,8 +803,8 @@ void communication_transport_disconnect_indication(ContextId id, const char *add
 
 	communication_fire_transport_disconnect_evt(ctx);
 
-	if (disconnection_listener)
-		disconnection_listener(ctx, addr);
+	if (disconnection_listener[LISTENER_INDEX(ctx->type)])
+		disconnection_listener[LISTENER_INDEX(ctx->type)](ctx, addr);
 
 	context_unlock(ctx);
 
@@ -504,19 +814,48 @@ void communication_transport_disconnect_indication(ContextId id, const char *add
 
 /**
  * Locks this connection context if communication runs with
- * multithread implementation
+ * multithread implementation. Not called from within the stack,
+ * which goes through the communication_lock() macro instead.
  *
  * @param ctx
  */
-void communication_lock(Context *ctx)
+void (communication_lock)(Context *ctx)
 {
-	CommunicationPlugin *comm_plugin =
-		communication_get_plugin(ctx->id.plugin);
+	(communication_lock_at)(ctx, __FILE__, __LINE__, __FUNCTION__);
+}
+
+/**
+ * Locks this connection context if communication runs with
+ * multithread implementation, accounting wait and hold time to
+ * the call site when lock profiling is on
+ *
+ * @param ctx
+ * @param file source file of the caller
+ * @param line source line of the caller
+ * @param function function of the caller
+ */
+void (communication_lock_at)(Context *ctx, const char *file, int line,
+			     const char *function)
+{
+	CommunicationPlugin *comm_plugin;
+	unsigned long long start;
+
+	if (communication_single_thread)
+		return;
+
+	comm_plugin = communication_get_plugin(ctx->id.plugin);
 
 	if (!comm_plugin)
 		return;
 
+	if (!__atomic_load_n(&stats_lock_profiling, __ATOMIC_RELAXED)) {
+		comm_plugin->thread_lock(ctx);
+		return;
+	}
+
+	start = stats_clock();
 	comm_plugin->thread_lock(ctx);
+	stats_lock_acquired(ctx, file, line, function, start);
 }
 
 /**
@@ -525,42 +864,69 @@ void communication_lock(Context *ctx)
  *
  * @param ctx
  */
-void communication_unlock(Context *ctx)
+void (communication_unlock)(Context *ctx)
 {
-	CommunicationPlugin *comm_plugin =
-		communication_get_plugin(ctx->id.plugin);
+	CommunicationPlugin *comm_plugin;
+
+	if (communication_single_thread)
+		return;
+
+	comm_plugin = communication_get_plugin(ctx->id.plugin);
 
 	if (!comm_plugin)
 		return;
 
+	stats_lock_released(ctx);
 	comm_plugin->thread_unlock(ctx);
 }
 
 /**
- * Locks global mutex
+ * Locks global mutex. Not called from within the stack, which goes
+ * through the gil_lock() macro instead.
  */
-void gil_lock()
+void (gil_lock)()
 {
-	if (plugin_count > 0) {
-		// gets the first plug-in (in a multithreaded
-		// environment, all plugins must implement 
-		// thread locking)
-		CommunicationPlugin *comm_plugin = comm_plugins[1];
-		comm_plugin->thread_lock(0);
+	(gil_lock_at)(__FILE__, __LINE__, __FUNCTION__);
+}
+
+/**
+ * Locks global mutex, accounting wait and hold time to the call site
+ * when lock profiling is on
+ *
+ * @param file source file of the caller
+ * @param line source line of the caller
+ * @param function function of the caller
+ */
+void (gil_lock_at)(const char *file, int line, const char *function)
+{
+	unsigned long long start;
+
+	if (communication_single_thread)
+		return;
+
+	if (gil_lock_fn) {
+		if (!__atomic_load_n(&stats_lock_profiling, __ATOMIC_RELAXED)) {
+			gil_lock_fn(0);
+			return;
+		}
+
+		start = stats_clock();
+		gil_lock_fn(0);
+		stats_lock_acquired(NULL, file, line, function, start);
 	}
 }
 
 /**
  * Unlocks global mutex
  */
-void gil_unlock()
+void (gil_unlock)()
 {
-	if (plugin_count > 0) {
-		// gets the first plug-in (in a multithreaded
-		// environment, all plugins must implement 
-		// thread locking)
-		CommunicationPlugin *comm_plugin = comm_plugins[1];
-		comm_plugin->thread_unlock(0);
+	if (communication_single_thread)
+		return;
+
+	if (gil_unlock_fn) {
+		stats_lock_released(NULL);
+		gil_unlock_fn(0);
 	}
 }
 
@@ -607,26 +973,54 @@ void communication_process_input_data(Context *ctx, ByteStreamReader *stream)
 			return;
 		}
 
-#ifdef APDU_DUMP
-		ioutil_buffer_to_file("apdu_dump", 5, (unsigned char *) "recv ", 1);
-		ioutil_buffer_to_file("apdu_dump", stream->unread_bytes, stream->buffer, 1);
-		ioutil_buffer_to_file("apdu_dump", 1, (unsigned char *) "\n", 1);
-#endif
+		apdu_capture_record(ctx->id.plugin, ctx->id.connid,
+				    APDU_CAPTURE_RECEIVED, stream->buffer,
+				    stream->unread_bytes);
+
+		intu32 bytes = stream->unread_bytes;
+		unsigned long long span_start = TRACE_BEGIN();
+		unsigned long long decode_start = stats_clock();
+
+		if (!ctx->scratch) {
+			ctx->scratch = arena_new(0);
+		}
 
-		// Decode the APDU
+		// Decode the APDU into the scratch arena
 		APDU apdu;
+		Arena *previous = decoder_set_arena(ctx->scratch);
 		decode_apdu(stream, &apdu, &error);
+		decoder_set_arena(previous);
+		TRACE_END(ctx, TRACE_DECODE, span_start, bytes, 0, 0);
+
 		if (error) {
+			// what was decoded before the error is in the arena
+			if (ctx->scratch) {
+				arena_reset(ctx->scratch);
+			}
+
+			stats_count_decode_error(ctx, bytes);
 			DEBUG("Invalid APDU, firing abort");
 			communication_fire_evt(ctx, fsm_evt_req_assoc_abort, NULL);
+			TRACE_END(ctx, TRACE_RECEIVE, span_start, bytes, 0, 0);
 			return;
 		}
 
+		stats_count_received(ctx, &apdu, bytes, decode_start);
+
+		if (apdu.choice == ABRT_CHOSEN) {
+			trace_abort(ctx, 1);
+		}
+
 		// Process APDU
 		communication_process_apdu(ctx, &apdu);
+		TRACE_END(ctx, TRACE_RECEIVE, span_start, bytes, 0, 0);
 
-		// Delete APDU
-		del_apdu(&apdu);
+		// Delete APDU, all at once if it is in the arena
+		if (ctx->scratch) {
+			arena_reset(ctx->scratch);
+		} else {
+			del_apdu(&apdu);
+		}
 
 		del_byte_stream_reader(stream, 1);
 	}
@@ -663,8 +1057,13 @@ void communication_fire_evt(Context *ctx, fsm_events evt, FSMEventData *data)
 	// thread safe state transition
 	FSM *fsm  = ctx->fsm;
 	fsm_states previous = fsm->state;
+	unsigned long long span_start = TRACE_BEGIN();
 
-	if (fsm_process_evt(ctx, evt, data) == FSM_PROCESS_EVT_RESULT_STATE_CHANGED) {
+	FSM_PROCESS_EVT_STATUS result = fsm_process_evt(ctx, evt, data);
+	TRACE_END(ctx, TRACE_FSM_EVENT, span_start, evt, previous, fsm->state);
+
+	if (result == FSM_PROCESS_EVT_RESULT_STATE_CHANGED) {
+		stats_count_transition(ctx, previous, fsm->state);
 		communication_notify_state_transition_evt(ctx, previous, fsm->state);
 	}
 
@@ -747,17 +1146,25 @@ static void communication_process_apdu_manager(Context *ctx, APDU *apdu)
  */
 void communication_process_apdu(Context *ctx, APDU *apdu)
 {
+	Arena *cleaner_previous;
+
 	// thread-safe block - start
 	communication_lock(ctx);
 
 	DEBUG(" communication: current sm(%s) ", fsm_get_current_state_name(ctx->fsm));
 
+	// attributes the APDU replaces may have been configured in the
+	// arena of the MDS
+	cleaner_previous = cleaner_set_arena(ctx->mds ? ctx->mds->arena : NULL);
+
 	if (ctx->type & AGENT_CONTEXT) {
 		communication_process_apdu_agent(ctx, apdu);
 	} else {
 		communication_process_apdu_manager(ctx, apdu);
 	}
 
+	cleaner_set_arena(cleaner_previous);
+
 	communication_unlock(ctx);
 	// thread-safe block - end
 }
@@ -783,20 +1190,30 @@ int communication_send_apdu(Context *ctx, APDU *apdu)
 
 	DEBUG(" communication: sending APDU ");
 
+	unsigned long long span_start = TRACE_BEGIN();
+
 	ByteStreamWriter *encoded_apdu = NULL;
 	encoded_apdu = byte_stream_writer_instance(apdu->length + 4/*apdu header*/);
 
 	encode_apdu(encoded_apdu, apdu);
+	TRACE_END(ctx, TRACE_ENCODE, span_start, encoded_apdu->size, 0, 0);
 
-#ifdef APDU_DUMP
-	ioutil_buffer_to_file("apdu_dump", 5, (unsigned char *) "send ", 1);
-	ioutil_buffer_to_file("apdu_dump", encoded_apdu->size, encoded_apdu->buffer, 1);
-	ioutil_buffer_to_file("apdu_dump", 1, (unsigned char *) "\n", 1);
-#endif
+	if (apdu->choice == ABRT_CHOSEN) {
+		trace_abort(ctx, 0);
+	}
+
+	apdu_capture_record(ctx->id.plugin, ctx->id.connid, APDU_CAPTURE_SENT,
+			    encoded_apdu->buffer, encoded_apdu->size);
 
 	// send encoded_apdu bytes
 	int return_val = comm_plugin->network_send_apdu_stream(ctx, encoded_apdu);
 
+	if (return_val == NETWORK_ERROR_NONE) {
+		stats_count_sent(ctx, apdu, encoded_apdu->size);
+	}
+
+	TRACE_END(ctx, TRACE_SEND, span_start, encoded_apdu->size, 0, 0);
+
 	del_byte_stream_writer(encoded_apdu, 1);
 
 	DEBUG(" communication: APDU sent ");
@@ -1059,11 +1476,16 @@ void communication_timeout(Context *ctx)
 	communication_lock(ctx);
 
 	if (ctx != NULL) {
+		unsigned long long span_start = TRACE_BEGIN();
+
+		stats_count_timeout(ctx);
 		communication_fire_evt(ctx, fsm_evt_ind_timeout, NULL);
 		if (ctx->type & MANAGER_CONTEXT)
 			manager_notify_evt_timeout(ctx);
 		else if (ctx->type & AGENT_CONTEXT)
 			agent_notify_evt_timeout(ctx);
+
+		TRACE_END(ctx, TRACE_TIMEOUT, span_start, 0, 0, 0);
 	}
 
 	communication_unlock(ctx);
@@ -1235,7 +1657,8 @@ void communication_connection_loop(Context *ctx)
 	// so we need so check it every loop, based on ID.
 
 	while ((ctx = context_get_and_lock(id))) {
-		if (!get_connection_loop_active(ctx)) {
+		// already locked, no need for get_connection_loop_active()
+		if (!ctx->connection_loop_active) {
 			context_unlock(ctx);
 			break;
 		}
@@ -50,9 +50,12 @@ typedef void (*communication_state_transition_handler_function)(Context *ctx, fs
 
 typedef int (*comm_conn_cb)(Context *ctx, const char *addr);
 typedef int (*comm_disconn_cb)(Context *ctx, const char *addr);
+typedef void (*comm_teardown_cb)(ContextId *ids, int count);
 
 void communication_add_plugin(CommunicationPlugin *plugin);
 
+void communication_remove_plugin(CommunicationPlugin *plugin);
+
 unsigned int communication_plugin_id(CommunicationPlugin *plugin);
 
 CommunicationPlugin *communication_get_plugin(unsigned int label);
@@ -70,6 +73,12 @@ int communication_add_state_transition_listener(
 
 void communication_set_connection_listeners(comm_conn_cb cf, comm_disconn_cb df);
 
+void communication_set_context_connection_listeners(int type, comm_conn_cb cf,
+						    comm_disconn_cb df);
+
+void communication_set_context_teardown_listener(int type,
+						 comm_teardown_cb tf);
+
 void communication_remove_connection_listeners();
 
 void communication_remove_all_state_transition_listeners();
@@ -80,6 +89,10 @@ int communication_is_network_started();
 
 int communication_network_stop();
 
+void communication_plugin_network_start(CommunicationPlugin *plugin);
+
+void communication_plugin_network_stop(CommunicationPlugin *plugin);
+
 
 Context *communication_transport_connect_indication(ContextId id, const char *addr);
 
@@ -88,6 +101,30 @@ void communication_transport_disconnect_indication(ContextId id, const char *add
 void gil_lock();
 void gil_unlock();
 
+void gil_lock_at(const char *file, int line, const char *function);
+
+/**
+ * Locks the GIL, telling the lock profiler where from
+ */
+#define gil_lock() gil_lock_at(__FILE__, __LINE__, __FUNCTION__)
+
+#ifdef SINGLE_THREAD
+#define gil_lock_at(file, line, function) ((void) 0)
+#define gil_unlock() ((void) 0)
+#endif
+
+int communication_set_single_thread(int enabled);
+
+void communication_set_deferred_teardown(unsigned int batch);
+
+int communication_is_teardown_deferred();
+
+unsigned int communication_reclaim();
+
+int communication_start_reclaimer(unsigned int interval);
+
+void communication_stop_reclaimer();
+
 int communication_wait_for_data_input(Context *ctx);
 
 void communication_read_input_stream(ContextId id);
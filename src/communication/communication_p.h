@@ -34,6 +34,32 @@
 void communication_lock(Context *ctx);
 void communication_unlock(Context *ctx);
 
+void communication_lock_at(Context *ctx, const char *file, int line,
+			   const char *function);
+
+void communication_notify_teardown(int type, ContextId *ids, int count);
+
+/**
+ * Locks a context, telling the lock profiler where from
+ */
+#define communication_lock(ctx) \
+	communication_lock_at((ctx), __FILE__, __LINE__, __FUNCTION__)
+
+#ifdef SINGLE_THREAD
+
+/**
+ * Built single-threaded (--enable-single-thread): nothing is locked
+ */
+#define communication_single_thread 1
+#define communication_lock_at(ctx, file, line, function) ((void) (ctx))
+#define communication_unlock(ctx) ((void) (ctx))
+
+#else
+
+extern int communication_single_thread;
+
+#endif
+
 /**
  * @}
  */
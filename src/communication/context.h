@@ -32,6 +32,8 @@
 #ifndef CONTEXT_H_
 #define CONTEXT_H_
 
+#include <communication/stats.h>
+
 /**
  * \ingroup Communication
  * @{
@@ -55,6 +57,8 @@ typedef struct ContextId {
 
 struct MDS;
 struct Service;
+struct LatestValueIndex;
+struct Arena;
 struct Context;
 
 /**
@@ -133,6 +137,40 @@ typedef struct Context {
 	 */
 	int ref;
 
+	/**
+	 * Slots of latest value cache owned by this context
+	 */
+	struct LatestValueIndex *latest_values;
+
+	/**
+	 * Runtime counters of this context
+	 */
+	CommunicationStats stats;
+
+	/**
+	 * stats_clock() at transport connection, 0 once association
+	 * latency is recorded
+	 */
+	unsigned long long connect_time;
+
+	/**
+	 * stats_clock() at reception of an unknown configuration, 0 once
+	 * configuration latency is recorded
+	 */
+	unsigned long long config_time;
+
+	/**
+	 * Arena received APDUs are decoded into, reset after each one.
+	 * Its peak tells the most memory an APDU of this context took.
+	 */
+	struct Arena *scratch;
+
+	/**
+	 * Next context waiting to be destroyed, see
+	 * communication_set_deferred_teardown()
+	 */
+	struct Context *next_dead;
+
 } Context;
 
 #define MANAGER_CONTEXT 1
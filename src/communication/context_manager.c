@@ -43,15 +43,94 @@
 #include "src/communication/communication.h"
 #include "src/communication/communication_p.h"
 #include "src/dim/mds.h"
+#include "src/dim/latest_value.h"
+#include "src/communication/stats.h"
 #include "context_manager.h"
 #include "src/util/log.h"
+#include "src/util/arena.h"
 #include "src/util/linkedlist.h"
+#include "src/util/pool.h"
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
 
 /**
- * List of the context.
+ * Contexts of one plugin, and the lock that guards them
  */
-static LinkedList *context_list = NULL;
+typedef struct ContextList {
+	/**
+	 * Contexts, NULL until the first one is added
+	 */
+	LinkedList *contexts;
+
+	/**
+	 * Lock of the owner of the plugin, see context_set_plugin_lock()
+	 */
+	pthread_mutex_t *mutex;
+} ContextList;
+
+/**
+ * Lists of contexts, one per plugin id, so that finding a context
+ * only scans those of its transport, and contexts of a plugin (or
+ * of a manager instance) can be dropped together. The table grows
+ * when plugins are added, like the plugin registry; each list is
+ * protected by its own lock, never by the GIL.
+ */
+static ContextList *context_lists = NULL;
+
+/**
+ * Size of context_lists
+ */
+static unsigned int context_list_count = 0;
+
+/**
+ * Lock of the lists of plugins whose owner has none of its own
+ */
+static pthread_mutex_t shared_mutex;
+static pthread_once_t shared_mutex_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Released contexts, kept for reuse by new connections
+ */
+static ObjectPool context_pool = OBJECT_POOL_INIT(Context, 64);
+
+/**
+ * Contexts no longer referenced, waiting for context_reclaim(), linked
+ * through next_dead. Pushed one at a time and taken all at once, both
+ * without locks.
+ */
+static Context *dead_contexts = NULL;
+
+/**
+ * Number of contexts in dead_contexts
+ */
+static unsigned int dead_count = 0;
+
+/**
+ * Dead contexts that trigger a reclaim, 0 to destroy them at once
+ */
+static unsigned int deferred_batch = 0;
+
+/**
+ * Serializes context_reclaim() runs
+ */
+static pthread_mutex_t reclaim_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Reclaimer thread state, protected by reclaimer_mutex
+ */
+static pthread_mutex_t reclaimer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaimer_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t reclaimer_thread;
+static int reclaimer_running = 0;
+static int reclaimer_stop = 0;
+static int reclaimer_wake = 0;
+
+/**
+ * Milliseconds between periodic reclaims, 0 for none
+ */
+static unsigned int reclaimer_interval = 0;
 
 
 /**
@@ -74,26 +153,89 @@ static int destroy_context(Context *context)
 		}
 
 		if (context->mds != NULL) {
-			mds_destroy(context->mds);
+			// kept warm for a quick reassociation of the device
+			if (context->type & MANAGER_CONTEXT) {
+				mds_cache_put(context->mds);
+			} else {
+				mds_destroy(context->mds);
+			}
 			context->mds = NULL;
 		}
 
 		if (context->service != NULL) {
 			service_destroy(context->service);
 			context->service = NULL;
+			stats_sync_pending(context);
 		}
 
 		if (context->multithread != NULL) {
 			communication_finalize_thread_context(context);
 		}
 
-		free(context);
+		latest_value_remove_context(context);
+
+		arena_destroy(context->scratch);
+		context->scratch = NULL;
+
+		pool_free(&context_pool, context);
 	}
 
 	return 1;
 }
 
 
+/**
+ * @brief Wakes the reclaimer thread up, if it runs.
+ *
+ * @return 1 if the reclaimer thread will reclaim, 0 if there is none
+ */
+static int reclaimer_kick()
+{
+	int running;
+
+	if (!__atomic_load_n(&reclaimer_running, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&reclaimer_mutex);
+	running = reclaimer_running && !reclaimer_stop;
+	if (running) {
+		reclaimer_wake = 1;
+		pthread_cond_signal(&reclaimer_cond);
+	}
+	pthread_mutex_unlock(&reclaimer_mutex);
+
+	return running;
+}
+
+/**
+ * @brief Queues a context no longer referenced for context_reclaim().
+ *
+ * It disappears from the latest value cache at once, so a device that
+ * comes back under the same id never sees its old values.
+ *
+ * @param context context
+ */
+static void defer_destroy(Context *context)
+{
+	unsigned int batch = __atomic_load_n(&deferred_batch, __ATOMIC_RELAXED);
+
+	latest_value_remove_context(context);
+
+	context->next_dead = __atomic_load_n(&dead_contexts, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&dead_contexts, &context->next_dead,
+					    context, 1, __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED)) {
+	}
+
+	if (__atomic_add_fetch(&dead_count, 1, __ATOMIC_RELAXED) >= batch) {
+		// without a reclaimer, the disconnecting thread pays for it
+		if (!reclaimer_kick()) {
+			context_reclaim();
+		}
+	}
+}
+
 /**
  * @brief Verify if the context element have the given id.
  *
@@ -114,6 +256,89 @@ static int context_search_by_id(void *arg, void *element)
 	return (id->plugin == c->id.plugin) && (id->connid == c->id.connid);
 }
 
+static void shared_mutex_init()
+{
+	pthread_mutexattr_t attr;
+
+	// recursive, as the GIL it replaces here
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&shared_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+/**
+ * @brief Gets the entry of a plugin in the table, growing the table
+ * if asked to. Growing must not race with lookups, so it is done when
+ * plugins are added (see context_set_plugin_lock()).
+ *
+ * @param plugin plugin id
+ * @param create 1 to grow the table if the plugin is not in it
+ * @return entry, or NULL
+ */
+static ContextList *context_list_of(unsigned int plugin, int create)
+{
+	if (plugin >= context_list_count) {
+		ContextList *lists;
+		unsigned int i;
+
+		if (!create) {
+			return NULL;
+		}
+
+		pthread_once(&shared_mutex_once, shared_mutex_init);
+
+		lists = realloc(context_lists, (plugin + 1) * sizeof(ContextList));
+		if (!lists) {
+			return NULL;
+		}
+
+		for (i = context_list_count; i <= plugin; ++i) {
+			lists[i].contexts = NULL;
+			lists[i].mutex = &shared_mutex;
+		}
+
+		context_lists = lists;
+		context_list_count = plugin + 1;
+	}
+
+	return &context_lists[plugin];
+}
+
+/**
+ * @brief Gives the contexts of a plugin the lock of its owner, so
+ * that lookups of different owners (manager instances) never contend.
+ * Plugins get a lock shared with other plugins otherwise.
+ *
+ * This method should be invoked in a thread safe execution, before
+ * the plugin has any context.
+ *
+ * @param plugin plugin id
+ * @param mutex recursive lock, NULL for the shared one
+ */
+void context_set_plugin_lock(unsigned int plugin, pthread_mutex_t *mutex)
+{
+	ContextList *list = context_list_of(plugin, 1);
+
+	if (list) {
+		list->mutex = mutex ? mutex : &shared_mutex;
+	}
+}
+
+/**
+ * @brief Finds a context in the list of its plugin. Must be called
+ * with the list locked.
+ *
+ * @param list list of the plugin of the context
+ * @param id context id
+ * @return context, or NULL
+ */
+static Context *context_search(ContextList *list, ContextId *id)
+{
+	return (Context *) llist_search_first(list->contexts, id,
+					      &context_search_by_id);
+}
+
 /**
  * @brief Creates execution context.
  *
@@ -125,14 +350,10 @@ static int context_search_by_id(void *arg, void *element)
  */
 Context *context_create(ContextId id, int type)
 {
-	if (context_list == NULL) {
-		context_list = llist_new();
-	}
-
 	// Remove from list if exists any previous
 	context_remove(id);
 
-	Context *context = calloc(1, sizeof(struct Context));
+	Context *context = pool_alloc(&context_pool);
 
 	if (context == NULL) {
 		ERROR("Cannot create context %u:%llu", context->id.plugin, context->id.connid);
@@ -151,9 +372,22 @@ Context *context_create(ContextId id, int type)
 	context->id = id;
 	context->ref = 1; // reference from list
 
-	gil_lock();
-	llist_add(context_list, context);
-	gil_unlock();
+	ContextList *list = context_list_of(id.plugin, 1);
+
+	if (list == NULL) {
+		ERROR("Cannot create context %u:%llu", id.plugin, id.connid);
+		pool_free(&context_pool, context);
+		return NULL;
+	}
+
+	pthread_mutex_lock(list->mutex);
+
+	if (!list->contexts) {
+		list->contexts = llist_new();
+	}
+
+	llist_add(list->contexts, context);
+	pthread_mutex_unlock(list->mutex);
 
 	DEBUG("Created context id %u:%llu", context->id.plugin, context->id.connid);
 
@@ -169,18 +403,26 @@ void context_remove(ContextId id)
 {
 	DEBUG("Removing context %u:%llu", id.plugin, id.connid);
 
+	ContextList *list = context_list_of(id.plugin, 0);
+
+	if (!list) {
+		return;
+	}
+
 	// grab context and remove from list atomically
-	gil_lock();
+	pthread_mutex_lock(list->mutex);
 
-	Context *context = context_get_and_lock(id);
+	Context *context = context_search(list, &id);
 	if (!context) {
-		gil_unlock();
+		pthread_mutex_unlock(list->mutex);
 		return;
 	}
 
-	llist_remove(context_list, context);
+	communication_lock(context);
+	++context->ref;
+	llist_remove(list->contexts, context);
 
-	gil_unlock();
+	pthread_mutex_unlock(list->mutex);
 
 	--context->ref; // remove reference from list
 
@@ -188,32 +430,67 @@ void context_remove(ContextId id)
 }
 
 /**
- * @brief Destroys all execution context.
+ * @brief Destroys all execution contexts of a plugin.
+ *
+ * @param plugin plugin id
  */
-void context_remove_all()
+void context_remove_plugin(unsigned int plugin)
 {
+	ContextList *list = context_list_of(plugin, 0);
+
+	if (!list) {
+		return;
+	}
+
 	while (1) {
-		// make sure no one will mess the table while we
+		// make sure no one will mess the list while we
 		// get one context id to be destroyed
-		gil_lock();
+		pthread_mutex_lock(list->mutex);
 
-		if ((!context_list) || (context_list->size <= 0)) {
-			gil_unlock();
+		if (!list->contexts || list->contexts->size <= 0) {
+			pthread_mutex_unlock(list->mutex);
 			break;
 		}
-		Context *c = llist_get(context_list, 0);
+
+		Context *c = llist_get(list->contexts, 0);
 		ContextId id = c->id;
 
-		gil_unlock();
+		pthread_mutex_unlock(list->mutex);
 
 		// safely remove
 		context_remove(id);
 	}
 
-	gil_lock();
-	free(context_list);
-	context_list = NULL;
-	gil_unlock();
+	pthread_mutex_lock(list->mutex);
+	free(list->contexts);
+	list->contexts = NULL;
+	pthread_mutex_unlock(list->mutex);
+
+	// the owner and its lock may go away with the plugin
+	list->mutex = &shared_mutex;
+}
+
+/**
+ * @brief Destroys all execution context.
+ */
+void context_remove_all()
+{
+	unsigned int i;
+
+	for (i = 0; i < context_list_count; ++i) {
+		context_remove_plugin(i);
+	}
+
+	free(context_lists);
+	context_lists = NULL;
+	context_list_count = 0;
+
+	context_stop_reclaimer();
+	context_reclaim();
+	mds_cache_clear();
+	pool_drain(&context_pool);
+	fsm_pool_drain();
+	service_pool_drain();
 }
 
 /**
@@ -222,27 +499,51 @@ void context_remove_all()
  * @param id Context ID
  * @return pointer to context struct or NULL if cannot find.
  */
-Context *context_get_and_lock(ContextId id)
+Context *(context_get_and_lock)(ContextId id)
 {
-	gil_lock();
+	return context_get_and_lock_at(id, __FILE__, __LINE__, __FUNCTION__);
+}
 
-	Context *ctx = (Context *) llist_search_first(context_list, &id,
-			&context_search_by_id);
+/**
+ * @brief Get execution context and lock it in a single move; locks are
+ * accounted to the given call site when lock profiling is on.
+ *
+ * @param id Context ID
+ * @param file source file of the caller
+ * @param line source line of the caller
+ * @param function function of the caller
+ * @return pointer to context struct or NULL if cannot find.
+ */
+Context *context_get_and_lock_at(ContextId id, const char *file, int line,
+				 const char *function)
+{
+	ContextList *list = context_list_of(id.plugin, 0);
+
+	if (list == NULL) {
+		WARNING("Cannot find context id %u:%llu", id.plugin, id.connid);
+		return NULL;
+	}
+
+	// only the lock of the plugin owner, lookups of other manager
+	// instances go on meanwhile
+	pthread_mutex_lock(list->mutex);
+
+	Context *ctx = context_search(list, &id);
 
 	if (ctx == NULL) {
 		WARNING("Cannot find context id %u:%llu", id.plugin, id.connid);
-		gil_unlock();
+		pthread_mutex_unlock(list->mutex);
 		return ctx;
 	}
 
 	if (ctx) {
-		communication_lock(ctx);
+		communication_lock_at(ctx, file, line, function);
 		++ctx->ref;
 		DEBUG("Context @%p %u:%llu addref to %d", ctx,
 			ctx->id.plugin, ctx->id.connid, ctx->ref);
 	}
 
-	gil_unlock();
+	pthread_mutex_unlock(list->mutex);
 
 	return ctx;
 }
@@ -263,9 +564,205 @@ void context_unlock(Context *ctx)
 		// nobody has ownership and nobody will find it
 		// between unlocking and destruction
 		if (ctx->ref <= 0) {
-			destroy_context(ctx);
+			if (__atomic_load_n(&deferred_batch, __ATOMIC_RELAXED)) {
+				defer_destroy(ctx);
+			} else {
+				destroy_context(ctx);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Defers or not destruction of contexts.
+ *
+ * When deferred, contexts that go away are only hidden from readers
+ * of latest values and queued. The queue is destroyed in one go by
+ * context_reclaim(), run by whoever calls it, by the reclaimer thread
+ * if started (see context_start_reclaimer()), or else by the thread
+ * that queues the batch-th context.
+ *
+ * @param batch number of queued contexts that triggers a reclaim,
+ *        0 to destroy contexts as soon as they go away
+ */
+void context_set_deferred_destroy(unsigned int batch)
+{
+	__atomic_store_n(&deferred_batch, batch, __ATOMIC_RELAXED);
+
+	if (!batch) {
+		context_reclaim();
+	}
+}
+
+/**
+ * @brief Tells whether destruction of contexts is deferred.
+ *
+ * @return 1 if deferred, 0 if contexts are destroyed as they go away
+ */
+int context_is_destroy_deferred()
+{
+	return __atomic_load_n(&deferred_batch, __ATOMIC_RELAXED) != 0;
+}
+
+static void *reclaimer_loop(void *arg)
+{
+	pthread_mutex_lock(&reclaimer_mutex);
+
+	while (!reclaimer_stop) {
+		if (!reclaimer_wake && reclaimer_interval) {
+			unsigned long long deadline;
+			struct timeval tv;
+			struct timespec ts;
+
+			gettimeofday(&tv, NULL);
+			deadline = tv.tv_sec * 1000000ULL + tv.tv_usec +
+				   reclaimer_interval * 1000ULL;
+			ts.tv_sec = deadline / 1000000ULL;
+			ts.tv_nsec = (deadline % 1000000ULL) * 1000;
+			pthread_cond_timedwait(&reclaimer_cond,
+					       &reclaimer_mutex, &ts);
+		} else if (!reclaimer_wake) {
+			pthread_cond_wait(&reclaimer_cond, &reclaimer_mutex);
+			continue;
+		}
+
+		reclaimer_wake = 0;
+
+		if (reclaimer_stop) {
+			break;
+		}
+
+		pthread_mutex_unlock(&reclaimer_mutex);
+		context_reclaim();
+		pthread_mutex_lock(&reclaimer_mutex);
+	}
+
+	pthread_mutex_unlock(&reclaimer_mutex);
+
+	return NULL;
+}
+
+/**
+ * @brief Starts a thread that reclaims deferred contexts, so that
+ * disconnecting threads never do it.
+ *
+ * It reclaims when batch contexts are waiting (see
+ * context_set_deferred_destroy()) and every interval milliseconds.
+ *
+ * @param interval milliseconds between reclaims, 0 to reclaim only
+ *        when a batch is waiting
+ * @return 1 if started, 0 if already running or on error
+ */
+int context_start_reclaimer(unsigned int interval)
+{
+	pthread_mutex_lock(&reclaimer_mutex);
+
+	if (reclaimer_running) {
+		pthread_mutex_unlock(&reclaimer_mutex);
+		return 0;
+	}
+
+	reclaimer_interval = interval;
+	reclaimer_stop = 0;
+	reclaimer_wake = 0;
+
+	if (pthread_create(&reclaimer_thread, NULL, reclaimer_loop, NULL)) {
+		pthread_mutex_unlock(&reclaimer_mutex);
+		ERROR("cannot start context reclaimer thread");
+		return 0;
+	}
+
+	__atomic_store_n(&reclaimer_running, 1, __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(&reclaimer_mutex);
+
+	return 1;
+}
+
+/**
+ * @brief Stops the reclaimer thread, if it runs. Contexts still
+ * queued are left for the next context_reclaim().
+ */
+void context_stop_reclaimer()
+{
+	pthread_mutex_lock(&reclaimer_mutex);
+
+	if (!reclaimer_running) {
+		pthread_mutex_unlock(&reclaimer_mutex);
+		return;
+	}
+
+	reclaimer_stop = 1;
+	pthread_cond_signal(&reclaimer_cond);
+
+	pthread_mutex_unlock(&reclaimer_mutex);
+
+	pthread_join(reclaimer_thread, NULL);
+
+	pthread_mutex_lock(&reclaimer_mutex);
+	__atomic_store_n(&reclaimer_running, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&reclaimer_mutex);
+}
+
+/**
+ * @brief Destroys all queued contexts, then tells the teardown
+ * listeners which ones went away. Waits for a reclaim in progress in
+ * another thread, so every context queued before the call is destroyed
+ * when it returns.
+ *
+ * @return number of contexts destroyed
+ */
+unsigned int context_reclaim()
+{
+	Context *ctx;
+	ContextId *ids[2] = {NULL, NULL};
+	int counts[2] = {0, 0};
+	unsigned int n = 0;
+	Context *c;
+	int t;
+
+	pthread_mutex_lock(&reclaim_mutex);
+
+	ctx = __atomic_exchange_n(&dead_contexts, NULL, __ATOMIC_ACQUIRE);
+
+	if (!ctx) {
+		pthread_mutex_unlock(&reclaim_mutex);
+		return 0;
+	}
+
+	for (c = ctx; c; c = c->next_dead) {
+		++n;
+	}
+
+	__atomic_sub_fetch(&dead_count, n, __ATOMIC_RELAXED);
+
+	ids[0] = malloc(n * sizeof(ContextId));
+	ids[1] = malloc(n * sizeof(ContextId));
+
+	while (ctx) {
+		Context *next = ctx->next_dead;
+
+		t = (ctx->type & AGENT_CONTEXT) ? 1 : 0;
+
+		if (ids[t]) {
+			ids[t][counts[t]++] = ctx->id;
 		}
+
+		destroy_context(ctx);
+		ctx = next;
 	}
+
+	pthread_mutex_unlock(&reclaim_mutex);
+
+	DEBUG("reclaimed %u contexts", n);
+
+	communication_notify_teardown(MANAGER_CONTEXT, ids[0], counts[0]);
+	communication_notify_teardown(AGENT_CONTEXT, ids[1], counts[1]);
+
+	free(ids[0]);
+	free(ids[1]);
+
+	return n;
 }
 
 /**
@@ -275,7 +772,29 @@ void context_unlock(Context *ctx)
  */
 void context_iterate(context_handle function)
 {
-	llist_iterate(context_list, (llist_handle_element) function);
+	unsigned int i;
+
+	for (i = 0; i < context_list_count; ++i) {
+		if (!llist_iterate(context_lists[i].contexts,
+				   (llist_handle_element) function)) {
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Iterate over the contexts of one plugin and call
+ * context_handle for each one.
+ *
+ * @param plugin plugin id
+ * @param function Handle function called at each iterated element.
+ */
+void context_iterate_plugin(unsigned int plugin, context_handle function)
+{
+	if (plugin < context_list_count) {
+		llist_iterate(context_lists[plugin].contexts,
+			      (llist_handle_element) function);
+	}
 }
 
 /** @} */
@@ -30,6 +30,7 @@
 #ifndef CONTEXT_MANAGER_H_
 #define CONTEXT_MANAGER_H_
 
+#include <pthread.h>
 #include <communication/context.h>
 
 /**
@@ -42,8 +43,24 @@ typedef int (*context_handle)(Context *ctx);
 Context *context_create(ContextId id, int type);
 void context_remove(ContextId id);
 void context_remove_all();
+void context_remove_plugin(unsigned int plugin);
+void context_set_plugin_lock(unsigned int plugin, pthread_mutex_t *mutex);
 Context *context_get_and_lock(ContextId id);
+Context *context_get_and_lock_at(ContextId id, const char *file, int line,
+				 const char *function);
 void context_unlock(Context *ctx);
+void context_set_deferred_destroy(unsigned int batch);
+unsigned int context_reclaim();
+int context_is_destroy_deferred();
+int context_start_reclaimer(unsigned int interval);
+void context_stop_reclaimer();
 void context_iterate(context_handle function);
+void context_iterate_plugin(unsigned int plugin, context_handle function);
+
+/**
+ * Gets and locks a context, telling the lock profiler where from
+ */
+#define context_get_and_lock(id) \
+	context_get_and_lock_at((id), __FILE__, __LINE__, __FUNCTION__)
 
 #endif /* CONTEXT_MANAGER_H_ */
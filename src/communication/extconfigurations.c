@@ -88,6 +88,13 @@ static struct ExtConfig *ext_configuration_list = NULL;
  */
 static int ext_configuration_size = 0;
 
+/**
+ * Size of the index file as last seen by this process. When it
+ * changes, other processes sharing the directory have learnt new
+ * configurations.
+ */
+static long ext_index_size = 0;
+
 static char *ext_configurations_get_file_name(octet_string *system_id,
 		ConfigId config_id);
 
@@ -201,6 +208,7 @@ void ext_configurations_destroy()
 
 		ext_configuration_size = 0;
 	}
+	ext_index_size = 0;
 	gil_unlock();
 }
 
@@ -250,7 +258,11 @@ static void ext_configurations_wipe()
 	ioutil_buffer_to_file(concat, stream->size, stream->buffer, 0);
 	free(concat);
 	del_byte_stream_writer(stream, 1);
-	
+
+	gil_lock();
+	ext_index_size = 0;
+	gil_unlock();
+
 	DEBUG("wiped ext config file");
 }
 
@@ -273,6 +285,10 @@ void ext_configurations_load_configurations()
 		goto exit;
 	}
 
+	gil_lock();
+	ext_index_size = buffer_size;
+	gil_unlock();
+
 	stream = byte_stream_reader_instance(buffer, buffer_size);
 	if (!stream) {
 		DEBUG("Zero-sized ext config buffer");
@@ -281,6 +297,12 @@ void ext_configurations_load_configurations()
 
 	gil_lock();
 	if (ext_configuration_list != NULL) {
+		int index;
+
+		for (index = 0; index < ext_configuration_size; index++) {
+			del_octet_string(&ext_configuration_list[index].system_id);
+		}
+
 		free(ext_configuration_list);
 		ext_configuration_list = NULL;
 		ext_configuration_size = 0;
@@ -363,6 +385,9 @@ static void ext_configurations_write_file(octet_string *system_id,
 		int err = ioutil_buffer_to_file(concat, header_stream->size,
 					     header_stream->buffer, 1);
 		free(concat);
+		gil_lock();
+		ext_index_size += header_stream->size;
+		gil_unlock();
 		del_byte_stream_writer(header_stream, 1);
 
 		if (err) {
@@ -412,12 +437,13 @@ void ext_configurations_register_conf(octet_string *system_id,
 	DEBUG("Encoding %x to index", config_id);
 	encode_configobjectlist(stream, object_list);
 
+	gil_lock();
+
 	struct ExtConfig *cfg = ext_configurations_get_config(system_id, config_id);
 	if (!cfg) {
 		int error = 0;
 		DEBUG("Adding new ext config %x to index", config_id);
 		new = 1;
-		gil_lock();
 		ext_configuration_size++;
 		ext_configuration_list = realloc(ext_configuration_list,
 					 ext_configuration_size * sizeof(struct ExtConfig));
@@ -435,25 +461,24 @@ void ext_configurations_register_conf(octet_string *system_id,
 
 		del_byte_stream_writer(w_stream, 1);
 		free(r_stream);
-		gil_unlock();
 	} else {
 		DEBUG("Updating ext config");
 		new = 0;
 	}
 
-	ext_configurations_write_file(system_id, config_id, stream, new);
-
 	cfg->obj_size = stream->size;
 
-	if (ext_configuration_list == NULL) {
-		ERROR("ext configuration list is null");
-	}
+	gil_unlock();
+
+	ext_configurations_write_file(system_id, config_id, stream, new);
 
 	del_byte_stream_writer(stream, 1);
 }
 
 /**
- * Get extended configuration for a given system and config id
+ * Get extended configuration for a given system and config id. Must be
+ * called with the GIL locked; the structure may be freed by a reload
+ * as soon as the GIL is unlocked.
  *
  * @param system_id System ID (device identification)
  * @param config_id Extended configuration ID
@@ -462,8 +487,6 @@ void ext_configurations_register_conf(octet_string *system_id,
 static struct ExtConfig *ext_configurations_get_config(octet_string *system_id,
 		ConfigId config_id) {
 	int index;
-	
-	gil_lock();
 
 	for (index = 0; index < ext_configuration_size; index++) {
 		ConfigId selected_conf_id =
@@ -483,15 +506,42 @@ static struct ExtConfig *ext_configurations_get_config(octet_string *system_id,
 			}
 
 			if (is_different == 0) {
-				gil_unlock();
 				return &ext_configuration_list[index];
 			}
 		}
 	}
 
+	return NULL;
+}
+
+/**
+ * Tells whether a configuration is in the index, and its size
+ *
+ * @param system_id System ID (device identification)
+ * @param config_id Extended configuration ID
+ * @param obj_size size of the encoded configuration, output; may be NULL
+ * @return 1 if found
+ */
+static int ext_configurations_find(octet_string *system_id,
+				   ConfigId config_id,
+				   unsigned long *obj_size)
+{
+	struct ExtConfig *config;
+	int found = 0;
+
+	gil_lock();
+
+	config = ext_configurations_get_config(system_id, config_id);
+	if (config != NULL) {
+		if (obj_size) {
+			*obj_size = config->obj_size;
+		}
+		found = 1;
+	}
+
 	gil_unlock();
 
-	return NULL;
+	return found;
 }
 
 /**
@@ -507,7 +557,29 @@ static struct ExtConfig *ext_configurations_get_config(octet_string *system_id,
 int ext_configurations_is_supported_standard(octet_string *system_id,
 		ConfigId config_id)
 {
-	return ext_configurations_get_config(system_id, config_id) != NULL;
+	struct stat st;
+	long known_size;
+	char *concat;
+
+	if (ext_configurations_find(system_id, config_id, NULL)) {
+		return 1;
+	}
+
+	// another process sharing the index may know it
+	concat = ext_concat_path_file();
+
+	gil_lock();
+	known_size = ext_index_size;
+	gil_unlock();
+
+	if (stat(concat, &st) == 0 && st.st_size != known_size) {
+		DEBUG("ext config index changed, reloading");
+		ext_configurations_load_configurations();
+	}
+
+	free(concat);
+
+	return ext_configurations_find(system_id, config_id, NULL);
 }
 
 /**
@@ -523,16 +595,14 @@ ConfigObjectList *ext_configurations_get_configuration_attributes(
 	octet_string *system_id, ConfigId config_id)
 {
 
-	struct ExtConfig *config = ext_configurations_get_config(system_id,
-				   config_id);
+	unsigned long obj_size;
 
-	if (config != NULL) {
-		ConfigId selected_cfg_id = config->config_id;
-		octet_string selected_sys_id = config->system_id;
-		unsigned long size = config->obj_size;
+	// the index entry may be freed by a reload once the GIL is unlocked
+	if (ext_configurations_find(system_id, config_id, &obj_size)) {
+		unsigned long size = obj_size;
 
 		char *file_path = ext_configurations_get_file_name(
-					  &selected_sys_id, selected_cfg_id);
+					  system_id, config_id);
 		intu8 *buffer = ioutil_buffer_from_file(file_path, &size);
 
 		free(file_path);
@@ -541,7 +611,7 @@ ConfigObjectList *ext_configurations_get_configuration_attributes(
 		if (buffer == NULL) {
 			ERROR("ext_config_get could not read from file");
 			return NULL;
-		} else if (size != config->obj_size) {
+		} else if (size != obj_size) {
 			ERROR("ext_config_get: bad obj size");
 			free(buffer);
 			return NULL;
@@ -48,6 +48,7 @@
 #include "src/communication/operating.h"
 #include "src/communication/agent_ops.h"
 #include "src/util/log.h"
+#include "src/util/pool.h"
 
 static char *fsm_state_strings[] = {
 	"disconnected",
@@ -341,13 +342,18 @@ static FsmTransitionRule IEEE11073_20601_agent_state_table[] = {
 	};
 
 
+/**
+ * Released state machines, kept for reuse by new connections
+ */
+static ObjectPool fsm_pool = OBJECT_POOL_INIT(FSM, 64);
+
 /**
  * Construct the state machine
  * @return finite state machine
  */
 FSM *fsm_instance()
 {
-	FSM *fsm = malloc(sizeof(struct FSM));
+	FSM *fsm = pool_alloc(&fsm_pool);
 	return fsm;
 }
 
@@ -358,7 +364,15 @@ FSM *fsm_instance()
  */
 void fsm_destroy(FSM *fsm)
 {
-	free(fsm);
+	pool_free(&fsm_pool, fsm);
+}
+
+/**
+ * Frees the state machines kept for reuse
+ */
+void fsm_pool_drain()
+{
+	pool_drain(&fsm_pool);
 }
 
 /**
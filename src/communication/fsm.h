@@ -226,6 +226,8 @@ FSM *fsm_instance();
 
 void fsm_destroy(FSM *fsm);
 
+void fsm_pool_drain();
+
 void fsm_set_manager_state_table(FSM *fsm);
 void fsm_set_agent_state_table(FSM *fsm);
 
@@ -39,11 +39,18 @@
 #include "encoder_ASN1.h"
 #include "decoder_ASN1.h"
 #include "struct_cleaner.h"
+#include "src/util/arena.h"
 #include "src/util/log.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * Arena decoded structures are carved from, NULL for the heap.
+ * Per thread, see decoder_set_arena().
+ */
+static __thread Arena *decode_arena = NULL;
+
 #define QUOTE(x) #x
 
 #define CHK(f)			\
@@ -72,7 +79,7 @@
 
 #define CHILDREN_GENERIC(typeU, decodefunction)									\
 	if (pointer->count > 0) {								\
-		pointer->value = (typeU *) calloc(pointer->count, sizeof(typeU));				\
+		pointer->value = (typeU *) decoder_calloc(pointer->count, sizeof(typeU));			\
 												\
 		if (pointer->value == NULL) {							\
 			ERROR("memory full");							\
@@ -98,10 +105,38 @@
 	return; 			\
 fail:					\
 	ERROR("err dec " QUOTE(name));	\
-	del_##name(pointer);		\
+	if (!decode_arena)		\
+		del_##name(pointer);	\
 	*error = 1;			\
 	return;
 
+/**
+ * Makes the decoders of the calling thread allocate from an arena
+ * instead of the heap. Structures decoded meanwhile are released by
+ * resetting the arena and must not be passed to the del_* functions.
+ *
+ * @param arena arena, or NULL to go back to the heap
+ * @return arena in use before the call
+ */
+Arena *decoder_set_arena(Arena *arena)
+{
+	Arena *previous = decode_arena;
+	decode_arena = arena;
+	return previous;
+}
+
+/**
+ * Allocates zeroed memory for decoded structures
+ */
+static void *decoder_calloc(size_t count, size_t size)
+{
+	if (decode_arena) {
+		return arena_calloc(decode_arena, count, size);
+	}
+
+	return calloc(count, size);
+}
+
 /**
  * Decodes SegmentDataResult.
  *
@@ -395,7 +430,7 @@ void decode_octet_string(ByteStreamReader *stream, octet_string *pointer, int *e
 	LV();
 
 	if (pointer->length > 0) {
-		pointer->value = (intu8 *) calloc(pointer->length, sizeof(intu8));
+		pointer->value = (intu8 *) decoder_calloc(pointer->length, sizeof(intu8));
 
 		if (pointer->value == NULL) {
 			ERROR("memory full");
@@ -932,7 +967,7 @@ void decode_prst_apdu(ByteStreamReader *stream, PRST_apdu *pointer, int *error)
 	LV();
 
 	if (pointer->length > 0) {
-		DATA_apdu *data = (DATA_apdu *) calloc(1, sizeof(DATA_apdu));
+		DATA_apdu *data = (DATA_apdu *) decoder_calloc(1, sizeof(DATA_apdu));
 
 		if (data == NULL) {
 			ERROR("memory full");
@@ -974,7 +1009,7 @@ void decode_any(ByteStreamReader *stream, Any *pointer, int *error)
 	LV();
 
 	if (pointer->length > 0) {
-		pointer->value = (intu8 *) calloc(pointer->length, sizeof(intu8));
+		pointer->value = (intu8 *) decoder_calloc(pointer->length, sizeof(intu8));
 
 		if (pointer->value == NULL) {
 			ERROR("memory full");
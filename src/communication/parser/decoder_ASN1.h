@@ -43,6 +43,9 @@
 #define DECODER_ASN1_H_
 
 #include "src/util/bytelib.h"
+#include "src/util/arena.h"
+
+Arena *decoder_set_arena(Arena *arena);
 
 void decode_segmentdataresult(ByteStreamReader *stream, SegmentDataResult *pointer, int *error);
 void decode_scanreportpervar(ByteStreamReader *stream, ScanReportPerVar *pointer, int *error);
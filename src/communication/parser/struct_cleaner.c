@@ -41,6 +41,7 @@
 #include "src/communication/parser/struct_cleaner.h"
 #include "src/communication/parser/encoder_ASN1.h"
 #include "src/dim/nomenclature.h"
+#include "src/util/arena.h"
 
 #define QUOTE(x) #x
 
@@ -48,9 +49,40 @@
 	memset(pointer, 0, sizeof(*pointer));
 
 #define CLV()				\
-	free(pointer->value);		\
+	cleaner_free(pointer->value);	\
 	CLVC();
 
+/**
+ * Arena whose memory is not freed by the cleaners of the calling
+ * thread, see cleaner_set_arena()
+ */
+static __thread Arena *cleaner_arena = NULL;
+
+/**
+ * Makes the cleaners of the calling thread leave alone the memory of
+ * an arena. Structures mixing values decoded into the arena with
+ * values later decoded onto the heap can then go through the del_*
+ * functions, which free only the latter.
+ *
+ * @param arena arena, or NULL to free everything
+ * @return arena in use before the call
+ */
+Arena *cleaner_set_arena(Arena *arena)
+{
+	Arena *previous = cleaner_arena;
+	cleaner_arena = arena;
+	return previous;
+}
+
+static void cleaner_free(void *p)
+{
+	if (cleaner_arena && arena_owns(cleaner_arena, p)) {
+		return;
+	}
+
+	free(p);
+}
+
 #define CHILDREN_GENERIC(delfunction)								\
 	if (pointer->value) {									\
 		int i;										\
@@ -40,6 +40,9 @@
 #define STRUCT_CLEANER_H_
 
 #include "../../asn1/phd_types.h"
+#include "src/util/arena.h"
+
+Arena *cleaner_set_arena(Arena *arena);
 
 void del_segmentdataresult(SegmentDataResult *pointer);
 void del_scanreportpervar(ScanReportPerVar *pointer);
@@ -149,6 +149,7 @@ CommunicationPlugin communication_plugin()
 		.timer_reset_timeout = stub_timer_reset_timeout_ptr,
 		.timer_wait_for_timeout = stub_timer_wait_for_timeout_ptr,
 		.type = 0,
+		.owner = NULL,
 	};
 
 	return plugin;
@@ -64,7 +64,8 @@
 			.timer_count_timeout = NULL,\
 			.timer_wait_for_timeout = NULL,\
 			.timer_reset_timeout = NULL, \
-			.type = 0 \
+			.type = 0, \
+			.owner = NULL \
 			}
 
 /**
@@ -230,6 +231,11 @@ typedef struct CommunicationPlugin {
 	 */
 	int type;
 
+	/**
+	 * Manager instance the plug-in was given to, NULL if none
+	 */
+	void *owner;
+
 } CommunicationPlugin;
 
 CommunicationPlugin communication_plugin();
@@ -0,0 +1,460 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file plugin_loopback.c
+ * \brief In-process loopback plugin source.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * @addtogroup LoopbackPlugin
+ *
+ * Connects agent and manager contexts living in the same process.
+ *
+ * Two plugins are set up together: one is passed to agent_init(), the
+ * other to manager_init(). Each channel N pairs agent context
+ * {agent plugin, N} with manager context {manager plugin, N}. APDUs
+ * travel through a single-producer single-consumer ring per direction,
+ * so sending and receiving never enter the kernel.
+ *
+ * Channels are brought up by plugin_network_loopback_connect(), and
+ * APDUs are delivered by plugin_network_loopback_pump(), or by a
+ * connection loop per context (which spins while the ring is empty).
+ * Each direction of a channel must be drained by one thread at a time.
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "src/communication/communication.h"
+#include "src/communication/context.h"
+#include "src/communication/plugin/plugin_loopback.h"
+#include "src/util/log.h"
+
+/**
+ * Ring capacity in APDUs, power of two
+ */
+#define LOOPBACK_QUEUE_SIZE 256
+
+/**
+ * Side of a channel, also index of the ring that side reads from
+ */
+enum {
+	LOOPBACK_AGENT = 0,
+	LOOPBACK_MANAGER = 1
+};
+
+static const char *LOOPBACK_ADDR = "loopback";
+
+/**
+ * APDU in transit
+ */
+typedef struct LoopbackApdu {
+	intu8 *buffer;
+	intu32 size;
+} LoopbackApdu;
+
+/**
+ * Single-producer single-consumer ring. Head is only written by the
+ * consumer and tail only by the producer.
+ */
+typedef struct LoopbackQueue {
+	unsigned int head;
+	unsigned int tail;
+	LoopbackApdu apdus[LOOPBACK_QUEUE_SIZE];
+} LoopbackQueue;
+
+/**
+ * Agent/manager pair
+ */
+typedef struct LoopbackChannel {
+	/**
+	 * APDUs waiting to be read by each side
+	 */
+	LoopbackQueue queue[2];
+
+	/**
+	 * Non-zero while the context of each side exists
+	 */
+	int up[2];
+
+	/**
+	 * Set when either side disconnects
+	 */
+	int closed;
+} LoopbackChannel;
+
+static LoopbackChannel *channels = NULL;
+static int channel_count = 0;
+static unsigned int plugin_ids[2] = {0, 0};
+static int initialized = 0;
+
+static int queue_push(LoopbackQueue *q, intu8 *buffer, intu32 size)
+{
+	unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	unsigned int head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+	if (tail - head >= LOOPBACK_QUEUE_SIZE) {
+		return 0;
+	}
+
+	q->apdus[tail & (LOOPBACK_QUEUE_SIZE - 1)].buffer = buffer;
+	q->apdus[tail & (LOOPBACK_QUEUE_SIZE - 1)].size = size;
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+static int queue_pop(LoopbackQueue *q, LoopbackApdu *apdu)
+{
+	unsigned int head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail) {
+		return 0;
+	}
+
+	*apdu = q->apdus[head & (LOOPBACK_QUEUE_SIZE - 1)];
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+static int queue_empty(LoopbackQueue *q)
+{
+	return __atomic_load_n(&q->head, __ATOMIC_RELAXED) ==
+		__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+}
+
+static void queue_clear(LoopbackQueue *q)
+{
+	LoopbackApdu apdu;
+
+	while (queue_pop(q, &apdu)) {
+		free(apdu.buffer);
+	}
+}
+
+static int side_of(Context *ctx)
+{
+	return ctx->id.plugin == plugin_ids[LOOPBACK_MANAGER] ?
+		LOOPBACK_MANAGER : LOOPBACK_AGENT;
+}
+
+static LoopbackChannel *channel_of(Context *ctx)
+{
+	if (!channels || ctx->id.connid < 1 ||
+	    ctx->id.connid > (unsigned long long) channel_count) {
+		return NULL;
+	}
+
+	return &channels[ctx->id.connid - 1];
+}
+
+/**
+ * Destroys the context of one side, if it still exists
+ */
+static void side_down(int channel, int side)
+{
+	LoopbackChannel *ch = &channels[channel - 1];
+	ContextId cid = {plugin_ids[side], channel};
+
+	if (!__atomic_exchange_n(&ch->up[side], 0, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+
+	DEBUG("network loopback: channel %d side %d down", channel, side);
+	communication_transport_disconnect_indication(cid, LOOPBACK_ADDR);
+	queue_clear(&ch->queue[side]);
+}
+
+static int network_init(int side, unsigned int plugin_label)
+{
+	plugin_ids[side] = plugin_label;
+	initialized |= 1 << side;
+	return NETWORK_ERROR_NONE;
+}
+
+static int agent_network_init(unsigned int plugin_label)
+{
+	return network_init(LOOPBACK_AGENT, plugin_label);
+}
+
+static int manager_network_init(unsigned int plugin_label)
+{
+	return network_init(LOOPBACK_MANAGER, plugin_label);
+}
+
+/**
+ * Spins until an APDU is available
+ *
+ * @param ctx connection context
+ * @return NETWORK_ERROR_NONE if data is available, NETWORK_ERROR if
+ * channel was closed
+ */
+static int network_wait_for_data(Context *ctx)
+{
+	LoopbackChannel *ch = channel_of(ctx);
+	int side = side_of(ctx);
+
+	if (!ch) {
+		return NETWORK_ERROR;
+	}
+
+	while (queue_empty(&ch->queue[side])) {
+		if (__atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) {
+			return NETWORK_ERROR;
+		}
+		sched_yield();
+	}
+
+	return NETWORK_ERROR_NONE;
+}
+
+/**
+ * Takes the next APDU off the ring. The APDU buffer is handed to the
+ * reader, so nothing is copied on this side.
+ *
+ * @param ctx connection context
+ * @return a byteStream with the APDU, or NULL if there is none
+ */
+static ByteStreamReader *network_get_apdu_stream(Context *ctx)
+{
+	LoopbackChannel *ch = channel_of(ctx);
+	int side = side_of(ctx);
+	LoopbackApdu apdu;
+
+	if (!ch) {
+		return NULL;
+	}
+
+	if (!queue_pop(&ch->queue[side], &apdu)) {
+		if (__atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) {
+			side_down(ctx->id.connid, side);
+		}
+		return NULL;
+	}
+
+	return byte_stream_reader_instance(apdu.buffer, apdu.size);
+}
+
+/**
+ * Puts an APDU on the ring of the other side
+ *
+ * @param ctx connection context
+ * @param stream the APDU
+ * @return NETWORK_ERROR_NONE if APDU was queued
+ */
+static int network_send_apdu_stream(Context *ctx, ByteStreamWriter *stream)
+{
+	LoopbackChannel *ch = channel_of(ctx);
+	intu8 *buffer;
+
+	if (!ch || __atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) {
+		return NETWORK_ERROR;
+	}
+
+	buffer = malloc(stream->size);
+	memcpy(buffer, stream->buffer, stream->size);
+
+	if (!queue_push(&ch->queue[!side_of(ctx)], buffer, stream->size)) {
+		ERROR("network loopback: channel %d ring full",
+		      (int) ctx->id.connid);
+		free(buffer);
+		return NETWORK_ERROR;
+	}
+
+	return NETWORK_ERROR_NONE;
+}
+
+/**
+ * Closes the channel. Both contexts are destroyed by the next pump,
+ * or when their connection loop finds the ring empty.
+ *
+ * @param ctx connection context
+ * @return NETWORK_ERROR_NONE
+ */
+static int network_disconnect(Context *ctx)
+{
+	LoopbackChannel *ch = channel_of(ctx);
+
+	if (ch) {
+		__atomic_store_n(&ch->closed, 1, __ATOMIC_RELEASE);
+	}
+
+	return NETWORK_ERROR_NONE;
+}
+
+static int network_finalize()
+{
+	int i;
+
+	if (!initialized) {
+		return NETWORK_ERROR_NONE;
+	}
+
+	initialized = 0;
+
+	for (i = 0; i < channel_count; ++i) {
+		channels[i].closed = 1;
+		channels[i].up[LOOPBACK_AGENT] = 0;
+		channels[i].up[LOOPBACK_MANAGER] = 0;
+		queue_clear(&channels[i].queue[LOOPBACK_AGENT]);
+		queue_clear(&channels[i].queue[LOOPBACK_MANAGER]);
+	}
+
+	return NETWORK_ERROR_NONE;
+}
+
+/**
+ * Brings a channel up, creating the manager context and then the agent
+ * context. Network must have been started.
+ *
+ * @param channel channel number, from 1 to the number of channels
+ * @return 1 if channel was connected, 0 if not
+ */
+int plugin_network_loopback_connect(int channel)
+{
+	LoopbackChannel *ch;
+	ContextId manager_cid = {plugin_ids[LOOPBACK_MANAGER], channel};
+	ContextId agent_cid = {plugin_ids[LOOPBACK_AGENT], channel};
+
+	if (initialized != 3 || channel < 1 || channel > channel_count) {
+		ERROR("network loopback: cannot connect channel %d", channel);
+		return 0;
+	}
+
+	ch = &channels[channel - 1];
+
+	if (ch->up[LOOPBACK_AGENT] || ch->up[LOOPBACK_MANAGER]) {
+		return 0;
+	}
+
+	ch->closed = 0;
+	ch->up[LOOPBACK_MANAGER] = 1;
+	ch->up[LOOPBACK_AGENT] = 1;
+
+	communication_transport_connect_indication(manager_cid, LOOPBACK_ADDR);
+	communication_transport_connect_indication(agent_cid, LOOPBACK_ADDR);
+
+	return 1;
+}
+
+/**
+ * Closes a channel and destroys both of its contexts right away
+ *
+ * @param channel channel number
+ */
+void plugin_network_loopback_disconnect(int channel)
+{
+	if (!channels || channel < 1 || channel > channel_count) {
+		return;
+	}
+
+	__atomic_store_n(&channels[channel - 1].closed, 1, __ATOMIC_RELEASE);
+	side_down(channel, LOOPBACK_AGENT);
+	side_down(channel, LOOPBACK_MANAGER);
+}
+
+/**
+ * Delivers queued APDUs on every channel, including the ones sent in
+ * response, until all rings are empty. Contexts of closed channels are
+ * destroyed.
+ *
+ * @return number of APDUs delivered
+ */
+int plugin_network_loopback_pump()
+{
+	int delivered = 0;
+	int progress = 1;
+	int i;
+	int side;
+
+	while (progress && initialized == 3) {
+		progress = 0;
+
+		for (i = 0; i < channel_count; ++i) {
+			LoopbackChannel *ch = &channels[i];
+
+			for (side = LOOPBACK_AGENT; side <= LOOPBACK_MANAGER; ++side) {
+				ContextId cid = {plugin_ids[side], i + 1};
+
+				while (ch->up[side] && !queue_empty(&ch->queue[side])) {
+					communication_read_input_stream(cid);
+					++delivered;
+					progress = 1;
+				}
+			}
+
+			if (__atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) {
+				side_down(i + 1, LOOPBACK_AGENT);
+				side_down(i + 1, LOOPBACK_MANAGER);
+			}
+		}
+	}
+
+	return delivered;
+}
+
+/**
+ * Sets up a pair of loopback plugins. Plugins should have been
+ * initialized by communication_plugin() beforehand.
+ *
+ * @param agent_plugin plugin to be passed to agent_init()
+ * @param manager_plugin plugin to be passed to manager_init()
+ * @param count number of channels
+ * @return NETWORK_ERROR_NONE if operation succeeds
+ */
+int plugin_network_loopback_setup(CommunicationPlugin *agent_plugin,
+				  CommunicationPlugin *manager_plugin,
+				  int count)
+{
+	if (count < 1) {
+		return NETWORK_ERROR;
+	}
+
+	free(channels);
+	channels = calloc(count, sizeof(LoopbackChannel));
+	channel_count = count;
+	initialized = 0;
+
+	agent_plugin->network_init = agent_network_init;
+	manager_plugin->network_init = manager_network_init;
+
+	agent_plugin->network_wait_for_data = network_wait_for_data;
+	agent_plugin->network_get_apdu_stream = network_get_apdu_stream;
+	agent_plugin->network_send_apdu_stream = network_send_apdu_stream;
+	agent_plugin->network_disconnect = network_disconnect;
+	agent_plugin->network_finalize = network_finalize;
+
+	manager_plugin->network_wait_for_data = network_wait_for_data;
+	manager_plugin->network_get_apdu_stream = network_get_apdu_stream;
+	manager_plugin->network_send_apdu_stream = network_send_apdu_stream;
+	manager_plugin->network_disconnect = network_disconnect;
+	manager_plugin->network_finalize = network_finalize;
+
+	return NETWORK_ERROR_NONE;
+}
+
+/** @} */
@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file plugin_loopback.h
+ * \brief In-process loopback plugin header.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef PLUGIN_LOOPBACK_H_
+#define PLUGIN_LOOPBACK_H_
+
+#include <communication/plugin/plugin.h>
+
+int plugin_network_loopback_setup(CommunicationPlugin *agent_plugin,
+				  CommunicationPlugin *manager_plugin,
+				  int channels);
+
+int plugin_network_loopback_connect(int channel);
+
+void plugin_network_loopback_disconnect(int channel);
+
+int plugin_network_loopback_pump();
+
+#endif /* PLUGIN_LOOPBACK_H_ */
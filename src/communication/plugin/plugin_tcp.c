@@ -120,6 +120,11 @@ typedef struct NetworkSocket {
  */
 static LinkedList *sockets = NULL;
 
+/**
+ * Whether listening ports may be shared with other processes
+ */
+static int reuse_port = 0;
+
 /**
  * \cond Undocumented
  */
@@ -152,62 +157,84 @@ static NetworkSocket *get_socket(int port)
 }
 
 /**
- * Initialize network layer.
- * Initialize network layer, in this case opens and initializes the tcp socket.
+ * Opens a TCP socket listening on a port of all interfaces, shared
+ * with other processes if plugin_network_tcp_set_reuseport() was called
  *
- * @param element Struct which contains network context
- * @return 1 if operation succeeds and 0 otherwise
+ * @param port TCP port
+ * @param server filled with the bound address
+ * @return socket, or -1 if error
  */
-static int init_socket(void *element)
+int plugin_network_tcp_listen(int port, struct sockaddr_in *server)
 {
-	int error = TCP_ERROR_NONE;
+	int error;
+	int sk;
 
-	NetworkSocket *sk = (NetworkSocket *) element;
+	memset(server, 0x00, sizeof(*server));
+	server->sin_family = AF_INET;
+	server->sin_addr.s_addr = INADDR_ANY;
+	server->sin_port = htons(port);
 
-	if (sk->tcp_port == 0) {
-		DEBUG(" network:tcp Error: TCP port not set");
-		return 0;
+	sk = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	if (sk < 0) {
+		DEBUG(" network:tcp Error opening the tcp socket");
+		return -1;
 	}
 
-	DEBUG("network tcp: starting socket  %d", sk->tcp_port);
+	// Set the socket options
+	int opt = 1; /* option is to be on/TRUE or off/FALSE */
 
-	memset(&(sk->server), 0x00, sizeof(sk->server));
-	sk->server.sin_family = AF_INET;
-	sk->server.sin_addr.s_addr = INADDR_ANY;
-	sk->server.sin_port = htons(sk->tcp_port);
+	setsockopt(sk, SOL_SOCKET, SO_REUSEADDR, (char *) &opt, sizeof(opt));
 
-	sk->server_sk = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	error = sk->server_sk;
+#ifdef SO_REUSEPORT
+	if (reuse_port && setsockopt(sk, SOL_SOCKET, SO_REUSEPORT,
+				     (char *) &opt, sizeof(opt)) < 0) {
+		ERROR(" network:tcp Cannot share port %d: %d", port, errno);
+		close(sk);
+		return -1;
+	}
+#endif
+
+	error = bind(sk, (struct sockaddr *) server, sizeof(struct sockaddr));
 
 	if (error < 0) {
-		DEBUG(" network:tcp Error opening the tcp socket");
-		close(sk->server_sk);
-		sk->server_sk = -1;
-		return 0;
+		DEBUG(" network:tcp Error in bind %d socket: %d", sk, errno);
+		close(sk);
+		return -1;
 	}
 
-	// Set the socket options
-	int opt = 1; /* option is to be on/TRUE or off/FALSE */
+	error = listen(sk, BACKLOG);
 
-	setsockopt(sk->server_sk, SOL_SOCKET, SO_REUSEADDR, (char *) &opt,
-		   sizeof(opt));
+	if (error < 0) {
+		DEBUG(" network:tcp Error in listen %d", sk);
+		close(sk);
+		return -1;
+	}
 
-	error = bind(sk->server_sk, (struct sockaddr *) &sk->server,
-		     sizeof(struct sockaddr));
+	return sk;
+}
 
-	if (error < 0) {
-		DEBUG(" network:tcp Error in bind %d socket: %d", sk->server_sk, errno);
-		close(sk->server_sk);
-		sk->server_sk = -1;
+/**
+ * Initialize network layer.
+ * Initialize network layer, in this case opens and initializes the tcp socket.
+ *
+ * @param element Struct which contains network context
+ * @return 1 if operation succeeds and 0 otherwise
+ */
+static int init_socket(void *element)
+{
+	NetworkSocket *sk = (NetworkSocket *) element;
+
+	if (sk->tcp_port == 0) {
+		DEBUG(" network:tcp Error: TCP port not set");
 		return 0;
 	}
 
-	error = listen(sk->server_sk, BACKLOG);
+	DEBUG("network tcp: starting socket  %d", sk->tcp_port);
 
-	if (error < 0) {
-		DEBUG(" network:tcp Error in listen %d", sk->server_sk);
-		close(sk->server_sk);
-		sk->server_sk = -1;
+	sk->server_sk = plugin_network_tcp_listen(sk->tcp_port, &sk->server);
+
+	if (sk->server_sk < 0) {
 		return 0;
 	}
 
@@ -217,6 +244,27 @@ static int init_socket(void *element)
 	return 1;
 }
 
+/**
+ * Lets several processes listen on the same ports (SO_REUSEPORT), the
+ * kernel spreading incoming connections among them. Every process must
+ * enable it before the network is started. Processes sharing ports
+ * should share the extended configuration directory too, so that a
+ * configuration learnt by one of them is known by all.
+ *
+ * @param enabled 1 to share ports, 0 otherwise
+ * @return 1 if the setting is supported by the system, 0 otherwise
+ */
+int plugin_network_tcp_set_reuseport(int enabled)
+{
+#ifdef SO_REUSEPORT
+	reuse_port = enabled;
+	return 1;
+#else
+	reuse_port = 0;
+	return !enabled;
+#endif
+}
+
 /**
  * Notify stack that there is a connection (and it should create a context)
  */
@@ -518,8 +566,27 @@ int plugin_network_tcp_setup(CommunicationPlugin *plugin, int numberOfPorts,
 			     ...)
 {
 	va_list port_list;
+	int ret;
+
 	va_start(port_list, numberOfPorts);
+	ret = plugin_network_tcp_vsetup(plugin, numberOfPorts, port_list);
+	va_end(port_list);
 
+	return ret;
+}
+
+/**
+ * Like plugin_network_tcp_setup(), taking the ports as a va_list
+ *
+ * @param plugin CommunicationPlugin pointer
+ * @param numberOfPorts number of socket ports
+ * @param port_list the ports
+ *
+ * @return TCP_ERROR if error
+ */
+int plugin_network_tcp_vsetup(CommunicationPlugin *plugin, int numberOfPorts,
+			      va_list port_list)
+{
 	DEBUG("network:tcp Initializing %d sockets", numberOfPorts);
 
 	if (sockets) {
@@ -539,8 +606,6 @@ int plugin_network_tcp_setup(CommunicationPlugin *plugin, int numberOfPorts,
 		}
 	}
 
-	va_end(port_list);
-
 	plugin->network_init = network_init;
 	plugin->network_wait_for_data = network_tcp_wait_for_data;
 	plugin->network_get_apdu_stream = network_get_apdu_stream;
@@ -33,10 +33,16 @@
 #ifndef PLUGIN_TCP_H_
 #define PLUGIN_TCP_H_
 
+#include <stdarg.h>
+#include <netinet/in.h>
 #include <communication/plugin/plugin.h>
 
 int plugin_network_tcp_setup(CommunicationPlugin *plugin, int numberOfPorts, ...);
+int plugin_network_tcp_vsetup(CommunicationPlugin *plugin, int numberOfPorts,
+			      va_list port_list);
+int plugin_network_tcp_listen(int port, struct sockaddr_in *server);
 void plugin_network_tcp_connect(int port);
+int plugin_network_tcp_set_reuseport(int enabled);
 
 
 #endif /* PLUGIN_TCP_H_ */
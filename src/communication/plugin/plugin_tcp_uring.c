@@ -0,0 +1,1037 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file plugin_tcp_uring.c
+ * \brief TCP manager plugin based on io_uring
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * @addtogroup Plugin
+ * @{
+ *
+ * Same behaviour as plugin_tcp (one listening port per context, the
+ * context id being the port), with the socket I/O done by io_uring:
+ *
+ * - receiving is a multishot recv armed once per connection, filling
+ *   buffers of a ring registered with the kernel. Data that arrives
+ *   while the stack is busy is already there on the next call, so
+ *   reading it costs no system call;
+ * - each APDU is sent straight from the encoder buffer, the submission
+ *   and the wait for its completion taking a single system call.
+ *
+ * Each port has a ring for accept and receive, used by the connection
+ * loop, and another one for sending, so that sends from other threads
+ * never wait behind a pending receive.
+ *
+ * If the kernel (or a seccomp filter) does not provide io_uring with
+ * provided buffer rings, plugin_network_tcp_uring_setup() sets up
+ * plugin_tcp instead.
+ */
+
+#include "src/communication/plugin/plugin_tcp_uring.h"
+#include "src/communication/plugin/plugin_tcp.h"
+#include "src/communication/communication.h"
+#include "src/util/log.h"
+#include "src/util/ioutil.h"
+#include "src/util/linkedlist.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * Set when plugin_tcp was set up instead
+ */
+static int fallback = 0;
+
+#ifdef HAVE_IO_URING
+
+/**
+ * \cond Undocumented
+ */
+static const int TCP_ERROR = NETWORK_ERROR;
+static const int TCP_ERROR_NONE = NETWORK_ERROR_NONE;
+
+#define URING_ENTRIES 8
+#define URING_BUFFERS 8
+#define URING_BUFFER_SIZE 16384
+#define URING_BUFFER_GROUP 0
+
+#define URING_ACCEPT 1
+#define URING_RECV 2
+#define URING_SEND 3
+/**
+ * \endcond
+ */
+
+/**
+ * Plugin ID attributed by stack
+ */
+static unsigned int plugin_id = 0;
+
+/**
+ * Whether the kernel supports multishot recv; cleared when it rejects it
+ */
+static int multishot = 1;
+
+/**
+ * Submission and completion queues shared with the kernel
+ */
+typedef struct Uring {
+	int fd;
+	unsigned int entries;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	void *cq_ring;
+	size_t cq_ring_size;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/**
+	 * Entries queued and not submitted yet
+	 */
+	unsigned int pending;
+} Uring;
+
+/**
+ * Struct which contains network context
+ */
+typedef struct UringSocket {
+	int server_sk;
+	int client_sk;
+	int tcp_port;
+	struct sockaddr_in server;
+	int connected;
+
+	/**
+	 * Accept and receive ring, used by the connection loop
+	 */
+	Uring rx;
+
+	/**
+	 * Send ring
+	 */
+	Uring tx;
+
+	/**
+	 * Receive buffers given to the kernel
+	 */
+	struct io_uring_buf_ring *buf_ring;
+	intu8 *bufs;
+	unsigned short buf_tail;
+
+	/**
+	 * Set while an accept is in flight; holds its result after
+	 */
+	int accepting;
+	int accept_result;
+
+	/**
+	 * Set while a receive is in flight
+	 */
+	int recv_armed;
+
+	/**
+	 * Set when the peer closed the connection or it failed
+	 */
+	int eof;
+
+	/**
+	 * Received bytes not consumed yet
+	 */
+	intu8 *buffer;
+	int buffer_size;
+	int buffer_retry;
+} UringSocket;
+
+/**
+ * List of the sockets
+ */
+static LinkedList *sockets = NULL;
+
+/**
+ * \cond Undocumented
+ */
+static int search_socket_by_port(void *arg, void *element)
+{
+	int port = *((int *) arg);
+	UringSocket *sk = (UringSocket *) element;
+
+	if (sk == NULL) {
+		return 0;
+	}
+
+	return port == sk->tcp_port;
+}
+/**
+ * \endcond
+ */
+
+/**
+ * Gets a socket
+ *
+ * @param port The port of the socket
+ * @return The socket
+ */
+static UringSocket *get_socket(int port)
+{
+	return (UringSocket *) llist_search_first(sockets, &port,
+			&search_socket_by_port);
+}
+
+/**
+ * Unmaps and closes a ring
+ *
+ * @param r ring
+ */
+static void uring_fin(Uring *r)
+{
+	if (r->sq_ring && r->sq_ring != MAP_FAILED) {
+		munmap(r->sq_ring, r->sq_ring_size);
+	}
+
+	if (r->cq_ring && r->cq_ring != MAP_FAILED) {
+		munmap(r->cq_ring, r->cq_ring_size);
+	}
+
+	if (r->sqes && r->sqes != MAP_FAILED) {
+		munmap(r->sqes, r->sqes_size);
+	}
+
+	if (r->fd >= 0) {
+		close(r->fd);
+	}
+
+	memset(r, 0, sizeof(Uring));
+	r->fd = -1;
+}
+
+/**
+ * Creates a ring
+ *
+ * @param r ring
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int uring_init(Uring *r)
+{
+	struct io_uring_params p;
+	intu8 *sq;
+	intu8 *cq;
+
+	memset(r, 0, sizeof(Uring));
+	memset(&p, 0, sizeof(p));
+
+	r->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+
+	if (r->fd < 0) {
+		DEBUG(" network:tcp_uring io_uring_setup: %d", errno);
+		r->fd = -1;
+		return 0;
+	}
+
+	r->entries = p.sq_entries;
+	r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_ring_size = p.cq_off.cqes +
+			  p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+
+	if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED ||
+	    r->sqes == MAP_FAILED) {
+		DEBUG(" network:tcp_uring cannot map rings: %d", errno);
+		uring_fin(r);
+		return 0;
+	}
+
+	sq = r->sq_ring;
+	r->sq_head = (unsigned int *) (sq + p.sq_off.head);
+	r->sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+	r->sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned int *) (sq + p.sq_off.array);
+
+	cq = r->cq_ring;
+	r->cq_head = (unsigned int *) (cq + p.cq_off.head);
+	r->cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+	r->cq_mask = (unsigned int *) (cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+	return 1;
+}
+
+/**
+ * Gets a cleared submission entry, to be queued by uring_commit()
+ *
+ * @param r ring
+ * @return entry, or NULL if the queue is full
+ */
+static struct io_uring_sqe *uring_sqe(Uring *r)
+{
+	unsigned int tail = *r->sq_tail;
+	unsigned int head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	struct io_uring_sqe *sqe;
+
+	if (tail - head >= r->entries) {
+		return NULL;
+	}
+
+	sqe = &r->sqes[tail & *r->sq_mask];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	return sqe;
+}
+
+/**
+ * Queues the entry returned by the last uring_sqe()
+ *
+ * @param r ring
+ */
+static void uring_commit(Uring *r)
+{
+	unsigned int tail = *r->sq_tail;
+
+	r->sq_array[tail & *r->sq_mask] = tail & *r->sq_mask;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	++r->pending;
+}
+
+/**
+ * Submits queued entries and waits for completions, in one system call
+ *
+ * @param r ring
+ * @param wait number of completions to wait for
+ * @return 0 if operation succeeds, -1 otherwise
+ */
+static int uring_wait(Uring *r, unsigned int wait)
+{
+	int ret;
+
+	do {
+		ret = syscall(__NR_io_uring_enter, r->fd, r->pending, wait,
+			      wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		DEBUG(" network:tcp_uring io_uring_enter: %d", errno);
+		return -1;
+	}
+
+	r->pending -= (unsigned int) ret < r->pending ? (unsigned int) ret
+						       : r->pending;
+
+	return 0;
+}
+
+/**
+ * Takes a completion, if any
+ *
+ * @param r ring
+ * @param cqe filled with the completion
+ * @return 1 if a completion was taken, 0 otherwise
+ */
+static int uring_peek(Uring *r, struct io_uring_cqe *cqe)
+{
+	unsigned int head = *r->cq_head;
+	unsigned int tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail) {
+		return 0;
+	}
+
+	*cqe = r->cqes[head & *r->cq_mask];
+	__atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/**
+ * Gives a receive buffer back to the kernel
+ *
+ * @param sk socket
+ * @param bid buffer id
+ */
+static void buffer_recycle(UringSocket *sk, int bid)
+{
+	struct io_uring_buf *buf =
+		&sk->buf_ring->bufs[sk->buf_tail & (URING_BUFFERS - 1)];
+
+	buf->addr = (unsigned long) (sk->bufs + bid * URING_BUFFER_SIZE);
+	buf->len = URING_BUFFER_SIZE;
+	buf->bid = bid;
+
+	++sk->buf_tail;
+	__atomic_store_n(&sk->buf_ring->tail, sk->buf_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Frees the rings and buffers of a socket
+ *
+ * @param sk socket
+ */
+static void uring_socket_fin(UringSocket *sk)
+{
+	uring_fin(&sk->rx);
+	uring_fin(&sk->tx);
+
+	if (sk->buf_ring) {
+		munmap(sk->buf_ring, URING_BUFFERS * sizeof(struct io_uring_buf));
+		sk->buf_ring = NULL;
+	}
+
+	free(sk->bufs);
+	sk->bufs = NULL;
+}
+
+/**
+ * Creates the rings of a socket and registers its receive buffers
+ *
+ * @param sk socket
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int uring_socket_init(UringSocket *sk)
+{
+	struct io_uring_buf_reg reg;
+	void *ring;
+	int i;
+
+	sk->rx.fd = -1;
+	sk->tx.fd = -1;
+
+	if (!uring_init(&sk->rx) || !uring_init(&sk->tx)) {
+		uring_socket_fin(sk);
+		return 0;
+	}
+
+	// must be page aligned
+	ring = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf),
+		    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	sk->bufs = malloc(URING_BUFFERS * URING_BUFFER_SIZE);
+
+	if (ring == MAP_FAILED || !sk->bufs) {
+		if (ring != MAP_FAILED) {
+			munmap(ring, URING_BUFFERS * sizeof(struct io_uring_buf));
+		}
+		uring_socket_fin(sk);
+		return 0;
+	}
+
+	sk->buf_ring = ring;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long) ring;
+	reg.ring_entries = URING_BUFFERS;
+	reg.bgid = URING_BUFFER_GROUP;
+
+	if (syscall(__NR_io_uring_register, sk->rx.fd,
+		    IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		DEBUG(" network:tcp_uring cannot register buffers: %d", errno);
+		uring_socket_fin(sk);
+		return 0;
+	}
+
+	sk->buf_tail = 0;
+
+	for (i = 0; i < URING_BUFFERS; ++i) {
+		buffer_recycle(sk, i);
+	}
+
+	return 1;
+}
+
+/**
+ * Handles the completions available in the receive ring
+ *
+ * @param sk socket
+ * @return number of completions handled
+ */
+static int rx_reap(UringSocket *sk)
+{
+	struct io_uring_cqe cqe;
+	int count = 0;
+
+	while (uring_peek(&sk->rx, &cqe)) {
+		++count;
+
+		if (cqe.user_data == URING_ACCEPT) {
+			sk->accepting = 0;
+			sk->accept_result = cqe.res;
+			continue;
+		}
+
+		if (!(cqe.flags & IORING_CQE_F_MORE)) {
+			sk->recv_armed = 0;
+		}
+
+		if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+			int bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+			intu8 *buffer = realloc(sk->buffer,
+						sk->buffer_size + cqe.res);
+
+			if (buffer == NULL) {
+				// old buffer kept; connection is dropped
+				ERROR(" network:tcp_uring out of memory");
+				buffer_recycle(sk, bid);
+				sk->eof = 1;
+				continue;
+			}
+
+			sk->buffer = buffer;
+			memcpy(sk->buffer + sk->buffer_size,
+			       sk->bufs + bid * URING_BUFFER_SIZE, cqe.res);
+			sk->buffer_size += cqe.res;
+
+			buffer_recycle(sk, bid);
+		} else if (cqe.res == -EINVAL && multishot) {
+			DEBUG(" network:tcp_uring no multishot recv");
+			multishot = 0;
+		} else if (cqe.res != -ENOBUFS) {
+			// 0 when the peer closed the connection
+			sk->eof = 1;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Queues a receive into the registered buffers
+ *
+ * @param sk socket
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int rx_arm(UringSocket *sk)
+{
+	struct io_uring_sqe *sqe = uring_sqe(&sk->rx);
+
+	if (!sqe) {
+		return 0;
+	}
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = sk->client_sk;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	sqe->ioprio = multishot ? IORING_RECV_MULTISHOT : 0;
+	sqe->user_data = URING_RECV;
+	uring_commit(&sk->rx);
+
+	sk->recv_armed = 1;
+
+	return 1;
+}
+
+/**
+ * Ends the connection, waiting for the receive in flight to complete
+ * so that it does not reach the next connection
+ *
+ * @param sk socket
+ */
+static void rx_close(UringSocket *sk)
+{
+	if (sk->client_sk < 0) {
+		return;
+	}
+
+	shutdown(sk->client_sk, SHUT_RDWR);
+
+	while (sk->recv_armed) {
+		if (!rx_reap(sk) && uring_wait(&sk->rx, 1) < 0) {
+			break;
+		}
+	}
+
+	close(sk->client_sk);
+	sk->client_sk = -1;
+	sk->connected = 0;
+	sk->eof = 0;
+
+	free(sk->buffer);
+	sk->buffer = NULL;
+	sk->buffer_size = 0;
+	sk->buffer_retry = 0;
+}
+
+/**
+ * Initialize network layer, in this case opens the listening socket
+ * and the rings.
+ *
+ * @param element Struct which contains network context
+ * @return 1 if operation succeeds and 0 otherwise
+ */
+static int init_socket(void *element)
+{
+	UringSocket *sk = (UringSocket *) element;
+
+	DEBUG("network tcp_uring: starting socket  %d", sk->tcp_port);
+
+	if (!uring_socket_init(sk)) {
+		ERROR(" network:tcp_uring Cannot set up io_uring");
+		return 0;
+	}
+
+	sk->server_sk = plugin_network_tcp_listen(sk->tcp_port, &sk->server);
+
+	if (sk->server_sk < 0) {
+		uring_socket_fin(sk);
+		return 0;
+	}
+
+	ContextId cid = {plugin_id, sk->tcp_port};
+	communication_transport_connect_indication(cid, "tcp");
+
+	return 1;
+}
+
+/**
+ * Initialize network layer
+ *
+ * @param plugin_label the Plugin ID or label attributed by stack to this plugin
+ * @return TCP_ERROR_NONE if operation succeeds
+ */
+static int network_init(unsigned int plugin_label)
+{
+	plugin_id = plugin_label;
+
+	if (llist_iterate(sockets, init_socket)) {
+		return TCP_ERROR_NONE;
+	}
+
+	return TCP_ERROR;
+}
+
+/**
+ * Blocks until an agent connects, if none is connected
+ *
+ * @param ctx current connection context.
+ * @return TCP_ERROR_NONE if data is available or TCP_ERROR if error.
+ */
+static int network_wait_for_data(Context *ctx)
+{
+	UringSocket *sk = get_socket(ctx->id.connid);
+	struct io_uring_sqe *sqe;
+
+	if (sk == NULL) {
+		DEBUG("network tcp_uring: network_wait_for_data unknown context");
+		return TCP_ERROR;
+	}
+
+	if (sk->connected) {
+		return TCP_ERROR_NONE;
+	}
+
+	sqe = uring_sqe(&sk->rx);
+
+	if (!sqe) {
+		return TCP_ERROR;
+	}
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = sk->server_sk;
+	sqe->user_data = URING_ACCEPT;
+	uring_commit(&sk->rx);
+	sk->accepting = 1;
+
+	while (sk->accepting) {
+		if (!rx_reap(sk) && uring_wait(&sk->rx, 1) < 0) {
+			return TCP_ERROR;
+		}
+	}
+
+	if (sk->accept_result < 0) {
+		DEBUG(" network:tcp_uring Error in accept %d: %d",
+		      sk->server_sk, -sk->accept_result);
+		close(sk->server_sk);
+		sk->server_sk = -1;
+		return TCP_ERROR;
+	}
+
+	sk->client_sk = sk->accept_result;
+	sk->connected = 1;
+	sk->eof = 0;
+
+	// armed once for the whole connection (multishot)
+	rx_arm(sk);
+
+	return TCP_ERROR_NONE;
+}
+
+/**
+ * Reads an APDU
+ *
+ * @param ctx
+ * @return a byteStream with the read APDU or NULL if error.
+ */
+static ByteStreamReader *network_get_apdu_stream(Context *ctx)
+{
+	UringSocket *sk = get_socket(ctx->id.connid);
+
+	if (sk == NULL) {
+		ERROR("network tcp_uring: network_get_apdu_stream cannot find a valid socket");
+		return NULL;
+	}
+
+	ContextId cid = {plugin_id, sk->tcp_port};
+
+	if (sk->buffer_retry) {
+		// see if there is another complete APDU in buffer
+		sk->buffer_retry = 0;
+	} else {
+		int before = sk->buffer_size;
+
+		rx_reap(sk);
+
+		while (sk->buffer_size == before && !sk->eof) {
+			if (!sk->recv_armed && !rx_arm(sk)) {
+				sk->eof = 1;
+			} else if (uring_wait(&sk->rx, 1) < 0) {
+				sk->eof = 1;
+			} else {
+				rx_reap(sk);
+			}
+		}
+
+		if (sk->buffer_size == before) {
+			rx_close(sk);
+			communication_transport_disconnect_indication(cid, "tcp");
+			return NULL;
+		}
+	}
+
+	if (sk->buffer_size < 4) {
+		DEBUG(" network:tcp_uring incomplete APDU (received %d)",
+		      sk->buffer_size);
+		return NULL;
+	}
+
+	int apdu_size = (sk->buffer[2] << 8 | sk->buffer[3]) + 4;
+
+	if (sk->buffer_size < apdu_size) {
+		DEBUG(" network:tcp_uring incomplete APDU (expect %d received %d)",
+		      apdu_size, sk->buffer_size);
+		return NULL;
+	}
+
+	ByteStreamReader *stream = byte_stream_reader_instance(sk->buffer,
+							       apdu_size);
+
+	if (stream == NULL) {
+		DEBUG(" network:tcp_uring Error creating bytelib");
+		free(sk->buffer);
+		sk->buffer = NULL;
+		sk->buffer_size = 0;
+		return NULL;
+	}
+
+	sk->buffer = NULL;
+	sk->buffer_size -= apdu_size;
+
+	if (sk->buffer_size > 0) {
+		// leave next APDU in place
+		sk->buffer_retry = 1;
+		sk->buffer = malloc(sk->buffer_size);
+		memcpy(sk->buffer, stream->buffer_cur + apdu_size,
+		       sk->buffer_size);
+	}
+
+	DEBUG(" network:tcp_uring APDU received ");
+	ioutil_print_buffer(stream->buffer_cur, apdu_size);
+
+	return stream;
+}
+
+/**
+ * Sends an encoded apdu, straight from its buffer
+ *
+ * @param ctx Context
+ * @param stream the apdu to be sent
+ * @return TCP_ERROR_NONE if data sent successfully and TCP_ERROR otherwise
+ */
+static int network_send_apdu_stream(Context *ctx, ByteStreamWriter *stream)
+{
+	UringSocket *sk = get_socket(ctx->id.connid);
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+	unsigned int written = 0;
+
+	if (sk == NULL || sk->client_sk < 0)
+		return TCP_ERROR;
+
+	while (written < stream->size) {
+		sqe = uring_sqe(&sk->tx);
+
+		if (!sqe) {
+			return TCP_ERROR;
+		}
+
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = sk->client_sk;
+		sqe->addr = (unsigned long) (stream->buffer + written);
+		sqe->len = stream->size - written;
+		sqe->msg_flags = MSG_NOSIGNAL;
+		sqe->user_data = URING_SEND;
+		uring_commit(&sk->tx);
+
+		if (uring_wait(&sk->tx, 1) < 0 || !uring_peek(&sk->tx, &cqe)) {
+			return TCP_ERROR;
+		}
+
+		if (cqe.res <= 0) {
+			DEBUG(" network:tcp_uring Error sending APDU: %d",
+			      -cqe.res);
+			return TCP_ERROR;
+		}
+
+		written += cqe.res;
+	}
+
+	DEBUG(" network:tcp_uring APDU sent ");
+	ioutil_print_buffer(stream->buffer, stream->size);
+
+	return TCP_ERROR_NONE;
+}
+
+/**
+ * Finalizes a socket (can be re-initialized again)
+ *
+ * @param element contains a UringSocket struct pointer
+ */
+static int fin_socket(void *element)
+{
+	UringSocket *sk = (UringSocket *) element;
+
+	if (sk != NULL) {
+		rx_close(sk);
+
+		if (sk->server_sk >= 0) {
+			close(sk->server_sk);
+			sk->server_sk = -1;
+		}
+
+		uring_socket_fin(sk);
+		DEBUG(" network tcp_uring: socket %d closed ", sk->tcp_port);
+	}
+
+	return 1;
+}
+
+/**
+ * Network disconnect. The receive ring belongs to the connection loop,
+ * so the socket is only shut down here; the loop sees the end of the
+ * stream and closes it.
+ *
+ * @param ctx
+ * @return TCP_ERROR_NONE
+ */
+static int network_disconnect(Context *ctx)
+{
+	UringSocket *sk = get_socket(ctx->id.connid);
+
+	if (sk == NULL)
+		return TCP_ERROR;
+
+	if (sk->client_sk >= 0) {
+		shutdown(sk->client_sk, SHUT_RDWR);
+	}
+
+	return TCP_ERROR_NONE;
+}
+
+/**
+ * Finalizes network layer and deallocated data
+ *
+ * @return TCP_ERROR_NONE if operation succeeds
+ */
+static int network_finalize()
+{
+	llist_iterate(sockets, &fin_socket);
+
+	return TCP_ERROR_NONE;
+}
+
+/**
+ * Checks that io_uring, with provided buffer rings, can be used
+ *
+ * @return 1 if so, 0 otherwise
+ */
+static int uring_probe()
+{
+	UringSocket sk;
+	int ok;
+
+	memset(&sk, 0, sizeof(sk));
+	ok = uring_socket_init(&sk);
+
+	if (ok) {
+		uring_socket_fin(&sk);
+	}
+
+	return ok;
+}
+
+/**
+ * Frees a UringSocket struct, for llist_destroy()
+ *
+ * @param element UringSocket struct pointer
+ */
+static int free_socket(void *element)
+{
+	free(element);
+	return 1;
+}
+
+/**
+ * Creates a UringSocket struct for the given port
+ *
+ * @param port TCP port
+ * @return TCP_ERROR_NONE if ok
+ */
+static int create_socket(int port)
+{
+	if (sockets == NULL) {
+		sockets = llist_new();
+	}
+
+	UringSocket *sk = calloc(1, sizeof(UringSocket));
+
+	if (sk == NULL || !llist_add(sockets, sk)) {
+		ERROR("network tcp_uring: Cannot create socket %d", port);
+		free(sk);
+		return TCP_ERROR;
+	}
+
+	sk->tcp_port = port;
+	sk->server_sk = -1;
+	sk->client_sk = -1;
+	sk->rx.fd = -1;
+	sk->tx.fd = -1;
+
+	return TCP_ERROR_NONE;
+}
+
+#endif /* HAVE_IO_URING */
+
+/**
+ * Notify stack that there is a connection (and it should create a context)
+ */
+void plugin_network_tcp_uring_connect(int port)
+{
+#ifdef HAVE_IO_URING
+	if (!fallback) {
+		ContextId cid = {plugin_id, port};
+		communication_transport_connect_indication(cid, "tcp");
+		return;
+	}
+#endif
+
+	plugin_network_tcp_connect(port);
+}
+
+/**
+ * @return 1 if io_uring is in use, 0 if plugin_tcp was set up instead
+ */
+int plugin_network_tcp_uring_active()
+{
+	return !fallback;
+}
+
+/**
+ * Initiate a CommunicationPlugin struct to use tcp connections through
+ * io_uring, or through plugin_tcp if io_uring is not available.
+ *
+ * @param plugin CommunicationPlugin pointer
+ * @param numberOfPorts number of socket ports
+ *
+ * @return NETWORK_ERROR if error
+ */
+int plugin_network_tcp_uring_setup(CommunicationPlugin *plugin,
+				   int numberOfPorts, ...)
+{
+	va_list port_list;
+	int ret;
+
+	va_start(port_list, numberOfPorts);
+
+#ifdef HAVE_IO_URING
+	if (uring_probe()) {
+		int i;
+
+		fallback = 0;
+
+		if (sockets) {
+			// plugin was already initialized once
+			llist_destroy(sockets, &free_socket);
+			sockets = NULL;
+		}
+
+		ret = TCP_ERROR_NONE;
+
+		for (i = 0; i < numberOfPorts && ret == TCP_ERROR_NONE; i++) {
+			ret = create_socket(va_arg(port_list, int));
+		}
+
+		va_end(port_list);
+
+		plugin->network_init = network_init;
+		plugin->network_wait_for_data = network_wait_for_data;
+		plugin->network_get_apdu_stream = network_get_apdu_stream;
+		plugin->network_send_apdu_stream = network_send_apdu_stream;
+		plugin->network_disconnect = network_disconnect;
+		plugin->network_finalize = network_finalize;
+
+		return ret;
+	}
+#endif
+
+	INFO("network:tcp_uring io_uring not available, using plain TCP");
+
+	fallback = 1;
+	ret = plugin_network_tcp_vsetup(plugin, numberOfPorts, port_list);
+	va_end(port_list);
+
+	return ret;
+}
+
+/** @} */
@@ -0,0 +1,732 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file plugin_unix.c
+ * \brief Unix domain socket plugin, for manager and agent
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * @addtogroup Plugin
+ * @{
+ *
+ * Transport for bridges and proxies running on the same host as the
+ * manager. Sockets are SOCK_SEQPACKET: every APDU is sent as one
+ * message and received whole, so there is no reassembly buffer and
+ * each received message becomes the APDU stream as is.
+ *
+ * Unlike plugin_tcp, the manager listens on a single address and
+ * accepts any number of agents, each one with a context of its own
+ * (connection ids 1, 2, ...). The application accepts connections
+ * with plugin_network_unix_accept(), e.g. when
+ * plugin_network_unix_listen_fd() becomes readable, and then runs the
+ * connection loop of the returned context.
+ *
+ * Addresses starting with '@' are in the Linux abstract namespace:
+ * nothing is created in the file system, and the name goes away with
+ * the socket. Other addresses are file system paths; the manager
+ * removes stale ones before binding and on finalization.
+ *
+ * The manager and the agent sides keep separate state, so both may be
+ * used in the same process, but each side may be set up once only.
+ */
+
+#include "src/communication/communication.h"
+#include "src/communication/plugin/plugin_unix.h"
+#include "src/util/log.h"
+#include "src/util/ioutil.h"
+#include "src/util/linkedlist.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * \cond Undocumented
+ */
+static const int UNIX_ERROR = NETWORK_ERROR;
+static const int UNIX_ERROR_NONE = NETWORK_ERROR_NONE;
+static const int BACKLOG = 16;
+
+/**
+ * Largest APDU: 4 bytes of header plus a 16-bit length
+ */
+#define UNIX_MAX_APDU (65535 + 4)
+/**
+ * \endcond
+ */
+
+/**
+ * Connection to a peer
+ */
+typedef struct UnixConnection {
+	unsigned long long connid;
+	int sk;
+	/**
+	 * References: one from the connection list, one per call using
+	 * the socket. Protected by the endpoint mutex.
+	 */
+	int ref;
+} UnixConnection;
+
+/**
+ * State of one side (manager or agent)
+ */
+typedef struct UnixEndpoint {
+	/**
+	 * Address, '@' first for the abstract namespace
+	 */
+	char *path;
+
+	/**
+	 * Plugin ID attributed by stack
+	 */
+	unsigned int plugin_id;
+
+	/**
+	 * Listening socket (manager only)
+	 */
+	int listen_sk;
+
+	/**
+	 * Connection id of the next accepted connection
+	 */
+	unsigned long long next_connid;
+
+	/**
+	 * Open connections (UnixConnection)
+	 */
+	LinkedList *connections;
+
+	/**
+	 * Protects connections and next_connid
+	 */
+	pthread_mutex_t mutex;
+} UnixEndpoint;
+
+static UnixEndpoint manager_side = {
+	.path = NULL,
+	.plugin_id = 0,
+	.listen_sk = -1,
+	.next_connid = 1,
+	.connections = NULL,
+	.mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+static UnixEndpoint agent_side = {
+	.path = NULL,
+	.plugin_id = 0,
+	.listen_sk = -1,
+	.next_connid = 1,
+	.connections = NULL,
+	.mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+/**
+ * \cond Undocumented
+ */
+static int search_connection(void *arg, void *element)
+{
+	unsigned long long connid = *((unsigned long long *) arg);
+	UnixConnection *conn = (UnixConnection *) element;
+
+	return conn != NULL && conn->connid == connid;
+}
+
+static int close_connection(void *element)
+{
+	UnixConnection *conn = (UnixConnection *) element;
+
+	if (conn->sk >= 0) {
+		close(conn->sk);
+	}
+
+	free(conn);
+	return 1;
+}
+/**
+ * \endcond
+ */
+
+/**
+ * Gets the side a context belongs to
+ *
+ * @param ctx context
+ * @return side, or NULL if none
+ */
+static UnixEndpoint *endpoint_of(Context *ctx)
+{
+	if (manager_side.plugin_id && ctx->id.plugin == manager_side.plugin_id) {
+		return &manager_side;
+	} else if (agent_side.plugin_id && ctx->id.plugin == agent_side.plugin_id) {
+		return &agent_side;
+	}
+
+	return NULL;
+}
+
+/**
+ * Gets the connection of a context, holding a reference so that its
+ * socket is not closed (and its number not reused) while in use
+ *
+ * @param ctx context
+ * @return connection, to be released by connection_put(), or NULL
+ */
+static UnixConnection *connection_get(Context *ctx)
+{
+	UnixEndpoint *ep = endpoint_of(ctx);
+	UnixConnection *conn;
+
+	if (!ep) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&ep->mutex);
+	conn = llist_search_first(ep->connections, &ctx->id.connid,
+				  &search_connection);
+	if (conn) {
+		++conn->ref;
+	}
+	pthread_mutex_unlock(&ep->mutex);
+
+	return conn;
+}
+
+/**
+ * Drops a reference to a connection, closing it with the last one
+ *
+ * @param ep side
+ * @param conn connection
+ */
+static void connection_put(UnixEndpoint *ep, UnixConnection *conn)
+{
+	int ref;
+
+	pthread_mutex_lock(&ep->mutex);
+	ref = --conn->ref;
+	pthread_mutex_unlock(&ep->mutex);
+
+	if (ref == 0) {
+		close_connection(conn);
+	}
+}
+
+/**
+ * Adds a connection and tells the stack about it
+ *
+ * @param ep side
+ * @param sk connected socket
+ * @param id filled with the context id
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int add_connection(UnixEndpoint *ep, int sk, ContextId *id)
+{
+	UnixConnection *conn = calloc(1, sizeof(UnixConnection));
+
+	if (!conn) {
+		close(sk);
+		return 0;
+	}
+
+	conn->sk = sk;
+	conn->ref = 1;
+
+	pthread_mutex_lock(&ep->mutex);
+	if (!ep->connections) {
+		ep->connections = llist_new();
+	}
+	conn->connid = ep->next_connid++;
+	llist_add(ep->connections, conn);
+	pthread_mutex_unlock(&ep->mutex);
+
+	id->plugin = ep->plugin_id;
+	id->connid = conn->connid;
+
+	communication_transport_connect_indication(*id, "unix");
+
+	return 1;
+}
+
+/**
+ * Closes and forgets the connection of a context
+ *
+ * @param ep side
+ * @param connid connection id
+ * @return 1 if the connection existed, 0 otherwise
+ */
+static int remove_connection(UnixEndpoint *ep, unsigned long long connid)
+{
+	UnixConnection *conn;
+
+	pthread_mutex_lock(&ep->mutex);
+	conn = llist_search_first(ep->connections, &connid,
+				  &search_connection);
+	if (conn) {
+		llist_remove(ep->connections, conn);
+	}
+	pthread_mutex_unlock(&ep->mutex);
+
+	if (conn) {
+		// wakes up users of the socket, closed by the last one
+		shutdown(conn->sk, SHUT_RDWR);
+		connection_put(ep, conn);
+	}
+
+	return conn != NULL;
+}
+
+/**
+ * Fills a Unix socket address
+ *
+ * @param path address, '@' first for the abstract namespace
+ * @param sa address to fill
+ * @return address length, 0 if the address is not valid
+ */
+static socklen_t unix_address(const char *path, struct sockaddr_un *sa)
+{
+	size_t len = strlen(path);
+
+	memset(sa, 0, sizeof(struct sockaddr_un));
+	sa->sun_family = AF_UNIX;
+
+	if (len == 0 || len >= sizeof(sa->sun_path)) {
+		ERROR("network:unix Invalid address %s", path);
+		return 0;
+	}
+
+	memcpy(sa->sun_path, path, len);
+
+	if (path[0] == '@') {
+#ifdef __linux__
+		sa->sun_path[0] = '\0';
+		return offsetof(struct sockaddr_un, sun_path) + len;
+#else
+		ERROR("network:unix No abstract namespace on this system");
+		return 0;
+#endif
+	}
+
+	return offsetof(struct sockaddr_un, sun_path) + len + 1;
+}
+
+/**
+ * Opens the listening socket of the manager
+ *
+ * @param plugin_label the Plugin ID or label attributed by stack to this plugin
+ * @return UNIX_ERROR_NONE if operation succeeds
+ */
+static int manager_network_init(unsigned int plugin_label)
+{
+	struct sockaddr_un sa;
+	socklen_t len = unix_address(manager_side.path, &sa);
+
+	manager_side.plugin_id = plugin_label;
+
+	if (!len) {
+		return UNIX_ERROR;
+	}
+
+	manager_side.listen_sk = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+	if (manager_side.listen_sk < 0) {
+		ERROR("network:unix Cannot open socket: %d", errno);
+		return UNIX_ERROR;
+	}
+
+	if (manager_side.path[0] != '@') {
+		unlink(manager_side.path);
+	}
+
+	if (bind(manager_side.listen_sk, (struct sockaddr *) &sa, len) < 0 ||
+	    listen(manager_side.listen_sk, BACKLOG) < 0) {
+		ERROR("network:unix Cannot listen on %s: %d",
+		      manager_side.path, errno);
+		close(manager_side.listen_sk);
+		manager_side.listen_sk = -1;
+		return UNIX_ERROR;
+	}
+
+	DEBUG("network:unix listening on %s", manager_side.path);
+
+	return UNIX_ERROR_NONE;
+}
+
+/**
+ * Connects the agent to the manager
+ *
+ * @param plugin_label the Plugin ID or label attributed by stack to this plugin
+ * @return UNIX_ERROR_NONE if operation succeeds
+ */
+static int agent_network_init(unsigned int plugin_label)
+{
+	struct sockaddr_un sa;
+	socklen_t len = unix_address(agent_side.path, &sa);
+	ContextId id;
+	int sk;
+
+	agent_side.plugin_id = plugin_label;
+
+	if (!len) {
+		return UNIX_ERROR;
+	}
+
+	sk = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+	if (sk < 0) {
+		ERROR("network:unix Cannot open socket: %d", errno);
+		return UNIX_ERROR;
+	}
+
+	if (connect(sk, (struct sockaddr *) &sa, len) < 0) {
+		ERROR("network:unix Cannot connect to %s: %d",
+		      agent_side.path, errno);
+		close(sk);
+		return UNIX_ERROR;
+	}
+
+	return add_connection(&agent_side, sk, &id) ? UNIX_ERROR_NONE
+						    : UNIX_ERROR;
+}
+
+/**
+ * Blocks to wait data to be available from the socket
+ *
+ * @param ctx current connection context.
+ * @return UNIX_ERROR_NONE if data is available or UNIX_ERROR if error.
+ */
+static int network_wait_for_data(Context *ctx)
+{
+	UnixConnection *conn = connection_get(ctx);
+	struct pollfd pfd;
+	int ret;
+
+	if (!conn) {
+		DEBUG("network:unix network_wait_for_data unknown context");
+		return UNIX_ERROR;
+	}
+
+	pfd.fd = conn->sk;
+	pfd.events = POLLIN;
+
+	do {
+		ret = poll(&pfd, 1, -1);
+	} while (ret < 0 && errno == EINTR);
+
+	connection_put(endpoint_of(ctx), conn);
+
+	return ret > 0 ? UNIX_ERROR_NONE : UNIX_ERROR;
+}
+
+/**
+ * Reads an APDU, which is exactly one message
+ *
+ * @param ctx
+ * @return a byteStream with the read APDU or NULL if error.
+ */
+static ByteStreamReader *network_get_apdu_stream(Context *ctx)
+{
+	UnixEndpoint *ep = endpoint_of(ctx);
+	UnixConnection *conn = connection_get(ctx);
+	ByteStreamReader *stream;
+	intu8 *buffer;
+	intu8 *shrunk;
+	ssize_t size;
+
+	if (!conn) {
+		ERROR("network:unix network_get_apdu_stream cannot find a valid socket");
+		return NULL;
+	}
+
+	buffer = malloc(UNIX_MAX_APDU);
+
+	if (!buffer) {
+		connection_put(ep, conn);
+		return NULL;
+	}
+
+	do {
+		size = recv(conn->sk, buffer, UNIX_MAX_APDU, 0);
+	} while (size < 0 && errno == EINTR);
+
+	connection_put(ep, conn);
+
+	if (size <= 0) {
+		DEBUG("network:unix connection %u:%llu closed",
+		      ctx->id.plugin, ctx->id.connid);
+		free(buffer);
+		remove_connection(ep, ctx->id.connid);
+		communication_transport_disconnect_indication(ctx->id, "unix");
+		return NULL;
+	}
+
+	if (size < 4 || ((buffer[2] << 8 | buffer[3]) + 4) != size) {
+		ERROR("network:unix malformed APDU message (%d bytes)",
+		      (int) size);
+		free(buffer);
+		return NULL;
+	}
+
+	shrunk = realloc(buffer, size);
+	if (shrunk) {
+		buffer = shrunk;
+	}
+
+	stream = byte_stream_reader_instance(buffer, size);
+
+	if (!stream) {
+		free(buffer);
+		return NULL;
+	}
+
+	DEBUG(" network:unix APDU received ");
+	ioutil_print_buffer(buffer, size);
+
+	return stream;
+}
+
+/**
+ * Sends an encoded apdu as one message
+ *
+ * @param ctx
+ * @param stream the apdu to be sent
+ * @return UNIX_ERROR_NONE if data sent successfully and UNIX_ERROR otherwise
+ */
+static int network_send_apdu_stream(Context *ctx, ByteStreamWriter *stream)
+{
+	UnixConnection *conn = connection_get(ctx);
+	ssize_t ret;
+
+	if (!conn) {
+		return UNIX_ERROR;
+	}
+
+	do {
+		ret = send(conn->sk, stream->buffer, stream->size,
+			   MSG_NOSIGNAL);
+	} while (ret < 0 && errno == EINTR);
+
+	connection_put(endpoint_of(ctx), conn);
+
+	if (ret != (ssize_t) stream->size) {
+		DEBUG(" network:unix Error sending APDU: %d", errno);
+		return UNIX_ERROR;
+	}
+
+	DEBUG(" network:unix APDU sent ");
+	ioutil_print_buffer(stream->buffer, stream->size);
+
+	return UNIX_ERROR_NONE;
+}
+
+/**
+ * Network disconnect. The peer sees the end of the connection.
+ *
+ * @param ctx
+ * @return UNIX_ERROR_NONE
+ */
+static int network_disconnect(Context *ctx)
+{
+	UnixEndpoint *ep = endpoint_of(ctx);
+
+	if (!ep || !remove_connection(ep, ctx->id.connid)) {
+		return UNIX_ERROR;
+	}
+
+	return UNIX_ERROR_NONE;
+}
+
+/**
+ * Closes all connections of a side
+ *
+ * @param ep side
+ */
+static void endpoint_finalize(UnixEndpoint *ep)
+{
+	LinkedList *connections;
+	LinkedNode *i;
+
+	pthread_mutex_lock(&ep->mutex);
+	connections = ep->connections;
+	ep->connections = NULL;
+	pthread_mutex_unlock(&ep->mutex);
+
+	if (connections) {
+		// connections still in use are closed by their last user
+		for (i = connections->first; i; i = i->next) {
+			UnixConnection *conn = i->element;
+			shutdown(conn->sk, SHUT_RDWR);
+			connection_put(ep, conn);
+		}
+		llist_destroy(connections, NULL);
+	}
+
+	if (ep->listen_sk >= 0) {
+		close(ep->listen_sk);
+		ep->listen_sk = -1;
+
+		if (ep->path[0] != '@') {
+			unlink(ep->path);
+		}
+	}
+}
+
+/**
+ * Finalizes the manager side
+ *
+ * @return UNIX_ERROR_NONE
+ */
+static int manager_network_finalize()
+{
+	endpoint_finalize(&manager_side);
+	return UNIX_ERROR_NONE;
+}
+
+/**
+ * Finalizes the agent side
+ *
+ * @return UNIX_ERROR_NONE
+ */
+static int agent_network_finalize()
+{
+	endpoint_finalize(&agent_side);
+	return UNIX_ERROR_NONE;
+}
+
+/**
+ * Sets up the functions common to both sides
+ *
+ * @param plugin CommunicationPlugin pointer
+ * @param ep side
+ * @param path address
+ * @return UNIX_ERROR if error
+ */
+static int setup(CommunicationPlugin *plugin, UnixEndpoint *ep,
+		 const char *path)
+{
+	if (!path || !*path) {
+		return UNIX_ERROR;
+	}
+
+	free(ep->path);
+	ep->path = strdup(path);
+	ep->next_connid = 1;
+
+	plugin->network_wait_for_data = network_wait_for_data;
+	plugin->network_get_apdu_stream = network_get_apdu_stream;
+	plugin->network_send_apdu_stream = network_send_apdu_stream;
+	plugin->network_disconnect = network_disconnect;
+
+	return UNIX_ERROR_NONE;
+}
+
+/**
+ * Initiate a CommunicationPlugin struct for a manager listening on a
+ * Unix socket.
+ *
+ * @param plugin CommunicationPlugin pointer
+ * @param path address, '@' first for the abstract namespace
+ *
+ * @return NETWORK_ERROR if error
+ */
+int plugin_network_unix_manager_setup(CommunicationPlugin *plugin,
+				      const char *path)
+{
+	DEBUG("network:unix Initializing manager socket %s", path);
+
+	if (setup(plugin, &manager_side, path) != UNIX_ERROR_NONE) {
+		return UNIX_ERROR;
+	}
+
+	plugin->network_init = manager_network_init;
+	plugin->network_finalize = manager_network_finalize;
+
+	return UNIX_ERROR_NONE;
+}
+
+/**
+ * Initiate a CommunicationPlugin struct for an agent connecting to a
+ * manager through a Unix socket. Its context has connection id 1.
+ *
+ * @param plugin CommunicationPlugin pointer
+ * @param path address, '@' first for the abstract namespace
+ *
+ * @return NETWORK_ERROR if error
+ */
+int plugin_network_unix_agent_setup(CommunicationPlugin *plugin,
+				    const char *path)
+{
+	DEBUG("network:unix Initializing agent socket %s", path);
+
+	if (setup(plugin, &agent_side, path) != UNIX_ERROR_NONE) {
+		return UNIX_ERROR;
+	}
+
+	plugin->network_init = agent_network_init;
+	plugin->network_finalize = agent_network_finalize;
+
+	return UNIX_ERROR_NONE;
+}
+
+/**
+ * Returns the listening socket of the manager, readable when an agent
+ * is waiting to be accepted
+ *
+ * @return socket, -1 if the network is not started
+ */
+int plugin_network_unix_listen_fd()
+{
+	return manager_side.listen_sk;
+}
+
+/**
+ * Accepts an agent, blocking until one connects, and creates its
+ * context. Run the connection loop of the context afterwards.
+ *
+ * @param id filled with the context id
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int plugin_network_unix_accept(ContextId *id)
+{
+	int sk;
+
+	if (manager_side.listen_sk < 0) {
+		return 0;
+	}
+
+	do {
+		sk = accept(manager_side.listen_sk, NULL, NULL);
+	} while (sk < 0 && errno == EINTR);
+
+	if (sk < 0) {
+		DEBUG("network:unix accept failed: %d", errno);
+		return 0;
+	}
+
+	return add_connection(&manager_side, sk, id);
+}
+
+/** @} */
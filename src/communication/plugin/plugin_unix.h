@@ -0,0 +1,44 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file plugin_unix.h
+ * \brief Unix domain socket plugin, for manager and agent
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef PLUGIN_UNIX_H_
+#define PLUGIN_UNIX_H_
+
+#include <communication/plugin/plugin.h>
+#include <communication/context.h>
+
+int plugin_network_unix_manager_setup(CommunicationPlugin *plugin,
+				      const char *path);
+
+int plugin_network_unix_agent_setup(CommunicationPlugin *plugin,
+				    const char *path);
+
+int plugin_network_unix_listen_fd();
+
+int plugin_network_unix_accept(ContextId *id);
+
+#endif /* PLUGIN_UNIX_H_ */
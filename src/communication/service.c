@@ -37,17 +37,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "src/communication/service.h"
+#include "src/communication/stats.h"
 #include "src/communication/communication.h"
 #include "src/communication/parser/decoder_ASN1.h"
 #include "src/communication/parser/encoder_ASN1.h"
 #include "src/communication/parser/struct_cleaner.h"
 #include "src/trans/trans.h"
 #include "src/util/log.h"
+#include "src/util/pool.h"
 
 static void service_change_state(Context *ctx, ServiceState new_state);
 static void service_send_apdu_now(Context *ctx, APDU *apdu, timeout_callback timeout);
 static void service_release_resources(Context *ctx);
 
+/**
+ * Released services, kept for reuse by new connections
+ */
+static ObjectPool service_pool = OBJECT_POOL_INIT(Service, 64);
 
 /**
  * Construct service structure
@@ -56,7 +62,7 @@ static void service_release_resources(Context *ctx);
  */
 Service *service_instance()
 {
-	Service *s = calloc(1, sizeof(struct Service));
+	Service *s = pool_alloc(&service_pool);
 	return s;
 }
 
@@ -72,6 +78,7 @@ void clean_request(Request *req)
 	req->timeout.timeout = 0;
 	req->timeout.id = 0;
 	req->request_callback = NULL;
+	req->issue_time = 0;
 	if (req->context) {
 		free(req->context);
 		req->context = NULL;
@@ -102,6 +109,7 @@ void service_init(Context *ctx)
 	ctx->service->last_invoke_id = 0xF;
 	ctx->service->current_invoke_id = 0;
 	ctx->service->requests_count = 0;
+	stats_sync_pending(ctx);
 
 	// Make sure unused requests are clean
 	for (i = 0; i < 15; ++i) {
@@ -124,10 +132,18 @@ void service_destroy(Service *service)
 			service_del_request(&service->requests_list[i]);
 		}
 
-		free(service);
+		pool_free(&service_pool, service);
 	}
 }
 
+/**
+ * Frees the services kept for reuse
+ */
+void service_pool_drain()
+{
+	pool_drain(&service_pool);
+}
+
 
 /**
  * Release resources.
@@ -152,6 +168,7 @@ static void service_release_resources(Context *ctx)
 	service->last_invoke_id = 0xF;
 	service->current_invoke_id = 0;
 	service->requests_count = 0;
+	stats_sync_pending(ctx);
 }
 
 /**
@@ -197,8 +214,10 @@ Request *service_send_remote_operation_request(Context *ctx, APDU *apdu, timeout
 			req->timeout = timeout;
 			req->is_valid = REQUEST_VALID;
 			req->request_callback = request_callback;
+			req->issue_time = stats_clock();
 
 			service->requests_count++;
+			stats_sync_pending(ctx);
 
 			if (service->state == READY) {
 				service_send_apdu_now(ctx, apdu, timeout);
@@ -235,6 +254,7 @@ void service_trans_request_cb(Context *ctx)
 	req->is_valid = REQUEST_INVALID;
 	service_del_request(req);
 	ctx->service->requests_count--;
+	stats_sync_pending(ctx);
 }
 
 /**
@@ -262,6 +282,7 @@ Request *service_trans_request(Context *ctx, service_request_callback request_ca
 	req->request_callback = request_callback;
 
 	ctx->service->requests_count++;
+	stats_sync_pending(ctx);
 
 	// make it wait for the next event loop cycle
 	communication_count_timeout(ctx, service_trans_request_cb, 0);
@@ -302,6 +323,7 @@ Request *service_trans_set_time_request(Context *ctx, SetTimeInvoke *time,
 	req->request_callback = request_callback;
 
 	ctx->service->requests_count++;
+	stats_sync_pending(ctx);
 
 	return req;
 }
@@ -331,6 +353,7 @@ void service_trans_set_time_response(ContextId id, int invoke_id, int ok)
 	req->is_valid = REQUEST_INVALID;
 	service_del_request(req);
 	ctx->service->requests_count--;
+	stats_sync_pending(ctx);
 
 	context_unlock(ctx);
 }
@@ -433,13 +456,15 @@ void service_request_retired(Context *ctx, DATA_apdu *response_apdu)
 		InvokeIDType retiredInvokeID = response_apdu->invoke_id;
 		req->is_valid = REQUEST_INVALID;
 
+		stats_count_request(req->apdu, req->issue_time);
+
 		if (req->request_callback != NULL) {
 			(req->request_callback)(ctx, req, response_apdu);
 		}
 
 		service_del_request(req);
 		service->requests_count--;
-
+		stats_sync_pending(ctx);
 
 		if (service->state == PROCESSING) {
 			service_change_state(ctx, READY);
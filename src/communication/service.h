@@ -112,6 +112,10 @@ typedef struct Request {
 	service_request_callback request_callback;
 	void *context;
 	struct RequestRet *return_data;
+	/**
+	 * stats_clock() when request was issued
+	 */
+	unsigned long long issue_time;
 } Request;
 
 /**
@@ -132,6 +136,8 @@ Service *service_instance();
 
 void service_destroy(Service *serive);
 
+void service_pool_drain();
+
 void service_init(Context *ctx);
 
 void service_del_request(Request *req);
@@ -0,0 +1,739 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file stats.c
+ * \brief Runtime counters and latency histograms of the communication layer
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * \addtogroup Communication
+ *
+ * Counters are kept twice: in the Context, where they are only
+ * written with the context locked, and process-wide, where they are
+ * updated with atomic adds. Readers never take a lock besides the
+ * context lock needed to keep the context alive.
+ *
+ * Latencies are recorded process-wide only, in log-bucketed
+ * histograms (see histogram.h).
+ *
+ * When lock profiling is on, communication_lock() and gil_lock()
+ * report where they were called from, how long they waited and,
+ * at release, how long the lock was held. Each call site gets its
+ * own pair of histograms, allocated when first seen and kept until
+ * the process exits. Each thread keeps the locks it holds in a small
+ * thread-local stack, so recursive acquisitions are told apart
+ * without touching shared state.
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "src/communication/stats.h"
+#include "src/communication/trace.h"
+#include "src/communication/context.h"
+#include "src/communication/fsm.h"
+#include "src/communication/service.h"
+#include "src/communication/parser/encoder_ASN1.h"
+#include "src/util/histogram.h"
+
+/**
+ * Counters of the whole process
+ */
+static CommunicationStats global_stats;
+
+/**
+ * Latency histograms of the whole process
+ */
+static Histogram latency[STATS_LATENCY_KINDS];
+
+/**
+ * Wait and hold time histograms of one lock call site
+ */
+typedef struct LockSite {
+	const char *file;
+	int line;
+	const char *function;
+	int gil;
+	Histogram wait;
+	Histogram hold;
+} LockSite;
+
+/**
+ * Open-addressed table of lock call sites; slots are filled once and
+ * never emptied. Sites beyond the table share lock_site_other.
+ */
+#define LOCK_SITES 256
+
+static LockSite *lock_sites[LOCK_SITES];
+
+static LockSite lock_site_other = {
+	.file = "(other)",
+	.function = "(other)"
+};
+
+/**
+ * A lock held by the current thread
+ */
+typedef struct HeldLock {
+	const void *lock;
+	LockSite *site;
+	unsigned long long since;
+	int depth;
+	unsigned int generation;
+} HeldLock;
+
+/**
+ * Deeper nesting is not profiled
+ */
+#define LOCK_NESTING 16
+
+static __thread HeldLock held_locks[LOCK_NESTING];
+static __thread int held_count = 0;
+
+int stats_lock_profiling = 0;
+
+/**
+ * Bumped each time profiling is turned on, so locks taken before it
+ * was last turned off are not mistaken for current ones
+ */
+static unsigned int lock_generation = 0;
+
+static const char *apdu_kind_names[STATS_APDU_KINDS] = {
+	"aarq", "aare", "rlrq", "rlre", "abrt",
+	"roiv", "rors", "roer", "rorj", "other"
+};
+
+static const char *latency_names[STATS_LATENCY_KINDS] = {
+	"association", "configuration", "confirmed_event_report", "get",
+	"confirmed_set", "confirmed_action", "listener"
+};
+
+/**
+ * Adds to a context counter. Only the thread holding the context
+ * lock writes it, so no atomic read-modify-write is needed; the
+ * store is atomic only to keep readers from seeing torn values.
+ */
+#define CTX_ADD(field, n) \
+	__atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (n), \
+			 __ATOMIC_RELAXED)
+
+#define GLOBAL_ADD(field, n) \
+	__atomic_fetch_add(&global_stats.field, (n), __ATOMIC_RELAXED)
+
+#define ADD(ctx, field, n) \
+	do { \
+		CTX_ADD((ctx)->stats.field, (n)); \
+		GLOBAL_ADD(field, (n)); \
+	} while (0)
+
+/**
+ * @param kind APDU kind
+ * @return short lowercase name of the APDU kind
+ */
+const char *stats_apdu_kind_name(StatsApduKind kind)
+{
+	if (kind < 0 || kind >= STATS_APDU_KINDS) {
+		return apdu_kind_names[STATS_APDU_OTHER];
+	}
+
+	return apdu_kind_names[kind];
+}
+
+/**
+ * @param latency latency kind
+ * @return short lowercase name of the latency kind
+ */
+const char *stats_latency_name(StatsLatency latency)
+{
+	if (latency < 0 || latency >= STATS_LATENCY_KINDS) {
+		return "unknown";
+	}
+
+	return latency_names[latency];
+}
+
+/**
+ * @return monotonic time in nanoseconds
+ */
+unsigned long long stats_clock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static StatsApduKind apdu_kind(APDU *apdu)
+{
+	DATA_apdu *data;
+
+	switch (apdu->choice) {
+	case AARQ_CHOSEN:
+		return STATS_APDU_AARQ;
+	case AARE_CHOSEN:
+		return STATS_APDU_AARE;
+	case RLRQ_CHOSEN:
+		return STATS_APDU_RLRQ;
+	case RLRE_CHOSEN:
+		return STATS_APDU_RLRE;
+	case ABRT_CHOSEN:
+		return STATS_APDU_ABRT;
+	case PRST_CHOSEN:
+		data = encode_get_data_apdu(&apdu->u.prst);
+		if (data == NULL) {
+			break;
+		}
+
+		switch (data->message.choice >> 8) {
+		case ROIV_CMIP_EVENT_REPORT_CHOSEN >> 8:
+			return STATS_APDU_ROIV;
+		case RORS_CMIP_GET_CHOSEN >> 8:
+			return STATS_APDU_RORS;
+		case ROER_CHOSEN >> 8:
+			return STATS_APDU_ROER;
+		case RORJ_CHOSEN >> 8:
+			return STATS_APDU_RORJ;
+		}
+		break;
+	}
+
+	return STATS_APDU_OTHER;
+}
+
+/**
+ * Counts a received APDU
+ *
+ * @param ctx context
+ * @param apdu decoded APDU
+ * @param bytes encoded APDU size
+ * @param decode_start stats_clock() taken before decoding
+ */
+void stats_count_received(Context *ctx, APDU *apdu, intu32 bytes,
+			  unsigned long long decode_start)
+{
+	unsigned long long elapsed = stats_clock() - decode_start;
+
+	ADD(ctx, apdus_in[apdu_kind(apdu)], 1);
+	ADD(ctx, bytes_in, bytes);
+	ADD(ctx, decode_ns, elapsed);
+}
+
+/**
+ * Counts a received APDU that could not be decoded
+ *
+ * @param ctx context
+ * @param bytes encoded APDU size
+ */
+void stats_count_decode_error(Context *ctx, intu32 bytes)
+{
+	ADD(ctx, decode_errors, 1);
+	ADD(ctx, bytes_in, bytes);
+}
+
+/**
+ * Counts a sent APDU
+ *
+ * @param ctx context
+ * @param apdu APDU
+ * @param bytes encoded APDU size
+ */
+void stats_count_sent(Context *ctx, APDU *apdu, intu32 bytes)
+{
+	ADD(ctx, apdus_out[apdu_kind(apdu)], 1);
+	ADD(ctx, bytes_out, bytes);
+}
+
+/**
+ * Starts timing association of a new context
+ *
+ * @param ctx context
+ */
+void stats_count_connection(Context *ctx)
+{
+	ctx->connect_time = stats_clock();
+}
+
+/**
+ * Counts a state machine transition, and records association and
+ * configuration latencies
+ *
+ * @param ctx context
+ * @param previous previous state
+ * @param next new state
+ */
+void stats_count_transition(Context *ctx, int previous, int next)
+{
+	unsigned long long now;
+
+	ADD(ctx, fsm_transitions, 1);
+
+	if (!(ctx->type & MANAGER_CONTEXT)) {
+		return;
+	}
+
+	if (previous == fsm_state_waiting_for_config &&
+	    next == fsm_state_checking_config) {
+		ctx->config_time = stats_clock();
+	} else if (next == fsm_state_operating) {
+		now = stats_clock();
+
+		if (ctx->connect_time) {
+			histogram_record(&latency[STATS_LATENCY_ASSOCIATION],
+					 now - ctx->connect_time);
+			ctx->connect_time = 0;
+		}
+
+		if (ctx->config_time) {
+			histogram_record(&latency[STATS_LATENCY_CONFIGURATION],
+					 now - ctx->config_time);
+			ctx->config_time = 0;
+		}
+	}
+}
+
+/**
+ * Records the round trip of a confirmed request
+ *
+ * @param apdu request APDU
+ * @param start stats_clock() taken when request was issued
+ */
+void stats_count_request(APDU *apdu, unsigned long long start)
+{
+	unsigned long long elapsed = stats_clock() - start;
+	DATA_apdu *data;
+	StatsLatency kind;
+
+	if (!apdu || apdu->choice != PRST_CHOSEN || !start) {
+		return;
+	}
+
+	data = encode_get_data_apdu(&apdu->u.prst);
+	if (!data) {
+		return;
+	}
+
+	switch (data->message.choice) {
+	case ROIV_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN:
+		kind = STATS_LATENCY_CONFIRMED_EVENT_REPORT;
+		break;
+	case ROIV_CMIP_GET_CHOSEN:
+		kind = STATS_LATENCY_GET;
+		break;
+	case ROIV_CMIP_CONFIRMED_SET_CHOSEN:
+		kind = STATS_LATENCY_CONFIRMED_SET;
+		break;
+	case ROIV_CMIP_CONFIRMED_ACTION_CHOSEN:
+		kind = STATS_LATENCY_CONFIRMED_ACTION;
+		break;
+	default:
+		return;
+	}
+
+	histogram_record(&latency[kind], elapsed);
+}
+
+/**
+ * Counts a timeout indication
+ *
+ * @param ctx context
+ */
+void stats_count_timeout(Context *ctx)
+{
+	ADD(ctx, timeouts, 1);
+}
+
+/**
+ * Accounts time spent in application listeners, and traces it
+ *
+ * @param ctx context
+ * @param start stats_clock() taken before calling listeners
+ */
+void stats_count_listener(Context *ctx, unsigned long long start)
+{
+	unsigned long long elapsed = stats_clock() - start;
+
+	ADD(ctx, listener_ns, elapsed);
+	histogram_record(&latency[STATS_LATENCY_LISTENER], elapsed);
+
+	if (__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED)) {
+		trace_end(ctx, TRACE_LISTENER, start, 0, 0, 0);
+	}
+}
+
+/**
+ * Updates requests_pending after the service request queue of the
+ * context has changed, or is about to be destroyed (ctx->service
+ * NULL).
+ *
+ * @param ctx context
+ */
+void stats_sync_pending(Context *ctx)
+{
+	long long now = ctx->service ? ctx->service->requests_count : 0;
+	long long delta = now - ctx->stats.requests_pending;
+
+	if (delta != 0) {
+		ADD(ctx, requests_pending, delta);
+	}
+}
+
+/**
+ * Copies counters. Each counter is read atomically; counters are not
+ * read all at the same instant unless the writer is locked out.
+ *
+ * @param from counters being updated
+ * @param to copy
+ */
+void stats_snapshot(CommunicationStats *from, CommunicationStats *to)
+{
+	int i;
+
+	for (i = 0; i < STATS_APDU_KINDS; ++i) {
+		to->apdus_in[i] = __atomic_load_n(&from->apdus_in[i], __ATOMIC_RELAXED);
+		to->apdus_out[i] = __atomic_load_n(&from->apdus_out[i], __ATOMIC_RELAXED);
+	}
+
+	to->bytes_in = __atomic_load_n(&from->bytes_in, __ATOMIC_RELAXED);
+	to->bytes_out = __atomic_load_n(&from->bytes_out, __ATOMIC_RELAXED);
+	to->decode_errors = __atomic_load_n(&from->decode_errors, __ATOMIC_RELAXED);
+	to->fsm_transitions = __atomic_load_n(&from->fsm_transitions, __ATOMIC_RELAXED);
+	to->timeouts = __atomic_load_n(&from->timeouts, __ATOMIC_RELAXED);
+	to->requests_pending = __atomic_load_n(&from->requests_pending, __ATOMIC_RELAXED);
+	to->decode_ns = __atomic_load_n(&from->decode_ns, __ATOMIC_RELAXED);
+	to->listener_ns = __atomic_load_n(&from->listener_ns, __ATOMIC_RELAXED);
+}
+
+/**
+ * Copies the counters of the whole process
+ *
+ * @param stats copy
+ */
+void stats_get_global(CommunicationStats *stats)
+{
+	stats_snapshot(&global_stats, stats);
+}
+
+static void summarize(Histogram *h, LatencySummary *summary)
+{
+	static const double percentiles[4] = {50.0, 90.0, 99.0, 99.9};
+	unsigned long long values[4];
+
+	histogram_percentiles(h, percentiles, values, 4);
+
+	summary->count = histogram_count(h);
+	summary->sum = histogram_sum(h);
+	summary->mean = histogram_mean(h);
+	summary->max = histogram_max(h);
+	summary->p50 = values[0];
+	summary->p90 = values[1];
+	summary->p99 = values[2];
+	summary->p999 = values[3];
+}
+
+/**
+ * Summarizes a latency histogram of the whole process
+ *
+ * @param kind latency kind
+ * @param summary receives count, mean, max and percentiles
+ */
+void stats_get_latency(StatsLatency kind, LatencySummary *summary)
+{
+	memset(summary, 0, sizeof(LatencySummary));
+
+	if (kind < 0 || kind >= STATS_LATENCY_KINDS) {
+		return;
+	}
+
+	summarize(&latency[kind], summary);
+}
+
+/**
+ * @param kind latency kind
+ * @param percentile percentile wanted (0 to 100)
+ * @return latency at percentile in nanoseconds, 0 if nothing recorded
+ */
+unsigned long long stats_get_latency_percentile(StatsLatency kind,
+						double percentile)
+{
+	if (kind < 0 || kind >= STATS_LATENCY_KINDS) {
+		return 0;
+	}
+
+	return histogram_percentile(&latency[kind], percentile);
+}
+
+/**
+ * Forgets all recorded latencies
+ */
+void stats_reset_latency()
+{
+	int i;
+
+	for (i = 0; i < STATS_LATENCY_KINDS; ++i) {
+		histogram_reset(&latency[i]);
+	}
+}
+
+/**
+ * Turns lock profiling on or off. Off by default; when off, locking
+ * costs one extra relaxed load.
+ *
+ * @param enabled 1 to profile
+ */
+void stats_set_lock_profiling(int enabled)
+{
+	if (enabled) {
+		__atomic_fetch_add(&lock_generation, 1, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&stats_lock_profiling, enabled ? 1 : 0,
+			 __ATOMIC_RELEASE);
+}
+
+static LockSite *lock_site(const char *file, int line, const char *function,
+			   int gil)
+{
+	unsigned int hash = ((unsigned int) line * 2654435761u) ^ gil;
+	LockSite *fresh = NULL;
+	LockSite *site;
+	int probe;
+
+	for (probe = 0; probe < LOCK_SITES; ++probe) {
+		LockSite **slot = &lock_sites[(hash + probe) % LOCK_SITES];
+
+		site = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+		if (!site) {
+			if (!fresh) {
+				fresh = calloc(1, sizeof(LockSite));
+
+				if (!fresh) {
+					return &lock_site_other;
+				}
+
+				fresh->file = file;
+				fresh->line = line;
+				fresh->function = function;
+				fresh->gil = gil;
+			}
+
+			if (__atomic_compare_exchange_n(slot, &site, fresh, 0,
+							__ATOMIC_ACQ_REL,
+							__ATOMIC_ACQUIRE)) {
+				return fresh;
+			}
+			// lost the slot; site is the winner
+		}
+
+		if (site->line == line && site->gil == gil &&
+		    (site->file == file || strcmp(site->file, file) == 0)) {
+			free(fresh);
+			return site;
+		}
+	}
+
+	free(fresh);
+	return &lock_site_other;
+}
+
+/**
+ * Finds a lock in the stack of the current thread, dropping locks
+ * left over from a previous profiling session
+ */
+static HeldLock *held_lock(const void *lock, unsigned int generation)
+{
+	int i;
+
+	for (i = held_count - 1; i >= 0; --i) {
+		if (held_locks[i].generation != generation) {
+			held_locks[i] = held_locks[--held_count];
+		} else if (held_locks[i].lock == lock) {
+			return &held_locks[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Records a lock acquisition. Called right after the lock is taken.
+ *
+ * @param lock context, or NULL for the GIL
+ * @param file source file of the call site
+ * @param line source line of the call site
+ * @param function function of the call site
+ * @param wait_start stats_clock() taken before locking
+ */
+void stats_lock_acquired(const void *lock, const char *file, int line,
+			 const char *function, unsigned long long wait_start)
+{
+	unsigned long long now = stats_clock();
+	unsigned int generation = __atomic_load_n(&lock_generation,
+						  __ATOMIC_RELAXED);
+	HeldLock *held = held_lock(lock, generation);
+	LockSite *site;
+
+	if (held) {
+		++held->depth;
+		return;
+	}
+
+	site = lock_site(file, line, function, lock == NULL);
+	histogram_record(&site->wait, now - wait_start);
+
+	if (held_count < LOCK_NESTING) {
+		held = &held_locks[held_count++];
+		held->lock = lock;
+		held->site = site;
+		held->since = now;
+		held->depth = 1;
+		held->generation = generation;
+	}
+}
+
+/**
+ * Records a lock release. Called right before the lock is released.
+ *
+ * @param lock context, or NULL for the GIL
+ */
+void stats_lock_released(const void *lock)
+{
+	unsigned long long now;
+	HeldLock *held;
+
+	if (held_count == 0) {
+		return;
+	}
+
+	now = stats_clock();
+	held = held_lock(lock, __atomic_load_n(&lock_generation,
+					       __ATOMIC_RELAXED));
+
+	if (!held || --held->depth > 0) {
+		return;
+	}
+
+	histogram_record(&held->site->hold, now - held->since);
+	*held = held_locks[--held_count];
+}
+
+static void lock_site_stats(LockSite *site, LockSiteStats *stats)
+{
+	stats->file = site->file;
+	stats->line = site->line;
+	stats->function = site->function;
+	stats->gil = site->gil;
+	summarize(&site->wait, &stats->wait);
+	summarize(&site->hold, &stats->hold);
+}
+
+static int by_wait(const void *a, const void *b)
+{
+	unsigned long long x = ((const LockSiteStats *) a)->wait.sum;
+	unsigned long long y = ((const LockSiteStats *) b)->wait.sum;
+
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int by_hold(const void *a, const void *b)
+{
+	unsigned long long x = ((const LockSiteStats *) a)->hold.sum;
+	unsigned long long y = ((const LockSiteStats *) b)->hold.sum;
+
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/**
+ * Gets the lock call sites that waited or held locks the longest
+ *
+ * @param order rank by total wait or total hold time
+ * @param sites receives up to max sites, worst first
+ * @param max size of sites
+ * @return number of sites copied
+ */
+int stats_get_lock_sites(StatsLockOrder order, LockSiteStats *sites, int max)
+{
+	LockSiteStats *all;
+	LockSite *site;
+	int count = 0;
+	int i;
+
+	if (max <= 0) {
+		return 0;
+	}
+
+	all = calloc(LOCK_SITES + 1, sizeof(LockSiteStats));
+
+	if (!all) {
+		return 0;
+	}
+
+	for (i = 0; i < LOCK_SITES; ++i) {
+		site = __atomic_load_n(&lock_sites[i], __ATOMIC_ACQUIRE);
+
+		if (site && histogram_count(&site->wait) > 0) {
+			lock_site_stats(site, &all[count++]);
+		}
+	}
+
+	if (histogram_count(&lock_site_other.wait) > 0) {
+		lock_site_stats(&lock_site_other, &all[count++]);
+	}
+
+	qsort(all, count, sizeof(LockSiteStats),
+	      order == STATS_LOCK_BY_HOLD ? by_hold : by_wait);
+
+	if (count > max) {
+		count = max;
+	}
+
+	memcpy(sites, all, count * sizeof(LockSiteStats));
+	free(all);
+
+	return count;
+}
+
+/**
+ * Forgets all recorded lock wait and hold times. Call sites already
+ * seen are kept.
+ */
+void stats_reset_lock_sites()
+{
+	LockSite *site;
+	int i;
+
+	for (i = 0; i < LOCK_SITES; ++i) {
+		site = __atomic_load_n(&lock_sites[i], __ATOMIC_ACQUIRE);
+
+		if (site) {
+			histogram_reset(&site->wait);
+			histogram_reset(&site->hold);
+		}
+	}
+
+	histogram_reset(&lock_site_other.wait);
+	histogram_reset(&lock_site_other.hold);
+}
+
+/** @} */
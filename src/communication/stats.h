@@ -0,0 +1,202 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file stats.h
+ * \brief Runtime counters and latency histograms of the communication layer
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <asn1/phd_types.h>
+
+struct Context;
+
+/**
+ * APDU kinds counted apart. PRST APDUs are split by the
+ * type of their DATA-apdu message.
+ */
+typedef enum {
+	STATS_APDU_AARQ = 0,
+	STATS_APDU_AARE,
+	STATS_APDU_RLRQ,
+	STATS_APDU_RLRE,
+	STATS_APDU_ABRT,
+	STATS_APDU_ROIV,	// !< PRST, remote operation invoke
+	STATS_APDU_RORS,	// !< PRST, remote operation response
+	STATS_APDU_ROER,	// !< PRST, remote operation error
+	STATS_APDU_RORJ,	// !< PRST, remote operation reject
+	STATS_APDU_OTHER,
+	STATS_APDU_KINDS
+} StatsApduKind;
+
+/**
+ * Counters of one context, or of the whole process. All but
+ * requests_pending only grow; process counters include contexts
+ * already gone.
+ */
+typedef struct CommunicationStats {
+	unsigned long long apdus_in[STATS_APDU_KINDS];
+	unsigned long long apdus_out[STATS_APDU_KINDS];
+	unsigned long long bytes_in;
+	unsigned long long bytes_out;
+	/**
+	 * Received APDUs that could not be decoded
+	 */
+	unsigned long long decode_errors;
+	unsigned long long fsm_transitions;
+	unsigned long long timeouts;
+	/**
+	 * Confirmed requests waiting for an answer
+	 */
+	long long requests_pending;
+	/**
+	 * Time spent decoding received APDUs, in nanoseconds
+	 */
+	unsigned long long decode_ns;
+	/**
+	 * Time spent in application listeners, in nanoseconds
+	 */
+	unsigned long long listener_ns;
+} CommunicationStats;
+
+/**
+ * Intervals whose latency is recorded in histograms
+ */
+typedef enum {
+	/**
+	 * Transport connection to operating state, first association
+	 * of manager contexts only
+	 */
+	STATS_LATENCY_ASSOCIATION = 0,
+	/**
+	 * Unknown configuration report to its acceptance (manager)
+	 */
+	STATS_LATENCY_CONFIGURATION,
+	/**
+	 * Confirmed request to its response, by type of request
+	 */
+	STATS_LATENCY_CONFIRMED_EVENT_REPORT,
+	STATS_LATENCY_GET,
+	STATS_LATENCY_CONFIRMED_SET,
+	STATS_LATENCY_CONFIRMED_ACTION,
+	/**
+	 * Duration of each round of listener callbacks
+	 */
+	STATS_LATENCY_LISTENER,
+	STATS_LATENCY_KINDS
+} StatsLatency;
+
+/**
+ * Latency percentiles, in nanoseconds. Percentiles are within 3%
+ * of the exact values; count, sum, mean and max are exact.
+ */
+typedef struct LatencySummary {
+	unsigned long long count;
+	unsigned long long sum;
+	unsigned long long mean;
+	unsigned long long p50;
+	unsigned long long p90;
+	unsigned long long p99;
+	unsigned long long p999;
+	unsigned long long max;
+} LatencySummary;
+
+/**
+ * Wait and hold times of the GIL or of context locks, taken at one
+ * place of the code. Only the outermost acquisition of a recursive
+ * lock is accounted; its hold time lasts until the matching release.
+ */
+typedef struct LockSiteStats {
+	const char *file;
+	int line;
+	const char *function;
+	/**
+	 * 1 for the GIL, 0 for context locks
+	 */
+	int gil;
+	LatencySummary wait;
+	LatencySummary hold;
+} LockSiteStats;
+
+/**
+ * How lock sites are ranked: by total wait or total hold time
+ */
+typedef enum {
+	STATS_LOCK_BY_WAIT = 0,
+	STATS_LOCK_BY_HOLD
+} StatsLockOrder;
+
+/**
+ * Lock profiling switch, see stats_set_lock_profiling()
+ */
+extern int stats_lock_profiling;
+
+const char *stats_apdu_kind_name(StatsApduKind kind);
+
+const char *stats_latency_name(StatsLatency latency);
+
+unsigned long long stats_clock();
+
+void stats_count_received(struct Context *ctx, APDU *apdu, intu32 bytes,
+			  unsigned long long decode_start);
+
+void stats_count_decode_error(struct Context *ctx, intu32 bytes);
+
+void stats_count_sent(struct Context *ctx, APDU *apdu, intu32 bytes);
+
+void stats_count_connection(struct Context *ctx);
+
+void stats_count_transition(struct Context *ctx, int previous, int next);
+
+void stats_count_request(APDU *apdu, unsigned long long start);
+
+void stats_count_timeout(struct Context *ctx);
+
+void stats_count_listener(struct Context *ctx, unsigned long long start);
+
+void stats_sync_pending(struct Context *ctx);
+
+void stats_snapshot(CommunicationStats *from, CommunicationStats *to);
+
+void stats_get_global(CommunicationStats *stats);
+
+void stats_get_latency(StatsLatency latency, LatencySummary *summary);
+
+unsigned long long stats_get_latency_percentile(StatsLatency latency,
+						double percentile);
+
+void stats_reset_latency();
+
+void stats_set_lock_profiling(int enabled);
+
+void stats_lock_acquired(const void *lock, const char *file, int line,
+			 const char *function, unsigned long long wait_start);
+
+void stats_lock_released(const void *lock);
+
+int stats_get_lock_sites(StatsLockOrder order, LockSiteStats *sites, int max);
+
+void stats_reset_lock_sites();
+
+#endif /* STATS_H_ */
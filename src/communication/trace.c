@@ -0,0 +1,393 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file trace.c
+ * \brief Flight recorder of communication layer events
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * \addtogroup Communication
+ *
+ * Spans are kept in per-thread rings of fixed size, overwriting the
+ * oldest ones, so the last few thousand events of every thread can
+ * be dumped at any time, e.g. right after an association abort. The
+ * dump is in Chrome trace event format (chrome://tracing, Perfetto),
+ * with one track per context: pid is the plugin, tid the connection.
+ *
+ * Trace points cost a load and a branch while tracing is disabled.
+ * While enabled, a span is two clock reads and a copy into the ring;
+ * no lock is taken.
+ *
+ * @{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "src/communication/trace.h"
+#include "src/communication/context.h"
+#include "src/communication/fsm.h"
+#include "src/util/log.h"
+
+/**
+ * Events kept per thread
+ */
+#define TRACE_RING_EVENTS 8192
+
+typedef struct TraceEvent {
+	unsigned long long start;
+	unsigned long long duration;
+	unsigned long long connid;
+	unsigned int plugin;
+	TraceSpan span;
+	long long args[3];
+} TraceEvent;
+
+/**
+ * Ring of a thread. Only the owner thread writes it; dumps read it
+ * concurrently and discard events that may have been overwritten.
+ */
+typedef struct TraceRing {
+	/**
+	 * Events ever written; the last TRACE_RING_EVENTS are kept
+	 */
+	unsigned long long count;
+	/**
+	 * Events whose slot is being or has been written, published before
+	 * the slot is touched
+	 */
+	unsigned long long reserved;
+	/**
+	 * Non-zero while a live thread writes to this ring
+	 */
+	int owned;
+	/**
+	 * Sequential number of the ring, shown as an event argument
+	 */
+	int thread;
+	struct TraceRing *next;
+	TraceEvent events[TRACE_RING_EVENTS];
+} TraceRing;
+
+typedef struct {
+	const char *name;
+	const char *args[3];
+} TraceSpanInfo;
+
+static const TraceSpanInfo span_info[TRACE_SPANS] = {
+	{"receive", {"bytes", NULL, NULL}},
+	{"decode", {"bytes", NULL, NULL}},
+	{"fsm_event", {"event", "from", "to"}},
+	{"listener", {NULL, NULL, NULL}},
+	{"send", {"bytes", NULL, NULL}},
+	{"encode", {"bytes", NULL, NULL}},
+	{"timeout", {NULL, NULL, NULL}},
+	{"abort", {"received", NULL, NULL}}
+};
+
+int trace_enabled = 0;
+
+/**
+ * All rings ever created. Rings of finished threads are reused,
+ * none is freed.
+ */
+static TraceRing *rings = NULL;
+static int ring_count = 0;
+
+static __thread TraceRing *thread_ring = NULL;
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Dump file prefix on abort, and number of dumps so far
+ */
+static char *abort_path = NULL;
+static int abort_dumps = 0;
+
+static void ring_release(void *ring)
+{
+	__atomic_store_n(&((TraceRing *) ring)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void ring_key_create()
+{
+	pthread_key_create(&ring_key, ring_release);
+}
+
+/**
+ * Gets a ring for the calling thread, reusing one of a finished
+ * thread if possible
+ */
+static TraceRing *ring_claim()
+{
+	TraceRing *ring;
+	int unowned;
+
+	pthread_once(&ring_key_once, ring_key_create);
+
+	for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next) {
+		unowned = 0;
+		if (__atomic_compare_exchange_n(&ring->owned, &unowned, 1, 0,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+
+	if (!ring) {
+		ring = calloc(1, sizeof(TraceRing));
+
+		if (!ring) {
+			return NULL;
+		}
+
+		ring->owned = 1;
+		ring->thread = __atomic_add_fetch(&ring_count, 1,
+						  __ATOMIC_RELAXED);
+		ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+
+		while (!__atomic_compare_exchange_n(&rings, &ring->next, ring,
+						    0, __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED)) {
+		}
+	}
+
+	pthread_setspecific(ring_key, ring);
+	thread_ring = ring;
+
+	return ring;
+}
+
+static void record(Context *ctx, TraceSpan span, unsigned long long start,
+		   unsigned long long duration, long long arg0,
+		   long long arg1, long long arg2)
+{
+	TraceRing *ring = thread_ring;
+	TraceEvent *evt;
+	unsigned long long count;
+
+	if (!ring) {
+		ring = ring_claim();
+	}
+
+	if (!ring) {
+		return;
+	}
+
+	count = ring->count;
+	evt = &ring->events[count % TRACE_RING_EVENTS];
+
+	// dumps must see the slot is being reused before it changes
+	__atomic_store_n(&ring->reserved, count + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	evt->start = start;
+	evt->duration = duration;
+	evt->plugin = ctx ? ctx->id.plugin : 0;
+	evt->connid = ctx ? ctx->id.connid : 0;
+	evt->span = span;
+	evt->args[0] = arg0;
+	evt->args[1] = arg1;
+	evt->args[2] = arg2;
+
+	__atomic_store_n(&ring->count, count + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Records a span. Use TRACE_END(), which skips the call when the
+ * span was not started.
+ *
+ * @param ctx context the span belongs to, may be NULL
+ * @param span span type
+ * @param start value of TRACE_BEGIN() when the span started
+ * @param arg0, arg1, arg2 span arguments
+ */
+void trace_end(Context *ctx, TraceSpan span, unsigned long long start,
+	       long long arg0, long long arg1, long long arg2)
+{
+	record(ctx, span, start, stats_clock() - start, arg0, arg1, arg2);
+}
+
+/**
+ * Records an association abort, and dumps the trace if
+ * trace_dump_on_abort() was called.
+ *
+ * @param ctx context
+ * @param received 1 if ABRT was received, 0 if sent
+ */
+void trace_abort(Context *ctx, int received)
+{
+	char *path;
+	int n;
+
+	if (!__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	record(ctx, TRACE_ABORT, stats_clock(), 0, received, 0, 0);
+
+	path = __atomic_load_n(&abort_path, __ATOMIC_ACQUIRE);
+
+	if (path) {
+		char file[1024];
+
+		n = __atomic_add_fetch(&abort_dumps, 1, __ATOMIC_RELAXED);
+		snprintf(file, sizeof(file), "%s.%d.json", path, n);
+		trace_dump(file);
+	}
+}
+
+/**
+ * Starts recording. Events recorded before the last trace_stop()
+ * are kept, up to the capacity of each thread ring.
+ */
+void trace_start()
+{
+	__atomic_store_n(&trace_enabled, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Stops recording. Recorded events can still be dumped.
+ */
+void trace_stop()
+{
+	__atomic_store_n(&trace_enabled, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Makes every association abort dump the trace to a new file,
+ * named path.N.json.
+ *
+ * @param path file name prefix, or NULL to stop dumping on abort.
+ * Not to be called while contexts may abort.
+ */
+void trace_dump_on_abort(const char *path)
+{
+	char *old = abort_path;
+
+	__atomic_store_n(&abort_path, path ? strdup(path) : NULL,
+			 __ATOMIC_RELEASE);
+	free(old);
+}
+
+static void dump_event(FILE *f, TraceRing *ring, TraceEvent *evt, int *first)
+{
+	const TraceSpanInfo *info = &span_info[evt->span];
+	int i;
+
+	fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"antidote\","
+		"\"ts\":%llu.%03llu,", *first ? "" : ",", info->name,
+		evt->start / 1000, evt->start % 1000);
+
+	if (evt->span == TRACE_ABORT) {
+		fprintf(f, "\"ph\":\"i\",\"s\":\"t\",");
+	} else {
+		fprintf(f, "\"ph\":\"X\",\"dur\":%llu.%03llu,",
+			evt->duration / 1000, evt->duration % 1000);
+	}
+
+	fprintf(f, "\"pid\":%u,\"tid\":%llu,\"args\":{\"thread\":%d",
+		evt->plugin, evt->connid, ring->thread);
+
+	for (i = 0; i < 3; ++i) {
+		if (!info->args[i]) {
+			continue;
+		}
+
+		if (evt->span == TRACE_FSM_EVENT) {
+			fprintf(f, ",\"%s\":\"%s\"", info->args[i], i == 0 ?
+				fsm_event_to_string(evt->args[i]) :
+				fsm_state_to_string(evt->args[i]));
+		} else {
+			fprintf(f, ",\"%s\":%lld", info->args[i], evt->args[i]);
+		}
+	}
+
+	fprintf(f, "}}");
+	*first = 0;
+}
+
+/**
+ * Writes the recorded events of all threads in Chrome trace event
+ * format. May be called while other threads are recording.
+ *
+ * @param path file to write
+ * @return 1 if written, 0 on error
+ */
+int trace_dump(const char *path)
+{
+	TraceRing *ring;
+	TraceEvent evt;
+	int first = 1;
+	FILE *f = fopen(path, "w");
+
+	if (!f) {
+		ERROR("trace: cannot open %s", path);
+		return 0;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+	for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next) {
+		unsigned long long count;
+		unsigned long long i;
+
+		count = __atomic_load_n(&ring->count, __ATOMIC_ACQUIRE);
+		i = count > TRACE_RING_EVENTS ? count - TRACE_RING_EVENTS : 0;
+
+		for (; i < count; ++i) {
+			memcpy(&evt, &ring->events[i % TRACE_RING_EVENTS],
+			       sizeof(evt));
+
+			// the writer may have reused the slot meanwhile
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&ring->reserved, __ATOMIC_RELAXED) >=
+			    i + TRACE_RING_EVENTS) {
+				continue;
+			}
+
+			if (evt.span >= TRACE_SPANS) {
+				continue;
+			}
+
+			dump_event(f, ring, &evt, &first);
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+
+	if (fclose(f)) {
+		ERROR("trace: cannot write %s", path);
+		return 0;
+	}
+
+	DEBUG("trace: dumped to %s", path);
+
+	return 1;
+}
+
+/** @} */
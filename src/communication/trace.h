@@ -0,0 +1,85 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file trace.h
+ * \brief Flight recorder of communication layer events
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <communication/stats.h>
+
+struct Context;
+
+/**
+ * Traced spans. Each one records up to three integer arguments,
+ * named in trace.c.
+ */
+typedef enum {
+	TRACE_RECEIVE = 0,	// !< APDU receive and processing (bytes)
+	TRACE_DECODE,		// !< APDU decoding (bytes)
+	TRACE_FSM_EVENT,	// !< FSM event (event, state before, after)
+	TRACE_LISTENER,		// !< application listener callbacks
+	TRACE_SEND,		// !< APDU encoding and sending (bytes)
+	TRACE_ENCODE,		// !< APDU encoding (bytes)
+	TRACE_TIMEOUT,		// !< protocol timer fire
+	TRACE_ABORT,		// !< ABRT sent or received, instant
+	TRACE_SPANS
+} TraceSpan;
+
+/**
+ * Non-zero while tracing. Checked inline at every trace point.
+ */
+extern int trace_enabled;
+
+/**
+ * @brief Start time of a span, or 0 if tracing is disabled.
+ */
+#define TRACE_BEGIN() \
+	(__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED) ? stats_clock() : 0)
+
+/**
+ * @brief Records a span started with TRACE_BEGIN().
+ */
+#define TRACE_END(ctx, span, start, arg0, arg1, arg2) \
+	do { \
+		if (start) { \
+			trace_end(ctx, span, start, arg0, arg1, arg2); \
+		} \
+	} while (0)
+
+void trace_end(struct Context *ctx, TraceSpan span, unsigned long long start,
+	       long long arg0, long long arg1, long long arg2);
+
+void trace_abort(struct Context *ctx, int received);
+
+void trace_start();
+
+void trace_stop();
+
+void trace_dump_on_abort(const char *path);
+
+int trace_dump(const char *path);
+
+#endif /* TRACE_H_ */
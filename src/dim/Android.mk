@@ -18,6 +18,7 @@ LOCAL_SRC_FILES = \
 			       rtsa.c \
 			       enumeration.c \
 			       peri_cfg_scanner.c \
+			       latest_value.c \
 			       scanner.c 
 
 LOCAL_MODULE:= libantidotedim
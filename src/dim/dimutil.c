@@ -1177,6 +1177,7 @@ void dimutil_update_mds_from_obs_scan(struct MDS *mds, ObservationScan *var_obs,
 	struct MDS_object *object = NULL;
 	struct Metric_object *metric_obj = NULL;
 	struct PMStore *pmstore = NULL;
+	Arena *cleaner_previous = cleaner_set_arena(mds ? mds->arena : NULL);
 
 	obj_handle = var_obs->obj_handle;
 
@@ -1215,6 +1216,8 @@ void dimutil_update_mds_from_obs_scan(struct MDS *mds, ObservationScan *var_obs,
 			free(stream);
 		}
 	}
+
+	cleaner_set_arena(cleaner_previous);
 }
 
 /**
@@ -1232,6 +1235,7 @@ void dimutil_update_mds_from_obs_scan_fixed(struct MDS *mds, ObservationScanFixe
 	struct Metric_object *metric_obj = NULL;
 	struct MDS_object *object = NULL;
 	ASN1_HANDLE handle = fixed_obs->obj_handle;
+	Arena *cleaner_previous = cleaner_set_arena(mds ? mds->arena : NULL);
 	object = mds_get_object_by_handle(mds, handle);
 
 	if (object != NULL) {
@@ -1315,6 +1319,8 @@ void dimutil_update_mds_from_obs_scan_fixed(struct MDS *mds, ObservationScanFixe
 
 		free(stream);
 	}
+
+	cleaner_set_arena(cleaner_previous);
 }
 
 /**
@@ -1337,6 +1343,7 @@ void dimutil_update_mds_from_grouped_observations(struct MDS *mds, ByteStreamRea
 
 	struct MDS_object *obj = mds_get_object_by_handle(mds, val_map_entry->obj_handle);
 	AttrValMap *val_map = &val_map_entry->attr_val_map;
+	Arena *cleaner_previous = cleaner_set_arena(mds ? mds->arena : NULL);
 
 	measurement_entry->choice = COMPOUND_DATA_ENTRY;
 	data_meta_set_handle(measurement_entry, val_map_entry->obj_handle);
@@ -1395,6 +1402,8 @@ void dimutil_update_mds_from_grouped_observations(struct MDS *mds, ByteStreamRea
 		break;
 		}
 	}
+
+	cleaner_set_arena(cleaner_previous);
 }
 
 /** @} */
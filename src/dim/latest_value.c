@@ -0,0 +1,794 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * \file latest_value.c
+ * \brief Latest observed value cache
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * \defgroup LatestValue Latest value cache
+ * \ingroup ObjectClasses
+ * \brief Last observation of every metric, per device
+ *
+ * Every measurement delivered to the manager listeners is also
+ * stored here, keyed by (context, object handle, metric-id), so
+ * applications can poll the current value of a metric without
+ * listening to events or asking the agent.
+ *
+ * The table is a single open-addressing hash shared by all contexts.
+ * Values are written by the context that owns the slot, with the
+ * context lock held. Each slot carries a sequence counter: writers
+ * make it odd while the slot is being changed, and readers copy the
+ * slot and retry if the counter moved. Readers therefore take no
+ * lock at all, and may run in any thread.
+ *
+ * Claiming and releasing slots is serialized by table_mutex. A
+ * released slot becomes a tombstone, unless the next slot is empty,
+ * in which case it (and the tombstones before it) become empty
+ * again. When too many tombstones are left, the table is compacted
+ * by shifting entries back into them, so misses stay short under
+ * connection churn.
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "src/dim/latest_value.h"
+#include "src/dim/mds.h"
+#include "src/util/log.h"
+
+#define SLOT_EMPTY 0
+#define SLOT_USED 1
+#define SLOT_DEAD 2
+
+#define SLOT_MASK (LATEST_VALUE_CACHE_SIZE - 1)
+
+/**
+ * Tombstones tolerated before the table is compacted
+ */
+#define TOMBSTONE_LIMIT (LATEST_VALUE_CACHE_SIZE / 8)
+
+#define VALUE_WORDS ((sizeof(LatestValue) + 7) / 8)
+
+/**
+ * Hash table slot
+ */
+typedef struct LatestValueSlot {
+	unsigned int state;
+	/**
+	 * Odd while the slot is being written; also the writer lock
+	 */
+	unsigned int seq;
+	unsigned int plugin;
+	unsigned int pad;
+	unsigned long long connid;
+	union {
+		LatestValue v;
+		unsigned long long w[VALUE_WORDS];
+	} data;
+} LatestValueSlot;
+
+/**
+ * Key of a value owned by a context
+ */
+typedef struct LatestValueKey {
+	ASN1_HANDLE handle;
+	OID_Type metric_id;
+} LatestValueKey;
+
+/**
+ * Keys stored by a context, so they can be released when it goes away.
+ * Keys rather than slot positions are kept, since compaction moves
+ * entries around.
+ */
+struct LatestValueIndex {
+	unsigned int count;
+	unsigned int size;
+	LatestValueKey *keys;
+};
+
+static LatestValueSlot *table = NULL;
+
+/**
+ * Serializes claim, release and compaction of slots
+ */
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Number of SLOT_DEAD slots, protected by table_mutex
+ */
+static unsigned int tombstones = 0;
+
+/**
+ * Odd while the table is being compacted, so readers that missed
+ * a key can tell that it may have been moving
+ */
+static unsigned int generation = 0;
+
+static unsigned int hash(ContextId id, ASN1_HANDLE handle, OID_Type metric_id)
+{
+	unsigned long long h = id.connid;
+
+	h ^= ((unsigned long long) id.plugin << 32)
+	     ^ ((unsigned long long) handle << 16) ^ metric_id;
+	h *= 0x9e3779b97f4a7c15ULL;
+
+	return (h >> 32) & SLOT_MASK;
+}
+
+/**
+ * Makes the sequence counter odd. The owner of a slot and the
+ * compaction may write it at the same time, so this also works as
+ * the writer lock of the slot; it is held for a handful of stores.
+ */
+static void write_begin(LatestValueSlot *slot)
+{
+	unsigned int seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+	while ((seq & 1) || !__atomic_compare_exchange_n(&slot->seq, &seq,
+							 seq + 1, 1,
+							 __ATOMIC_ACQUIRE,
+							 __ATOMIC_RELAXED))
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void write_end(LatestValueSlot *slot)
+{
+	unsigned int seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+static void write_value(LatestValueSlot *slot, const LatestValue *value)
+{
+	union {
+		LatestValue v;
+		unsigned long long w[VALUE_WORDS];
+	} data;
+	unsigned int i;
+
+	memset(&data, 0, sizeof(data));
+	data.v = *value;
+
+	for (i = 0; i < VALUE_WORDS; ++i)
+		__atomic_store_n(&slot->data.w[i], data.w[i], __ATOMIC_RELAXED);
+}
+
+/**
+ * Looks for a key, taking a consistent snapshot of each slot probed
+ *
+ * @param id context id
+ * @param handle object handle
+ * @param metric_id metric-id
+ * @param value if not NULL, receives the value found
+ * @return slot index, or -1 if not found
+ */
+static int lookup(ContextId id, ASN1_HANDLE handle, OID_Type metric_id,
+		  LatestValue *value)
+{
+	unsigned int pos = hash(id, handle, metric_id);
+	unsigned int probes;
+
+	for (probes = 0; probes < LATEST_VALUE_CACHE_SIZE; ++probes) {
+		LatestValueSlot *slot = &table[pos];
+		union {
+			LatestValue v;
+			unsigned long long w[VALUE_WORDS];
+		} data;
+		unsigned int s1, s2, state, plugin, i;
+		unsigned long long connid;
+
+		do {
+			s1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+			if (s1 & 1)
+				continue;
+
+			state = __atomic_load_n(&slot->state, __ATOMIC_RELAXED);
+			plugin = __atomic_load_n(&slot->plugin, __ATOMIC_RELAXED);
+			connid = __atomic_load_n(&slot->connid, __ATOMIC_RELAXED);
+
+			for (i = 0; i < VALUE_WORDS; ++i)
+				data.w[i] = __atomic_load_n(&slot->data.w[i],
+							    __ATOMIC_RELAXED);
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			s2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+		} while ((s1 & 1) || s1 != s2);
+
+		if (state == SLOT_EMPTY)
+			return -1;
+
+		if (state == SLOT_USED && plugin == id.plugin
+		    && connid == id.connid && data.v.handle == handle
+		    && data.v.metric_id == metric_id) {
+			if (value)
+				*value = data.v;
+			return pos;
+		}
+
+		pos = (pos + 1) & SLOT_MASK;
+	}
+
+	return -1;
+}
+
+/**
+ * Tells whether a write-locked slot holds a key
+ */
+static int holds(LatestValueSlot *slot, ContextId id, ASN1_HANDLE handle,
+		 OID_Type metric_id)
+{
+	return slot->state == SLOT_USED && slot->plugin == id.plugin
+	       && slot->connid == id.connid && slot->data.v.handle == handle
+	       && slot->data.v.metric_id == metric_id;
+}
+
+/**
+ * Claims a free slot for a new key. Called with table_mutex held.
+ *
+ * @return slot index, or -1 if table is full
+ */
+static int claim(Context *ctx, const LatestValue *value)
+{
+	unsigned int pos = hash(ctx->id, value->handle, value->metric_id);
+	unsigned int probes;
+
+	for (probes = 0; probes < LATEST_VALUE_CACHE_SIZE; ++probes) {
+		LatestValueSlot *slot = &table[pos];
+		unsigned int state = __atomic_load_n(&slot->state,
+						     __ATOMIC_RELAXED);
+
+		if (state == SLOT_EMPTY || state == SLOT_DEAD) {
+			write_begin(slot);
+			__atomic_store_n(&slot->plugin, ctx->id.plugin,
+					 __ATOMIC_RELAXED);
+			__atomic_store_n(&slot->connid, ctx->id.connid,
+					 __ATOMIC_RELAXED);
+			write_value(slot, value);
+			__atomic_store_n(&slot->state, SLOT_USED,
+					 __ATOMIC_RELAXED);
+			write_end(slot);
+
+			if (state == SLOT_DEAD)
+				--tombstones;
+
+			return pos;
+		}
+
+		pos = (pos + 1) & SLOT_MASK;
+	}
+
+	return -1;
+}
+
+/**
+ * Turns a tombstone back into an empty slot when the next slot is
+ * empty, and then the tombstones right before it: no probe sequence
+ * runs across them. Called with table_mutex held.
+ */
+static void reclaim(unsigned int pos)
+{
+	while (table[pos].state == SLOT_DEAD
+	       && table[(pos + 1) & SLOT_MASK].state == SLOT_EMPTY) {
+		__atomic_store_n(&table[pos].state, SLOT_EMPTY,
+				 __ATOMIC_RELAXED);
+		--tombstones;
+		pos = (pos - 1) & SLOT_MASK;
+	}
+}
+
+/**
+ * Hides a slot from readers. Called with table_mutex held.
+ */
+static void release(unsigned int pos)
+{
+	write_begin(&table[pos]);
+	__atomic_store_n(&table[pos].state, SLOT_DEAD, __ATOMIC_RELAXED);
+	write_end(&table[pos]);
+	++tombstones;
+
+	reclaim(pos);
+}
+
+/**
+ * Position where the key of a write-locked slot hashes to
+ */
+static unsigned int home_of(LatestValueSlot *slot)
+{
+	ContextId id;
+
+	id.plugin = slot->plugin;
+	id.connid = slot->connid;
+
+	return hash(id, slot->data.v.handle, slot->data.v.metric_id);
+}
+
+/**
+ * Fills a tombstone with the next entry of the cluster that may live
+ * there, then the slot left behind by it, and so on. The last hole
+ * is emptied once the end of the cluster is reached.
+ * Called with table_mutex held.
+ */
+static void shift_back(unsigned int hole)
+{
+	unsigned int pos;
+	unsigned int i;
+
+	for (pos = (hole + 1) & SLOT_MASK; pos != hole;
+	     pos = (pos + 1) & SLOT_MASK) {
+		LatestValueSlot *slot = &table[pos];
+		LatestValueSlot *dest = &table[hole];
+		unsigned int home;
+
+		if (slot->state == SLOT_EMPTY) {
+			__atomic_store_n(&dest->state, SLOT_EMPTY,
+					 __ATOMIC_RELAXED);
+			--tombstones;
+			return;
+		}
+
+		if (slot->state != SLOT_USED)
+			continue;
+
+		write_begin(slot);
+		home = home_of(slot);
+
+		if (((pos - home) & SLOT_MASK) < ((pos - hole) & SLOT_MASK)) {
+			/* hole is before the key's home */
+			write_end(slot);
+			continue;
+		}
+
+		/* publish the copy before hiding the original */
+		write_begin(dest);
+		__atomic_store_n(&dest->plugin, slot->plugin, __ATOMIC_RELAXED);
+		__atomic_store_n(&dest->connid, slot->connid, __ATOMIC_RELAXED);
+
+		for (i = 0; i < VALUE_WORDS; ++i)
+			__atomic_store_n(&dest->data.w[i], slot->data.w[i],
+					 __ATOMIC_RELAXED);
+
+		__atomic_store_n(&dest->state, SLOT_USED, __ATOMIC_RELAXED);
+		write_end(dest);
+
+		__atomic_store_n(&slot->state, SLOT_DEAD, __ATOMIC_RELAXED);
+		write_end(slot);
+
+		hole = pos;
+	}
+}
+
+/**
+ * Removes all tombstones that are followed by an empty slot somewhere
+ * in their cluster, i.e. all of them unless the table is full.
+ * Called with table_mutex held.
+ */
+static void compact()
+{
+	unsigned int pos;
+
+	DEBUG("latest value cache: compacting %u tombstones", tombstones);
+
+	/* readers that miss while this is odd must look again */
+	__atomic_store_n(&generation, generation + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	for (pos = 0; pos < LATEST_VALUE_CACHE_SIZE; ++pos) {
+		if (table[pos].state == SLOT_DEAD)
+			shift_back(pos);
+	}
+
+	__atomic_store_n(&generation, generation + 1, __ATOMIC_RELEASE);
+}
+
+static void index_add(Context *ctx, const LatestValue *value)
+{
+	struct LatestValueIndex *index = ctx->latest_values;
+
+	if (!index) {
+		index = calloc(1, sizeof(struct LatestValueIndex));
+		ctx->latest_values = index;
+	}
+
+	if (index->count >= index->size) {
+		index->size = index->size ? index->size * 2 : 8;
+		index->keys = realloc(index->keys,
+				      index->size * sizeof(LatestValueKey));
+	}
+
+	index->keys[index->count].handle = value->handle;
+	index->keys[index->count].metric_id = value->metric_id;
+	++index->count;
+}
+
+static void store(Context *ctx, LatestValue *value)
+{
+	LatestValueSlot *slot;
+	int pos;
+
+	while ((pos = lookup(ctx->id, value->handle, value->metric_id,
+			     NULL)) >= 0) {
+		slot = &table[pos];
+		write_begin(slot);
+
+		if (holds(slot, ctx->id, value->handle, value->metric_id)) {
+			write_value(slot, value);
+			write_end(slot);
+			return;
+		}
+
+		/* moved by compaction in the meantime */
+		write_end(slot);
+	}
+
+	pthread_mutex_lock(&table_mutex);
+
+	/* a miss is only certain while no compaction is running */
+	pos = lookup(ctx->id, value->handle, value->metric_id, NULL);
+
+	if (pos >= 0) {
+		slot = &table[pos];
+		write_begin(slot);
+		write_value(slot, value);
+		write_end(slot);
+	} else {
+		pos = claim(ctx, value);
+
+		if (pos >= 0)
+			index_add(ctx, value);
+	}
+
+	pthread_mutex_unlock(&table_mutex);
+
+	if (pos < 0)
+		DEBUG("latest value cache full, dropping %d/%d",
+		      value->handle, value->metric_id);
+}
+
+static int metric_id_of(struct Metric *metric)
+{
+	return metric->use_metric_id_field ? metric->metric_id
+	       : metric->type.code;
+}
+
+/**
+ * Metric-id of i-th element of a compound observation, as listed
+ * in Metric-Id-List
+ */
+static int compound_metric_id(struct Metric *metric, int i)
+{
+	if (i < metric->metric_id_list.count)
+		return metric->metric_id_list.value[i];
+
+	return metric_id_of(metric);
+}
+
+static void store_number(Context *ctx, LatestValue *base, OID_Type metric_id,
+			 FLOAT_Type number)
+{
+	LatestValue value = *base;
+
+	value.metric_id = metric_id;
+	value.type = LATEST_VALUE_NUMBER;
+	value.u.number = number;
+	store(ctx, &value);
+}
+
+static void update_numeric(Context *ctx, LatestValue *base,
+			   struct Numeric *numeric, const char *name)
+{
+	struct Metric *metric = &numeric->metric;
+	int i;
+
+	if (strcmp(name, "Simple-Nu-Observed-Value") == 0) {
+		store_number(ctx, base, metric_id_of(metric),
+			     numeric->simple_nu_observed_value);
+	} else if (strcmp(name, "Basic-Nu-Observed-Value") == 0) {
+		store_number(ctx, base, metric_id_of(metric),
+			     numeric->basic_nu_observed_value);
+	} else if (strcmp(name, "Compound-Simple-Nu-Observed-Value") == 0) {
+		SimpleNuObsValueCmp *cmp =
+			&numeric->compound_simple_nu_observed_value;
+
+		for (i = 0; i < cmp->count; ++i)
+			store_number(ctx, base, compound_metric_id(metric, i),
+				     cmp->value[i]);
+	} else if (strcmp(name, "Compound-Basic-Nu-Observed-Value") == 0) {
+		BasicNuObsValueCmp *cmp =
+			&numeric->compound_basic_nu_observed_value;
+
+		for (i = 0; i < cmp->count; ++i)
+			store_number(ctx, base, compound_metric_id(metric, i),
+				     cmp->value[i]);
+	} else if (strcmp(name, "Nu-Observed-Value") == 0) {
+		NuObsValue *obs = &numeric->nu_observed_value;
+		LatestValue value = *base;
+
+		value.unit_code = obs->unit_code;
+		value.status = obs->state;
+		store_number(ctx, &value, obs->metric_id, obs->value);
+	} else if (strcmp(name, "Compound-Nu-Observed-Value") == 0) {
+		NuObsValueCmp *cmp = &numeric->compound_nu_observed_value;
+
+		for (i = 0; i < cmp->count; ++i) {
+			NuObsValue *obs = &cmp->value[i];
+			LatestValue value = *base;
+
+			value.unit_code = obs->unit_code;
+			value.status = obs->state;
+			store_number(ctx, &value, obs->metric_id, obs->value);
+		}
+	}
+}
+
+static void update_enumeration(Context *ctx, LatestValue *base,
+			       struct Enumeration *enumeration, const char *name)
+{
+	LatestValue value = *base;
+
+	value.metric_id = metric_id_of(&enumeration->metric);
+
+	if (strcmp(name, "Enum-Observed-Value-Simple-OID") == 0) {
+		value.type = LATEST_VALUE_OID;
+		value.u.oid = enumeration->enum_observed_value_simple_OID;
+	} else if (strcmp(name, "Enum-Observed-Value-Simple-Bit-Str") == 0) {
+		value.type = LATEST_VALUE_BITS;
+		value.u.bits = enumeration->enum_observed_value_simple_bit_str;
+	} else if (strcmp(name, "Enum-Observed-Value-Basic-Bit-Str") == 0) {
+		value.type = LATEST_VALUE_BITS;
+		value.u.bits = enumeration->enum_observed_value_basic_bit_str;
+	} else if (strcmp(name, "Enum-Observed-Value") == 0) {
+		EnumObsValue *obs = &enumeration->enum_observed_value;
+
+		value.metric_id = obs->metric_id;
+		value.status = obs->state;
+
+		if (obs->value.choice == OBJ_ID_CHOSEN) {
+			value.type = LATEST_VALUE_OID;
+			value.u.oid = obs->value.u.enum_obj_id;
+		} else if (obs->value.choice == BIT_STR_CHOSEN) {
+			value.type = LATEST_VALUE_BITS;
+			value.u.bits = obs->value.u.enum_bit_str;
+		} else {
+			return;
+		}
+	} else {
+		/* text values are left to listeners */
+		return;
+	}
+
+	store(ctx, &value);
+}
+
+static const char *entry_name(const DataEntry *entry)
+{
+	if (entry->choice == SIMPLE_DATA_ENTRY)
+		return entry->u.simple.name;
+
+	return entry->u.compound.name;
+}
+
+static int entry_handle(const DataEntry *entry)
+{
+	int i;
+
+	for (i = 0; i < entry->meta_data.size; ++i) {
+		MetaAtt *meta = &entry->meta_data.values[i];
+
+		if (meta->name && meta->value && strcmp(meta->name, "HANDLE") == 0)
+			return atoi(meta->value);
+	}
+
+	return -1;
+}
+
+static void update_entry(Context *ctx, DataEntry *entry,
+			 unsigned long long received)
+{
+	struct MDS_object *object;
+	struct Metric *metric;
+	LatestValue base;
+	int handle;
+	int i;
+
+	if (entry->choice != COMPOUND_DATA_ENTRY)
+		return;
+
+	handle = entry_handle(entry);
+
+	if (handle < 0)
+		return;
+
+	object = mds_get_object_by_handle(ctx->mds, handle);
+
+	if (!object || object->choice != MDS_OBJ_METRIC)
+		return;
+
+	if (object->u.metric.choice == METRIC_NUMERIC)
+		metric = &object->u.metric.u.numeric.metric;
+	else if (object->u.metric.choice == METRIC_ENUM)
+		metric = &object->u.metric.u.enumeration.metric;
+	else
+		return;
+
+	memset(&base, 0, sizeof(base));
+	base.handle = handle;
+	base.unit_code = metric->unit_code;
+	base.status = metric->measurement_status;
+	base.time_stamp = metric->absolute_time_stamp;
+	base.received = received;
+
+	for (i = 0; i < entry->u.compound.entries_count; ++i) {
+		const char *name = entry_name(&entry->u.compound.entries[i]);
+
+		if (!name)
+			continue;
+
+		if (object->u.metric.choice == METRIC_NUMERIC)
+			update_numeric(ctx, &base,
+				       &object->u.metric.u.numeric, name);
+		else
+			update_enumeration(ctx, &base,
+					   &object->u.metric.u.enumeration,
+					   name);
+	}
+}
+
+/**
+ * Allocates the cache. Called by manager_init().
+ */
+void latest_value_init()
+{
+	if (table)
+		return;
+
+	table = calloc(LATEST_VALUE_CACHE_SIZE, sizeof(LatestValueSlot));
+	tombstones = 0;
+}
+
+/**
+ * Frees the cache. Called by manager_finalize(), after all
+ * contexts are gone; no reader may be running.
+ */
+void latest_value_finalize()
+{
+	free(table);
+	table = NULL;
+}
+
+/**
+ * Records the values of a measurement notification. The MDS
+ * objects referenced by list must already hold the decoded
+ * observations.
+ *
+ * This function must be called with the context locked.
+ *
+ * @param ctx context that received the measurement
+ * @param list measurement data list
+ */
+void latest_value_update(Context *ctx, DataList *list)
+{
+	struct timeval now;
+	unsigned long long received;
+	int i;
+
+	if (!table || !ctx || !ctx->mds || !list)
+		return;
+
+	gettimeofday(&now, NULL);
+	received = now.tv_sec * 1000000ULL + now.tv_usec;
+
+	for (i = 0; i < list->size; ++i)
+		update_entry(ctx, &list->values[i], received);
+}
+
+/**
+ * Releases all values of a context. Called when context is destroyed.
+ *
+ * @param ctx context
+ */
+void latest_value_remove_context(Context *ctx)
+{
+	struct LatestValueIndex *index = ctx->latest_values;
+	unsigned int i;
+	int pos;
+
+	if (!index)
+		return;
+
+	if (table) {
+		pthread_mutex_lock(&table_mutex);
+
+		for (i = 0; i < index->count; ++i) {
+			pos = lookup(ctx->id, index->keys[i].handle,
+				     index->keys[i].metric_id, NULL);
+
+			if (pos >= 0)
+				release(pos);
+		}
+
+		if (tombstones > TOMBSTONE_LIMIT)
+			compact();
+
+		pthread_mutex_unlock(&table_mutex);
+	}
+
+	free(index->keys);
+	free(index);
+	ctx->latest_values = NULL;
+}
+
+/**
+ * Gets the last value received for a metric. Takes no lock; may be
+ * called from any thread while the manager is initialized.
+ *
+ * @param id context id
+ * @param handle handle of the Numeric or Enumeration object
+ * @param metric_id metric-id (the object type, or one of its
+ *	  Metric-Id-List entries for compound observations)
+ * @param value receives the value
+ * @return 1 if found, 0 if not
+ */
+int latest_value_get(ContextId id, ASN1_HANDLE handle, OID_Type metric_id,
+			LatestValue *value)
+{
+	unsigned int gen;
+	int found;
+
+	if (!table)
+		return 0;
+
+	do {
+		gen = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+		found = lookup(id, handle, metric_id, value) >= 0;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (!found && ((gen & 1)
+			    || gen != __atomic_load_n(&generation,
+						      __ATOMIC_RELAXED)));
+
+	return found;
+}
+
+/**
+ * Number of released slots not reclaimed yet, for diagnostics
+ *
+ * @return tombstone count
+ */
+unsigned int latest_value_tombstones()
+{
+	unsigned int count;
+
+	pthread_mutex_lock(&table_mutex);
+	count = tombstones;
+	pthread_mutex_unlock(&table_mutex);
+
+	return count;
+}
+
+/** @} */
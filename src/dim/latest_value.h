@@ -0,0 +1,97 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * \file latest_value.h
+ * \brief Latest observed value cache
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef LATEST_VALUE_H_
+#define LATEST_VALUE_H_
+
+#include <asn1/phd_types.h>
+#include <api/api_definitions.h>
+#include <communication/context.h>
+
+/**
+ * Maximum number of (context, handle, metric-id) entries kept.
+ * Must be a power of 2.
+ */
+#ifndef LATEST_VALUE_CACHE_SIZE
+#define LATEST_VALUE_CACHE_SIZE 16384
+#endif
+
+/**
+ * Kind of value held by LatestValue
+ */
+typedef enum {
+	LATEST_VALUE_NONE = 0,
+	LATEST_VALUE_NUMBER,	// !< u.number is valid
+	LATEST_VALUE_OID,	// !< u.oid is valid
+	LATEST_VALUE_BITS	// !< u.bits is valid
+} LatestValueType;
+
+/**
+ * Last value reported by an agent for a (handle, metric-id) pair
+ */
+typedef struct LatestValue {
+	ASN1_HANDLE handle;
+	OID_Type metric_id;
+	OID_Type unit_code;
+	/**
+	 * LatestValueType
+	 */
+	intu16 type;
+	/**
+	 * Measurement status, 0 if not reported
+	 */
+	MeasurementStatus status;
+	intu16 reserved[3];
+	union {
+		FLOAT_Type number;
+		OID_Type oid;
+		BITS_32 bits;
+	} u;
+	/**
+	 * Agent time stamp, zeroed if agent does not report it
+	 */
+	AbsoluteTime time_stamp;
+	/**
+	 * Manager time of reception, microseconds since the epoch
+	 */
+	unsigned long long received;
+} LatestValue;
+
+void latest_value_init();
+
+void latest_value_finalize();
+
+void latest_value_update(Context *ctx, DataList *list);
+
+void latest_value_remove_context(Context *ctx);
+
+int latest_value_get(ContextId id, ASN1_HANDLE handle, OID_Type metric_id,
+			LatestValue *value);
+
+unsigned int latest_value_tombstones();
+
+#endif /* LATEST_VALUE_H_ */
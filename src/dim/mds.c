@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 #include "mds.h"
 #include "dimutil.h"
 #include "nomenclature.h"
@@ -487,6 +488,23 @@ void mds_configure_operating(Context *ctx, ConfigObjectList *config_obj_list,
 	int j;
 
 	MDS *mds  = ctx->mds;
+	Arena *cleaner_previous;
+	Arena *decode_previous;
+
+	// objects and their attributes as configured live as long as the
+	// MDS, so they are carved from an arena of its own
+	if (!mds->arena) {
+		mds->arena = arena_new(0);
+	}
+
+	if (mds->arena && mds->objects_list_count == 0 && obj_list_size > 0) {
+		mds->objects_list = arena_calloc(mds->arena, obj_list_size,
+						 sizeof(struct MDS_object));
+		mds->objects_list_capacity = mds->objects_list ? obj_list_size : 0;
+	}
+
+	cleaner_previous = cleaner_set_arena(mds->arena);
+	decode_previous = decoder_set_arena(mds->arena);
 
 	for (i = 0; i < obj_list_size; ++i) {
 		struct MDS_object object;
@@ -687,17 +705,32 @@ void mds_configure_operating(Context *ctx, ConfigObjectList *config_obj_list,
 		}
 	}
 
+	decoder_set_arena(decode_previous);
+	cleaner_set_arena(cleaner_previous);
+
+	mds_resume_operating(ctx, manager);
+
+	del_configobjectlist(config_obj_list);
+	config_obj_list = NULL;
+}
+
+/**
+ * Starts operation of a context whose MDS objects are in place, either
+ * just configured or kept warm from an earlier association
+ *
+ * @param ctx context
+ * @param manager 1 if the context is of a manager
+ */
+void mds_resume_operating(Context *ctx, int manager)
+{
 	service_init(ctx);
 
 	if (manager) {
 		DataList *list = data_list_new(1);
-		mds_populate_attributes(mds, &list->values[0]);
+		mds_populate_attributes(ctx->mds, &list->values[0]);
 
 		manager_notify_evt_device_available(ctx, list);
 	}
-
-	del_configobjectlist(config_obj_list);
-	config_obj_list = NULL;
 }
 
 /**
@@ -882,8 +915,28 @@ void mds_populate_attributes(MDS *mds, DataEntry *entry)
  */
 void mds_add_object(MDS *mds, struct MDS_object object)
 {
-	// test if there is not elements in the list
-	if (mds->objects_list_count == 0 && mds != NULL) {
+	if (mds->objects_list_count < mds->objects_list_capacity) {
+		// room left in the list carved at configuration
+	} else if (mds->arena) {
+		struct MDS_object *list;
+
+		list = arena_calloc(mds->arena, mds->objects_list_count + 1,
+				    sizeof(struct MDS_object));
+
+		if (list == NULL) {
+			ERROR("ERROR");
+			return;
+		}
+
+		if (mds->objects_list_count > 0) {
+			memcpy(list, mds->objects_list,
+			       sizeof(struct MDS_object) * mds->objects_list_count);
+		}
+
+		mds->objects_list = list;
+		mds->objects_list_capacity = mds->objects_list_count + 1;
+	} else if (mds->objects_list_count == 0) {
+		// test if there is not elements in the list
 		mds->objects_list = malloc(sizeof(struct MDS_object));
 		memset(mds->objects_list, 0, sizeof(struct MDS_object));
 
@@ -891,11 +944,13 @@ void mds_add_object(MDS *mds, struct MDS_object object)
 		mds->objects_list = realloc(mds->objects_list,
 					    sizeof(struct MDS_object)
 					    * (mds->objects_list_count + 1));
-		memset(mds->objects_list+mds->objects_list_count, 0, sizeof(struct MDS_object));
 
 		if (mds->objects_list == NULL) {
 			ERROR("ERROR");
+			return;
 		}
+
+		memset(mds->objects_list+mds->objects_list_count, 0, sizeof(struct MDS_object));
 	}
 
 	// add element to list
@@ -1511,6 +1566,9 @@ void mds_destroy(MDS *mds)
 {
 	if (mds != NULL) {
 		int i;
+		// only values replaced after configuration are freed one
+		// by one, the configuration goes with the arena
+		Arena *cleaner_previous = cleaner_set_arena(mds->arena);
 
 		if (mds->objects_list != NULL) {
 			for (i = 0; i < mds->objects_list_count; ++i) {
@@ -1547,7 +1605,10 @@ void mds_destroy(MDS *mds)
 				}
 			}
 
-			free(mds->objects_list);
+			if (!mds->arena) {
+				free(mds->objects_list);
+			}
+
 			mds->objects_list = NULL;
 		}
 
@@ -1560,6 +1621,8 @@ void mds_destroy(MDS *mds)
 		del_highresrelativetime(&mds->hires_relative_time);
 		del_typeverlist(&mds->system_type_spec_list);
 
+		cleaner_set_arena(cleaner_previous == mds->arena ? NULL : cleaner_previous);
+		arena_destroy(mds->arena);
 
 		free(mds);
 		mds = NULL;
@@ -1567,4 +1630,291 @@ void mds_destroy(MDS *mds)
 }
 
 
+/**
+ * Most MDSs kept warm
+ */
+#define MDS_CACHE_MAX 16
+
+/**
+ * MDSs of recently disconnected devices, most recent first
+ */
+static MDS *mds_cache[MDS_CACHE_MAX];
+static unsigned int mds_cache_count = 0;
+static unsigned int mds_cache_capacity = MDS_CACHE_MAX;
+static pthread_mutex_t mds_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Removes an entry of the cache. Must be called with the cache locked.
+ *
+ * \param i entry index
+ * \return the MDS of the entry
+ */
+static MDS *mds_cache_remove(unsigned int i)
+{
+	MDS *mds = mds_cache[i];
+
+	memmove(&mds_cache[i], &mds_cache[i + 1],
+		(mds_cache_count - i - 1) * sizeof(MDS *));
+	--mds_cache_count;
+
+	return mds;
+}
+
+/**
+ * Finds the entry of a device configuration. Must be called with the
+ * cache locked.
+ *
+ * \param system_id system id of the device
+ * \param config_id configuration id
+ * \return entry index, -1 if none
+ */
+static int mds_cache_find(octet_string *system_id, ConfigId config_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < mds_cache_count; ++i) {
+		MDS *mds = mds_cache[i];
+
+		if (mds->dev_configuration_id == config_id &&
+		    mds->system_id.length == system_id->length &&
+		    memcmp(mds->system_id.value, system_id->value,
+			   system_id->length) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Drops observed values and time stamps of a metric
+ *
+ * \param metric the metric
+ */
+static void mds_reset_metric(struct Metric *metric)
+{
+	metric->measurement_status = 0;
+	del_absolutetime(&metric->absolute_time_stamp);
+	memset(&metric->absolute_time_stamp, 0, sizeof(AbsoluteTime));
+	metric->relative_time_stamp = 0;
+	del_highresrelativetime(&metric->hi_res_time_stamp);
+	memset(&metric->hi_res_time_stamp, 0, sizeof(HighResRelativeTime));
+}
+
+/**
+ * Drops the state an object gathered while its device was operating,
+ * leaving it as mds_configure_operating() builds it
+ *
+ * \param object the MDS object
+ */
+static void mds_reset_object(struct MDS_object *object)
+{
+	struct Numeric *numeric;
+	struct Enumeration *enumeration;
+
+	switch (object->choice) {
+	case MDS_OBJ_METRIC:
+		switch (object->u.metric.choice) {
+		case METRIC_NUMERIC:
+			numeric = &object->u.metric.u.numeric;
+			mds_reset_metric(&numeric->metric);
+			numeric->simple_nu_observed_value = 0;
+			del_simplenuobsvaluecmp(&numeric->compound_simple_nu_observed_value);
+			numeric->basic_nu_observed_value = 0;
+			del_basicnuobsvaluecmp(&numeric->compound_basic_nu_observed_value);
+			del_nuobsvalue(&numeric->nu_observed_value);
+			memset(&numeric->nu_observed_value, 0, sizeof(NuObsValue));
+			del_nuobsvaluecmp(&numeric->compound_nu_observed_value);
+			break;
+		case METRIC_ENUM:
+			enumeration = &object->u.metric.u.enumeration;
+			mds_reset_metric(&enumeration->metric);
+			enumeration->enum_observed_value_simple_OID = 0;
+			enumeration->enum_observed_value_simple_bit_str = 0;
+			enumeration->enum_observed_value_basic_bit_str = 0;
+			del_enumprintablestring(&enumeration->enum_observed_value_simple_str);
+			del_enumobsvalue(&enumeration->enum_observed_value);
+			memset(&enumeration->enum_observed_value, 0,
+			       sizeof(EnumObsValue));
+			break;
+		case METRIC_RTSA:
+			mds_reset_metric(&object->u.metric.u.rtsa.metric);
+			del_octet_string(&object->u.metric.u.rtsa.simple_sa_observed_value);
+			break;
+		default:
+			break;
+		}
+		break;
+	case MDS_OBJ_SCANNER:
+		switch (object->u.scanner.choice) {
+		case EPI_CFG_SCANNER:
+			object->u.scanner.u.epi_cfg_scanner.scanner.scanner.operational_state = os_disabled;
+			break;
+		case PERI_CFG_SCANNER:
+			object->u.scanner.u.peri_cfg_scanner.scanner.scanner.operational_state = os_disabled;
+			break;
+		default:
+			break;
+		}
+		break;
+	case MDS_OBJ_PMSTORE:
+		pmstore_remove_all_segments(&object->u.pmstore);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Keeps the MDS of a disconnected device, so that a reassociation with
+ * the same configuration finds its objects in place instead of loading
+ * the configuration and building them again. MDSs without objects or
+ * system id are destroyed. The least recently kept MDS is destroyed
+ * when the cache is full. The dynamic state of the objects is dropped,
+ * so a reassociation gets them as if just configured.
+ *
+ * \param mds the MDS, owned by the cache from now on
+ */
+void mds_cache_put(MDS *mds)
+{
+	MDS *replaced = NULL;
+	MDS *evicted = NULL;
+	Arena *cleaner;
+	int i;
+
+	if (!mds) {
+		return;
+	}
+
+	if (mds->objects_list_count <= 0 || mds->system_id.length == 0 ||
+	    mds->system_id.value == NULL) {
+		mds_destroy(mds);
+		return;
+	}
+
+	// next association must not see values, scanner states or
+	// segments of this one
+	cleaner = cleaner_set_arena(mds->arena);
+
+	for (i = 0; i < mds->objects_list_count; ++i) {
+		mds_reset_object(&mds->objects_list[i]);
+	}
+
+	cleaner_set_arena(cleaner == mds->arena ? NULL : cleaner);
+
+	pthread_mutex_lock(&mds_cache_mutex);
+
+	if (mds_cache_capacity == 0) {
+		pthread_mutex_unlock(&mds_cache_mutex);
+		mds_destroy(mds);
+		return;
+	}
+
+	i = mds_cache_find(&mds->system_id, mds->dev_configuration_id);
+
+	if (i >= 0) {
+		replaced = mds_cache_remove(i);
+	} else if (mds_cache_count >= mds_cache_capacity) {
+		evicted = mds_cache_remove(mds_cache_count - 1);
+	}
+
+	memmove(&mds_cache[1], &mds_cache[0], mds_cache_count * sizeof(MDS *));
+	mds_cache[0] = mds;
+	++mds_cache_count;
+
+	pthread_mutex_unlock(&mds_cache_mutex);
+
+	mds_destroy(replaced);
+	mds_destroy(evicted);
+}
+
+/**
+ * Takes the MDS kept for a device configuration out of the cache
+ *
+ * \param system_id system id of the device
+ * \param config_id configuration id
+ * \return the MDS, owned by the caller, or NULL if none is kept
+ */
+MDS *mds_cache_take(octet_string *system_id, ConfigId config_id)
+{
+	MDS *mds = NULL;
+	int i;
+
+	pthread_mutex_lock(&mds_cache_mutex);
+
+	i = mds_cache_find(system_id, config_id);
+
+	if (i >= 0) {
+		mds = mds_cache_remove(i);
+	}
+
+	pthread_mutex_unlock(&mds_cache_mutex);
+
+	return mds;
+}
+
+/**
+ * Sets how many MDSs are kept warm, at most 16. Zero disables the cache.
+ *
+ * \param capacity number of MDSs
+ */
+void mds_cache_set_capacity(unsigned int capacity)
+{
+	if (capacity > MDS_CACHE_MAX) {
+		capacity = MDS_CACHE_MAX;
+	}
+
+	pthread_mutex_lock(&mds_cache_mutex);
+	mds_cache_capacity = capacity;
+	pthread_mutex_unlock(&mds_cache_mutex);
+
+	while (1) {
+		MDS *evicted = NULL;
+
+		pthread_mutex_lock(&mds_cache_mutex);
+		if (mds_cache_count > mds_cache_capacity) {
+			evicted = mds_cache_remove(mds_cache_count - 1);
+		}
+		pthread_mutex_unlock(&mds_cache_mutex);
+
+		if (!evicted) {
+			break;
+		}
+
+		mds_destroy(evicted);
+	}
+}
+
+/**
+ * Returns the number of MDSs kept warm
+ *
+ * \return number of MDSs
+ */
+int mds_cache_size()
+{
+	return __atomic_load_n(&mds_cache_count, __ATOMIC_RELAXED);
+}
+
+/**
+ * Destroys all MDSs kept warm
+ */
+void mds_cache_clear()
+{
+	while (1) {
+		MDS *mds = NULL;
+
+		pthread_mutex_lock(&mds_cache_mutex);
+		if (mds_cache_count > 0) {
+			mds = mds_cache_remove(mds_cache_count - 1);
+		}
+		pthread_mutex_unlock(&mds_cache_mutex);
+
+		if (!mds) {
+			break;
+		}
+
+		mds_destroy(mds);
+	}
+}
+
 /** @} */
@@ -41,6 +41,7 @@
 #include <dim/scanner.h>
 #include <dim/peri_cfg_scanner.h>
 #include <dim/epi_cfg_scanner.h>
+#include <util/arena.h>
 
 /*
  * Static mds handle value
@@ -280,6 +281,19 @@ typedef struct MDS {
  	 */
 	int objects_list_count;
 
+	/**
+	 * Room for children objects in objects_list
+ 	 */
+	int objects_list_capacity;
+
+	/**
+	 * Holds objects_list and the attributes of the objects as
+	 * configured, released at once with the MDS. Values an agent
+	 * updates later are on the heap. NULL for an MDS whose objects
+	 * were not built by mds_configure_operating().
+ 	 */
+	Arena *arena;
+
 	/**
 	 * Count of PM-Store objects among children
  	 */
@@ -365,6 +379,16 @@ MDS *mds_create();
 
 void mds_destroy(MDS *mds);
 
+void mds_cache_put(MDS *mds);
+
+MDS *mds_cache_take(octet_string *system_id, ConfigId config_id);
+
+void mds_cache_set_capacity(unsigned int capacity);
+
+int mds_cache_size();
+
+void mds_cache_clear();
+
 int mds_get_nomenclature_code();
 
 void mds_set_attribute(MDS *mds, AVA_Type *attribute);
@@ -400,6 +424,8 @@ Request *mds_get_pmstore(Context *ctx, int handle, service_request_callback requ
 
 void mds_configure_operating(Context *ctx, ConfigObjectList *config_obj_list, int manager);
 
+void mds_resume_operating(Context *ctx, int manager);
+
 void mds_populate_attributes(MDS *mds, DataEntry *mds_entry);
 
 DataList *mds_populate_configuration(MDS *mds);
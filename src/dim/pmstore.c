@@ -1329,20 +1329,32 @@ static void decode_fixed_segment_data(Context *ctx, struct PMStore *pmstore,
 void pmstore_destroy(struct PMStore *pm_store)
 {
 	if (pm_store != NULL) {
-		if (pm_store->segm_list != NULL) {
-			int i;
+		pmstore_remove_all_segments(pm_store);
+		del_octet_string(&pm_store->pm_store_label);
+	}
+}
 
-			for (i = 0; i < pm_store->segment_list_count; i++) {
-				pmsegment_destroy(pm_store->segm_list[i]);
-				free(pm_store->segm_list[i]);
-			}
+/**
+ * Destroys all PM-Segments known by the given PMStore, leaving it as
+ * configured.
+ *
+ * \param pm_store the PMStore.
+ */
+void pmstore_remove_all_segments(struct PMStore *pm_store)
+{
+	if (pm_store->segm_list != NULL) {
+		int i;
 
-			free(pm_store->segm_list);
-			pm_store->segm_list = NULL;
+		for (i = 0; i < pm_store->segment_list_count; i++) {
+			pmsegment_destroy(pm_store->segm_list[i]);
+			free(pm_store->segm_list[i]);
 		}
 
-		del_octet_string(&pm_store->pm_store_label);
+		free(pm_store->segm_list);
+		pm_store->segm_list = NULL;
 	}
+
+	pm_store->segment_list_count = 0;
 }
 
 /**
@@ -179,6 +179,8 @@ void pmstore_get_data_result(struct PMStore *pm_store,
 
 void pmstore_destroy(struct PMStore *pm_store);
 
+void pmstore_remove_all_segments(struct PMStore *pm_store);
+
 struct PMSegment *pmstore_get_segment_by_inst_number(struct PMStore *pm_store,
 		InstNumber inst_number);
 
@@ -87,6 +87,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 #include "src/manager_p.h"
 #include "src/api/data_encoder.h"
 #include "src/communication/plugin/plugin.h"
@@ -95,23 +96,66 @@
 #include "src/communication/extconfigurations.h"
 #include "src/communication/configuring.h"
 #include "src/communication/stdconfigurations.h"
+#include "src/communication/stats.h"
+#include "src/dim/latest_value.h"
 #include "src/specializations/blood_pressure_monitor.h"
 #include "src/specializations/pulse_oximeter.h"
 #include "src/specializations/weighing_scale.h"
 #include "src/specializations/glucometer.h"
 #include "src/util/log.h"
 #include "src/util/dateutil.h"
+#include "src/util/event_queue.h"
 
 
 /**
- * Manager listener list
+ * State of one manager: its plugins, listeners and event queue, and
+ * the lock over the contexts of its plugins. Configurations, under
+ * the GIL, and the system id are shared by all instances.
  */
-static ManagerListener *manager_listener_list = NULL;
+struct ManagerInstance {
+	/**
+	 * Manager listener list
+	 */
+	ManagerListener *listeners;
+
+	/**
+	 * Manager listener count
+	 */
+	int listener_count;
+
+	/**
+	 * Events waiting for the application, when it has chosen to take
+	 * them from a queue instead of having listeners called
+	 */
+	EventQueue *event_queue;
+
+	/**
+	 * Plugins of this instance, NULL-terminated
+	 */
+	CommunicationPlugin **plugins;
+
+	/**
+	 * Guards the context lists of the plugins of this instance, so
+	 * that finding a context never waits for another instance
+	 */
+	pthread_mutex_t contexts_mutex;
+};
 
 /**
- * Manager listener count
+ * Instance behind manager_init() and the other functions that take
+ * no instance
  */
-static int manager_listener_count = 0;
+static ManagerInstance default_manager = {
+	.listeners = NULL,
+	.listener_count = 0,
+	.event_queue = NULL,
+	.plugins = NULL
+};
+
+/**
+ * Instances initialized and not finalized yet
+ */
+static int manager_instances = 0;
 
 static void manager_handle_transition_evt(Context *ctx, fsm_states previous, fsm_states next);
 
@@ -148,29 +192,57 @@ static void manager_handle_transition_evt(Context *ctx, fsm_states previous, fsm
 
 int manager_notify_evt_device_connected(Context *ctx, const char *addr);
 int manager_notify_evt_device_disconnected(Context *ctx, const char *addr);
+void manager_notify_evt_devices_disconnected(ContextId *ids, int count);
 
 /**
- * Initializes the manager on application load. This function also
- * registers existing device specializations.
- *
- * This method should be invoked in a thread safe execution.
+ * Initializes an instance, and the state shared by all instances if
+ * it is the first one
  *
+ * @param m instance
  * @param plugins the configured communication plugins
  */
-void manager_init(CommunicationPlugin **plugins)
+static void manager_instance_init(ManagerInstance *m,
+				  CommunicationPlugin **plugins)
 {
-	DEBUG("Manager Initialization");
+	pthread_mutexattr_t attr;
+	int count = 0;
+	int i;
 
-	while (*plugins) {
-		(*plugins)->type |= MANAGER_CONTEXT;
-		communication_add_plugin(*plugins);
-		++plugins;
+	if (manager_instances++ == 0) {
+		latest_value_init();
+	}
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&m->contexts_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	while (plugins[count]) {
+		++count;
+	}
+
+	m->plugins = calloc(count + 1, sizeof(CommunicationPlugin *));
+
+	for (i = 0; i < count; ++i) {
+		plugins[i]->type |= MANAGER_CONTEXT;
+		plugins[i]->owner = m;
+		communication_add_plugin(plugins[i]);
+		context_set_plugin_lock(communication_plugin_id(plugins[i]),
+					&m->contexts_mutex);
+		m->plugins[i] = plugins[i];
+	}
+
+	if (manager_instances > 1) {
+		return;
 	}
 
 	// Listen to all communication state transitions
 	communication_add_state_transition_listener(fsm_state_size, &manager_handle_transition_evt);
-	communication_set_connection_listeners(&manager_notify_evt_device_connected,
-						&manager_notify_evt_device_disconnected);
+	communication_set_context_connection_listeners(MANAGER_CONTEXT,
+					&manager_notify_evt_device_connected,
+					&manager_notify_evt_device_disconnected);
+	communication_set_context_teardown_listener(MANAGER_CONTEXT,
+					&manager_notify_evt_devices_disconnected);
 
 	// Register standard configurations for each specialization.
 	// (comment these if you want to test acquisition of extended
@@ -188,7 +260,54 @@ void manager_init(CommunicationPlugin **plugins)
 
 	// Load Configurations File
 	ext_configurations_load_configurations();
+}
 
+/**
+ * Finalizes an instance, and the state shared by all instances if
+ * it is the last one
+ *
+ * @param m instance
+ */
+static void manager_instance_finalize(ManagerInstance *m)
+{
+	int i;
+
+	manager_instance_remove_all_listeners(m);
+
+	if (--manager_instances == 0) {
+		ext_configurations_destroy();
+		std_configurations_destroy();
+		communication_finalize();
+		manager_instance_event_queue_stop(m);
+		latest_value_finalize();
+	} else {
+		for (i = 0; m->plugins && m->plugins[i]; ++i) {
+			communication_remove_plugin(m->plugins[i]);
+		}
+
+		manager_instance_event_queue_stop(m);
+	}
+
+	// contexts of its plugins are gone
+	pthread_mutex_destroy(&m->contexts_mutex);
+
+	free(m->plugins);
+	m->plugins = NULL;
+}
+
+/**
+ * Initializes the manager on application load. This function also
+ * registers existing device specializations.
+ *
+ * This method should be invoked in a thread safe execution.
+ *
+ * @param plugins the configured communication plugins
+ */
+void manager_init(CommunicationPlugin **plugins)
+{
+	DEBUG("Manager Initialization");
+
+	manager_instance_init(&default_manager, plugins);
 }
 
 /**
@@ -201,12 +320,88 @@ void manager_finalize()
 {
 	DEBUG("Manager Finalization");
 
-	manager_remove_all_listeners();
-	ext_configurations_destroy();
-	std_configurations_destroy();
-	communication_finalize();
+	manager_instance_finalize(&default_manager);
+}
+
+/**
+ * Creates a manager instance of its own, with its plugins, listeners
+ * and event queue. Several instances may serve different transports
+ * in the same process; events of a context go to the instance of its
+ * plugin only. Device configurations and the system id are shared.
+ *
+ * This method should be invoked in a thread safe execution.
+ *
+ * @param plugins the configured communication plugins, not given to
+ *	  any other instance
+ * @return instance, to be freed with manager_instance_free()
+ */
+ManagerInstance *manager_instance_new(CommunicationPlugin **plugins)
+{
+	ManagerInstance *m = calloc(1, sizeof(ManagerInstance));
+
+	if (!m) {
+		return NULL;
+	}
+
+	DEBUG("Manager instance %p initialization", m);
+
+	manager_instance_init(m, plugins);
+
+	return m;
+}
+
+/**
+ * Stops and frees a manager instance created by manager_instance_new(),
+ * closing the contexts of its plugins
+ *
+ * This method should be invoked in a thread safe execution.
+ *
+ * @param m instance
+ */
+void manager_instance_free(ManagerInstance *m)
+{
+	if (!m) {
+		return;
+	}
+
+	DEBUG("Manager instance %p finalization", m);
+
+	manager_instance_stop(m);
+	manager_instance_finalize(m);
+	free(m);
 }
 
+/**
+ * Starts the network of the plugins of an instance, restarting it
+ * if already started. Plugins of other instances are not touched.
+ *
+ * @param m instance
+ */
+void manager_instance_start(ManagerInstance *m)
+{
+	int i;
+
+	manager_instance_stop(m);
+
+	for (i = 0; m->plugins && m->plugins[i]; ++i) {
+		communication_plugin_network_start(m->plugins[i]);
+	}
+}
+
+/**
+ * Stops the network of the plugins of an instance, closing their
+ * connections
+ *
+ * @param m instance
+ */
+void manager_instance_stop(ManagerInstance *m)
+{
+	int i;
+
+	for (i = 0; m->plugins && m->plugins[i]; ++i) {
+		communication_plugin_network_stop(m->plugins[i]);
+	}
+}
 
 /**
  * Adds a manager listener.
@@ -217,27 +412,41 @@ void manager_finalize()
  * @return 1 if operation succeeds, 0 if not.
  */
 int manager_add_listener(ManagerListener listener)
+{
+	return manager_instance_add_listener(&default_manager, listener);
+}
+
+/**
+ * Adds a listener to a manager instance.
+ *
+ * This method should be invoked in a thread safe execution.
+ *
+ * @param m instance
+ * @param listener the listener to be added.
+ * @return 1 if operation succeeds, 0 if not.
+ */
+int manager_instance_add_listener(ManagerInstance *m, ManagerListener listener)
 {
 
 	// test if there is not elements in the list
-	if (manager_listener_count == 0) {
-		manager_listener_list = malloc(sizeof(struct ManagerListener));
+	if (m->listener_count == 0) {
+		m->listeners = malloc(sizeof(struct ManagerListener));
 
 	} else { // change the list size
-		manager_listener_list = realloc(manager_listener_list,
-						sizeof(struct ManagerListener)
-						* (manager_listener_count + 1));
+		m->listeners = realloc(m->listeners,
+				       sizeof(struct ManagerListener)
+				       * (m->listener_count + 1));
 	}
 
 	// add element to list
 
-	if (manager_listener_list == NULL) {
+	if (m->listeners == NULL) {
 		return 0;
 	}
 
-	manager_listener_list[manager_listener_count] = listener;
+	m->listeners[m->listener_count] = listener;
 
-	manager_listener_count++;
+	m->listener_count++;
 
 	return 1;
 
@@ -251,11 +460,245 @@ int manager_add_listener(ManagerListener listener)
  */
 void manager_remove_all_listeners()
 {
-	if (manager_listener_list != NULL) {
-		manager_listener_count = 0;
-		free(manager_listener_list);
-		manager_listener_list = NULL;
+	manager_instance_remove_all_listeners(&default_manager);
+}
+
+/**
+ * Removes all listeners of a manager instance
+ *
+ * This method should be invoked in a thread safe execution.
+ *
+ * @param m instance
+ */
+void manager_instance_remove_all_listeners(ManagerInstance *m)
+{
+	if (m->listeners != NULL) {
+		m->listener_count = 0;
+		free(m->listeners);
+		m->listeners = NULL;
+	}
+}
+
+/**
+ * Delivers events through a queue instead of calling listeners.
+ *
+ * Listeners run in the thread that processes the event, with the
+ * context locked, so a slow listener delays the answers sent to the
+ * agent and anything else waiting for that context. With the queue,
+ * the stack only pushes the event, and the application takes it with
+ * manager_event_queue_pop() in threads of its own, waiting on
+ * manager_event_queue_fd() or manager_event_queue_wait(). Listener
+ * callbacks are not called while the queue is on. The queue does not
+ * block the stack: events that do not fit are dropped and counted.
+ *
+ * This method should be invoked in a thread safe execution, before
+ * manager_start().
+ *
+ * @param capacity maximum number of events waiting
+ * @return 1 if operation succeeds, 0 if not.
+ */
+int manager_event_queue_start(unsigned int capacity)
+{
+	return manager_instance_event_queue_start(&default_manager, capacity);
+}
+
+/**
+ * Returns to calling listeners, deleting events not taken yet.
+ *
+ * This method should be invoked in a thread safe execution, after
+ * manager_stop() and after consumers of the queue have stopped.
+ */
+void manager_event_queue_stop()
+{
+	manager_instance_event_queue_stop(&default_manager);
+}
+
+/**
+ * Returns a descriptor that becomes readable when events arrive
+ * after manager_event_queue_pop() has returned NULL. Poll it for
+ * reading, then pop events until NULL.
+ *
+ * @return descriptor, -1 if the event queue is not on
+ */
+int manager_event_queue_fd()
+{
+	return manager_instance_event_queue_fd(&default_manager);
+}
+
+/**
+ * Waits for events, for applications without a poll loop
+ *
+ * @param timeout_ms timeout in milliseconds, -1 to wait forever
+ * @return 1 if events may be available, 0 on timeout
+ */
+int manager_event_queue_wait(int timeout_ms)
+{
+	return manager_instance_event_queue_wait(&default_manager, timeout_ms);
+}
+
+/**
+ * Takes the oldest event. Never blocks; may be called from several
+ * threads at once.
+ *
+ * @return event, to be deleted with manager_event_del(), or NULL if
+ *	   there is none
+ */
+ManagerEvent *manager_event_queue_pop()
+{
+	return manager_instance_event_queue_pop(&default_manager);
+}
+
+/**
+ * @return number of events dropped because the queue was full
+ */
+unsigned long long manager_event_queue_dropped()
+{
+	return manager_instance_event_queue_dropped(&default_manager);
+}
+
+/**
+ * Like manager_event_queue_start(), for a manager instance
+ */
+int manager_instance_event_queue_start(ManagerInstance *m,
+				       unsigned int capacity)
+{
+	if (m->event_queue) {
+		return 1;
 	}
+
+	m->event_queue = event_queue_new(capacity);
+
+	return m->event_queue != NULL;
+}
+
+/**
+ * Like manager_event_queue_stop(), for a manager instance
+ */
+void manager_instance_event_queue_stop(ManagerInstance *m)
+{
+	ManagerEvent *evt;
+
+	if (!m->event_queue) {
+		return;
+	}
+
+	while ((evt = event_queue_pop(m->event_queue))) {
+		manager_event_del(evt);
+	}
+
+	event_queue_destroy(m->event_queue);
+	m->event_queue = NULL;
+}
+
+/**
+ * Like manager_event_queue_fd(), for a manager instance
+ */
+int manager_instance_event_queue_fd(ManagerInstance *m)
+{
+	return m->event_queue ? event_queue_fd(m->event_queue) : -1;
+}
+
+/**
+ * Like manager_event_queue_wait(), for a manager instance
+ */
+int manager_instance_event_queue_wait(ManagerInstance *m, int timeout_ms)
+{
+	return m->event_queue ?
+		event_queue_wait(m->event_queue, timeout_ms) : 0;
+}
+
+/**
+ * Like manager_event_queue_pop(), for a manager instance
+ */
+ManagerEvent *manager_instance_event_queue_pop(ManagerInstance *m)
+{
+	return m->event_queue ? event_queue_pop(m->event_queue) : NULL;
+}
+
+/**
+ * Like manager_event_queue_dropped(), for a manager instance
+ */
+unsigned long long manager_instance_event_queue_dropped(ManagerInstance *m)
+{
+	return m->event_queue ? event_queue_dropped(m->event_queue) : 0;
+}
+
+/**
+ * Deletes an event taken from the queue, along with its data
+ *
+ * @param evt event
+ */
+void manager_event_del(ManagerEvent *evt)
+{
+	if (!evt) {
+		return;
+	}
+
+	data_list_del(evt->list);
+	free(evt->addr);
+	free(evt);
+}
+
+/**
+ * Finds the manager instance of a context id, through its plugin
+ *
+ * @param id context id
+ * @return instance
+ */
+static ManagerInstance *manager_instance_of_id(ContextId id)
+{
+	CommunicationPlugin *plugin = communication_get_plugin(id.plugin);
+
+	if (plugin && plugin->owner) {
+		return plugin->owner;
+	}
+
+	return &default_manager;
+}
+
+/**
+ * Finds the manager instance of a context, through its plugin
+ *
+ * @param ctx context
+ * @return instance
+ */
+static ManagerInstance *manager_instance_of(Context *ctx)
+{
+	return manager_instance_of_id(ctx->id);
+}
+
+/**
+ * Queues an event, taking ownership of its data list
+ *
+ * @return 1 if queued, 0 if dropped
+ */
+static int manager_queue_evt(ManagerInstance *m, Context *ctx,
+			     ManagerEventType type,
+			     DataList *list, const char *addr,
+			     int handle, int instnumber)
+{
+	ManagerEvent *evt = calloc(1, sizeof(ManagerEvent));
+
+	if (!evt) {
+		data_list_del(list);
+		return 0;
+	}
+
+	evt->type = type;
+	evt->id = ctx->id;
+	evt->list = list;
+	evt->handle = handle;
+	evt->instnumber = instnumber;
+	evt->addr = addr ? strdup(addr) : NULL;
+
+	if (!event_queue_push(m->event_queue, evt)) {
+		WARNING("Event queue full, dropping event %d of %u:%llu",
+			type, ctx->id.plugin, ctx->id.connid);
+		manager_event_del(evt);
+		return 0;
+	}
+
+	return 1;
 }
 
 /**
@@ -269,11 +712,20 @@ void manager_remove_all_listeners()
  */
 int manager_notify_evt_device_available(Context *ctx, DataList *data_list)
 {
+	ManagerInstance *m = manager_instance_of(ctx);
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
+
+	if (m->event_queue) {
+		ret_val = manager_queue_evt(m, ctx, MANAGER_EVT_DEVICE_AVAILABLE,
+					    data_list, NULL, 0, 0);
+		stats_count_listener(ctx, start);
+		return ret_val;
+	}
 
-	for (i = 0; i < manager_listener_count; i++) {
-		ManagerListener *l = &manager_listener_list[i];
+	for (i = 0; i < m->listener_count; i++) {
+		ManagerListener *l = &m->listeners[i];
 
 		if (l != NULL && l->device_available != NULL) {
 			(l->device_available)(ctx, data_list);
@@ -281,6 +733,8 @@ int manager_notify_evt_device_available(Context *ctx, DataList *data_list)
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	data_list_del(data_list);
 	return ret_val;
 }
@@ -295,11 +749,20 @@ int manager_notify_evt_device_available(Context *ctx, DataList *data_list)
  */
 int manager_notify_evt_device_unavailable(Context *ctx)
 {
+	ManagerInstance *m = manager_instance_of(ctx);
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
+
+	if (m->event_queue) {
+		ret_val = manager_queue_evt(m, ctx, MANAGER_EVT_DEVICE_UNAVAILABLE,
+					    NULL, NULL, 0, 0);
+		stats_count_listener(ctx, start);
+		return ret_val;
+	}
 
-	for (i = 0; i < manager_listener_count; i++) {
-		ManagerListener *l = &manager_listener_list[i];
+	for (i = 0; i < m->listener_count; i++) {
+		ManagerListener *l = &m->listeners[i];
 
 		if (l != NULL && l->device_unavailable != NULL) {
 			(l->device_unavailable)(ctx);
@@ -307,6 +770,8 @@ int manager_notify_evt_device_unavailable(Context *ctx)
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	return ret_val;
 }
 
@@ -321,11 +786,20 @@ int manager_notify_evt_device_unavailable(Context *ctx)
  */
 int manager_notify_evt_device_connected(Context *ctx, const char *addr)
 {
+	ManagerInstance *m = manager_instance_of(ctx);
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
 
-	for (i = 0; i < manager_listener_count; i++) {
-		ManagerListener *l = &manager_listener_list[i];
+	if (m->event_queue) {
+		ret_val = manager_queue_evt(m, ctx, MANAGER_EVT_DEVICE_CONNECTED,
+					    NULL, addr, 0, 0);
+		stats_count_listener(ctx, start);
+		return ret_val;
+	}
+
+	for (i = 0; i < m->listener_count; i++) {
+		ManagerListener *l = &m->listeners[i];
 
 		if (l != NULL && l->device_connected != NULL) {
 			(l->device_connected)(ctx, addr);
@@ -333,6 +807,8 @@ int manager_notify_evt_device_connected(Context *ctx, const char *addr)
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	return ret_val;
 }
 
@@ -347,21 +823,94 @@ int manager_notify_evt_device_connected(Context *ctx, const char *addr)
  */
 int manager_notify_evt_device_disconnected(Context *ctx, const char *addr)
 {
+	ManagerInstance *m = manager_instance_of(ctx);
 	int ret_val = 0;
 	int i;
+	int deferred;
+	unsigned long long start = stats_clock();
+
+	if (m->event_queue) {
+		ret_val = manager_queue_evt(m, ctx, MANAGER_EVT_DEVICE_DISCONNECTED,
+					    NULL, addr, 0, 0);
+		stats_count_listener(ctx, start);
+		return ret_val;
+	}
+
+	// listeners that take batches are told at reclaim time instead
+	deferred = communication_is_teardown_deferred();
 
-	for (i = 0; i < manager_listener_count; i++) {
-		ManagerListener *l = &manager_listener_list[i];
+	for (i = 0; i < m->listener_count; i++) {
+		ManagerListener *l = &m->listeners[i];
 
-		if (l != NULL && l->device_disconnected != NULL) {
+		if (l != NULL && l->device_disconnected != NULL
+		    && !(deferred && l->devices_disconnected != NULL)) {
 			(l->device_disconnected)(ctx, addr);
 			ret_val = 1;
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	return ret_val;
 }
 
+/**
+ * Notifies 'devices disconnected' event, for contexts torn down
+ * together. Each manager instance is told about its own contexts.
+ * Called without locks, from the thread that reclaims contexts.
+ *
+ * @param ids context ids
+ * @param count number of ids
+ */
+void manager_notify_evt_devices_disconnected(ContextId *ids, int count)
+{
+	ContextId *batch = malloc(count * sizeof(ContextId));
+	char *done = calloc(count, 1);
+	int i;
+	int j;
+	int n;
+
+	if (!batch || !done) {
+		free(batch);
+		free(done);
+		return;
+	}
+
+	for (i = 0; i < count; ++i) {
+		ManagerInstance *m;
+
+		if (done[i]) {
+			continue;
+		}
+
+		m = manager_instance_of_id(ids[i]);
+		n = 0;
+
+		for (j = i; j < count; ++j) {
+			if (!done[j] && manager_instance_of_id(ids[j]) == m) {
+				batch[n++] = ids[j];
+				done[j] = 1;
+			}
+		}
+
+		// queue consumers had one event per device
+		if (m->event_queue) {
+			continue;
+		}
+
+		for (j = 0; j < m->listener_count; j++) {
+			ManagerListener *l = &m->listeners[j];
+
+			if (l->devices_disconnected != NULL) {
+				(l->devices_disconnected)(batch, n);
+			}
+		}
+	}
+
+	free(batch);
+	free(done);
+}
+
 /**
  * Notifies 'measurement data updated'  event.
  * This function should be visible to source layer of events.
@@ -373,11 +922,23 @@ int manager_notify_evt_device_disconnected(Context *ctx, const char *addr)
  */
 int manager_notify_evt_measurement_data_updated(Context *ctx, DataList *data_list)
 {
+	ManagerInstance *m = manager_instance_of(ctx);
 	int ret_val = 0;
 	int i;
 
-	for (i = 0; i < manager_listener_count; i++) {
-		ManagerListener *l = &manager_listener_list[i];
+	latest_value_update(ctx, data_list);
+
+	unsigned long long start = stats_clock();
+
+	if (m->event_queue) {
+		ret_val = manager_queue_evt(m, ctx, MANAGER_EVT_MEASUREMENT_DATA_UPDATED,
+					    data_list, NULL, 0, 0);
+		stats_count_listener(ctx, start);
+		return ret_val;
+	}
+
+	for (i = 0; i < m->listener_count; i++) {
+		ManagerListener *l = &m->listeners[i];
 
 		if (l != NULL && l->measurement_data_updated != NULL) {
 			(l->measurement_data_updated)(ctx, data_list);
@@ -385,6 +946,8 @@ int manager_notify_evt_measurement_data_updated(Context *ctx, DataList *data_lis
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	data_list_del(data_list);
 	return ret_val;
 
@@ -398,29 +961,40 @@ int manager_notify_evt_measurement_data_updated(Context *ctx, DataList *data_lis
  * @param ctx
  * @param handle PM-Store handle
  * @param instnumber PM-Segment instance number
- * @param data_list with the segment data. Ownership is transferred; delete with data_list_del.
+ * @param data_list with the segment data. Each listener gets a reference
+ *	  of its own.
  * @return 1 if any listener catches the notification, 0 if not
  */
 int manager_notify_evt_segment_data(Context *ctx, int handle, int instnumber,
 							DataList *data_list)
 {
+	ManagerInstance *m = manager_instance_of(ctx);
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
 
-	for (i = 0; i < manager_listener_count; i++) {
-		ManagerListener *l = &manager_listener_list[i];
+	if (m->event_queue) {
+		ret_val = manager_queue_evt(m, ctx, MANAGER_EVT_SEGMENT_DATA_RECEIVED,
+					    data_list, NULL, handle, instnumber);
+		stats_count_listener(ctx, start);
+		return ret_val;
+	}
+
+	for (i = 0; i < m->listener_count; i++) {
+		ManagerListener *l = &m->listeners[i];
 
 		if (l && l->segment_data_received) {
-			(l->segment_data_received)(ctx, handle, instnumber, data_list);
+			// encoding this may take a lot of time, so each
+			// listener may keep the list as long as it needs
+			(l->segment_data_received)(ctx, handle, instnumber,
+						   data_list_ref(data_list));
 			ret_val = 1;
 		}
 	}
 
-	// Since encoding this may take a lot of time, we pass ownership to
-	// listeners. If there is more than one in app, it must make a deep
-	// copy of DataList or coordinate between listeners to free in time.
+	stats_count_listener(ctx, start);
 
-	// data_list_del(data_list);
+	data_list_del(data_list);
 
 	return ret_val;
 }
@@ -435,11 +1009,20 @@ int manager_notify_evt_segment_data(Context *ctx, int handle, int instnumber,
  */
 int manager_notify_evt_timeout(Context *ctx)
 {
+	ManagerInstance *m = manager_instance_of(ctx);
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_clock();
+
+	if (m->event_queue) {
+		ret_val = manager_queue_evt(m, ctx, MANAGER_EVT_TIMEOUT,
+					    NULL, NULL, 0, 0);
+		stats_count_listener(ctx, start);
+		return ret_val;
+	}
 
-	for (i = 0; i < manager_listener_count; i++) {
-		ManagerListener *l = &manager_listener_list[i];
+	for (i = 0; i < m->listener_count; i++) {
+		ManagerListener *l = &m->listeners[i];
 
 		if (l != NULL && l->timeout != NULL) {
 			(l->timeout)(ctx);
@@ -447,6 +1030,8 @@ int manager_notify_evt_timeout(Context *ctx)
 		}
 	}
 
+	stats_count_listener(ctx, start);
+
 	return ret_val;
 }
 
@@ -588,6 +1173,115 @@ DataList *manager_get_configuration(ContextId id)
 	return list;
 }
 
+/**
+ * Returns the last value received for a metric, without contacting
+ * the agent. Does not lock the context and may be called from any
+ * thread.
+ *
+ * @param id context id
+ * @param handle handle of the Numeric or Enumeration object
+ * @param metric_id metric-id of the observation; for compound values,
+ *	  one of the object's Metric-Id-List entries
+ * @param value receives the value, unit and time stamps
+ * @return 1 if a value is known, 0 if not
+ */
+int manager_get_latest_value(ContextId id, int handle, int metric_id,
+				LatestValue *value)
+{
+	return latest_value_get(id, handle, metric_id, value);
+}
+
+/**
+ * Copies the runtime counters of the whole process: APDUs and bytes
+ * exchanged, decode errors, state transitions, timeouts, pending
+ * requests and time spent decoding and in listeners. Counters of
+ * contexts already gone are included. May be called from any thread.
+ *
+ * @param stats receives the counters
+ */
+void manager_get_stats(CommunicationStats *stats)
+{
+	stats_get_global(stats);
+}
+
+/**
+ * Copies the runtime counters of one context. The context is locked
+ * while copying, so the counters are consistent with each other.
+ *
+ * @param id context id
+ * @param stats receives the counters
+ * @return 1 if context exists, 0 if not
+ */
+int manager_get_context_stats(ContextId id, CommunicationStats *stats)
+{
+	Context *ctx = context_get_and_lock(id);
+
+	if (ctx == NULL) {
+		return 0;
+	}
+
+	stats_snapshot(&ctx->stats, stats);
+	context_unlock(ctx);
+
+	return 1;
+}
+
+/**
+ * Summarizes the latency of association, configuration, confirmed
+ * requests or listener callbacks, over the whole life of the process.
+ * May be called from any thread.
+ *
+ * @param latency which latency
+ * @param summary receives count, mean, max and percentiles, in
+ *	  nanoseconds
+ */
+void manager_get_latency(StatsLatency latency, LatencySummary *summary)
+{
+	stats_get_latency(latency, summary);
+}
+
+/**
+ * Returns one percentile of a latency, e.g. 99.0 for the p99
+ * association time.
+ *
+ * @param latency which latency
+ * @param percentile percentile, from 0 to 100
+ * @return latency in nanoseconds, 0 if nothing was recorded
+ */
+unsigned long long manager_get_latency_percentile(StatsLatency latency,
+						  double percentile)
+{
+	return stats_get_latency_percentile(latency, percentile);
+}
+
+/**
+ * Turns lock profiling on or off. While on, every acquisition of the
+ * GIL and of context locks records its wait time and, at release,
+ * its hold time, by call site. Hold times include listener callbacks
+ * run with the lock held.
+ *
+ * @param enabled 1 to profile, 0 to stop
+ */
+void manager_set_lock_profiling(int enabled)
+{
+	stats_set_lock_profiling(enabled);
+}
+
+/**
+ * Returns the lock call sites that waited or held locks the longest,
+ * worst first. May be called from any thread.
+ *
+ * @param order STATS_LOCK_BY_WAIT or STATS_LOCK_BY_HOLD
+ * @param sites receives the sites, times in nanoseconds
+ * @param max size of sites
+ * @return number of sites returned
+ */
+int manager_get_lock_sites(StatsLockOrder order, LockSiteStats *sites,
+			   int max)
+{
+	return stats_get_lock_sites(order, sites, max);
+}
+
 /**
  * Returns attributes from medical device since last updated.
  *
@@ -862,6 +1556,11 @@ Request *manager_set_time(ContextId id, time_t time, service_request_callback ca
  */
 void manager_handle_transition_evt(Context *ctx, fsm_states previous, fsm_states next)
 {
+	if (!(ctx->type & MANAGER_CONTEXT)) {
+		// agent context in the same process
+		return;
+	}
+
 	if (previous == fsm_state_operating && next != previous) {
 		DEBUG(" manager: Notify device unavailable.\n");
 		// Exiting operating state
@@ -37,23 +37,29 @@
 #include <communication/context.h>
 #include <communication/plugin/plugin.h>
 #include <communication/service.h>
+#include <communication/stats.h>
+#include <dim/latest_value.h>
 
 /**
  * Manager event listener definition
  */
 typedef struct ManagerListener {
 	/**
-	 *  Called when Medical Measurement is received and stored
+	 *  Called when Medical Measurement is received and stored.
+	 *  The list is released after return; take a reference with
+	 *  data_list_ref() to keep it.
 	 */
 	void (*measurement_data_updated)(Context *ctx, DataList *list);
 	/**
-	 *  Called when PM-Segment data event is received. In this case,
-	 *  DataList ownership is passed to the caller.
+	 *  Called when PM-Segment data event is received. Each listener
+	 *  is given a reference to the list, to be dropped with
+	 *  data_list_del() when done.
 	 */
 	void (*segment_data_received)(Context *ctx, int handle, int instnumber,
 					DataList *list);
 	/**
-	 * Called after device is operational
+	 * Called after device is operational. The list is released
+	 * after return; take a reference with data_list_ref() to keep it.
 	 */
 	void (*device_available)(Context *ctx, DataList *list);
 	/**
@@ -72,6 +78,14 @@ typedef struct ManagerListener {
  	* Called when peer disconnects
  	*/
 	int (*device_disconnected)(Context *ctx, const char *addr);
+	/**
+	 * Called with the ids of contexts torn down together, when
+	 * teardown is deferred (see communication_set_deferred_teardown()).
+	 * Called without locks, from the thread that reclaims. Not
+	 * called while the event queue is on. While teardown is deferred,
+	 * a listener that sets it gets no device_disconnected calls.
+	 */
+	void (*devices_disconnected)(ContextId *ids, int count);
 } ManagerListener;
 
 #define MANAGER_LISTENER_EMPTY {\
@@ -79,11 +93,49 @@ typedef struct ManagerListener {
 			.segment_data_received = NULL, \
 			.device_connected = NULL,\
 			.device_disconnected = NULL,\
+			.devices_disconnected = NULL,\
 			.device_available = NULL,\
 			.device_unavailable = NULL,\
 			.timeout = NULL\
 			}
 
+/**
+ * Kinds of events delivered through the event queue
+ */
+typedef enum {
+	MANAGER_EVT_DEVICE_CONNECTED = 0,
+	MANAGER_EVT_DEVICE_DISCONNECTED,
+	MANAGER_EVT_DEVICE_AVAILABLE,
+	MANAGER_EVT_DEVICE_UNAVAILABLE,
+	MANAGER_EVT_MEASUREMENT_DATA_UPDATED,
+	MANAGER_EVT_SEGMENT_DATA_RECEIVED,
+	MANAGER_EVT_TIMEOUT
+} ManagerEventType;
+
+/**
+ * Event taken from the event queue (see manager_event_queue_start()).
+ * It carries the context id, not the context, which may be gone by
+ * the time the event is handled. Delete with manager_event_del().
+ */
+typedef struct ManagerEvent {
+	ManagerEventType type;
+	ContextId id;
+	/**
+	 * Data of available, measurement and segment data events,
+	 * owned by the event
+	 */
+	DataList *list;
+	/**
+	 * PM-Store handle and PM-Segment instance of segment data events
+	 */
+	int handle;
+	int instnumber;
+	/**
+	 * Peer address of connection events
+	 */
+	char *addr;
+} ManagerEvent;
+
 void manager_init(CommunicationPlugin **plugins);
 
 void manager_finalize();
@@ -96,10 +148,71 @@ void manager_connection_loop(ContextId context_id);
 
 int manager_add_listener(ManagerListener listener);
 
+int manager_event_queue_start(unsigned int capacity);
+
+void manager_event_queue_stop();
+
+int manager_event_queue_fd();
+
+int manager_event_queue_wait(int timeout_ms);
+
+ManagerEvent *manager_event_queue_pop();
+
+unsigned long long manager_event_queue_dropped();
+
+void manager_event_del(ManagerEvent *evt);
+
+/**
+ * Manager with plugins, listeners and event queue of its own
+ * (see manager_instance_new())
+ */
+typedef struct ManagerInstance ManagerInstance;
+
+ManagerInstance *manager_instance_new(CommunicationPlugin **plugins);
+
+void manager_instance_free(ManagerInstance *m);
+
+void manager_instance_start(ManagerInstance *m);
+
+void manager_instance_stop(ManagerInstance *m);
+
+int manager_instance_add_listener(ManagerInstance *m, ManagerListener listener);
+
+void manager_instance_remove_all_listeners(ManagerInstance *m);
+
+int manager_instance_event_queue_start(ManagerInstance *m,
+				       unsigned int capacity);
+
+void manager_instance_event_queue_stop(ManagerInstance *m);
+
+int manager_instance_event_queue_fd(ManagerInstance *m);
+
+int manager_instance_event_queue_wait(ManagerInstance *m, int timeout_ms);
+
+ManagerEvent *manager_instance_event_queue_pop(ManagerInstance *m);
+
+unsigned long long manager_instance_event_queue_dropped(ManagerInstance *m);
+
 DataList *manager_get_mds_attributes(ContextId id);
 
 Request *manager_request_measurement_data_transmission(ContextId id, service_request_callback callback);
 
+int manager_get_latest_value(ContextId id, int handle, int metric_id, LatestValue *value);
+
+void manager_get_stats(CommunicationStats *stats);
+
+int manager_get_context_stats(ContextId id, CommunicationStats *stats);
+
+void manager_get_latency(StatsLatency latency, LatencySummary *summary);
+
+unsigned long long manager_get_latency_percentile(StatsLatency latency,
+						  double percentile);
+
+void manager_set_lock_profiling(int enabled);
+
+int manager_get_lock_sites(StatsLockOrder order, LockSiteStats *sites,
+			   int max);
+
 Request *manager_request_get_all_mds_attributes(ContextId id, service_request_callback callback);
 
 Request *manager_request_get_pmstore(ContextId id, int handle, service_request_callback callback);
@@ -5,10 +5,16 @@ include $(CLEAR_VARS)
 LOCAL_CFLAGS:= -Wall
 LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/.. $(LOCAL_PATH)/../..
 
-LOCAL_SRC_FILES = bytelib.c \
+LOCAL_SRC_FILES = apdu_capture.c \
+                    arena.c \
+                    bytelib.c \
                     dateutil.c \
+                    event_queue.c \
+                    histogram.c \
                     ioutil.c \
                     linkedlist.c \
+                    log.c \
+                    pool.c \
                     strbuff.c
 
 LOCAL_MODULE:= libantidoteutil
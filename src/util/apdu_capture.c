@@ -0,0 +1,627 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file apdu_capture.c
+ * \brief APDU capture to binary files, with rotation, and capture reader.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * \addtogroup Utility
+ *
+ * @{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "src/util/apdu_capture.h"
+#include "src/util/log.h"
+
+/**
+ * Records are gathered in memory and written in blocks of this size
+ */
+#define CAPTURE_BUFFER_SIZE 65536
+
+/**
+ * Records do not wait in memory for longer than this (microseconds)
+ */
+#define CAPTURE_FLUSH_INTERVAL 1000000ULL
+
+/**
+ * Non-zero while capturing. Checked without lock on every APDU.
+ */
+static int capturing = 0;
+
+/**
+ * Protects the front buffer and the requests to the writer thread.
+ * APDUs of different contexts may be sent and received by different
+ * threads; they only copy records into the front buffer. The writer
+ * thread swaps it with the back buffer and does all the I/O without
+ * holding the mutex.
+ */
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Wakes the writer thread
+ */
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Wakes threads waiting for the writer thread to take the front
+ * buffer or to finish a flush
+ */
+static pthread_cond_t drained_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t writer_thread;
+static int writer_running = 0;
+static int writer_stop = 0;
+
+static intu8 *front_buffer = NULL;
+static intu32 front_size = 0;
+static intu32 front_used = 0;
+static int front_full = 0;
+
+/**
+ * Reception time of the oldest record in the front buffer
+ */
+static unsigned long long front_since = 0;
+
+static unsigned int flush_requested = 0;
+static unsigned int flush_done = 0;
+
+/*
+ * Owned by the writer thread while it runs
+ */
+static int capture_fd = -1;
+static char *capture_path = NULL;
+static unsigned long capture_max_size = 0;
+static int capture_max_files = 0;
+static unsigned long capture_file_size = 0;
+static intu8 *back_buffer = NULL;
+static intu32 back_size = 0;
+
+static unsigned long long now_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (unsigned long long) tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void put_intu16(intu8 *p, intu16 v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static void put_intu32(intu8 *p, intu32 v)
+{
+	put_intu16(p, v >> 16);
+	put_intu16(p + 2, v);
+}
+
+static void put_intu64(intu8 *p, unsigned long long v)
+{
+	put_intu32(p, v >> 32);
+	put_intu32(p + 4, v);
+}
+
+static intu32 get_intu32(intu8 *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static unsigned long long get_intu64(intu8 *p)
+{
+	return ((unsigned long long) get_intu32(p) << 32) | get_intu32(p + 4);
+}
+
+static int write_all(int fd, intu8 *buf, intu32 size)
+{
+	while (size > 0) {
+		ssize_t written = write(fd, buf, size);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+
+		buf += written;
+		size -= written;
+	}
+
+	return 1;
+}
+
+/**
+ * Stops capturing after an I/O error. Called by the writer thread.
+ */
+static void fail()
+{
+	ERROR("apdu capture: cannot write %s, capture stopped", capture_path);
+
+	pthread_mutex_lock(&capture_mutex);
+	__atomic_store_n(&capturing, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&capture_mutex);
+
+	if (capture_fd >= 0) {
+		close(capture_fd);
+		capture_fd = -1;
+	}
+}
+
+/**
+ * Creates the capture file and writes its header
+ */
+static int open_file()
+{
+	capture_fd = open(capture_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (capture_fd < 0) {
+		return 0;
+	}
+
+	if (!write_all(capture_fd, (intu8 *) APDU_CAPTURE_MAGIC,
+			APDU_CAPTURE_FILE_HEADER)) {
+		close(capture_fd);
+		capture_fd = -1;
+		return 0;
+	}
+
+	capture_file_size = APDU_CAPTURE_FILE_HEADER;
+	return 1;
+}
+
+/**
+ * Appends whole records to the capture file
+ */
+static void write_chunk(intu8 *buf, intu32 size)
+{
+	if (capture_fd < 0 || size == 0) {
+		return;
+	}
+
+	if (!write_all(capture_fd, buf, size)) {
+		fail();
+		return;
+	}
+
+	capture_file_size += size;
+}
+
+/**
+ * Moves path to path.1, path.1 to path.2 and so on, dropping
+ * the oldest file, and starts a new file
+ */
+static void rotate()
+{
+	int len = strlen(capture_path) + 16;
+	char *from = malloc(len);
+	char *to = malloc(len);
+	int i;
+
+	if (capture_fd >= 0) {
+		close(capture_fd);
+		capture_fd = -1;
+	}
+
+	for (i = capture_max_files - 1; i >= 1; --i) {
+		snprintf(from, len, "%s.%d", capture_path, i);
+		snprintf(to, len, "%s.%d", capture_path, i + 1);
+		rename(from, to);
+	}
+
+	if (capture_max_files > 0) {
+		snprintf(to, len, "%s.1", capture_path);
+		rename(capture_path, to);
+	}
+
+	free(from);
+	free(to);
+
+	if (!open_file()) {
+		fail();
+	}
+}
+
+/**
+ * Writes a buffer of records, rotating the file between records
+ * when it would grow beyond the maximum size
+ */
+static void write_records(intu8 *buf, intu32 used)
+{
+	intu32 start = 0;
+	intu32 pos = 0;
+
+	while (pos < used) {
+		intu32 total = APDU_CAPTURE_RECORD_HEADER + get_intu32(buf + pos);
+		unsigned long pending = capture_file_size + (pos - start);
+
+		if (capture_max_size > 0 && pending + total > capture_max_size
+		    && pending > APDU_CAPTURE_FILE_HEADER) {
+			write_chunk(buf + start, pos - start);
+			rotate();
+			start = pos;
+		}
+
+		pos += total;
+	}
+
+	write_chunk(buf + start, pos - start);
+}
+
+/**
+ * Waits until the front buffer is due to be written. Called by the
+ * writer thread with the mutex held.
+ */
+static void writer_wait()
+{
+	while (!writer_stop && !front_full && flush_requested == flush_done) {
+		unsigned long long deadline;
+		struct timespec ts;
+
+		if (front_used == 0) {
+			pthread_cond_wait(&writer_cond, &capture_mutex);
+			continue;
+		}
+
+		deadline = front_since + CAPTURE_FLUSH_INTERVAL;
+
+		if (now_us() >= deadline) {
+			break;
+		}
+
+		ts.tv_sec = deadline / 1000000ULL;
+		ts.tv_nsec = (deadline % 1000000ULL) * 1000;
+		pthread_cond_timedwait(&writer_cond, &capture_mutex, &ts);
+	}
+}
+
+static void *writer_loop(void *arg)
+{
+	pthread_mutex_lock(&capture_mutex);
+
+	while (1) {
+		intu8 *buf;
+		intu32 size;
+		intu32 used;
+		unsigned int flush;
+		int stop;
+
+		writer_wait();
+
+		buf = front_buffer;
+		size = front_size;
+		used = front_used;
+		front_buffer = back_buffer;
+		front_size = back_size;
+		front_used = 0;
+		front_full = 0;
+		back_buffer = buf;
+		back_size = size;
+		flush = flush_requested;
+		stop = writer_stop;
+
+		pthread_cond_broadcast(&drained_cond);
+		pthread_mutex_unlock(&capture_mutex);
+
+		write_records(back_buffer, used);
+
+		pthread_mutex_lock(&capture_mutex);
+		flush_done = flush;
+		pthread_cond_broadcast(&drained_cond);
+
+		if (stop) {
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&capture_mutex);
+
+	return NULL;
+}
+
+/**
+ * Frees what apdu_capture_start() allocated. Writer must not be running.
+ */
+static void release()
+{
+	if (capture_fd >= 0) {
+		close(capture_fd);
+		capture_fd = -1;
+	}
+
+	free(front_buffer);
+	front_buffer = NULL;
+	front_size = 0;
+	front_used = 0;
+	free(back_buffer);
+	back_buffer = NULL;
+	back_size = 0;
+	free(capture_path);
+	capture_path = NULL;
+}
+
+/**
+ * Starts capturing every APDU sent or received by the stack.
+ *
+ * The file at path is truncated. When it would grow beyond max_size
+ * bytes, it is renamed to path.1 (path.1 to path.2 and so on) and a
+ * new file is started; up to max_files old files are kept.
+ *
+ * Records are written by a thread of their own, at least once per
+ * second.
+ *
+ * @param path capture file
+ * @param max_size rotation size in bytes, 0 for no rotation
+ * @param max_files number of rotated files kept
+ * @return 1 if operation succeeds, 0 if not
+ */
+int apdu_capture_start(const char *path, unsigned long max_size, int max_files)
+{
+	apdu_capture_stop();
+
+	capture_path = strdup(path);
+	capture_max_size = max_size;
+	capture_max_files = max_files < 0 ? 0 : max_files;
+
+	if (!open_file()) {
+		ERROR("apdu capture: cannot create %s", path);
+		release();
+		return 0;
+	}
+
+	pthread_mutex_lock(&capture_mutex);
+
+	front_buffer = malloc(CAPTURE_BUFFER_SIZE);
+	front_size = CAPTURE_BUFFER_SIZE;
+	front_used = 0;
+	front_full = 0;
+	back_buffer = malloc(CAPTURE_BUFFER_SIZE);
+	back_size = CAPTURE_BUFFER_SIZE;
+	writer_stop = 0;
+	flush_done = flush_requested;
+
+	if (pthread_create(&writer_thread, NULL, writer_loop, NULL)) {
+		pthread_mutex_unlock(&capture_mutex);
+		ERROR("apdu capture: cannot start writer thread");
+		release();
+		return 0;
+	}
+
+	writer_running = 1;
+	__atomic_store_n(&capturing, 1, __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(&capture_mutex);
+
+	DEBUG("apdu capture: capturing to %s", path);
+	return 1;
+}
+
+/**
+ * Stops capturing, writing pending records
+ */
+void apdu_capture_stop()
+{
+	pthread_mutex_lock(&capture_mutex);
+
+	if (!writer_running) {
+		pthread_mutex_unlock(&capture_mutex);
+		return;
+	}
+
+	__atomic_store_n(&capturing, 0, __ATOMIC_RELAXED);
+	writer_stop = 1;
+	pthread_cond_signal(&writer_cond);
+
+	pthread_mutex_unlock(&capture_mutex);
+
+	pthread_join(writer_thread, NULL);
+
+	pthread_mutex_lock(&capture_mutex);
+	writer_running = 0;
+	release();
+	pthread_mutex_unlock(&capture_mutex);
+}
+
+/**
+ * Writes pending records to file, returning when they are written
+ */
+void apdu_capture_flush()
+{
+	unsigned int request;
+
+	pthread_mutex_lock(&capture_mutex);
+
+	if (!writer_running) {
+		pthread_mutex_unlock(&capture_mutex);
+		return;
+	}
+
+	request = ++flush_requested;
+	pthread_cond_signal(&writer_cond);
+
+	while ((int) (flush_done - request) < 0) {
+		pthread_cond_wait(&drained_cond, &capture_mutex);
+	}
+
+	pthread_mutex_unlock(&capture_mutex);
+}
+
+/**
+ * @return 1 if APDUs are being captured
+ */
+int apdu_capture_enabled()
+{
+	return __atomic_load_n(&capturing, __ATOMIC_RELAXED);
+}
+
+/**
+ * Appends an APDU to the capture, if capture is enabled. Only copies
+ * the record to memory, unless the writer thread falls behind.
+ *
+ * @param plugin plugin id of the context
+ * @param connid connection id of the context
+ * @param direction whether APDU was sent or received
+ * @param apdu encoded APDU
+ * @param length APDU length
+ */
+void apdu_capture_record(unsigned int plugin, unsigned long long connid,
+			 ApduCaptureDirection direction, intu8 *apdu,
+			 intu32 length)
+{
+	intu8 header[APDU_CAPTURE_RECORD_HEADER];
+	intu32 total = APDU_CAPTURE_RECORD_HEADER + length;
+	unsigned long long now;
+
+	if (!__atomic_load_n(&capturing, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	now = now_us();
+
+	put_intu32(header, length);
+	header[4] = direction;
+	header[5] = 0;
+	put_intu16(header + 6, plugin);
+	put_intu64(header + 8, now);
+	put_intu64(header + 16, connid);
+
+	pthread_mutex_lock(&capture_mutex);
+
+	while (capturing && front_used + total > front_size) {
+		if (front_used == 0) {
+			// larger than the buffer: the buffer grows
+			front_buffer = realloc(front_buffer, total);
+			front_size = total;
+			break;
+		}
+
+		front_full = 1;
+		pthread_cond_signal(&writer_cond);
+		pthread_cond_wait(&drained_cond, &capture_mutex);
+	}
+
+	if (!capturing) {
+		// stopped meanwhile
+		pthread_mutex_unlock(&capture_mutex);
+		return;
+	}
+
+	memcpy(front_buffer + front_used, header, sizeof(header));
+	memcpy(front_buffer + front_used + sizeof(header), apdu, length);
+
+	if (front_used == 0) {
+		front_since = now;
+		// writer starts counting the flush interval
+		pthread_cond_signal(&writer_cond);
+	}
+
+	front_used += total;
+
+	pthread_mutex_unlock(&capture_mutex);
+}
+
+/**
+ * Opens a capture file for reading
+ *
+ * @param path capture file
+ * @return reader, or NULL if file cannot be read or is not a capture
+ */
+ApduCaptureReader *apdu_capture_reader_open(const char *path)
+{
+	char magic[APDU_CAPTURE_FILE_HEADER];
+	FILE *file = fopen(path, "rb");
+
+	if (!file) {
+		return NULL;
+	}
+
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+	    memcmp(magic, APDU_CAPTURE_MAGIC, sizeof(magic)) != 0) {
+		fclose(file);
+		return NULL;
+	}
+
+	ApduCaptureReader *reader = calloc(1, sizeof(ApduCaptureReader));
+	reader->file = file;
+	return reader;
+}
+
+/**
+ * Reads the next record of a capture file
+ *
+ * @param reader capture reader
+ * @param record filled with the record
+ * @return 1 if a record was read, 0 at end of file (a record cut
+ * short, as left by a crash, is taken as end of file)
+ */
+int apdu_capture_reader_next(ApduCaptureReader *reader,
+			     ApduCaptureRecord *record)
+{
+	intu8 header[APDU_CAPTURE_RECORD_HEADER];
+
+	if (fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+		return 0;
+	}
+
+	record->length = get_intu32(header);
+	record->direction = header[4];
+	record->plugin = (header[6] << 8) | header[7];
+	record->time_us = get_intu64(header + 8);
+	record->connid = get_intu64(header + 16);
+
+	if (record->length > reader->buffer_size) {
+		reader->buffer = realloc(reader->buffer, record->length);
+		reader->buffer_size = record->length;
+	}
+
+	if (fread(reader->buffer, 1, record->length, reader->file)
+						!= record->length) {
+		return 0;
+	}
+
+	record->apdu = reader->buffer;
+	return 1;
+}
+
+/**
+ * Closes a capture reader
+ *
+ * @param reader capture reader
+ */
+void apdu_capture_reader_close(ApduCaptureReader *reader)
+{
+	if (reader) {
+		fclose(reader->file);
+		free(reader->buffer);
+		free(reader);
+	}
+}
+
+/** @} */
@@ -0,0 +1,100 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file apdu_capture.h
+ * \brief APDU capture file definitions.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef APDU_CAPTURE_H_
+#define APDU_CAPTURE_H_
+
+#include <stdio.h>
+#include "src/asn1/phd_types.h"
+
+/**
+ * First bytes of a capture file
+ */
+#define APDU_CAPTURE_MAGIC "ANTDCAP\001"
+
+/**
+ * Size of the file header (magic) and of each record header.
+ *
+ * Record header, big-endian: APDU length (4), direction (1),
+ * reserved (1), plugin id (2), time in microseconds since the
+ * epoch (8), connection id (8). The APDU follows.
+ */
+#define APDU_CAPTURE_FILE_HEADER 8
+#define APDU_CAPTURE_RECORD_HEADER 24
+
+/**
+ * APDU direction, from the point of view of the capturing stack
+ */
+typedef enum {
+	APDU_CAPTURE_RECEIVED = 0,
+	APDU_CAPTURE_SENT = 1
+} ApduCaptureDirection;
+
+/**
+ * Record read back from a capture file
+ */
+typedef struct ApduCaptureRecord {
+	unsigned long long time_us;
+	unsigned int plugin;
+	unsigned long long connid;
+	ApduCaptureDirection direction;
+	intu32 length;
+	/**
+	 * APDU bytes, valid until the next read
+	 */
+	intu8 *apdu;
+} ApduCaptureRecord;
+
+/**
+ * Capture file being read
+ */
+typedef struct ApduCaptureReader {
+	FILE *file;
+	intu8 *buffer;
+	intu32 buffer_size;
+} ApduCaptureReader;
+
+int apdu_capture_start(const char *path, unsigned long max_size, int max_files);
+
+void apdu_capture_stop();
+
+void apdu_capture_flush();
+
+int apdu_capture_enabled();
+
+void apdu_capture_record(unsigned int plugin, unsigned long long connid,
+			 ApduCaptureDirection direction, intu8 *apdu,
+			 intu32 length);
+
+ApduCaptureReader *apdu_capture_reader_open(const char *path);
+
+int apdu_capture_reader_next(ApduCaptureReader *reader,
+			     ApduCaptureRecord *record);
+
+void apdu_capture_reader_close(ApduCaptureReader *reader);
+
+#endif /* APDU_CAPTURE_H_ */
@@ -0,0 +1,252 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file arena.c
+ * \brief Region allocator released all at once
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * \addtogroup Utility
+ *
+ * An arena hands out memory by bumping an offset in its current chunk
+ * and takes a new chunk when that one is full. Requests larger than a
+ * chunk get a chunk of their own. A reset keeps the first chunk for
+ * the next round and frees the others, so memory used by short-lived
+ * structures costs a handful of frees whatever their number.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/util/arena.h"
+
+/**
+ * Alignment of every allocation
+ */
+#define ARENA_ALIGN 16
+
+/**
+ * Chunk header, followed by the memory handed out
+ */
+typedef struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t size;
+	size_t offset;
+} ArenaChunk;
+
+/**
+ * Offset of the memory handed out, past the aligned header
+ */
+#define CHUNK_DATA ((sizeof(ArenaChunk) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+static ArenaChunk *chunk_new(Arena *arena, size_t size)
+{
+	ArenaChunk *chunk = malloc(CHUNK_DATA + size);
+
+	if (!chunk) {
+		return NULL;
+	}
+
+	chunk->size = size;
+	chunk->offset = 0;
+	arena->reserved += size;
+
+	return chunk;
+}
+
+/**
+ * Creates an empty arena. No memory is taken until the first
+ * allocation.
+ *
+ * @param chunk_size size of chunks, 0 for a default of 4 KB
+ * @return arena, NULL if out of memory
+ */
+Arena *arena_new(size_t chunk_size)
+{
+	Arena *arena = calloc(1, sizeof(Arena));
+
+	if (arena) {
+		arena->chunk_size = chunk_size ? chunk_size : 4096;
+	}
+
+	return arena;
+}
+
+/**
+ * Allocates memory, valid until the next reset
+ *
+ * @param arena arena
+ * @param size bytes
+ * @return memory aligned to 16 bytes, NULL if out of memory
+ */
+void *arena_alloc(Arena *arena, size_t size)
+{
+	ArenaChunk *chunk = arena->chunks;
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+	if (size == 0) {
+		size = ARENA_ALIGN;
+	}
+
+	if (!chunk || chunk->size - chunk->offset < size) {
+		if (size > arena->chunk_size) {
+			// oversized: keep carving the current chunk afterwards
+			chunk = chunk_new(arena, size);
+
+			if (!chunk) {
+				return NULL;
+			}
+
+			if (arena->chunks) {
+				chunk->next = arena->chunks->next;
+				arena->chunks->next = chunk;
+			} else {
+				chunk->next = NULL;
+				arena->chunks = chunk;
+			}
+		} else {
+			chunk = chunk_new(arena, arena->chunk_size);
+
+			if (!chunk) {
+				return NULL;
+			}
+
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+
+	p = (char *) chunk + CHUNK_DATA + chunk->offset;
+	chunk->offset += size;
+
+	arena->used += size;
+	if (arena->used > arena->peak) {
+		arena->peak = arena->used;
+	}
+
+	return p;
+}
+
+/**
+ * Allocates zeroed memory for an array, valid until the next reset
+ *
+ * @param arena arena
+ * @param count number of elements
+ * @param size size of elements
+ * @return memory, NULL if out of memory or on overflow
+ */
+void *arena_calloc(Arena *arena, size_t count, size_t size)
+{
+	void *p;
+
+	if (size && count > SIZE_MAX / size) {
+		return NULL;
+	}
+
+	p = arena_alloc(arena, count * size);
+
+	if (p) {
+		memset(p, 0, count * size);
+	}
+
+	return p;
+}
+
+/**
+ * Tells whether memory was handed out by an arena, so that code
+ * releasing a mix of arena and heap memory can leave the former alone
+ *
+ * @param arena arena, or NULL
+ * @param p memory
+ * @return 1 if p lies in one of the chunks of the arena
+ */
+int arena_owns(const Arena *arena, const void *p)
+{
+	const ArenaChunk *chunk;
+
+	if (!arena || !p) {
+		return 0;
+	}
+
+	for (chunk = arena->chunks; chunk; chunk = chunk->next) {
+		const char *data = (const char *) chunk + CHUNK_DATA;
+
+		if ((const char *) p >= data && (const char *) p < data + chunk->size) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Releases all allocations. One regular chunk is kept for reuse.
+ *
+ * @param arena arena
+ */
+void arena_reset(Arena *arena)
+{
+	ArenaChunk *kept = NULL;
+	ArenaChunk *chunk = arena->chunks;
+
+	while (chunk) {
+		ArenaChunk *next = chunk->next;
+
+		if (!kept && chunk->size == arena->chunk_size) {
+			kept = chunk;
+			kept->offset = 0;
+			kept->next = NULL;
+		} else {
+			arena->reserved -= chunk->size;
+			free(chunk);
+		}
+
+		chunk = next;
+	}
+
+	arena->chunks = kept;
+	arena->used = 0;
+}
+
+/**
+ * Frees an arena and all its memory
+ *
+ * @param arena arena, or NULL
+ */
+void arena_destroy(Arena *arena)
+{
+	if (!arena) {
+		return;
+	}
+
+	arena_reset(arena);
+
+	free(arena->chunks);
+	free(arena);
+}
+
+/** @} */
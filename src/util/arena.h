@@ -0,0 +1,79 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file arena.h
+ * \brief Region allocator released all at once
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+struct ArenaChunk;
+
+/**
+ * Arena. Allocations are carved from large chunks and are never freed
+ * one by one: arena_reset() releases all of them at once. Not
+ * thread-safe; an arena belongs to one context.
+ */
+typedef struct Arena {
+	/**
+	 * Chunks, the one being carved first
+	 */
+	struct ArenaChunk *chunks;
+
+	/**
+	 * Size of regular chunks
+	 */
+	size_t chunk_size;
+
+	/**
+	 * Bytes handed out since the last reset
+	 */
+	size_t used;
+
+	/**
+	 * Most bytes handed out between two resets
+	 */
+	size_t peak;
+
+	/**
+	 * Bytes held in chunks
+	 */
+	size_t reserved;
+} Arena;
+
+Arena *arena_new(size_t chunk_size);
+
+void *arena_alloc(Arena *arena, size_t size);
+
+void *arena_calloc(Arena *arena, size_t count, size_t size);
+
+int arena_owns(const Arena *arena, const void *p);
+
+void arena_reset(Arena *arena);
+
+void arena_destroy(Arena *arena);
+
+#endif /* ARENA_H_ */
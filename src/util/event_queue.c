@@ -0,0 +1,305 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file event_queue.c
+ * \brief Bounded lock-free queue with a wakeup descriptor
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * \addtogroup Utility
+ *
+ * The queue is a ring of cells, each carrying a sequence number
+ * (Vyukov's bounded queue). Producers and consumers claim positions
+ * with a compare-and-swap on push_pos and pop_pos and then wait for
+ * nothing: a cell whose sequence does not match is either full (push
+ * fails) or not yet published (pop finds the queue empty).
+ *
+ * Wakeups cost a system call only when a consumer may be asleep: a
+ * producer signals the descriptor when, after publishing, it sees
+ * pop_pos at its own cell, which means consumers have drained all
+ * earlier items and may have found this one not yet published. A pop
+ * that finds the queue empty clears the descriptor and looks again
+ * before giving up, so a signal is never lost between the two.
+ *
+ * The descriptor is an eventfd on Linux, a pipe elsewhere.
+ *
+ * @{
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include "src/util/event_queue.h"
+
+static int wakeup_open(int fd[2])
+{
+#ifdef __linux__
+	fd[0] = fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return fd[0] >= 0;
+#else
+	int i;
+
+	if (pipe(fd) < 0) {
+		return 0;
+	}
+
+	for (i = 0; i < 2; ++i) {
+		fcntl(fd[i], F_SETFL, fcntl(fd[i], F_GETFL) | O_NONBLOCK);
+		fcntl(fd[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	return 1;
+#endif
+}
+
+static void wakeup_close(int fd[2])
+{
+	close(fd[0]);
+
+	if (fd[1] != fd[0]) {
+		close(fd[1]);
+	}
+}
+
+static void wakeup_signal(EventQueue *q)
+{
+	uint64_t one = 1;
+	ssize_t n;
+
+	// a full pipe or a saturated eventfd is already readable
+	do {
+		n = write(q->fd[1], &one, q->fd[1] == q->fd[0] ? 8 : 1);
+	} while (n < 0 && errno == EINTR);
+}
+
+static void wakeup_clear(EventQueue *q)
+{
+	uint64_t buf[8];
+	ssize_t n;
+
+	while (1) {
+		n = read(q->fd[0], buf, sizeof(buf));
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+
+		// one read resets an eventfd; a pipe is read until empty
+		if (n <= 0 || q->fd[1] == q->fd[0]) {
+			break;
+		}
+	}
+}
+
+/**
+ * Creates a queue
+ *
+ * @param capacity maximum number of items, rounded up to a power of two
+ * @return queue, or NULL if it could not be created
+ */
+EventQueue *event_queue_new(unsigned int capacity)
+{
+	EventQueue *q;
+	unsigned long size = 2;
+	unsigned long i;
+
+	while (size < capacity) {
+		size <<= 1;
+	}
+
+	q = calloc(1, sizeof(EventQueue));
+	if (!q) {
+		return NULL;
+	}
+
+	q->cells = calloc(size, sizeof(EventQueueCell));
+	if (!q->cells || !wakeup_open(q->fd)) {
+		free(q->cells);
+		free(q);
+		return NULL;
+	}
+
+	for (i = 0; i < size; ++i) {
+		q->cells[i].seq = i;
+	}
+
+	q->mask = size - 1;
+
+	return q;
+}
+
+/**
+ * Destroys a queue. No thread may be using it; items still queued
+ * are not freed.
+ *
+ * @param q queue
+ */
+void event_queue_destroy(EventQueue *q)
+{
+	if (!q) {
+		return;
+	}
+
+	wakeup_close(q->fd);
+	free(q->cells);
+	free(q);
+}
+
+/**
+ * Adds an item. Never blocks.
+ *
+ * @param q queue
+ * @param item item, not NULL
+ * @return 1 if added, 0 if the queue was full
+ */
+int event_queue_push(EventQueue *q, void *item)
+{
+	unsigned long pos = __atomic_load_n(&q->push_pos, __ATOMIC_RELAXED);
+	EventQueueCell *cell;
+	long diff;
+
+	while (1) {
+		cell = &q->cells[pos & q->mask];
+		diff = (long) (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->push_pos, &pos, pos + 1,
+							1, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			__atomic_fetch_add(&q->dropped, 1, __ATOMIC_RELAXED);
+			return 0;
+		} else {
+			pos = __atomic_load_n(&q->push_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->item = item;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&q->pop_pos, __ATOMIC_SEQ_CST) == pos) {
+		wakeup_signal(q);
+	}
+
+	return 1;
+}
+
+static void *try_pop(EventQueue *q)
+{
+	unsigned long pos = __atomic_load_n(&q->pop_pos, __ATOMIC_RELAXED);
+	EventQueueCell *cell;
+	void *item;
+	long diff;
+
+	while (1) {
+		cell = &q->cells[pos & q->mask];
+		diff = (long) (__atomic_load_n(&cell->seq, __ATOMIC_SEQ_CST) - (pos + 1));
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->pop_pos, &pos, pos + 1,
+							1, __ATOMIC_SEQ_CST,
+							__ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return NULL;
+		} else {
+			pos = __atomic_load_n(&q->pop_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	item = cell->item;
+	__atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+
+	return item;
+}
+
+/**
+ * Takes the oldest item. Never blocks. When it returns NULL, the
+ * descriptor will become readable on the next push.
+ *
+ * @param q queue
+ * @return item, or NULL if the queue is empty
+ */
+void *event_queue_pop(EventQueue *q)
+{
+	void *item = try_pop(q);
+
+	if (!item) {
+		wakeup_clear(q);
+		item = try_pop(q);
+	}
+
+	return item;
+}
+
+/**
+ * @param q queue
+ * @return descriptor to poll for reading; readable when the queue
+ *	   may have items after event_queue_pop() returned NULL
+ */
+int event_queue_fd(EventQueue *q)
+{
+	return q->fd[0];
+}
+
+/**
+ * Waits until the descriptor is readable
+ *
+ * @param q queue
+ * @param timeout_ms timeout in milliseconds, -1 to wait forever
+ * @return 1 if items may be available, 0 on timeout
+ */
+int event_queue_wait(EventQueue *q, int timeout_ms)
+{
+	struct pollfd pfd;
+	int ret;
+
+	pfd.fd = q->fd[0];
+	pfd.events = POLLIN;
+
+	do {
+		ret = poll(&pfd, 1, timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret > 0;
+}
+
+/**
+ * @param q queue
+ * @return number of pushes that failed because the queue was full
+ */
+unsigned long long event_queue_dropped(EventQueue *q)
+{
+	return __atomic_load_n(&q->dropped, __ATOMIC_RELAXED);
+}
+
+/** @} */
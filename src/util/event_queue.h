@@ -0,0 +1,72 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file event_queue.h
+ * \brief Bounded lock-free queue with a wakeup descriptor
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef EVENT_QUEUE_H_
+#define EVENT_QUEUE_H_
+
+/**
+ * One slot of the queue. seq tells whether the slot is free for the
+ * push at position seq, or holds the item for the pop at seq - 1.
+ */
+typedef struct EventQueueCell {
+	unsigned long seq;
+	void *item;
+} EventQueueCell;
+
+/**
+ * Bounded queue of pointers. Any number of threads may push and pop
+ * without locks. A descriptor becomes readable when a push finds
+ * that consumers have emptied the queue, so a consumer can sleep in
+ * poll() between drains.
+ */
+typedef struct EventQueue {
+	EventQueueCell *cells;
+	unsigned long mask;
+	int fd[2];
+	char pad0[64];
+	unsigned long push_pos;
+	char pad1[64];
+	unsigned long pop_pos;
+	char pad2[64];
+	unsigned long long dropped;
+} EventQueue;
+
+EventQueue *event_queue_new(unsigned int capacity);
+
+void event_queue_destroy(EventQueue *q);
+
+int event_queue_push(EventQueue *q, void *item);
+
+void *event_queue_pop(EventQueue *q);
+
+int event_queue_fd(EventQueue *q);
+
+int event_queue_wait(EventQueue *q, int timeout_ms);
+
+unsigned long long event_queue_dropped(EventQueue *q);
+
+#endif /* EVENT_QUEUE_H_ */
@@ -0,0 +1,224 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file histogram.c
+ * \brief Log-bucketed histogram of 64-bit values
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * \addtogroup Utility
+ *
+ * @{
+ */
+
+#include "src/util/histogram.h"
+
+/**
+ * Bucket of a value. Bucket group g > 0 holds values with g + SUB_BITS - 1
+ * significant bits, SUB_BUCKETS of them, each 2^(g - 1) wide.
+ */
+static int bucket_of(unsigned long long value)
+{
+	int exp;
+
+	if (value < HISTOGRAM_SUB_BUCKETS) {
+		return value;
+	}
+
+	exp = 63 - __builtin_clzll(value);
+
+	return (exp - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+		((value >> (exp - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * Highest value that falls in a bucket
+ */
+static unsigned long long bucket_top(int bucket)
+{
+	int group = bucket / HISTOGRAM_SUB_BUCKETS;
+	unsigned long long sub = bucket % HISTOGRAM_SUB_BUCKETS;
+
+	if (group == 0) {
+		return sub;
+	}
+
+	return ((HISTOGRAM_SUB_BUCKETS + sub + 1) << (group - 1)) - 1;
+}
+
+/**
+ * Records a value
+ *
+ * @param h histogram
+ * @param value value
+ */
+void histogram_record(Histogram *h, unsigned long long value)
+{
+	unsigned long long max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	// max first, so percentiles of counted values are never clamped
+	while (value > max &&
+	       !__atomic_compare_exchange_n(&h->max, &max, value, 1,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+
+	__atomic_fetch_add(&h->counts[bucket_of(value)], 1, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Forgets all recorded values. Values recorded meanwhile by other
+ * threads may be partially kept.
+ *
+ * @param h histogram
+ */
+void histogram_reset(Histogram *h)
+{
+	int i;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		__atomic_store_n(&h->counts[i], 0, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&h->sum, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @param h histogram
+ * @return number of recorded values
+ */
+unsigned long long histogram_count(Histogram *h)
+{
+	unsigned long long count = 0;
+	int i;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		count += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+	}
+
+	return count;
+}
+
+/**
+ * @param h histogram
+ * @return sum of recorded values, exact
+ */
+unsigned long long histogram_sum(Histogram *h)
+{
+	return __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+}
+
+/**
+ * @param h histogram
+ * @return highest recorded value, exact
+ */
+unsigned long long histogram_max(Histogram *h)
+{
+	return __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+}
+
+/**
+ * @param h histogram
+ * @return mean of recorded values, exact, or 0 if there are none
+ */
+unsigned long long histogram_mean(Histogram *h)
+{
+	unsigned long long count = histogram_count(h);
+
+	if (count == 0) {
+		return 0;
+	}
+
+	return histogram_sum(h) / count;
+}
+
+/**
+ * Computes several percentiles in a single pass. Each one is the
+ * highest value of the bucket where the percentile falls, but never
+ * above the highest recorded value.
+ *
+ * @param h histogram
+ * @param percentiles percentiles wanted (0 to 100), in increasing order
+ * @param values receives the values, 0 if histogram is empty
+ * @param count number of percentiles
+ */
+void histogram_percentiles(Histogram *h, const double *percentiles,
+			   unsigned long long *values, int count)
+{
+	unsigned long long counts[HISTOGRAM_BUCKETS];
+	unsigned long long total = 0;
+	unsigned long long seen = 0;
+	unsigned long long max;
+	int bucket = 0;
+	int i;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		counts[i] = __atomic_load_n(&h->counts[i], __ATOMIC_ACQUIRE);
+		total += counts[i];
+	}
+
+	max = histogram_max(h);
+
+	for (i = 0; i < count; ++i) {
+		unsigned long long rank;
+
+		if (total == 0) {
+			values[i] = 0;
+			continue;
+		}
+
+		rank = (unsigned long long) (percentiles[i] / 100.0 * total + 0.999999);
+		if (rank < 1) {
+			rank = 1;
+		} else if (rank > total) {
+			rank = total;
+		}
+
+		while (seen + counts[bucket] < rank) {
+			seen += counts[bucket];
+			++bucket;
+		}
+
+		values[i] = bucket_top(bucket);
+		if (values[i] > max) {
+			values[i] = max;
+		}
+	}
+}
+
+/**
+ * @param h histogram
+ * @param percentile percentile wanted (0 to 100)
+ * @return value at percentile, 0 if histogram is empty
+ */
+unsigned long long histogram_percentile(Histogram *h, double percentile)
+{
+	unsigned long long value;
+
+	histogram_percentiles(h, &percentile, &value, 1);
+
+	return value;
+}
+
+/** @} */
@@ -0,0 +1,68 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file histogram.h
+ * \brief Log-bucketed histogram of 64-bit values
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+/**
+ * Each power of two is split in 2^HISTOGRAM_SUB_BITS linear buckets,
+ * so reported values are within 1/2^HISTOGRAM_SUB_BITS (about 3%) of
+ * the recorded ones. Values below 2^(HISTOGRAM_SUB_BITS + 1) are exact.
+ */
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Histogram. A zeroed struct is an empty histogram. Recording is
+ * lock-free and may happen from any thread; readers see each bucket
+ * atomically, but not all buckets at the same instant.
+ */
+typedef struct Histogram {
+	unsigned long long counts[HISTOGRAM_BUCKETS];
+	unsigned long long sum;
+	unsigned long long max;
+} Histogram;
+
+void histogram_record(Histogram *h, unsigned long long value);
+
+void histogram_reset(Histogram *h);
+
+unsigned long long histogram_count(Histogram *h);
+
+unsigned long long histogram_sum(Histogram *h);
+
+unsigned long long histogram_max(Histogram *h);
+
+unsigned long long histogram_mean(Histogram *h);
+
+unsigned long long histogram_percentile(Histogram *h, double percentile);
+
+void histogram_percentiles(Histogram *h, const double *percentiles,
+			   unsigned long long *values, int count);
+
+#endif /* HISTOGRAM_H_ */
@@ -32,6 +32,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "ioutil.h"
@@ -49,6 +51,8 @@
  *  Returns the file content as a string. If the file does not
  *  exist, this function returns \b NULL. If it is not possible to
  *  allocate enough memory for string, this function returns \b NULL.
+ *  The file is read under a shared lock, so appends made by other
+ *  processes with ioutil_buffer_to_file() are never seen halfway.
  *
  *  \param file_path the file path.
  *  \param buffer_size the length of result string.
@@ -70,6 +74,8 @@ intu8 *ioutil_buffer_from_file(const char *file_path,
 		return NULL;
 	}
 
+	flock(fileno(file), LOCK_SH);
+
 	// Get file length
 	fseek(file, 0, SEEK_END);
 	fileLen = ftell(file);
@@ -115,25 +121,72 @@ intu8 *ioutil_buffer_from_file(const char *file_path,
  *  \param buffer the input string.
  *  \param append tells whether a new file should be created (\b 0) or not (\b 1)
  *
+ *  Files may be shared by several processes (e.g. manager workers
+ *  sharing a TCP port). Appends are made under an exclusive lock, and
+ *  new files are written apart and renamed over the old one, so
+ *  readers see either the old or the new content.
+ *
  *  \return \b 0, if the operation is properly performed; \b 1 otherwise.
  */
 int ioutil_buffer_to_file(const char *file_path,
 			  unsigned long buffer_size, unsigned char *buffer, int append)
 {
 	FILE *file;
+	char *tmp_path = NULL;
+	int error = 0;
 
 	// Open file
-	file = fopen(file_path, (append ? "a" : "w"));
+	if (append) {
+		file = fopen(file_path, "a");
+	} else {
+		int fd;
+
+		tmp_path = malloc(strlen(file_path) + 8);
+		sprintf(tmp_path, "%s.XXXXXX", file_path);
+		fd = mkstemp(tmp_path);
+		file = NULL;
+
+		if (fd >= 0) {
+			fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+			file = fdopen(fd, "w");
+			if (!file) {
+				close(fd);
+				unlink(tmp_path);
+			}
+		}
+	}
 
 	if (!file) {
 		ERROR("Unable to open file %s", file_path);
+		free(tmp_path);
 		return 1;
 	}
 
+	if (append) {
+		flock(fileno(file), LOCK_EX);
+	}
+
 	// Read file contents into buffer_cur
-	fwrite(buffer, 1, buffer_size, file);
-	fclose(file);
-	return 0;
+	if (fwrite(buffer, 1, buffer_size, file) != buffer_size) {
+		error = 1;
+	}
+
+	// also releases the lock, after data is flushed
+	if (fclose(file) != 0) {
+		error = 1;
+	}
+
+	if (tmp_path) {
+		if (error || rename(tmp_path, file_path) != 0) {
+			ERROR("Unable to write file %s", file_path);
+			unlink(tmp_path);
+			error = 1;
+		}
+
+		free(tmp_path);
+	}
+
+	return error;
 }
 
 /**
@@ -143,19 +196,31 @@ int ioutil_buffer_to_file(const char *file_path,
  */
 void ioutil_print_buffer(intu8 *buffer, int size)
 {
-	char  *str = calloc(size*4, sizeof(char));
-
+	static const char hex[] = "0123456789ABCDEF";
+	char *str;
 	int i;
 
+	if (!LOG_ENABLED(LOG_LEVEL_DEBUG) || size <= 0) {
+		return;
+	}
+
+	str = malloc(size * 3 + 1);
+
+	if (!str) {
+		return;
+	}
+
 	for (i = 0; i < size; i++) {
-		sprintf(str, "%s%.2X ", str, buffer[i]);
+		str[i * 3] = hex[buffer[i] >> 4];
+		str[i * 3 + 1] = hex[buffer[i] & 0x0f];
+		str[i * 3 + 2] = ' ';
 	}
 
+	str[size * 3] = '\0';
+
 	DEBUG("%s", str);
 
-	fflush(stdout);
 	free(str);
-	str = NULL;
 }
 
 #ifdef ANDROID
@@ -0,0 +1,828 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file log.c
+ * \brief Synchronous and asynchronous log output
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * \addtogroup Utility
+ *
+ * @{
+ */
+
+/*
+ * By default every message is formatted and written by the caller.
+ *
+ * Once log_async_start() is called, callers only copy the message
+ * arguments, undecoded, into a ring owned by their thread: format
+ * string pointer, integers and pointers as 8-byte words, %s strings
+ * as bytes. No lock is taken and no system call is made; if the ring
+ * is full, the message is dropped and counted. A background thread
+ * formats the records of every ring and writes them out, with the
+ * same text the synchronous path would have written. Messages of a
+ * thread keep their order; messages of different threads may not.
+ *
+ * Format strings with conversions that cannot be copied this way
+ * (e.g. '*' width, %n, %m) are formatted by the caller instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "src/util/log.h"
+
+#ifdef ANDROID
+#include <android/log.h>
+#endif
+
+/**
+ * Ring size of each logging thread, a power of two
+ */
+#define LOG_RING_SIZE (256 * 1024)
+
+/**
+ * Maximum size of a record; longer strings are truncated
+ */
+#define LOG_RECORD_MAX 4096
+
+/**
+ * Maximum length of a formatted line
+ */
+#define LOG_LINE_MAX 8192
+
+/**
+ * Maximum length of a single conversion specification
+ */
+#define LOG_SPEC_MAX 32
+
+/**
+ * Background thread sleep when rings are empty (microseconds),
+ * doubled up to the maximum while they stay empty
+ */
+#define LOG_IDLE_MIN_US 500
+#define LOG_IDLE_MAX_US 16000
+
+int log_runtime_level = LOG_LEVEL_DEBUG;
+
+static FILE *log_output = NULL;
+
+static const char *level_names[] = {
+	"ERROR   ", "WARNING ", "INFO    ", "DEBUG   "
+};
+
+typedef enum {
+	ARG_NONE = 0,
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_SIZE,
+	ARG_INTMAX,
+	ARG_PTRDIFF,
+	ARG_DOUBLE,
+	ARG_POINTER,
+	ARG_STRING,
+	ARG_UNSUPPORTED
+} ArgType;
+
+/**
+ * Record header. A record without format pads the end of the ring.
+ */
+typedef struct {
+	unsigned int size;
+	int level;
+	int line;
+	/**
+	 * Payload is the message already formatted by the caller
+	 */
+	int eager;
+	const char *function;
+	const char *file;
+	const char *format;
+} LogRecord;
+
+/**
+ * Ring of a thread. Only the owner thread writes records and
+ * only the background thread reads them.
+ */
+typedef struct LogRing {
+	unsigned long long head;
+	unsigned long long tail;
+	unsigned long long dropped;
+	unsigned long long dropped_reported;
+	/**
+	 * Non-zero while a live thread writes to this ring
+	 */
+	int owned;
+	struct LogRing *next;
+	unsigned char data[LOG_RING_SIZE];
+} LogRing;
+
+/**
+ * All rings ever created. Rings of finished threads are reused, and
+ * none is freed, so writers racing with log_async_stop() are safe.
+ */
+static LogRing *rings = NULL;
+
+static __thread LogRing *thread_ring = NULL;
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static int async_running = 0;
+static pthread_t async_thread;
+
+static FILE *output()
+{
+	return log_output ? log_output : LOG_OUTPUT;
+}
+
+static const char *level_name(int level)
+{
+	if (level < LOG_LEVEL_ERROR || level > LOG_LEVEL_DEBUG) {
+		return level_names[LOG_LEVEL_ERROR];
+	}
+
+	return level_names[level];
+}
+
+/**
+ * Sets least severe level logged, up to LOG_COMPILE_LEVEL
+ *
+ * @param level one of LOG_LEVEL_*
+ */
+void log_set_level(int level)
+{
+	log_runtime_level = level;
+}
+
+/**
+ * @return least severe level logged at runtime
+ */
+int log_get_level()
+{
+	return log_runtime_level;
+}
+
+/**
+ * Redirects log output. Not to be called while asynchronous
+ * logging runs.
+ *
+ * @param out output stream, or NULL for LOG_OUTPUT
+ */
+void log_set_output(FILE *out)
+{
+	log_output = out;
+}
+
+static void sync_write(int level, const char *function, const char *file,
+		       int line, const char *format, va_list ap)
+{
+#ifdef ANDROID
+	char message[LOG_LINE_MAX];
+
+	vsnprintf(message, sizeof(message), format, ap);
+	__android_log_print(ANDROID_LOG_WARN, "antidote", "%s%s",
+			    level_name(level), message);
+#else
+	FILE *out = output();
+
+	flockfile(out);
+	fprintf(out, "%s<%s in %s:%d> ", level_name(level), function, file,
+		line);
+	vfprintf(out, format, ap);
+	fputc('\n', out);
+	fflush(out);
+	funlockfile(out);
+#endif
+}
+
+/**
+ * Finds the next conversion of a format string
+ *
+ * @param p where to start looking
+ * @param type filled with the type of the conversion argument
+ * @param end filled with the end of the conversion specification
+ * @return start of the conversion specification ('%'), or NULL
+ */
+static const char *next_spec(const char *p, ArgType *type, const char **end)
+{
+	int length = 0;
+
+	p = strchr(p, '%');
+
+	if (!p) {
+		return NULL;
+	}
+
+	*end = p + 1;
+
+	if (**end == '%') {
+		++*end;
+		*type = ARG_NONE;
+		return p;
+	}
+
+	while (**end && strchr("-+ #0'", **end)) {
+		++*end;
+	}
+
+	while (**end >= '0' && **end <= '9') {
+		++*end;
+	}
+
+	if (**end == '.') {
+		++*end;
+		while (**end >= '0' && **end <= '9') {
+			++*end;
+		}
+	}
+
+	switch (**end) {
+	case 'h':
+		++*end;
+		if (**end == 'h') {
+			++*end;
+		}
+		break;
+	case 'l':
+		++*end;
+		length = ARG_LONG;
+		if (**end == 'l') {
+			++*end;
+			length = ARG_LLONG;
+		}
+		break;
+	case 'z':
+		++*end;
+		length = ARG_SIZE;
+		break;
+	case 'j':
+		++*end;
+		length = ARG_INTMAX;
+		break;
+	case 't':
+		++*end;
+		length = ARG_PTRDIFF;
+		break;
+	}
+
+	if (**end == '\0') {
+		*type = ARG_UNSUPPORTED;
+		return p;
+	}
+
+	switch (*(*end)++) {
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'x':
+	case 'X':
+	case 'o':
+		*type = length ? length : ARG_INT;
+		break;
+	case 'c':
+		*type = length ? ARG_UNSUPPORTED : ARG_INT;
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		*type = length ? ARG_UNSUPPORTED : ARG_DOUBLE;
+		break;
+	case 'p':
+		*type = ARG_POINTER;
+		break;
+	case 's':
+		*type = length ? ARG_UNSUPPORTED : ARG_STRING;
+		break;
+	default:
+		// '*' width or precision, %n, %m, long double...
+		*type = ARG_UNSUPPORTED;
+		break;
+	}
+
+	return p;
+}
+
+/**
+ * Copies message arguments after the record header
+ *
+ * @return record size, or 0 if the format cannot be copied
+ */
+static unsigned int encode_args(unsigned char *rec, const char *format,
+				va_list ap)
+{
+	unsigned int size = sizeof(LogRecord);
+	const char *p = format;
+	const char *end;
+	ArgType type;
+
+	while ((p = next_spec(p, &type, &end))) {
+		long long word = 0;
+		double d;
+		void *ptr;
+		const char *s;
+		size_t len;
+
+		if (end - p >= LOG_SPEC_MAX) {
+			return 0;
+		}
+
+		p = end;
+
+		if (size + sizeof(word) > LOG_RECORD_MAX) {
+			return 0;
+		}
+
+		switch (type) {
+		case ARG_NONE:
+			continue;
+		case ARG_INT:
+			word = va_arg(ap, int);
+			break;
+		case ARG_LONG:
+			word = va_arg(ap, long);
+			break;
+		case ARG_LLONG:
+			word = va_arg(ap, long long);
+			break;
+		case ARG_SIZE:
+			word = va_arg(ap, size_t);
+			break;
+		case ARG_INTMAX:
+			word = va_arg(ap, intmax_t);
+			break;
+		case ARG_PTRDIFF:
+			word = va_arg(ap, ptrdiff_t);
+			break;
+		case ARG_DOUBLE:
+			d = va_arg(ap, double);
+			memcpy(rec + size, &d, sizeof(d));
+			size += sizeof(d);
+			continue;
+		case ARG_POINTER:
+			ptr = va_arg(ap, void *);
+			memcpy(rec + size, &ptr, sizeof(ptr));
+			size += sizeof(ptr);
+			continue;
+		case ARG_STRING:
+			s = va_arg(ap, const char *);
+			if (!s) {
+				s = "(null)";
+			}
+			len = strlen(s);
+			if (len > LOG_RECORD_MAX - size - 1) {
+				len = LOG_RECORD_MAX - size - 1;
+			}
+			memcpy(rec + size, s, len);
+			rec[size + len] = '\0';
+			size += len + 1;
+			continue;
+		default:
+			return 0;
+		}
+
+		memcpy(rec + size, &word, sizeof(word));
+		size += sizeof(word);
+	}
+
+	return size;
+}
+
+static void ring_release(void *ring)
+{
+	__atomic_store_n(&((LogRing *) ring)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void ring_key_create()
+{
+	pthread_key_create(&ring_key, ring_release);
+}
+
+/**
+ * Gets a ring for the calling thread, reusing one of a finished
+ * thread if possible
+ */
+static LogRing *ring_claim()
+{
+	LogRing *ring;
+	int unowned;
+
+	pthread_once(&ring_key_once, ring_key_create);
+
+	for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next) {
+		unowned = 0;
+		if (__atomic_compare_exchange_n(&ring->owned, &unowned, 1, 0,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+
+	if (!ring) {
+		ring = calloc(1, sizeof(LogRing));
+
+		if (!ring) {
+			return NULL;
+		}
+
+		ring->owned = 1;
+		ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+
+		while (!__atomic_compare_exchange_n(&rings, &ring->next, ring,
+						    0, __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED)) {
+		}
+	}
+
+	pthread_setspecific(ring_key, ring);
+	thread_ring = ring;
+
+	return ring;
+}
+
+static void async_write(int level, const char *function, const char *file,
+			int line, const char *format, va_list ap)
+{
+	union {
+		LogRecord hdr;
+		unsigned char bytes[LOG_RECORD_MAX];
+	} record;
+	unsigned char *rec = record.bytes;
+	LogRecord *hdr = &record.hdr;
+	LogRing *ring = thread_ring;
+	unsigned long long head;
+	unsigned long long tail;
+	unsigned int pos;
+	unsigned int room;
+	unsigned int skip = 0;
+	unsigned int size;
+	va_list copy;
+
+	if (!ring) {
+		ring = ring_claim();
+	}
+
+	if (!ring) {
+		sync_write(level, function, file, line, format, ap);
+		return;
+	}
+
+	va_copy(copy, ap);
+	size = encode_args(rec, format, copy);
+	va_end(copy);
+
+	hdr->eager = !size;
+
+	if (!size) {
+		int n = vsnprintf((char *) rec + sizeof(LogRecord),
+				  LOG_RECORD_MAX - sizeof(LogRecord), format, ap);
+
+		if (n < 0) {
+			n = 0;
+		} else if (n > (int) (LOG_RECORD_MAX - sizeof(LogRecord) - 1)) {
+			n = LOG_RECORD_MAX - sizeof(LogRecord) - 1;
+		}
+
+		size = sizeof(LogRecord) + n + 1;
+	}
+
+	size = (size + 7) & ~7U;
+	hdr->size = size;
+	hdr->level = level;
+	hdr->line = line;
+	hdr->function = function;
+	hdr->file = file;
+	hdr->format = format;
+
+	tail = ring->tail;
+	pos = tail & (LOG_RING_SIZE - 1);
+	room = LOG_RING_SIZE - pos;
+
+	if (room < size) {
+		// records are never split; pad up to the end of the ring
+		skip = room;
+	}
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if (tail + skip + size - head > LOG_RING_SIZE) {
+		__atomic_store_n(&ring->dropped, ring->dropped + 1,
+				 __ATOMIC_RELAXED);
+		return;
+	}
+
+	if (skip >= sizeof(LogRecord)) {
+		LogRecord pad;
+
+		memset(&pad, 0, sizeof(pad));
+		pad.size = skip;
+		memcpy(ring->data + pos, &pad, sizeof(pad));
+	}
+
+	memcpy(ring->data + ((tail + skip) & (LOG_RING_SIZE - 1)), rec, size);
+	__atomic_store_n(&ring->tail, tail + skip + size, __ATOMIC_RELEASE);
+}
+
+/**
+ * Formats a record copied by encode_args()
+ *
+ * @return length of the line
+ */
+static int format_record(LogRecord *hdr, const unsigned char *args,
+			 char *out)
+{
+	char spec[LOG_SPEC_MAX];
+	const char *p = hdr->format;
+	const char *start;
+	const char *end;
+	ArgType type;
+	int len;
+	int n = 0;
+
+	len = snprintf(out, LOG_LINE_MAX, "%s<%s in %s:%d> ",
+		       level_name(hdr->level), hdr->function, hdr->file,
+		       hdr->line);
+
+	if (hdr->eager) {
+		n = snprintf(out + len, LOG_LINE_MAX - len, "%s",
+			     (const char *) args);
+		len += n < LOG_LINE_MAX - len ? n : LOG_LINE_MAX - len - 1;
+		return len;
+	}
+
+	while (len < LOG_LINE_MAX - 1) {
+		long long word;
+		double d;
+		void *ptr;
+		size_t speclen;
+
+		start = next_spec(p, &type, &end);
+
+		if (!start) {
+			n = snprintf(out + len, LOG_LINE_MAX - len, "%s", p);
+			len += n < LOG_LINE_MAX - len ? n : LOG_LINE_MAX - len - 1;
+			break;
+		}
+
+		n = start - p;
+		if (n > LOG_LINE_MAX - 1 - len) {
+			n = LOG_LINE_MAX - 1 - len;
+		}
+		memcpy(out + len, p, n);
+		len += n;
+		p = end;
+
+		speclen = end - start;
+		if (speclen >= LOG_SPEC_MAX) {
+			break;
+		}
+		memcpy(spec, start, speclen);
+		spec[speclen] = '\0';
+
+		switch (type) {
+		case ARG_NONE:
+			n = snprintf(out + len, LOG_LINE_MAX - len, "%%");
+			break;
+		case ARG_DOUBLE:
+			memcpy(&d, args, sizeof(d));
+			args += sizeof(d);
+			n = snprintf(out + len, LOG_LINE_MAX - len, spec, d);
+			break;
+		case ARG_POINTER:
+			memcpy(&ptr, args, sizeof(ptr));
+			args += sizeof(ptr);
+			n = snprintf(out + len, LOG_LINE_MAX - len, spec, ptr);
+			break;
+		case ARG_STRING:
+			n = snprintf(out + len, LOG_LINE_MAX - len, spec,
+				     (const char *) args);
+			args += strlen((const char *) args) + 1;
+			break;
+		default:
+			memcpy(&word, args, sizeof(word));
+			args += sizeof(word);
+
+			switch (type) {
+			case ARG_LONG:
+				n = snprintf(out + len, LOG_LINE_MAX - len,
+					     spec, (long) word);
+				break;
+			case ARG_LLONG:
+				n = snprintf(out + len, LOG_LINE_MAX - len,
+					     spec, word);
+				break;
+			case ARG_SIZE:
+				n = snprintf(out + len, LOG_LINE_MAX - len,
+					     spec, (size_t) word);
+				break;
+			case ARG_INTMAX:
+				n = snprintf(out + len, LOG_LINE_MAX - len,
+					     spec, (intmax_t) word);
+				break;
+			case ARG_PTRDIFF:
+				n = snprintf(out + len, LOG_LINE_MAX - len,
+					     spec, (ptrdiff_t) word);
+				break;
+			default:
+				n = snprintf(out + len, LOG_LINE_MAX - len,
+					     spec, (int) word);
+				break;
+			}
+		}
+
+		if (n < 0) {
+			break;
+		}
+
+		len += n < LOG_LINE_MAX - len ? n : LOG_LINE_MAX - len - 1;
+	}
+
+	return len;
+}
+
+/**
+ * Writes out the records of a ring
+ *
+ * @return number of records written
+ */
+static int drain(LogRing *ring, FILE *out)
+{
+	char line[LOG_LINE_MAX];
+	unsigned long long head = ring->head;
+	unsigned long long tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	unsigned long long dropped;
+	int count = 0;
+
+	while (head < tail) {
+		unsigned int pos = head & (LOG_RING_SIZE - 1);
+		LogRecord hdr;
+		int len;
+
+		if (LOG_RING_SIZE - pos < sizeof(LogRecord)) {
+			head += LOG_RING_SIZE - pos;
+			continue;
+		}
+
+		memcpy(&hdr, ring->data + pos, sizeof(hdr));
+
+		if (hdr.format) {
+			len = format_record(&hdr, ring->data + pos +
+					    sizeof(LogRecord), line);
+			line[len++] = '\n';
+			fwrite(line, 1, len, out);
+			++count;
+		}
+
+		head += hdr.size;
+		__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+	}
+
+	dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+
+	if (dropped != ring->dropped_reported) {
+		fprintf(out, "%s<log> %llu messages dropped\n",
+			level_name(LOG_LEVEL_WARNING),
+			dropped - ring->dropped_reported);
+		ring->dropped_reported = dropped;
+	}
+
+	return count;
+}
+
+static int drain_all()
+{
+	FILE *out = output();
+	LogRing *ring;
+	int count = 0;
+
+	for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next) {
+		count += drain(ring, out);
+	}
+
+	if (count) {
+		fflush(out);
+	}
+
+	return count;
+}
+
+static void *async_loop(void *arg)
+{
+	unsigned int idle = LOG_IDLE_MIN_US;
+
+	while (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+		if (drain_all()) {
+			idle = LOG_IDLE_MIN_US;
+			continue;
+		}
+
+		usleep(idle);
+
+		if (idle < LOG_IDLE_MAX_US) {
+			idle *= 2;
+		}
+	}
+
+	drain_all();
+
+	return NULL;
+}
+
+/**
+ * Starts asynchronous logging: from now on, messages are formatted
+ * and written by a background thread.
+ *
+ * @return 1 if started (or already running), 0 on failure
+ */
+int log_async_start()
+{
+#ifdef ANDROID
+	return 0;
+#else
+	if (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+		return 1;
+	}
+
+	__atomic_store_n(&async_running, 1, __ATOMIC_RELEASE);
+
+	if (pthread_create(&async_thread, NULL, async_loop, NULL)) {
+		__atomic_store_n(&async_running, 0, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	return 1;
+#endif
+}
+
+/**
+ * Writes out pending messages and goes back to synchronous logging.
+ * Messages logged by other threads while stopping may be lost.
+ */
+void log_async_stop()
+{
+	if (!__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+
+	__atomic_store_n(&async_running, 0, __ATOMIC_RELEASE);
+	pthread_join(async_thread, NULL);
+}
+
+/**
+ * Logs a message. Called by the LOG() macros once the level has
+ * been checked.
+ *
+ * @param level log level
+ * @param function, file, line origin of the message
+ * @param format printf-like format
+ */
+void log_message(int level, const char *function, const char *file,
+		 int line, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+
+	if (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+		async_write(level, function, file, line, format, ap);
+	} else {
+		sync_write(level, function, file, line, format, ap);
+	}
+
+	va_end(ap);
+}
+
+/** @} */
@@ -33,60 +33,93 @@
 
 /**
  * \def LOG_OUTPUT
- * Output of the log.
+ * Default output of the log, see log_set_output().
  */
 #define LOG_OUTPUT stderr
 
 /**
- * @brief Log to the output defined in LOG_OUTPUT.
+ * Log levels, most severe first
+ */
+#define LOG_LEVEL_ERROR   0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_INFO    2
+#define LOG_LEVEL_DEBUG   3
+
+/**
+ * \def LOG_COMPILE_LEVEL
+ * Least severe level compiled in. Messages below it cost nothing, not
+ * even the level check. Set by configure --with-log-level.
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/**
+ * Least severe level logged at runtime, see log_set_level()
+ */
+extern int log_runtime_level;
+
+/**
+ * @brief Whether messages of a level are logged.
+ * @param level log level.
+ */
+#define LOG_ENABLED(level) \
+	((level) <= LOG_COMPILE_LEVEL && (level) <= log_runtime_level)
+
+/**
+ * @brief Log to the current output, if level is enabled.
  * @param level log level.
  * @param ... va_args like in printf.
  * @see printf
  */
-#ifdef ANDROID
-#include <android/log.h>
-#define LOG(level, ...) \
-	{ \
-		__android_log_print(ANDROID_LOG_WARN, "antidote", level); \
-		__android_log_print(ANDROID_LOG_WARN, "antidote",  __VA_ARGS__); \
-	}
-#else
 #define LOG(level, ...) \
 	{ \
-		fprintf(LOG_OUTPUT, level); \
-		fprintf(LOG_OUTPUT, "<%s in %s:%d> ", __FUNCTION__, __FILE__, __LINE__); \
-		fprintf(LOG_OUTPUT, __VA_ARGS__); \
-		fprintf(LOG_OUTPUT, "\n"); \
-		fflush(LOG_OUTPUT); \
+		if (LOG_ENABLED(level)) { \
+			log_message(level, __FUNCTION__, __FILE__, __LINE__, \
+				    __VA_ARGS__); \
+		} \
 	}
-#endif
 
 /**
  * @brief Logs a debug level message at the log output.
  * @param ... va_args like in printf.
  * @see printf
  */
-#define DEBUG(...)   LOG("DEBUG   ", __VA_ARGS__)
+#define DEBUG(...)   LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
 
 /**
  * @brief Logs a error level message at the log output.
  * @param ... va_args like in printf.
  * @see printf
  */
-#define ERROR(...)   LOG("ERROR   ", __VA_ARGS__)
+#define ERROR(...)   LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
 
 /**
  * @brief Logs a warning level message at the log output.
  * @param ... va_args like in printf.
  * @see printf
  */
-#define WARNING(...) LOG("WARNING ", __VA_ARGS__)
+#define WARNING(...) LOG(LOG_LEVEL_WARNING, __VA_ARGS__)
 
 /**
  * @brief Logs a information level message at the log output.
  * @param ... va_args like in printf.
  * @see printf
  */
-#define INFO(...)    LOG("INFO    ", __VA_ARGS__)
+#define INFO(...)    LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+
+void log_message(int level, const char *function, const char *file,
+		 int line, const char *format, ...)
+	__attribute__((format(printf, 5, 6)));
+
+void log_set_level(int level);
+
+int log_get_level();
+
+void log_set_output(FILE *output);
+
+int log_async_start();
+
+void log_async_stop();
 
 #endif /* LOG_H_ */
@@ -0,0 +1,122 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file pool.c
+ * \brief Free lists of fixed-size objects
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+/**
+ * \addtogroup Utility
+ *
+ * Objects that come and go with connections (contexts, state machines,
+ * services) are kept in pools when released, so that reconnection
+ * storms reuse memory instead of going through the allocator.
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "src/util/pool.h"
+
+/**
+ * Gets a zeroed object, from the pool if any is kept
+ *
+ * @param pool pool
+ * @return object, NULL if out of memory
+ */
+void *pool_alloc(ObjectPool *pool)
+{
+	void *object;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	object = pool->free_list;
+
+	if (!object) {
+		++pool->misses;
+		pthread_mutex_unlock(&pool->mutex);
+		return calloc(1, pool->size);
+	}
+
+	pool->free_list = *((void **) object);
+	--pool->count;
+	++pool->hits;
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	memset(object, 0, pool->size);
+
+	return object;
+}
+
+/**
+ * Releases an object, keeping it if the pool is not full
+ *
+ * @param pool pool
+ * @param object object taken from pool_alloc(), or NULL
+ */
+void pool_free(ObjectPool *pool, void *object)
+{
+	if (!object) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (pool->count >= pool->capacity) {
+		pthread_mutex_unlock(&pool->mutex);
+		free(object);
+		return;
+	}
+
+	*((void **) object) = pool->free_list;
+	pool->free_list = object;
+	++pool->count;
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Frees all objects kept by the pool
+ *
+ * @param pool pool
+ */
+void pool_drain(ObjectPool *pool)
+{
+	void *object;
+
+	pthread_mutex_lock(&pool->mutex);
+	object = pool->free_list;
+	pool->free_list = NULL;
+	pool->count = 0;
+	pthread_mutex_unlock(&pool->mutex);
+
+	while (object) {
+		void *next = *((void **) object);
+		free(object);
+		object = next;
+	}
+}
+
+/** @} */
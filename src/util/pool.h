@@ -0,0 +1,82 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file pool.h
+ * \brief Free lists of fixed-size objects
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ */
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+ * Pool of released objects of one size, kept for reuse instead of
+ * being returned to the allocator. At most capacity objects are kept;
+ * the rest are freed. Pools may be used from any thread; the mutex is
+ * held for a few instructions only, never across the allocator.
+ */
+typedef struct ObjectPool {
+	/**
+	 * Object size, at least the size of a pointer
+	 */
+	size_t size;
+
+	/**
+	 * Most objects kept
+	 */
+	unsigned int capacity;
+
+	/**
+	 * Objects kept
+	 */
+	unsigned int count;
+
+	/**
+	 * Kept objects, linked through their first word
+	 */
+	void *free_list;
+
+	/**
+	 * Allocations served from the pool and from the allocator
+	 */
+	unsigned long long hits;
+	unsigned long long misses;
+
+	pthread_mutex_t mutex;
+} ObjectPool;
+
+/**
+ * Static initializer of an empty pool of objects of type t
+ */
+#define OBJECT_POOL_INIT(t, capacity) \
+	{sizeof(t), (capacity), 0, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER}
+
+void *pool_alloc(ObjectPool *pool);
+
+void pool_free(ObjectPool *pool, void *object);
+
+void pool_drain(ObjectPool *pool);
+
+#endif /* POOL_H_ */
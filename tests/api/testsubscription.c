@@ -0,0 +1,217 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testsubscription.c
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testsubscription.h"
+#include "apps/healthd_subscription.h"
+#include "src/api/data_encoder.h"
+#include "src/api/data_list.h"
+#include "src/dim/mds.h"
+#include "src/dim/nomenclature.h"
+#include "src/specializations/blood_pressure_monitor.h"
+#include "Basic.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* MDC_PRESS_BLD_NONINV_SYS */
+#define METRIC_SYS 18949
+
+int testsubscription_init_suite(void)
+{
+	return 0;
+}
+
+int testsubscription_finish_suite(void)
+{
+	return 0;
+}
+
+void testsubscription_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Subscription Test Suite",
+				       testsubscription_init_suite,
+				       testsubscription_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_subscription_parse", test_subscription_parse);
+	CU_add_test(suite, "test_subscription_match", test_subscription_match);
+	CU_add_test(suite, "test_subscription_metrics",
+		    test_subscription_metrics);
+	/* Add tests here - End */
+}
+
+void test_subscription_parse()
+{
+	healthd_subscription *sub;
+
+	sub = healthd_subscription_new(NULL);
+	CU_ASSERT_PTR_NOT_NULL(sub);
+	if (sub) {
+		CU_ASSERT_EQUAL(sub->events, HEALTHD_EVT_ALL);
+		CU_ASSERT_EQUAL(sub->addr_count, 0);
+		CU_ASSERT_EQUAL(sub->system_id_count, 0);
+		CU_ASSERT_EQUAL(sub->metric_count, 0);
+	}
+	healthd_subscription_del(sub);
+
+	sub = healthd_subscription_new("events=associated,MEASUREMENT "
+				       "addr=00:11:22:33:44:55 "
+				       "sysid=0011223344556677,AABB\t"
+				       "metric=18949,0x4a05");
+	CU_ASSERT_PTR_NOT_NULL(sub);
+	if (sub) {
+		CU_ASSERT_EQUAL(sub->events, HEALTHD_EVT_ASSOCIATED
+					     | HEALTHD_EVT_MEASUREMENT);
+		CU_ASSERT_EQUAL(sub->addr_count, 1);
+		CU_ASSERT_STRING_EQUAL(sub->addrs[0], "00:11:22:33:44:55");
+		CU_ASSERT_EQUAL(sub->system_id_count, 2);
+		CU_ASSERT_STRING_EQUAL(sub->system_ids[1], "AABB");
+		CU_ASSERT_EQUAL(sub->metric_count, 2);
+		CU_ASSERT_EQUAL(sub->metric_ids[0], METRIC_SYS);
+		CU_ASSERT_EQUAL(sub->metric_ids[1], 0x4a05);
+	}
+	healthd_subscription_del(sub);
+
+	sub = healthd_subscription_new("events=NONE");
+	CU_ASSERT_PTR_NOT_NULL(sub);
+	if (sub) {
+		CU_ASSERT_EQUAL(sub->events, 0);
+	}
+	healthd_subscription_del(sub);
+
+	CU_ASSERT_PTR_NULL(healthd_subscription_new("events=BOGUS"));
+	CU_ASSERT_PTR_NULL(healthd_subscription_new("colour=red"));
+	CU_ASSERT_PTR_NULL(healthd_subscription_new("metric"));
+	CU_ASSERT_PTR_NULL(healthd_subscription_new("metric=12x"));
+	CU_ASSERT_PTR_NULL(healthd_subscription_new("metric=65536"));
+}
+
+void test_subscription_match()
+{
+	healthd_subscription *sub;
+	unsigned int metrics[] = {MDC_MASS_BODY_ACTUAL};
+	healthd_event evt;
+
+	memset(&evt, 0, sizeof(evt));
+	evt.type = HEALTHD_EVT_MEASUREMENT;
+	evt.low_addr = "00:11:22:33:44:55";
+	evt.system_id = "0011223344556677";
+	evt.metric_ids = metrics;
+	evt.metric_count = 1;
+
+	CU_ASSERT_EQUAL(healthd_subscription_match(NULL, &evt), 1);
+
+	sub = healthd_subscription_new("events=CONNECTED");
+	CU_ASSERT_EQUAL(healthd_subscription_match(sub, &evt), 0);
+	healthd_subscription_del(sub);
+
+	sub = healthd_subscription_new("addr=00:11:22:33:44:66,"
+				       "00:11:22:33:44:55");
+	CU_ASSERT_EQUAL(healthd_subscription_match(sub, &evt), 1);
+	healthd_subscription_del(sub);
+
+	// hex digits in any case
+	sub = healthd_subscription_new("sysid=0011223344556677");
+	CU_ASSERT_EQUAL(healthd_subscription_match(sub, &evt), 1);
+	evt.system_id = "00112233445566FF";
+	CU_ASSERT_EQUAL(healthd_subscription_match(sub, &evt), 0);
+	// not associated yet
+	evt.system_id = NULL;
+	CU_ASSERT_EQUAL(healthd_subscription_match(sub, &evt), 0);
+	healthd_subscription_del(sub);
+
+	sub = healthd_subscription_new("sysid=00112233445566ff");
+	evt.system_id = "00112233445566FF";
+	CU_ASSERT_EQUAL(healthd_subscription_match(sub, &evt), 1);
+	healthd_subscription_del(sub);
+
+	sub = healthd_subscription_new("metric=18949");
+	CU_ASSERT_EQUAL(healthd_subscription_match(sub, &evt), 0);
+	metrics[0] = METRIC_SYS;
+	CU_ASSERT_EQUAL(healthd_subscription_match(sub, &evt), 1);
+	// metrics only restrict events with observations
+	evt.type = HEALTHD_EVT_ASSOCIATED;
+	evt.metric_count = 0;
+	CU_ASSERT_EQUAL(healthd_subscription_match(sub, &evt), 1);
+	healthd_subscription_del(sub);
+}
+
+void test_subscription_metrics()
+{
+	struct MDS_object object;
+	DataList *list = data_list_new(3);
+	MDS *mds = mds_create();
+	healthd_event evt;
+	intu16 value = 70;
+
+	memset(&object, 0, sizeof(object));
+	object.obj_handle = 1;
+	object.choice = MDS_OBJ_METRIC;
+	object.u.metric.choice = METRIC_NUMERIC;
+	object.u.metric.u.numeric.metric.type.code = MDC_MASS_BODY_ACTUAL;
+	mds_add_object(mds, object);
+
+	memset(&object, 0, sizeof(object));
+	object.obj_handle = 2;
+	object.choice = MDS_OBJ_METRIC;
+	object.u.metric.choice = METRIC_ENUM;
+	object.u.metric.u.enumeration.metric.type.code = MDC_PULS_RATE_NON_INV;
+	mds_add_object(mds, object);
+
+	// simple observations carry only the metric handle
+	data_set_intu16(&list->values[0], "Basic-Nu-Observed-Value", &value);
+	data_meta_set_handle(&list->values[0], 1);
+	data_set_intu16(&list->values[1], "Enum-Observed-Value", &value);
+	data_meta_set_handle(&list->values[1], 2);
+	// compound ones, metric-ids; the handle of nothing is ignored
+	data_set_intu16(&list->values[2], "Compound-Observed-Value", &value);
+	data_set_meta_att(&list->values[2], data_strcp("metric-id"),
+			  data_strcp("18949"));
+	data_meta_set_handle(&list->values[2], 99);
+
+	memset(&evt, 0, sizeof(evt));
+	evt.type = HEALTHD_EVT_MEASUREMENT;
+
+	healthd_event_set_metrics(&evt, list, NULL);
+	CU_ASSERT_EQUAL(evt.metric_count, 1);
+	CU_ASSERT_EQUAL(evt.metric_ids[0], METRIC_SYS);
+	healthd_event_clear(&evt);
+
+	evt.type = HEALTHD_EVT_MEASUREMENT;
+	healthd_event_set_metrics(&evt, list, mds);
+	CU_ASSERT_EQUAL(evt.metric_count, 3);
+	if (evt.metric_count == 3) {
+		CU_ASSERT_EQUAL(evt.metric_ids[0], MDC_MASS_BODY_ACTUAL);
+		CU_ASSERT_EQUAL(evt.metric_ids[1], MDC_PULS_RATE_NON_INV);
+		CU_ASSERT_EQUAL(evt.metric_ids[2], METRIC_SYS);
+	}
+	healthd_event_clear(&evt);
+
+	data_list_del(list);
+	mds_destroy(mds);
+}
+
+#endif
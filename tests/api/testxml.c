@@ -30,6 +30,8 @@
 #include "Basic.h"
 #include "src/util/strbuff.h"
 #include "src/api/xml_encoder.h"
+#include "src/api/data_encoder.h"
+#include "src/api/data_list.h"
 #include "tests/functional_test_cases/test_functional.h"
 #include "testxml.h"
 #include "src/util/log.h"
@@ -54,6 +56,10 @@ void testxml_add_suite()
 
 	/* Add tests here - Start */
 	CU_add_test(suite, "test_xml_1", test_xml_1);
+	CU_add_test(suite, "test_xml_data_list_clone",
+		    test_xml_data_list_clone);
+	CU_add_test(suite, "test_xml_data_list_ref",
+		    test_xml_data_list_ref);
 	/* Add tests here - End */
 }
 
@@ -170,4 +176,61 @@ void test_xml_1()
 	DEBUG("test_xml_1");
 }
 
+void test_xml_data_list_clone()
+{
+	AbsoluteTime time = {0x20, 0x12, 0x04, 0x18, 0x10, 0x30, 0x45, 0x00};
+	intu16 value = 1234;
+
+	DataList *list = data_list_new(2);
+	data_meta_set_handle(&list->values[0], 5);
+	data_set_intu16(&list->values[0], "value", &value);
+	data_set_absolute_time(&list->values[1], "timestamp", &time);
+
+	DataList *copy = data_list_clone(list);
+	CU_ASSERT_PTR_NOT_NULL(copy);
+	CU_ASSERT_EQUAL(copy->size, 2);
+	CU_ASSERT_NOT_EQUAL(copy->values, list->values);
+
+	char *a = xml_encode_data_list(list);
+	data_list_del(list);
+
+	// copy must survive deletion of the original
+	char *b = xml_encode_data_list(copy);
+	CU_ASSERT_STRING_EQUAL(a, b);
+
+	data_list_del(copy);
+	free(a);
+	free(b);
+
+	CU_ASSERT_PTR_NULL(data_list_clone(NULL));
+}
+
+void test_xml_data_list_ref()
+{
+	intu16 value = 1234;
+
+	DataList *list = data_list_new(1);
+	data_set_intu16(&list->values[0], "value", &value);
+	char *a = xml_encode_data_list(list);
+
+	CU_ASSERT_PTR_EQUAL(data_list_ref(list), list);
+	CU_ASSERT_PTR_EQUAL(data_list_ref(list), list);
+
+	// two references left, list is shared, not copied
+	data_list_del(list);
+	char *b = xml_encode_data_list(list);
+	CU_ASSERT_STRING_EQUAL(a, b);
+	free(b);
+
+	data_list_del(list);
+	b = xml_encode_data_list(list);
+	CU_ASSERT_STRING_EQUAL(a, b);
+	free(b);
+
+	data_list_del(list);
+	free(a);
+
+	CU_ASSERT_PTR_NULL(data_list_ref(NULL));
+}
+
 #endif
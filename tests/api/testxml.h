@@ -34,6 +34,8 @@
 void testxml_add_suite(void);
 void testxml_test();
 void test_xml_1();
+void test_xml_data_list_clone();
+void test_xml_data_list_ref();
 
 #endif /* TEST_ENABLED */
 
@@ -41,6 +41,8 @@
 #include "testextconfiguration.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 int test_ext_configuration_init_suite(void)
 {
@@ -59,6 +61,7 @@ void testextconfiguration_add_suite()
 
 	/* Add tests here - Start */
 	CU_add_test(suite, "test_extconfiguration_persistent_config", test_extconfiguration_persistent_config);
+	CU_add_test(suite, "test_extconfiguration_shared_index", test_extconfiguration_shared_index);
 
 	/* Add tests here - End */
 }
@@ -287,4 +290,44 @@ void test_extconfiguration_persistent_config()
 	free(glu_object_list);
 
 }
+void test_extconfiguration_shared_index()
+{
+	intu8 sys_id_buffer[] = {0x00, 0x22, 0x09, 0x22, 0x58, 0x07, 0xe8, 0x99};
+	octet_string sys_id = {8, sys_id_buffer};
+	ConfigObjectList empty_object_list = {0, 0, NULL};
+	ConfigObjectList *result;
+	int status = -1;
+	pid_t pid;
+
+	ext_configurations_remove_all_configs();
+	ext_configurations_load_configurations();
+	CU_ASSERT(!ext_configurations_is_supported_standard(&sys_id, 0x4242));
+
+	// another manager process sharing the directory learns it
+	pid = fork();
+
+	if (pid == 0) {
+		ext_configurations_register_conf(&sys_id, 0x4242,
+						 &empty_object_list);
+		_exit(0);
+	}
+
+	CU_ASSERT(pid > 0);
+	waitpid(pid, &status, 0);
+	CU_ASSERT_EQUAL(status, 0);
+
+	CU_ASSERT(ext_configurations_is_supported_standard(&sys_id, 0x4242));
+
+	result = ext_configurations_get_configuration_attributes(&sys_id, 0x4242);
+	CU_ASSERT(result != NULL);
+
+	if (result) {
+		CU_ASSERT_EQUAL(result->count, 0);
+		del_configobjectlist(result);
+		free(result);
+	}
+
+	ext_configurations_remove_all_configs();
+}
+
 #endif
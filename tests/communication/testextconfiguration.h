@@ -33,6 +33,7 @@
 
 void testextconfiguration_add_suite();
 void test_extconfiguration_persistent_config();
+void test_extconfiguration_shared_index();
 
 #endif /* TEST_ENABLED */
 
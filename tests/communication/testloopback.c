@@ -0,0 +1,762 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testloopback.c
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testloopback.h"
+#include "src/manager.h"
+#include "src/agent.h"
+#include "src/api/data_list.h"
+#include "src/communication/communication.h"
+#include "src/communication/context_manager.h"
+#include "src/communication/plugin/plugin_loopback.h"
+#include "src/communication/plugin/plugin_unix.h"
+#include "src/communication/trace.h"
+#include "src/dim/mds.h"
+#include "src/specializations/blood_pressure_monitor.h"
+#include "src/util/arena.h"
+#include "src/util/ioutil.h"
+#include "Basic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOOPBACK_CHANNELS 2
+
+static CommunicationPlugin agent_plugin;
+static CommunicationPlugin manager_plugin;
+
+static int associated = 0;
+static int unavailable = 0;
+static int measurements = 0;
+static DataList *last_measurement = NULL;
+
+static void *loopback_event_report_cb()
+{
+	struct blood_pressure_event_report_data *data =
+		calloc(1, sizeof(struct blood_pressure_event_report_data));
+
+	data->systolic = 120;
+	data->diastolic = 80;
+	data->mean = 93;
+	data->pulse_rate = 70;
+
+	return data;
+}
+
+static struct mds_system_data *loopback_mds_data_cb()
+{
+	struct mds_system_data *data = calloc(1, sizeof(struct mds_system_data));
+	data->system_id[7] = 0x42;
+	return data;
+}
+
+static void loopback_associated(Context *ctx)
+{
+	++associated;
+}
+
+static void loopback_unavailable(Context *ctx)
+{
+	++unavailable;
+}
+
+static void loopback_measurement(Context *ctx, DataList *list)
+{
+	data_list_del(last_measurement);
+	last_measurement = data_list_ref(list);
+	++measurements;
+}
+
+static ContextId agent_context(int channel)
+{
+	ContextId id = {communication_plugin_id(&agent_plugin), channel};
+	return id;
+}
+
+static ContextId manager_context(int channel)
+{
+	ContextId id = {communication_plugin_id(&manager_plugin), channel};
+	return id;
+}
+
+static Context *lookup(ContextId id)
+{
+	Context *ctx = context_get_and_lock(id);
+
+	if (ctx) {
+		context_unlock(ctx);
+	}
+
+	return ctx;
+}
+
+int test_loopback_init_suite(void)
+{
+	CommunicationPlugin *agent_plugins[] = {&agent_plugin, 0};
+	CommunicationPlugin *manager_plugins[] = {&manager_plugin, 0};
+	ManagerListener mlistener = MANAGER_LISTENER_EMPTY;
+	AgentListener alistener = AGENT_LISTENER_EMPTY;
+
+	agent_plugin = communication_plugin();
+	manager_plugin = communication_plugin();
+	plugin_network_loopback_setup(&agent_plugin, &manager_plugin,
+				      LOOPBACK_CHANNELS);
+
+	manager_init(manager_plugins);
+	agent_init(agent_plugins, 0x02BC, loopback_event_report_cb,
+		   loopback_mds_data_cb);
+
+	mlistener.measurement_data_updated = &loopback_measurement;
+	manager_add_listener(mlistener);
+
+	alistener.device_associated = &loopback_associated;
+	alistener.device_unavailable = &loopback_unavailable;
+	agent_add_listener(alistener);
+
+	manager_start();
+	return 0;
+}
+
+int test_loopback_finish_suite(void)
+{
+	manager_stop();
+	agent_finalize();
+	manager_finalize();
+	data_list_del(last_measurement);
+	last_measurement = NULL;
+	return 0;
+}
+
+void testloopback_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Loopback Plugin Test Suite",
+				       test_loopback_init_suite,
+				       test_loopback_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_loopback_association",
+		    test_loopback_association);
+	CU_add_test(suite, "test_loopback_event_report",
+		    test_loopback_event_report);
+	CU_add_test(suite, "test_loopback_stats",
+		    test_loopback_stats);
+	CU_add_test(suite, "test_loopback_trace", test_loopback_trace);
+	CU_add_test(suite, "test_loopback_locks", test_loopback_locks);
+	CU_add_test(suite, "test_loopback_event_queue",
+		    test_loopback_event_queue);
+	CU_add_test(suite, "test_loopback_instances",
+		    test_loopback_instances);
+	CU_add_test(suite, "test_loopback_unix", test_loopback_unix);
+	CU_add_test(suite, "test_loopback_release",
+		    test_loopback_release);
+	CU_add_test(suite, "test_loopback_warm_mds",
+		    test_loopback_warm_mds);
+	CU_add_test(suite, "test_loopback_deferred_teardown",
+		    test_loopback_deferred_teardown);
+	/* Add tests here - End */
+}
+
+void test_loopback_association(void)
+{
+	int ch;
+
+	for (ch = 1; ch <= LOOPBACK_CHANNELS; ++ch) {
+		CU_ASSERT_EQUAL(plugin_network_loopback_connect(ch), 1);
+		CU_ASSERT_PTR_NOT_NULL(lookup(agent_context(ch)));
+		CU_ASSERT_PTR_NOT_NULL(lookup(manager_context(ch)));
+		agent_associate(agent_context(ch));
+	}
+
+	// channel already up
+	CU_ASSERT_EQUAL(plugin_network_loopback_connect(1), 0);
+	// no such channel
+	CU_ASSERT_EQUAL(plugin_network_loopback_connect(LOOPBACK_CHANNELS + 1), 0);
+
+	CU_ASSERT(plugin_network_loopback_pump() > 0);
+	CU_ASSERT_EQUAL(associated, LOOPBACK_CHANNELS);
+	CU_ASSERT_EQUAL(lookup(agent_context(1))->fsm->state,
+			fsm_state_operating);
+	CU_ASSERT_EQUAL(lookup(manager_context(1))->fsm->state,
+			fsm_state_operating);
+
+	// nothing left in flight
+	CU_ASSERT_EQUAL(plugin_network_loopback_pump(), 0);
+}
+
+void test_loopback_event_report(void)
+{
+	Context *ctx;
+	int ch;
+
+	for (ch = 1; ch <= LOOPBACK_CHANNELS; ++ch) {
+		agent_send_data(agent_context(ch));
+		agent_send_data(agent_context(ch));
+	}
+
+	// report and confirmation on each channel
+	CU_ASSERT_EQUAL(plugin_network_loopback_pump(), 4 * LOOPBACK_CHANNELS);
+	CU_ASSERT_EQUAL(measurements, 2 * LOOPBACK_CHANNELS);
+
+	// kept by the listener after the stack dropped its reference
+	CU_ASSERT_PTR_NOT_NULL(last_measurement);
+	if (last_measurement) {
+		CU_ASSERT(last_measurement->size > 0);
+		CU_ASSERT_EQUAL(last_measurement->refs, 0);
+	}
+
+	// reports were decoded into the arena, released after each one
+	ctx = lookup(manager_context(1));
+	CU_ASSERT_PTR_NOT_NULL(ctx);
+	if (ctx) {
+		CU_ASSERT_PTR_NOT_NULL(ctx->scratch);
+		CU_ASSERT(ctx->scratch->peak > 0);
+		CU_ASSERT_EQUAL(ctx->scratch->used, 0);
+	}
+}
+
+void test_loopback_stats(void)
+{
+	CommunicationStats mgr;
+	CommunicationStats agt;
+	CommunicationStats global;
+	LatencySummary latency;
+
+	CU_ASSERT_EQUAL(manager_get_context_stats(manager_context(1), &mgr), 1);
+	CU_ASSERT_EQUAL(manager_get_context_stats(agent_context(1), &agt), 1);
+	manager_get_stats(&global);
+
+	CU_ASSERT_EQUAL(mgr.apdus_in[STATS_APDU_AARQ], 1);
+	CU_ASSERT_EQUAL(mgr.apdus_out[STATS_APDU_AARE], 1);
+	CU_ASSERT_EQUAL(mgr.apdus_in[STATS_APDU_ROIV], 2);
+	CU_ASSERT_EQUAL(mgr.apdus_out[STATS_APDU_RORS], 2);
+	CU_ASSERT_EQUAL(agt.apdus_out[STATS_APDU_ROIV], 2);
+	CU_ASSERT_EQUAL(agt.apdus_in[STATS_APDU_RORS], 2);
+
+	CU_ASSERT_EQUAL(mgr.bytes_in, agt.bytes_out);
+	CU_ASSERT_EQUAL(mgr.bytes_out, agt.bytes_in);
+	CU_ASSERT_EQUAL(mgr.decode_errors, 0);
+	CU_ASSERT(mgr.fsm_transitions > 0);
+	CU_ASSERT_EQUAL(agt.requests_pending, 0);
+
+	CU_ASSERT(global.apdus_in[STATS_APDU_ROIV] >= 2 * LOOPBACK_CHANNELS);
+	CU_ASSERT(global.bytes_in >= mgr.bytes_in + agt.bytes_in);
+
+	CU_ASSERT_EQUAL(manager_get_context_stats(manager_context(
+				LOOPBACK_CHANNELS + 1), &mgr), 0);
+
+	manager_get_latency(STATS_LATENCY_ASSOCIATION, &latency);
+	CU_ASSERT(latency.count >= LOOPBACK_CHANNELS);
+	CU_ASSERT(latency.p50 > 0);
+	CU_ASSERT(latency.p50 <= latency.p99);
+	CU_ASSERT(latency.p99 <= latency.max);
+
+	manager_get_latency(STATS_LATENCY_CONFIRMED_EVENT_REPORT, &latency);
+	CU_ASSERT(latency.count >= 2 * LOOPBACK_CHANNELS);
+	CU_ASSERT_EQUAL(manager_get_latency_percentile(
+				STATS_LATENCY_CONFIRMED_EVENT_REPORT, 50.0),
+			latency.p50);
+}
+
+void test_loopback_trace(void)
+{
+	char path[300];
+	char *tmp = ioutil_get_tmp();
+	static char json[256 * 1024];
+	FILE *f;
+	size_t size;
+
+	mkdirp(tmp, 0755);
+	snprintf(path, sizeof(path), "%sloopback_trace_test.json", tmp);
+	free(tmp);
+
+	trace_start();
+	agent_send_data(agent_context(1));
+	plugin_network_loopback_pump();
+	trace_stop();
+
+	// not recorded
+	agent_send_data(agent_context(1));
+	plugin_network_loopback_pump();
+
+	CU_ASSERT_EQUAL(trace_dump(path), 1);
+	f = fopen(path, "r");
+	CU_ASSERT_PTR_NOT_NULL(f);
+
+	if (f) {
+		size = fread(json, 1, sizeof(json) - 1, f);
+		json[size] = '\0';
+		fclose(f);
+
+		CU_ASSERT(strncmp(json, "{\"displayTimeUnit\"", 18) == 0);
+		CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\":\"send\""));
+		CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\":\"encode\""));
+		CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\":\"receive\""));
+		CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\":\"decode\""));
+		CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\":\"listener\""));
+		CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"tid\":1,"));
+		CU_ASSERT_PTR_NULL(strstr(json, "\"tid\":2,"));
+	}
+
+	unlink(path);
+}
+
+static unsigned long long lock_acquisitions()
+{
+	LockSiteStats sites[64];
+	unsigned long long total = 0;
+	int count = manager_get_lock_sites(STATS_LOCK_BY_WAIT, sites, 64);
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		total += sites[i].wait.count;
+	}
+
+	return total;
+}
+
+void test_loopback_locks(void)
+{
+	LockSiteStats sites[64];
+	unsigned long long total;
+	int count;
+	int gil = 0;
+	int i;
+
+	manager_set_lock_profiling(1);
+	agent_send_data(agent_context(1));
+	plugin_network_loopback_pump();
+	manager_set_lock_profiling(0);
+
+	count = manager_get_lock_sites(STATS_LOCK_BY_HOLD, sites, 64);
+
+#ifdef SINGLE_THREAD
+	// no locks to profile
+	CU_ASSERT_EQUAL(count, 0);
+	return;
+#endif
+
+	CU_ASSERT(count > 1);
+
+	for (i = 0; i < count; ++i) {
+		gil += sites[i].gil;
+		CU_ASSERT_PTR_NOT_NULL(strstr(sites[i].file, ".c"));
+		CU_ASSERT(sites[i].line > 0);
+		CU_ASSERT(sites[i].wait.count > 0);
+		// everything taken was released
+		CU_ASSERT_EQUAL(sites[i].hold.count, sites[i].wait.count);
+
+		if (i > 0) {
+			CU_ASSERT(sites[i - 1].hold.sum >= sites[i].hold.sum);
+		}
+	}
+
+	// finding a context takes the lock of its manager instance, the
+	// GIL is left to the configuration store
+	CU_ASSERT_EQUAL(gil, 0);
+	CU_ASSERT_EQUAL(manager_get_lock_sites(STATS_LOCK_BY_WAIT, sites, 1), 1);
+
+	// not recorded
+	total = lock_acquisitions();
+	agent_send_data(agent_context(1));
+	plugin_network_loopback_pump();
+	CU_ASSERT_EQUAL(lock_acquisitions(), total);
+
+	// threading mode is fixed once the network is up
+	CU_ASSERT_EQUAL(communication_set_single_thread(1), 0);
+	CU_ASSERT_EQUAL(communication_set_single_thread(0), 1);
+}
+
+void test_loopback_event_queue(void)
+{
+	int before = measurements;
+	ManagerEvent *evt;
+
+	CU_ASSERT_EQUAL(manager_event_queue_fd(), -1);
+	CU_ASSERT_EQUAL(manager_event_queue_start(16), 1);
+	CU_ASSERT(manager_event_queue_fd() >= 0);
+	CU_ASSERT_PTR_NULL(manager_event_queue_pop());
+
+	agent_send_data(agent_context(1));
+	agent_send_data(agent_context(2));
+	plugin_network_loopback_pump();
+
+	// queued instead of given to listeners
+	CU_ASSERT_EQUAL(measurements, before);
+	CU_ASSERT_EQUAL(manager_event_queue_wait(0), 1);
+
+	evt = manager_event_queue_pop();
+	CU_ASSERT_PTR_NOT_NULL(evt);
+	if (evt) {
+		CU_ASSERT_EQUAL(evt->type, MANAGER_EVT_MEASUREMENT_DATA_UPDATED);
+		CU_ASSERT_EQUAL(evt->id.plugin, manager_context(1).plugin);
+		CU_ASSERT_EQUAL(evt->id.connid, 1);
+		CU_ASSERT_PTR_NOT_NULL(evt->list);
+		manager_event_del(evt);
+	}
+
+	evt = manager_event_queue_pop();
+	CU_ASSERT_PTR_NOT_NULL(evt);
+	if (evt) {
+		CU_ASSERT_EQUAL(evt->id.connid, 2);
+		manager_event_del(evt);
+	}
+
+	CU_ASSERT_PTR_NULL(manager_event_queue_pop());
+	CU_ASSERT_EQUAL(manager_event_queue_dropped(), 0);
+
+	// left in the queue, deleted when it stops
+	agent_send_data(agent_context(1));
+	plugin_network_loopback_pump();
+	manager_event_queue_stop();
+	CU_ASSERT_EQUAL(manager_event_queue_fd(), -1);
+
+	agent_send_data(agent_context(1));
+	plugin_network_loopback_pump();
+	CU_ASSERT_EQUAL(measurements, before + 1);
+}
+
+static int instance_connected = 0;
+
+static int instance_device_connected(Context *ctx, const char *addr)
+{
+	++instance_connected;
+	return 1;
+}
+
+void test_loopback_instances(void)
+{
+	CommunicationPlugin plugin = communication_plugin();
+	CommunicationPlugin *plugins[] = {&plugin, 0};
+	ManagerListener listener = MANAGER_LISTENER_EMPTY;
+	ManagerInstance *m;
+	ContextId id;
+	int before = measurements;
+
+	m = manager_instance_new(plugins);
+	CU_ASSERT_PTR_NOT_NULL(m);
+	if (!m) {
+		return;
+	}
+
+	listener.device_connected = &instance_device_connected;
+	CU_ASSERT_EQUAL(manager_instance_add_listener(m, listener), 1);
+	manager_instance_start(m);
+
+	id.plugin = communication_plugin_id(&plugin);
+	id.connid = 7;
+	CU_ASSERT(id.plugin > manager_context(1).plugin);
+	CU_ASSERT_PTR_NOT_NULL(communication_transport_connect_indication(id,
+								      "test"));
+	CU_ASSERT_EQUAL(instance_connected, 1);
+	CU_ASSERT_PTR_NOT_NULL(lookup(id));
+
+	// the default instance keeps serving its own contexts
+	agent_send_data(agent_context(1));
+	plugin_network_loopback_pump();
+	CU_ASSERT_EQUAL(measurements, before + 1);
+
+	manager_instance_free(m);
+	CU_ASSERT_PTR_NULL(lookup(id));
+	CU_ASSERT_PTR_NOT_NULL(lookup(manager_context(1)));
+	CU_ASSERT_PTR_NOT_NULL(lookup(manager_context(2)));
+
+	agent_send_data(agent_context(2));
+	plugin_network_loopback_pump();
+	CU_ASSERT_EQUAL(measurements, before + 2);
+	CU_ASSERT_EQUAL(instance_connected, 1);
+}
+
+static ByteStreamWriter *unix_apdu(intu16 choice, intu16 length)
+{
+	ByteStreamWriter *w = byte_stream_writer_instance(length + 4);
+	int i;
+
+	write_intu16(w, choice);
+	write_intu16(w, length);
+
+	for (i = 0; i < length; ++i) {
+		write_intu8(w, i & 0xff);
+	}
+
+	return w;
+}
+
+void test_loopback_unix(void)
+{
+	CommunicationPlugin mplugin = communication_plugin();
+	CommunicationPlugin aplugin = communication_plugin();
+	CommunicationPlugin *plugins[] = {&mplugin, 0};
+	ManagerInstance *m;
+	ByteStreamWriter *w1 = unix_apdu(0xE600, 2);
+	ByteStreamWriter *w2 = unix_apdu(0xE700, 300);
+	ByteStreamReader *r;
+	Context *actx;
+	Context *mctx;
+	ContextId aid;
+	ContextId mid;
+	char path[64];
+
+	snprintf(path, sizeof(path), "@antidote-test-%d", (int) getpid());
+
+	CU_ASSERT_EQUAL(plugin_network_unix_manager_setup(&mplugin, path),
+			NETWORK_ERROR_NONE);
+	m = manager_instance_new(plugins);
+	manager_instance_start(m);
+	CU_ASSERT(plugin_network_unix_listen_fd() >= 0);
+
+	CU_ASSERT_EQUAL(plugin_network_unix_agent_setup(&aplugin, path),
+			NETWORK_ERROR_NONE);
+	aplugin.type = AGENT_CONTEXT;
+	communication_add_plugin(&aplugin);
+	communication_plugin_network_start(&aplugin);
+
+	aid.plugin = communication_plugin_id(&aplugin);
+	aid.connid = 1;
+	actx = lookup(aid);
+	CU_ASSERT_PTR_NOT_NULL(actx);
+
+	CU_ASSERT_EQUAL(plugin_network_unix_accept(&mid), 1);
+	CU_ASSERT_EQUAL(mid.plugin, communication_plugin_id(&mplugin));
+	CU_ASSERT_EQUAL(mid.connid, 1);
+	mctx = lookup(mid);
+	CU_ASSERT_PTR_NOT_NULL(mctx);
+
+	if (actx && mctx) {
+		// back-to-back APDUs keep their boundaries
+		CU_ASSERT_EQUAL(aplugin.network_send_apdu_stream(actx, w1),
+				NETWORK_ERROR_NONE);
+		CU_ASSERT_EQUAL(aplugin.network_send_apdu_stream(actx, w2),
+				NETWORK_ERROR_NONE);
+
+		CU_ASSERT_EQUAL(mplugin.network_wait_for_data(mctx),
+				NETWORK_ERROR_NONE);
+		r = mplugin.network_get_apdu_stream(mctx);
+		CU_ASSERT_PTR_NOT_NULL(r);
+		if (r) {
+			CU_ASSERT_EQUAL(r->unread_bytes, 6);
+			CU_ASSERT_EQUAL(memcmp(r->buffer, w1->buffer, 6), 0);
+			del_byte_stream_reader(r, 1);
+		}
+
+		r = mplugin.network_get_apdu_stream(mctx);
+		CU_ASSERT_PTR_NOT_NULL(r);
+		if (r) {
+			CU_ASSERT_EQUAL(r->unread_bytes, 304);
+			CU_ASSERT_EQUAL(memcmp(r->buffer, w2->buffer, 304), 0);
+			del_byte_stream_reader(r, 1);
+		}
+
+		// peer hang-up removes the manager context
+		CU_ASSERT_EQUAL(aplugin.network_disconnect(actx),
+				NETWORK_ERROR_NONE);
+		CU_ASSERT_PTR_NULL(mplugin.network_get_apdu_stream(mctx));
+		CU_ASSERT_PTR_NULL(lookup(mid));
+	}
+
+	del_byte_stream_writer(w1, 1);
+	del_byte_stream_writer(w2, 1);
+
+	communication_remove_plugin(&aplugin);
+	manager_instance_free(m);
+	CU_ASSERT_EQUAL(plugin_network_unix_listen_fd(), -1);
+}
+
+void test_loopback_release(void)
+{
+	agent_request_association_release(agent_context(1));
+	plugin_network_loopback_pump();
+	CU_ASSERT_EQUAL(unavailable, 1);
+
+	plugin_network_loopback_disconnect(1);
+	CU_ASSERT_PTR_NULL(lookup(agent_context(1)));
+	CU_ASSERT_PTR_NULL(lookup(manager_context(1)));
+
+	// disconnection from one side reaches the other on next pump
+	agent_disconnect(agent_context(2));
+	plugin_network_loopback_pump();
+	CU_ASSERT_PTR_NULL(lookup(agent_context(2)));
+	CU_ASSERT_PTR_NULL(lookup(manager_context(2)));
+
+	// channel may be brought up again
+	CU_ASSERT_EQUAL(plugin_network_loopback_connect(1), 1);
+	plugin_network_loopback_disconnect(1);
+}
+
+void test_loopback_warm_mds(void)
+{
+	int kept = mds_cache_size();
+	int before = measurements;
+	Context *ctx;
+
+	// the MDS of the released device was kept (both channels share
+	// the same system id and configuration)
+	CU_ASSERT(kept >= 1);
+
+	associated = 0;
+	CU_ASSERT_EQUAL(plugin_network_loopback_connect(1), 1);
+	agent_associate(agent_context(1));
+	plugin_network_loopback_pump();
+
+	CU_ASSERT_EQUAL(associated, 1);
+	CU_ASSERT_EQUAL(mds_cache_size(), kept - 1);
+
+	ctx = lookup(manager_context(1));
+	CU_ASSERT_PTR_NOT_NULL(ctx);
+	if (ctx) {
+		CU_ASSERT_EQUAL(ctx->fsm->state, fsm_state_operating);
+		CU_ASSERT(ctx->mds->objects_list_count > 0);
+	}
+
+	agent_send_data(agent_context(1));
+	plugin_network_loopback_pump();
+	CU_ASSERT_EQUAL(measurements, before + 1);
+
+	plugin_network_loopback_disconnect(1);
+	CU_ASSERT_EQUAL(mds_cache_size(), kept);
+
+	mds_cache_set_capacity(0);
+	CU_ASSERT_EQUAL(mds_cache_size(), 0);
+	mds_cache_set_capacity(16);
+}
+
+static int teardown_batches = 0;
+static int teardown_devices = 0;
+static int teardown_inline = 0;
+
+static void loopback_devices_disconnected(ContextId *ids, int count)
+{
+	__atomic_add_fetch(&teardown_batches, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&teardown_devices, count, __ATOMIC_RELAXED);
+}
+
+static int loopback_device_disconnected(Context *ctx, const char *addr)
+{
+	++teardown_inline;
+	return 1;
+}
+
+/**
+ * Waits up to a second for the reclaimer thread to report batches
+ */
+static int wait_teardown_batches(int batches)
+{
+	int i;
+
+	for (i = 0; i < 100; ++i) {
+		if (__atomic_load_n(&teardown_batches, __ATOMIC_RELAXED)
+		    >= batches) {
+			break;
+		}
+		usleep(10000);
+	}
+
+	return __atomic_load_n(&teardown_batches, __ATOMIC_RELAXED);
+}
+
+static void loopback_connect_disconnect_all()
+{
+	int ch;
+
+	for (ch = 1; ch <= LOOPBACK_CHANNELS; ++ch) {
+		CU_ASSERT_EQUAL(plugin_network_loopback_connect(ch), 1);
+	}
+
+	for (ch = 1; ch <= LOOPBACK_CHANNELS; ++ch) {
+		plugin_network_loopback_disconnect(ch);
+	}
+}
+
+void test_loopback_deferred_teardown(void)
+{
+	ManagerListener listener = MANAGER_LISTENER_EMPTY;
+
+	listener.devices_disconnected = &loopback_devices_disconnected;
+	listener.device_disconnected = &loopback_device_disconnected;
+	manager_add_listener(listener);
+
+	communication_set_deferred_teardown(100);
+	CU_ASSERT_EQUAL(communication_is_teardown_deferred(), 1);
+
+	loopback_connect_disconnect_all();
+
+	// gone at once, destroyed later
+	CU_ASSERT_PTR_NULL(lookup(manager_context(1)));
+	CU_ASSERT_PTR_NULL(lookup(agent_context(2)));
+	CU_ASSERT_EQUAL(teardown_batches, 0);
+
+	// both sides of each channel
+	CU_ASSERT_EQUAL(communication_reclaim(), 2 * LOOPBACK_CHANNELS);
+	CU_ASSERT_EQUAL(teardown_batches, 1);
+	CU_ASSERT_EQUAL(teardown_devices, LOOPBACK_CHANNELS);
+	CU_ASSERT_EQUAL(communication_reclaim(), 0);
+
+	// the batch-th dead context triggers the reclaim
+	communication_set_deferred_teardown(2 * LOOPBACK_CHANNELS);
+
+	loopback_connect_disconnect_all();
+
+	CU_ASSERT_EQUAL(teardown_batches, 2);
+	CU_ASSERT_EQUAL(teardown_devices, 2 * LOOPBACK_CHANNELS);
+
+	// in the reclaimer thread, for a full batch
+	CU_ASSERT_EQUAL(communication_start_reclaimer(0), 1);
+	CU_ASSERT_EQUAL(communication_start_reclaimer(0), 0);
+
+	loopback_connect_disconnect_all();
+
+	CU_ASSERT_EQUAL(wait_teardown_batches(3), 3);
+	communication_stop_reclaimer();
+
+	// and periodically, for a partial one
+	communication_set_deferred_teardown(100);
+	CU_ASSERT_EQUAL(communication_start_reclaimer(10), 1);
+
+	loopback_connect_disconnect_all();
+
+	CU_ASSERT_EQUAL(wait_teardown_batches(4), 4);
+	communication_stop_reclaimer();
+	CU_ASSERT_EQUAL(teardown_devices, 4 * LOOPBACK_CHANNELS);
+
+	// batch listeners are not told one device at a time
+	CU_ASSERT_EQUAL(teardown_inline, 0);
+
+	// turning it off destroys what is left
+	CU_ASSERT_EQUAL(plugin_network_loopback_connect(1), 1);
+	plugin_network_loopback_disconnect(1);
+	communication_set_deferred_teardown(0);
+	CU_ASSERT_EQUAL(teardown_batches, 5);
+	CU_ASSERT_EQUAL(communication_reclaim(), 0);
+	CU_ASSERT_EQUAL(communication_is_teardown_deferred(), 0);
+
+	// and devices go one at a time again
+	CU_ASSERT_EQUAL(plugin_network_loopback_connect(1), 1);
+	plugin_network_loopback_disconnect(1);
+	CU_ASSERT_EQUAL(teardown_inline, 1);
+	CU_ASSERT_EQUAL(teardown_batches, 5);
+}
+
+#endif
@@ -0,0 +1,46 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testloopback.h
+ **********************************************************************/
+
+#ifndef TESTLOOPBACK_H_
+
+#ifdef TEST_ENABLED
+
+void testloopback_add_suite(void);
+void test_loopback_association(void);
+void test_loopback_event_report(void);
+void test_loopback_stats(void);
+void test_loopback_trace(void);
+void test_loopback_locks(void);
+void test_loopback_event_queue(void);
+void test_loopback_instances(void);
+void test_loopback_unix(void);
+void test_loopback_release(void);
+void test_loopback_warm_mds(void);
+void test_loopback_deferred_teardown(void);
+
+#endif
+
+#define TESTLOOPBACK_H_
+#endif /* TESTLOOPBACK_H_ */
@@ -0,0 +1,221 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testapducapture.c
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testapducapture.h"
+#include "src/util/apdu_capture.h"
+#include "src/util/ioutil.h"
+#include "Basic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char capture_path[256];
+
+int test_apdu_capture_init_suite(void)
+{
+	char *tmp = ioutil_get_tmp();
+	mkdirp(tmp, 0755);
+	snprintf(capture_path, sizeof(capture_path), "%sapdu_capture_test",
+		 tmp);
+	free(tmp);
+	return 0;
+}
+
+int test_apdu_capture_finish_suite(void)
+{
+	char path[300];
+	int i;
+
+	unlink(capture_path);
+	for (i = 1; i <= 3; ++i) {
+		snprintf(path, sizeof(path), "%s.%d", capture_path, i);
+		unlink(path);
+	}
+
+	return 0;
+}
+
+void testapducapture_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("APDU Capture Test Suite",
+				       test_apdu_capture_init_suite,
+				       test_apdu_capture_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_apdu_capture_round_trip",
+		    test_apdu_capture_round_trip);
+	CU_add_test(suite, "test_apdu_capture_rotation",
+		    test_apdu_capture_rotation);
+	CU_add_test(suite, "test_apdu_capture_idle_flush",
+		    test_apdu_capture_idle_flush);
+	CU_add_test(suite, "test_apdu_capture_not_a_capture",
+		    test_apdu_capture_not_a_capture);
+	/* Add tests here - End */
+}
+
+void test_apdu_capture_round_trip(void)
+{
+	intu8 rlrq[] = {0xE4, 0x00, 0x00, 0x02, 0x00, 0x00};
+	intu8 big[70000];
+	ApduCaptureReader *reader;
+	ApduCaptureRecord record;
+
+	memset(big, 0x5a, sizeof(big));
+
+	// not capturing: ignored
+	apdu_capture_record(1, 2, APDU_CAPTURE_SENT, rlrq, sizeof(rlrq));
+
+	CU_ASSERT_EQUAL(apdu_capture_start(capture_path, 0, 0), 1);
+	CU_ASSERT_EQUAL(apdu_capture_enabled(), 1);
+
+	apdu_capture_record(1, 6024, APDU_CAPTURE_RECEIVED, rlrq, sizeof(rlrq));
+	apdu_capture_record(3, 0x100000001ULL, APDU_CAPTURE_SENT, big,
+			    sizeof(big));
+	apdu_capture_record(1, 6024, APDU_CAPTURE_SENT, rlrq, 4);
+
+	apdu_capture_stop();
+	CU_ASSERT_EQUAL(apdu_capture_enabled(), 0);
+
+	reader = apdu_capture_reader_open(capture_path);
+	CU_ASSERT_PTR_NOT_NULL(reader);
+	if (!reader)
+		return;
+
+	CU_ASSERT_EQUAL(apdu_capture_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.plugin, 1);
+	CU_ASSERT_EQUAL(record.connid, 6024);
+	CU_ASSERT_EQUAL(record.direction, APDU_CAPTURE_RECEIVED);
+	CU_ASSERT_EQUAL(record.length, sizeof(rlrq));
+	CU_ASSERT_EQUAL(memcmp(record.apdu, rlrq, sizeof(rlrq)), 0);
+	CU_ASSERT_NOT_EQUAL(record.time_us, 0);
+
+	unsigned long long first = record.time_us;
+
+	// larger than the capture buffer, which grows for it
+	CU_ASSERT_EQUAL(apdu_capture_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.plugin, 3);
+	CU_ASSERT_EQUAL(record.connid, 0x100000001ULL);
+	CU_ASSERT_EQUAL(record.direction, APDU_CAPTURE_SENT);
+	CU_ASSERT_EQUAL(record.length, sizeof(big));
+	CU_ASSERT_EQUAL(memcmp(record.apdu, big, sizeof(big)), 0);
+	CU_ASSERT(record.time_us >= first);
+
+	CU_ASSERT_EQUAL(apdu_capture_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.length, 4);
+
+	CU_ASSERT_EQUAL(apdu_capture_reader_next(reader, &record), 0);
+
+	apdu_capture_reader_close(reader);
+}
+
+/**
+ * Counts the records of a capture file, -1 if not a capture
+ */
+static int count_records(const char *path)
+{
+	ApduCaptureRecord record;
+	ApduCaptureReader *reader = apdu_capture_reader_open(path);
+	int count = 0;
+
+	if (!reader)
+		return -1;
+
+	while (apdu_capture_reader_next(reader, &record))
+		++count;
+
+	apdu_capture_reader_close(reader);
+	return count;
+}
+
+void test_apdu_capture_rotation(void)
+{
+	intu8 apdu[76];
+	char path[300];
+	int i;
+
+	memset(apdu, 0, sizeof(apdu));
+
+	// 100 bytes per record, 3 records per file
+	CU_ASSERT_EQUAL(apdu_capture_start(capture_path,
+				APDU_CAPTURE_FILE_HEADER + 300, 2), 1);
+
+	for (i = 0; i < 10; ++i) {
+		apdu[0] = i;
+		apdu_capture_record(1, 1, APDU_CAPTURE_RECEIVED, apdu,
+				    sizeof(apdu));
+	}
+
+	apdu_capture_stop();
+
+	CU_ASSERT_EQUAL(count_records(capture_path), 1);
+
+	snprintf(path, sizeof(path), "%s.1", capture_path);
+	CU_ASSERT_EQUAL(count_records(path), 3);
+
+	snprintf(path, sizeof(path), "%s.2", capture_path);
+	CU_ASSERT_EQUAL(count_records(path), 3);
+
+	// only 2 rotated files are kept
+	snprintf(path, sizeof(path), "%s.3", capture_path);
+	CU_ASSERT_EQUAL(count_records(path), -1);
+}
+
+void test_apdu_capture_idle_flush(void)
+{
+	intu8 rlrq[] = {0xE4, 0x00, 0x00, 0x02, 0x00, 0x00};
+	int i;
+
+	CU_ASSERT_EQUAL(apdu_capture_start(capture_path, 0, 0), 1);
+
+	apdu_capture_record(1, 1, APDU_CAPTURE_RECEIVED, rlrq, sizeof(rlrq));
+	apdu_capture_flush();
+	CU_ASSERT_EQUAL(count_records(capture_path), 1);
+
+	// no more traffic: the record still reaches the file in a second
+	apdu_capture_record(1, 1, APDU_CAPTURE_SENT, rlrq, sizeof(rlrq));
+
+	for (i = 0; i < 30 && count_records(capture_path) < 2; ++i)
+		usleep(100000);
+
+	CU_ASSERT_EQUAL(count_records(capture_path), 2);
+
+	apdu_capture_stop();
+}
+
+void test_apdu_capture_not_a_capture(void)
+{
+	unsigned char text[] = "send \n";
+
+	ioutil_buffer_to_file(capture_path, sizeof(text), text, 0);
+	CU_ASSERT_PTR_NULL(apdu_capture_reader_open(capture_path));
+
+	unlink(capture_path);
+	CU_ASSERT_PTR_NULL(apdu_capture_reader_open(capture_path));
+}
+
+#endif
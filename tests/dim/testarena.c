@@ -0,0 +1,184 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testarena.c
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testarena.h"
+#include "src/util/arena.h"
+#include "src/communication/parser/decoder_ASN1.h"
+#include "src/communication/parser/struct_cleaner.h"
+#include "Basic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+int test_arena_init_suite(void)
+{
+	return 0;
+}
+
+int test_arena_finish_suite(void)
+{
+	return 0;
+}
+
+void testarena_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Arena Test Suite",
+				       test_arena_init_suite,
+				       test_arena_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_arena_alloc", test_arena_alloc);
+	CU_add_test(suite, "test_arena_reset", test_arena_reset);
+	CU_add_test(suite, "test_arena_owns", test_arena_owns);
+	/* Add tests here - End */
+}
+
+void test_arena_alloc(void)
+{
+	Arena *arena = arena_new(256);
+	char *a;
+	char *b;
+	char *big;
+	int *zeroed;
+
+	CU_ASSERT_PTR_NOT_NULL(arena);
+	if (!arena) {
+		return;
+	}
+
+	a = arena_alloc(arena, 10);
+	b = arena_alloc(arena, 1);
+	CU_ASSERT_PTR_NOT_NULL(a);
+	CU_ASSERT_EQUAL(((uintptr_t) a) % 16, 0);
+	CU_ASSERT_EQUAL(b - a, 16);
+	CU_ASSERT_EQUAL(arena->used, 32);
+	CU_ASSERT_EQUAL(arena->reserved, 256);
+
+	// larger than a chunk: gets its own, carving goes on in the first
+	big = arena_alloc(arena, 1000);
+	CU_ASSERT_PTR_NOT_NULL(big);
+	memset(big, 0xff, 1000);
+	CU_ASSERT_EQUAL(arena->reserved, 256 + 1008);
+	CU_ASSERT_EQUAL(((char *) arena_alloc(arena, 16)) - a, 32);
+
+	zeroed = arena_calloc(arena, 8, sizeof(int));
+	CU_ASSERT_PTR_NOT_NULL(zeroed);
+	if (zeroed) {
+		CU_ASSERT_EQUAL(zeroed[0], 0);
+		CU_ASSERT_EQUAL(zeroed[7], 0);
+	}
+
+	CU_ASSERT_PTR_NULL(arena_calloc(arena, SIZE_MAX / 2, 4));
+
+	arena_destroy(arena);
+}
+
+void test_arena_reset(void)
+{
+	Arena *arena = arena_new(128);
+	ByteStreamReader *stream;
+	octet_string s;
+	intu8 data[] = {0x00, 0x03, 'a', 'b', 'c'};
+	char *first;
+	int error = 0;
+	int i;
+
+	CU_ASSERT_PTR_NOT_NULL(arena);
+	if (!arena) {
+		return;
+	}
+
+	arena_alloc(arena, 8);
+
+	for (i = 0; i < 20; ++i) {
+		arena_alloc(arena, 100);
+	}
+
+	CU_ASSERT(arena->reserved > 128);
+
+	// one chunk is kept and carved from the start again
+	arena_reset(arena);
+	CU_ASSERT_EQUAL(arena->used, 0);
+	CU_ASSERT_EQUAL(arena->reserved, 128);
+	CU_ASSERT_EQUAL(arena->peak, 16 + 20 * 112);
+	first = arena_alloc(arena, 8);
+	CU_ASSERT_PTR_NOT_NULL(first);
+
+	// decoders allocate from the arena while it is set
+	stream = byte_stream_reader_instance(data, sizeof(data));
+	CU_ASSERT_PTR_NULL(decoder_set_arena(arena));
+	decode_octet_string(stream, &s, &error);
+	CU_ASSERT_PTR_EQUAL(decoder_set_arena(NULL), arena);
+	free(stream);
+
+	CU_ASSERT_EQUAL(error, 0);
+	CU_ASSERT_EQUAL(s.length, 3);
+	CU_ASSERT_EQUAL(memcmp(s.value, "abc", 3), 0);
+	CU_ASSERT_PTR_EQUAL((char *) s.value, first + 16);
+
+	arena_destroy(arena);
+}
+
+void test_arena_owns(void)
+{
+	Arena *arena = arena_new(64);
+	octet_string carved;
+	octet_string heap;
+	char *big;
+
+	CU_ASSERT_PTR_NOT_NULL(arena);
+	if (!arena) {
+		return;
+	}
+
+	CU_ASSERT_FALSE(arena_owns(arena, &carved));
+
+	carved.length = 8;
+	carved.value = arena_alloc(arena, 8);
+	big = arena_alloc(arena, 200);
+	CU_ASSERT_TRUE(arena_owns(arena, carved.value));
+	CU_ASSERT_TRUE(arena_owns(arena, big + 199));
+	CU_ASSERT_FALSE(arena_owns(NULL, carved.value));
+
+	heap.length = 8;
+	heap.value = calloc(1, 8);
+	CU_ASSERT_FALSE(arena_owns(arena, heap.value));
+
+	// cleaners free heap values and leave those of the arena alone
+	CU_ASSERT_PTR_NULL(cleaner_set_arena(arena));
+	del_octet_string(&carved);
+	del_octet_string(&heap);
+	CU_ASSERT_PTR_EQUAL(cleaner_set_arena(NULL), arena);
+
+	CU_ASSERT_PTR_NULL(carved.value);
+	CU_ASSERT_PTR_NULL(heap.value);
+
+	arena_destroy(arena);
+}
+
+#endif
@@ -0,0 +1,158 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testeventqueue.c
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testeventqueue.h"
+#include "src/util/event_queue.h"
+#include "Basic.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 50000
+
+int test_event_queue_init_suite(void)
+{
+	return 0;
+}
+
+int test_event_queue_finish_suite(void)
+{
+	return 0;
+}
+
+void testeventqueue_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Event Queue Test Suite",
+				       test_event_queue_init_suite,
+				       test_event_queue_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_event_queue_order", test_event_queue_order);
+	CU_add_test(suite, "test_event_queue_threads",
+		    test_event_queue_threads);
+	/* Add tests here - End */
+}
+
+void test_event_queue_order(void)
+{
+	EventQueue *q = event_queue_new(5);
+	intptr_t i;
+
+	CU_ASSERT_PTR_NOT_NULL(q);
+	if (!q) {
+		return;
+	}
+	CU_ASSERT(event_queue_fd(q) >= 0);
+	CU_ASSERT_PTR_NULL(event_queue_pop(q));
+	CU_ASSERT_EQUAL(event_queue_wait(q, 0), 0);
+
+	// capacity rounded up to 8
+	for (i = 1; i <= 8; ++i) {
+		CU_ASSERT_EQUAL(event_queue_push(q, (void *) i), 1);
+	}
+
+	CU_ASSERT_EQUAL(event_queue_push(q, (void *) 9), 0);
+	CU_ASSERT_EQUAL(event_queue_dropped(q), 1);
+
+	// first push into the empty queue signalled it
+	CU_ASSERT_EQUAL(event_queue_wait(q, 0), 1);
+
+	for (i = 1; i <= 8; ++i) {
+		CU_ASSERT_EQUAL((intptr_t) event_queue_pop(q), i);
+	}
+
+	CU_ASSERT_PTR_NULL(event_queue_pop(q));
+	CU_ASSERT_EQUAL(event_queue_wait(q, 0), 0);
+
+	CU_ASSERT_EQUAL(event_queue_push(q, (void *) 10), 1);
+	CU_ASSERT_EQUAL(event_queue_wait(q, 0), 1);
+	CU_ASSERT_EQUAL((intptr_t) event_queue_pop(q), 10);
+
+	event_queue_destroy(q);
+}
+
+static void *produce(void *arg)
+{
+	EventQueue *q = arg;
+	intptr_t i;
+
+	for (i = 1; i <= ITEMS_PER_PRODUCER; ++i) {
+		while (!event_queue_push(q, (void *) i)) {
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+void test_event_queue_threads(void)
+{
+	EventQueue *q = event_queue_new(256);
+	pthread_t producers[PRODUCERS];
+	long long sum = 0;
+	int received = 0;
+	int timeouts = 0;
+	intptr_t item;
+	int i;
+
+	CU_ASSERT_PTR_NOT_NULL(q);
+	if (!q) {
+		return;
+	}
+
+	for (i = 0; i < PRODUCERS; ++i) {
+		pthread_create(&producers[i], NULL, produce, q);
+	}
+
+	while (received < PRODUCERS * ITEMS_PER_PRODUCER && timeouts < 10) {
+		item = (intptr_t) event_queue_pop(q);
+
+		if (item) {
+			sum += item;
+			++received;
+		} else if (!event_queue_wait(q, 1000)) {
+			// a lost wakeup would stall here
+			++timeouts;
+		}
+	}
+
+	for (i = 0; i < PRODUCERS; ++i) {
+		pthread_join(producers[i], NULL);
+	}
+
+	CU_ASSERT_EQUAL(timeouts, 0);
+	CU_ASSERT_EQUAL(received, PRODUCERS * ITEMS_PER_PRODUCER);
+	CU_ASSERT_EQUAL(sum, (long long) PRODUCERS * ITEMS_PER_PRODUCER *
+			(ITEMS_PER_PRODUCER + 1) / 2);
+	CU_ASSERT_PTR_NULL(event_queue_pop(q));
+
+	event_queue_destroy(q);
+}
+
+#endif
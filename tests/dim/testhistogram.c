@@ -0,0 +1,124 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testhistogram.c
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testhistogram.h"
+#include "src/util/histogram.h"
+#include "Basic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static Histogram h;
+
+int test_histogram_init_suite(void)
+{
+	return 0;
+}
+
+int test_histogram_finish_suite(void)
+{
+	return 0;
+}
+
+void testhistogram_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Histogram Test Suite",
+				       test_histogram_init_suite,
+				       test_histogram_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_histogram_empty", test_histogram_empty);
+	CU_add_test(suite, "test_histogram_exact", test_histogram_exact);
+	CU_add_test(suite, "test_histogram_percentiles",
+		    test_histogram_percentiles);
+	/* Add tests here - End */
+}
+
+void test_histogram_empty(void)
+{
+	histogram_reset(&h);
+
+	CU_ASSERT_EQUAL(histogram_count(&h), 0);
+	CU_ASSERT_EQUAL(histogram_mean(&h), 0);
+	CU_ASSERT_EQUAL(histogram_max(&h), 0);
+	CU_ASSERT_EQUAL(histogram_percentile(&h, 50.0), 0);
+}
+
+void test_histogram_exact(void)
+{
+	int i;
+
+	histogram_reset(&h);
+
+	// small values get a bucket each
+	for (i = 0; i < 10; ++i) {
+		histogram_record(&h, i);
+	}
+
+	CU_ASSERT_EQUAL(histogram_count(&h), 10);
+	CU_ASSERT_EQUAL(histogram_percentile(&h, 0.0), 0);
+	CU_ASSERT_EQUAL(histogram_percentile(&h, 50.0), 4);
+	CU_ASSERT_EQUAL(histogram_percentile(&h, 100.0), 9);
+	CU_ASSERT_EQUAL(histogram_max(&h), 9);
+	CU_ASSERT_EQUAL(histogram_mean(&h), 4);
+
+	// percentiles never go above the highest value
+	histogram_record(&h, 1000001);
+	CU_ASSERT_EQUAL(histogram_percentile(&h, 100.0), 1000001);
+	CU_ASSERT_EQUAL(histogram_max(&h), 1000001);
+
+	histogram_record(&h, ~0ULL);
+	CU_ASSERT_EQUAL(histogram_percentile(&h, 100.0), ~0ULL);
+}
+
+void test_histogram_percentiles(void)
+{
+	static const double p[4] = {50.0, 90.0, 99.0, 99.9};
+	static const double expected[4] = {50000, 90000, 99000, 99900};
+	unsigned long long values[4];
+	int i;
+
+	histogram_reset(&h);
+
+	for (i = 1; i <= 100000; ++i) {
+		histogram_record(&h, i);
+	}
+
+	CU_ASSERT_EQUAL(histogram_count(&h), 100000);
+	CU_ASSERT_EQUAL(histogram_mean(&h), 50000);
+	CU_ASSERT_EQUAL(histogram_max(&h), 100000);
+
+	histogram_percentiles(&h, p, values, 4);
+
+	for (i = 0; i < 4; ++i) {
+		CU_ASSERT(values[i] >= expected[i]);
+		CU_ASSERT(values[i] <= expected[i] * 1.032);
+		CU_ASSERT_EQUAL(values[i], histogram_percentile(&h, p[i]));
+	}
+}
+
+#endif
@@ -33,6 +33,7 @@
 #include "Basic.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int test_ioutil_init_suite(void)
 {
@@ -51,6 +52,8 @@ void testioutil_add_suite()
 
 	/* Add tests here - Start */
 	CU_add_test(suite, "test_ioutil_get_tmp", test_ioutil_get_tmp);
+	CU_add_test(suite, "test_ioutil_buffer_to_file",
+		    test_ioutil_buffer_to_file);
 	/* Add tests here - End */
 }
 
@@ -59,4 +62,33 @@ void test_ioutil_get_tmp(void)
 	char *tmp = ioutil_get_tmp();
 	free(tmp);
 }
+
+void test_ioutil_buffer_to_file(void)
+{
+	const char *path = "ioutil_test.bin";
+	unsigned char first[] = "abcdef";
+	unsigned char second[] = "xyz";
+	unsigned long size = 0;
+	unsigned char *buffer;
+
+	CU_ASSERT_EQUAL(ioutil_buffer_to_file(path, 6, first, 0), 0);
+	CU_ASSERT_EQUAL(ioutil_buffer_to_file(path, 3, second, 1), 0);
+
+	buffer = ioutil_buffer_from_file(path, &size);
+	CU_ASSERT_EQUAL(size, 9);
+	CU_ASSERT(buffer && memcmp(buffer, "abcdefxyz", 9) == 0);
+	free(buffer);
+
+	// replaced as a whole, not truncated in place
+	CU_ASSERT_EQUAL(ioutil_buffer_to_file(path, 3, second, 0), 0);
+	buffer = ioutil_buffer_from_file(path, &size);
+	CU_ASSERT_EQUAL(size, 3);
+	CU_ASSERT(buffer && memcmp(buffer, "xyz", 3) == 0);
+	free(buffer);
+
+	remove(path);
+
+	CU_ASSERT_EQUAL(ioutil_buffer_to_file("no/such/dir/file", 3,
+					      second, 0), 1);
+}
 #endif
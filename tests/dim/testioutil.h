@@ -32,6 +32,7 @@
 
 void testioutil_add_suite(void);
 void test_ioutil_get_tmp(void);
+void test_ioutil_buffer_to_file(void);
 
 #endif
 
@@ -0,0 +1,187 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testlatestvalue.c
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testlatestvalue.h"
+#include "src/dim/latest_value.h"
+#include "src/dim/mds.h"
+#include "src/dim/nomenclature.h"
+#include "src/specializations/blood_pressure_monitor.h"
+#include "src/communication/context.h"
+#include "Basic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LIVE_CONTEXTS (LATEST_VALUE_CACHE_SIZE / 2)
+
+static MDS *mds = NULL;
+
+static Context *live[LIVE_CONTEXTS];
+
+int test_latest_value_init_suite(void)
+{
+	struct MDS_object object;
+
+	latest_value_init();
+
+	mds = mds_create();
+	memset(&object, 0, sizeof(object));
+	object.obj_handle = 1;
+	object.choice = MDS_OBJ_METRIC;
+	object.u.metric.choice = METRIC_NUMERIC;
+	object.u.metric.u.numeric.metric.type.code = MDC_PULS_RATE_NON_INV;
+	object.u.metric.u.numeric.metric.unit_code = MDC_DIM_BEAT_PER_MIN;
+	mds_add_object(mds, object);
+
+	return 0;
+}
+
+int test_latest_value_finish_suite(void)
+{
+	mds_destroy(mds);
+	mds = NULL;
+	latest_value_finalize();
+	return 0;
+}
+
+void testlatestvalue_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Latest Value Test Suite",
+				       test_latest_value_init_suite,
+				       test_latest_value_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_latest_value_reclaim",
+		    test_latest_value_reclaim);
+	CU_add_test(suite, "test_latest_value_churn", test_latest_value_churn);
+	/* Add tests here - End */
+}
+
+/**
+ * Creates a context with connid id and feeds it a measurement
+ */
+static Context *connect_and_measure(unsigned long long id, FLOAT_Type number)
+{
+	Context *ctx = calloc(1, sizeof(Context));
+	MetaAtt meta = {"HANDLE", "1"};
+	DataEntry observed;
+	DataEntry entry;
+	DataList list;
+
+	ctx->id.plugin = 1;
+	ctx->id.connid = id;
+	ctx->mds = mds;
+
+	mds->objects_list[0].u.metric.u.numeric.simple_nu_observed_value =
+		number;
+
+	memset(&observed, 0, sizeof(observed));
+	observed.choice = SIMPLE_DATA_ENTRY;
+	observed.u.simple.name = "Simple-Nu-Observed-Value";
+
+	memset(&entry, 0, sizeof(entry));
+	entry.choice = COMPOUND_DATA_ENTRY;
+	entry.meta_data.size = 1;
+	entry.meta_data.values = &meta;
+	entry.u.compound.entries_count = 1;
+	entry.u.compound.entries = &observed;
+
+	list.size = 1;
+	list.values = &entry;
+	list.refs = 0;
+
+	latest_value_update(ctx, &list);
+
+	return ctx;
+}
+
+static void disconnect(Context *ctx)
+{
+	latest_value_remove_context(ctx);
+	free(ctx);
+}
+
+static int has_value(unsigned long long id, FLOAT_Type *number)
+{
+	ContextId cid = {1, id};
+	LatestValue value;
+
+	if (!latest_value_get(cid, 1, MDC_PULS_RATE_NON_INV, &value))
+		return 0;
+
+	*number = value.u.number;
+	return 1;
+}
+
+void test_latest_value_reclaim(void)
+{
+	Context *ctx = connect_and_measure(1, 72);
+	FLOAT_Type number = 0;
+
+	CU_ASSERT_EQUAL(has_value(1, &number), 1);
+	CU_ASSERT_DOUBLE_EQUAL(number, 72, 0.01);
+
+	// the slot after it is empty, so no tombstone is left
+	disconnect(ctx);
+	CU_ASSERT_EQUAL(has_value(1, &number), 0);
+	CU_ASSERT_EQUAL(latest_value_tombstones(), 0);
+}
+
+void test_latest_value_churn(void)
+{
+	unsigned long long id;
+	FLOAT_Type number;
+	int i;
+	int ok = 1;
+
+	for (id = 0; id < 4 * LATEST_VALUE_CACHE_SIZE; ++id) {
+		if (id >= LIVE_CONTEXTS)
+			disconnect(live[id % LIVE_CONTEXTS]);
+
+		live[id % LIVE_CONTEXTS] = connect_and_measure(id, id % 1000);
+
+		if (latest_value_tombstones() > LATEST_VALUE_CACHE_SIZE / 8)
+			ok = 0;
+	}
+
+	CU_ASSERT_EQUAL(ok, 1);
+
+	for (i = 0; i < LIVE_CONTEXTS; ++i) {
+		id = live[i]->id.connid;
+		number = -1;
+		CU_ASSERT_EQUAL(has_value(id, &number), 1);
+		CU_ASSERT_DOUBLE_EQUAL(number, id % 1000, 0.01);
+		CU_ASSERT_EQUAL(has_value(id - LIVE_CONTEXTS, &number), 0);
+	}
+
+	for (i = 0; i < LIVE_CONTEXTS; ++i)
+		disconnect(live[i]);
+
+	CU_ASSERT_EQUAL(latest_value_tombstones(), 0);
+}
+
+#endif
@@ -0,0 +1,143 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testlog.c
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testlog.h"
+#include "src/util/log.h"
+#include "Basic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int test_log_init_suite(void)
+{
+	return 0;
+}
+
+int test_log_finish_suite(void)
+{
+	log_set_output(NULL);
+	log_set_level(LOG_LEVEL_DEBUG);
+	return 0;
+}
+
+void testlog_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Log Test Suite",
+				       test_log_init_suite,
+				       test_log_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_log_level", test_log_level);
+	CU_add_test(suite, "test_log_async", test_log_async);
+	/* Add tests here - End */
+}
+
+/**
+ * Reads back what was logged to f, and empties it
+ */
+static char *log_read(FILE *f, char *buf, size_t size)
+{
+	size_t n;
+
+	fflush(f);
+	rewind(f);
+	n = fread(buf, 1, size - 1, f);
+	buf[n] = '\0';
+	rewind(f);
+
+	return buf;
+}
+
+static void log_sample()
+{
+	DEBUG("plain");
+	DEBUG("%d %u %x %5.2f|%-4s|%c %%", -3, 7u, 255, 3.14159, "ab", 'z');
+	DEBUG("%ld %llu %zu %s", -1L, 18446744073709551615ULL,
+	      (size_t) 42, "str");
+	DEBUG("%.3s %p %*d", "abcdef", (void *) 0x1234, 4, 9);
+}
+
+void test_log_level(void)
+{
+	FILE *f = tmpfile();
+	char buf[1024];
+
+	log_set_output(f);
+	log_set_level(LOG_LEVEL_WARNING);
+
+	DEBUG("debug %d", 1);
+	INFO("info %d", 2);
+	WARNING("warning %d", 3);
+	ERROR("error %d", 4);
+
+	log_read(f, buf, sizeof(buf));
+
+	CU_ASSERT_PTR_NULL(strstr(buf, "debug 1"));
+	CU_ASSERT_PTR_NULL(strstr(buf, "info 2"));
+	CU_ASSERT_PTR_NOT_NULL(strstr(buf, "WARNING <"));
+	CU_ASSERT_PTR_NOT_NULL(strstr(buf, "> warning 3\n"));
+	CU_ASSERT_PTR_NOT_NULL(strstr(buf, "ERROR   <"));
+	CU_ASSERT_PTR_NOT_NULL(strstr(buf, "> error 4\n"));
+
+	CU_ASSERT_EQUAL(LOG_ENABLED(LOG_LEVEL_DEBUG), 0);
+	CU_ASSERT_EQUAL(LOG_ENABLED(LOG_LEVEL_ERROR), 1);
+
+	log_set_level(LOG_LEVEL_DEBUG);
+	log_set_output(NULL);
+	fclose(f);
+}
+
+void test_log_async(void)
+{
+	FILE *sync_file = tmpfile();
+	FILE *async_file = tmpfile();
+	char sync_buf[2048];
+	char async_buf[2048];
+
+	log_set_level(LOG_LEVEL_DEBUG);
+
+	log_set_output(sync_file);
+	log_sample();
+	log_read(sync_file, sync_buf, sizeof(sync_buf));
+
+	log_set_output(async_file);
+	CU_ASSERT_EQUAL(log_async_start(), 1);
+	log_sample();
+	log_async_stop();
+	log_read(async_file, async_buf, sizeof(async_buf));
+
+	// formatted by the background thread, same text
+	CU_ASSERT_PTR_NOT_NULL(strstr(sync_buf, "-3 7 ff  3.14|ab  |z %"));
+	CU_ASSERT_PTR_NOT_NULL(strstr(sync_buf, "abc 0x1234    9"));
+	CU_ASSERT_STRING_EQUAL(async_buf, sync_buf);
+
+	log_set_output(NULL);
+	fclose(sync_file);
+	fclose(async_file);
+}
+
+#endif
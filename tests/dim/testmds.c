@@ -30,8 +30,12 @@
 #include "Basic.h"
 #include "src/asn1/phd_types.h"
 #include "src/dim/mds.h"
+#include "src/dim/nomenclature.h"
+#include "src/dim/pmstore.h"
+#include "src/dim/pmsegment.h"
 #include "testmds.h"
 #include <stdlib.h>
+#include <string.h>
 
 int test_mds_init_suite(void)
 {
@@ -51,6 +55,7 @@ void testmds_add_suite()
 	/* Add tests here - Start */
 	CU_add_test(suite, "test_mds_is_supported_data_request",
 		    test_mds_is_supported_data_request);
+	CU_add_test(suite, "test_mds_cache_reset", test_mds_cache_reset);
 	/* Add tests here - End */
 
 }
@@ -89,4 +94,76 @@ void test_mds_is_supported_data_request(void)
 	mds_destroy(mds);
 }
 
+void test_mds_cache_reset(void)
+{
+	MDS *mds = mds_create();
+	struct MDS_object object;
+	struct Numeric *numeric;
+	struct PMSegment *segment;
+	octet_string system_id;
+	intu8 id[8] = {'t', 'e', 's', 't', 'r', 's', 'e', 't'};
+
+	mds->dev_configuration_id = 0x4001;
+	mds->system_id.length = sizeof(id);
+	mds->system_id.value = malloc(sizeof(id));
+	memcpy(mds->system_id.value, id, sizeof(id));
+
+	memset(&object, 0, sizeof(object));
+	object.obj_handle = 1;
+	object.choice = MDS_OBJ_METRIC;
+	object.u.metric.choice = METRIC_NUMERIC;
+	object.u.metric.u.numeric.metric.unit_code = MDC_DIM_MMHG;
+	object.u.metric.u.numeric.metric.measurement_status = 0x0800;
+	object.u.metric.u.numeric.metric.absolute_time_stamp.year = 0x12;
+	object.u.metric.u.numeric.simple_nu_observed_value = 36.5;
+	object.u.metric.u.numeric.compound_basic_nu_observed_value.count = 2;
+	object.u.metric.u.numeric.compound_basic_nu_observed_value.value =
+		calloc(2, sizeof(BasicNuObsValue));
+	mds_add_object(mds, object);
+
+	memset(&object, 0, sizeof(object));
+	object.obj_handle = 2;
+	object.choice = MDS_OBJ_SCANNER;
+	object.u.scanner.choice = EPI_CFG_SCANNER;
+	object.u.scanner.u.epi_cfg_scanner.scanner.scanner.operational_state =
+		os_enabled;
+	mds_add_object(mds, object);
+
+	memset(&object, 0, sizeof(object));
+	object.obj_handle = 3;
+	object.choice = MDS_OBJ_PMSTORE;
+	mds_add_object(mds, object);
+
+	segment = calloc(1, sizeof(struct PMSegment));
+	segment->instance_number = 7;
+	pmstore_add_segment(&mds->objects_list[2].u.pmstore, segment);
+
+	mds_cache_put(mds);
+
+	system_id.length = sizeof(id);
+	system_id.value = id;
+	mds = mds_cache_take(&system_id, 0x4001);
+	CU_ASSERT_PTR_NOT_NULL(mds);
+
+	if (!mds) {
+		return;
+	}
+
+	numeric = &mds->objects_list[0].u.metric.u.numeric;
+	CU_ASSERT_EQUAL(numeric->metric.unit_code, MDC_DIM_MMHG);
+	CU_ASSERT_EQUAL(numeric->metric.measurement_status, 0);
+	CU_ASSERT_EQUAL(numeric->metric.absolute_time_stamp.year, 0);
+	CU_ASSERT_DOUBLE_EQUAL(numeric->simple_nu_observed_value, 0, 0.001);
+	CU_ASSERT_EQUAL(numeric->compound_basic_nu_observed_value.count, 0);
+	CU_ASSERT_PTR_NULL(numeric->compound_basic_nu_observed_value.value);
+
+	CU_ASSERT_EQUAL(mds->objects_list[1].u.scanner.u.epi_cfg_scanner.scanner.scanner.operational_state,
+			os_disabled);
+
+	CU_ASSERT_EQUAL(mds->objects_list[2].u.pmstore.segment_list_count, 0);
+	CU_ASSERT_PTR_NULL(mds->objects_list[2].u.pmstore.segm_list);
+
+	mds_destroy(mds);
+}
+
 #endif
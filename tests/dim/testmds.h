@@ -31,4 +31,6 @@ void testmds_add_suite(void);
 
 void test_mds_is_supported_data_request(void);
 
+void test_mds_cache_reset(void);
+
 #endif
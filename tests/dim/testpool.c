@@ -0,0 +1,130 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testpool.c
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testpool.h"
+#include "src/util/pool.h"
+#include "Basic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct PoolItem {
+	void *next;
+	int value[8];
+} PoolItem;
+
+int test_pool_init_suite(void)
+{
+	return 0;
+}
+
+int test_pool_finish_suite(void)
+{
+	return 0;
+}
+
+void testpool_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Object Pool Test Suite",
+				       test_pool_init_suite,
+				       test_pool_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_pool_reuse", test_pool_reuse);
+	CU_add_test(suite, "test_pool_capacity", test_pool_capacity);
+	/* Add tests here - End */
+}
+
+void test_pool_reuse(void)
+{
+	ObjectPool pool = OBJECT_POOL_INIT(PoolItem, 4);
+	PoolItem *a = pool_alloc(&pool);
+	PoolItem *b;
+
+	CU_ASSERT_PTR_NOT_NULL(a);
+	CU_ASSERT_EQUAL(pool.misses, 1);
+
+	if (a) {
+		a->next = a;
+		a->value[7] = 42;
+	}
+
+	pool_free(&pool, a);
+	CU_ASSERT_EQUAL(pool.count, 1);
+
+	// same memory, handed out zeroed
+	b = pool_alloc(&pool);
+	CU_ASSERT_PTR_EQUAL(b, a);
+	CU_ASSERT_EQUAL(pool.hits, 1);
+	CU_ASSERT_EQUAL(pool.count, 0);
+
+	if (b) {
+		CU_ASSERT_PTR_NULL(b->next);
+		CU_ASSERT_EQUAL(b->value[7], 0);
+	}
+
+	pool_free(&pool, b);
+	pool_free(&pool, NULL);
+	CU_ASSERT_EQUAL(pool.count, 1);
+
+	pool_drain(&pool);
+	CU_ASSERT_EQUAL(pool.count, 0);
+	CU_ASSERT_PTR_NULL(pool.free_list);
+}
+
+void test_pool_capacity(void)
+{
+	ObjectPool pool = OBJECT_POOL_INIT(PoolItem, 2);
+	PoolItem *items[3];
+	int i;
+
+	for (i = 0; i < 3; ++i) {
+		items[i] = pool_alloc(&pool);
+	}
+
+	for (i = 0; i < 3; ++i) {
+		pool_free(&pool, items[i]);
+	}
+
+	// the third one went back to the allocator
+	CU_ASSERT_EQUAL(pool.count, 2);
+
+	for (i = 0; i < 3; ++i) {
+		items[i] = pool_alloc(&pool);
+	}
+
+	CU_ASSERT_EQUAL(pool.hits, 2);
+	CU_ASSERT_EQUAL(pool.misses, 4);
+
+	for (i = 0; i < 3; ++i) {
+		pool_free(&pool, items[i]);
+	}
+
+	pool_drain(&pool);
+}
+
+#endif
@@ -173,6 +173,10 @@ void functional_test_check_attributes_with_std_configuration_05DC()
 
 	CU_ASSERT_EQUAL(metric.attribute_value_map.count, 2);
 	CU_ASSERT_EQUAL(metric.attribute_value_map.length, 8);
+
+	// configured objects are carved from the arena of the MDS
+	CU_ASSERT_TRUE(arena_owns(mds->arena, mds->objects_list));
+	CU_ASSERT_TRUE(arena_owns(mds->arena, metric.attribute_value_map.value));
 	CU_ASSERT_EQUAL(metric.attribute_value_map.value[0].attribute_id, MDC_ATTR_NU_VAL_OBS_SIMP);
 	CU_ASSERT_EQUAL(metric.attribute_value_map.value[0].attribute_len, 4);
 	CU_ASSERT_EQUAL(metric.attribute_value_map.value[1].attribute_id, MDC_ATTR_TIME_STAMP_ABS);
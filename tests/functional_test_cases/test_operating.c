@@ -33,6 +33,7 @@
 #include "src/manager_p.h"
 #include "src/communication/fsm.h"
 #include "src/communication/communication.h"
+#include "src/specializations/blood_pressure_monitor.h"
 
 #include <Basic.h>
 #include <stdio.h>
@@ -158,6 +159,24 @@ void assert_tc_3_3()
 
 	func_simulate_incoming_apdu(apdu_H241_ID_02BC);
 
+	LatestValue value;
+
+	CU_ASSERT_EQUAL(manager_get_latest_value(FUNC_TEST_SINGLE_CONTEXT, 1,
+			MDC_PRESS_BLD_NONINV_DIA, &value), 1);
+	CU_ASSERT_EQUAL(value.type, LATEST_VALUE_NUMBER);
+	CU_ASSERT_EQUAL(value.unit_code, MDC_DIM_MMHG);
+	CU_ASSERT_DOUBLE_EQUAL(value.u.number, 80.000, 0.001);
+	CU_ASSERT_EQUAL(value.time_stamp.day, 0x06);
+	CU_ASSERT_EQUAL(value.time_stamp.minute, 0x10);
+
+	CU_ASSERT_EQUAL(manager_get_latest_value(FUNC_TEST_SINGLE_CONTEXT, 2,
+			MDC_PULS_RATE_NON_INV, &value), 1);
+	CU_ASSERT_EQUAL(value.unit_code, MDC_DIM_BEAT_PER_MIN);
+	CU_ASSERT_DOUBLE_EQUAL(value.u.number, 60.0, 0.01);
+
+	CU_ASSERT_EQUAL(manager_get_latest_value(FUNC_TEST_SINGLE_CONTEXT, 2,
+			MDC_PRESS_BLD_NONINV_DIA, &value), 0);
+
 	CU_ASSERT_DOUBLE_EQUAL(mds->objects_list[0].u.metric.u.numeric.compound_basic_nu_observed_value.value[0],
 			       120.000, 0.001);
 	CU_ASSERT_DOUBLE_EQUAL(mds->objects_list[0].u.metric.u.numeric.compound_basic_nu_observed_value.value[1],
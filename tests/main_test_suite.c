@@ -43,16 +43,25 @@
 #include "communication/parser/testbytelib.h"
 #include "communication/encoder/testencoder.h"
 #include "api/testxml.h"
+#include "api/testsubscription.h"
 #include "communication/testcontextmanager.h"
 #include "communication/testfsm.h"
 #include "communication/testservice.h"
 #include "communication/testextconfiguration.h"
+#include "communication/testloopback.h"
 #include "dim/testpmstore.h"
 #include "dim/testpmsegment.h"
 #include "dim/testdateutil.h"
 #include "dim/testdim.h"
 #include "dim/testmds.h"
 #include "dim/testioutil.h"
+#include "dim/testapducapture.h"
+#include "dim/testhistogram.h"
+#include "dim/testpool.h"
+#include "dim/testarena.h"
+#include "dim/testlatestvalue.h"
+#include "dim/testlog.h"
+#include "dim/testeventqueue.h"
 #include "functional_test_cases/test_association.h"
 #include "functional_test_cases/test_operating.h"
 #include "functional_test_cases/test_configuring.h"
@@ -77,6 +86,7 @@ void add_test_suites()
 
 	// Unit tests
 	testxml_add_suite();
+	testsubscription_add_suite();
 	testdim_add_suite();
 	testmds_add_suite();
 	testpmstore_add_suite();
@@ -86,11 +96,19 @@ void add_test_suites()
 	testencoder_add_suite();
 	testdateutil_add_suite();
 	testioutil_add_suite();
+	testapducapture_add_suite();
+	testhistogram_add_suite();
+	testpool_add_suite();
+	testarena_add_suite();
+	testlatestvalue_add_suite();
+	testlog_add_suite();
+	testeventqueue_add_suite();
 	testfsm_add_suite();
 	testservice_add_suite();
 	testtimer_add_suite();
 	testextconfiguration_add_suite();
 	testctxmanager_add_suite();
+	testloopback_add_suite();
 	testllist_add_suite();
 
 	// Functional tests